@@ -0,0 +1,303 @@
+#include "aliases.h"
+#include "bookmarks.h"
+#include "filters.h"
+#include "git_integration.h"
+#include "grep.h"
+#include "line_reader.h"
+#include "persistent_history.h"
+#include "structured_data.h"
+#include "system_monitor.h"
+#include "tab_complete.h"
+#include <sys/stat.h>
+#include <time.h>
+
+// Microbenchmarks for the paths a user waits on: each keystroke, each
+// prompt, grep and table filters. Fixtures are generated in a temporary
+// HOME so runs are repeatable. Results go to stdout as tab-separated
+// lines, one per benchmark, so runs on two commits can be compared with
+// diff, join or a spreadsheet; progress goes to stderr
+//
+//   make bench                  run everything
+//   ./shell_bench suggestions   run benchmarks whose name contains a word
+
+// Each benchmark runs for at least this long, in doubling batches
+#define BENCH_MIN_NS 200000000LL
+
+#define BENCH_DIRECTORY_FILES 5000
+#define BENCH_REPO_COMMITS 50
+#define BENCH_TEXT_BYTES (4 << 20)
+#define BENCH_FILTER_ROWS 20000
+#define BENCH_SORT_ROWS 1000 // sort-by is quadratic
+#define BENCH_PROCESSES 1024
+
+typedef struct {
+  const char *name;
+  const char *fixture;   // What the benchmark runs against
+  const char *directory; // Where it runs, relative to the fixture root
+  void (*run)(void);
+} Benchmark;
+
+static char fixture_root[PATH_MAX];
+static char *search_text = NULL;
+static TableData *filter_input = NULL;
+static TableData *sort_input = NULL;
+static ProcessInfo *processes = NULL;
+
+// Results are consumed through this so the compiler keeps the calls
+static volatile long sink;
+
+static long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void write_fixture_file(const char *path, const char *text) {
+  FILE *fp = fopen(path, "w");
+  if (fp) {
+    fputs(text, fp);
+    fclose(fp);
+  }
+}
+
+// Commands spread over a few programs, with enough variety that prefix
+// searches walk most of the history before matching
+static void make_history(void) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/.lsh", fixture_root);
+  mkdir(path, 0700);
+  snprintf(path, sizeof(path), "%s/.lsh/history", fixture_root);
+
+  FILE *fp = fopen(path, "w");
+  if (!fp)
+    return;
+  static const char *commands[] = {
+      "git status", "git commit -m 'change %d'", "ls -la dir%d",
+      "make -j%d",  "grep -r pattern%d src",     "cd projects/p%d",
+      "vim file%d.c"};
+  int kinds = sizeof(commands) / sizeof(commands[0]);
+  fprintf(fp, "# LSH history\n");
+  for (int i = 0; i < PERSISTENT_HISTORY_SIZE; i++) {
+    char command[128];
+    snprintf(command, sizeof(command), commands[i % kinds], i);
+    fprintf(fp, "%ld %s\n", 1700000000L + i, command);
+  }
+  fclose(fp);
+}
+
+static void make_directory(void) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/big", fixture_root);
+  mkdir(path, 0755);
+  for (int i = 0; i < BENCH_DIRECTORY_FILES; i++) {
+    snprintf(path, sizeof(path), "%s/big/file%05d.txt", fixture_root, i);
+    write_fixture_file(path, "");
+  }
+}
+
+// A repository with a linear history and one modified file, so the
+// status has both a branch and a dirty marker to report. Without git
+// there is no repo directory and the benchmark is skipped
+static void make_repo(void) {
+  char command[PATH_MAX * 2];
+  snprintf(command, sizeof(command),
+           "cd '%s' && mkdir -p repo && cd repo && git init -q && "
+           "git config user.email bench@example.com && "
+           "git config user.name bench && "
+           "for i in $(seq %d); do echo $i > f$i.txt && git add f$i.txt && "
+           "git commit -qm c$i; done && echo x >> f1.txt",
+           fixture_root, BENCH_REPO_COMMITS);
+  if (system(command) != 0) {
+    snprintf(command, sizeof(command), "rm -rf '%s/repo'", fixture_root);
+    if (system(command) != 0)
+      fprintf(stderr, "bench: could not remove the partial repo\n");
+  }
+}
+
+static void make_text(void) {
+  search_text = malloc(BENCH_TEXT_BYTES + 1);
+  if (!search_text)
+    return;
+  static const char words[] = "lorem ipsum dolor sit amet consectetur ";
+  for (int i = 0; i < BENCH_TEXT_BYTES; i++)
+    search_text[i] = words[i % (sizeof(words) - 1)];
+  search_text[BENCH_TEXT_BYTES] = '\0';
+}
+
+// Rows shaped like the ls table filters usually get
+static TableData *make_table(int rows) {
+  char *headers[] = {"Name", "Size", "Type"};
+  TableData *table = create_table(headers, 3);
+  if (!table)
+    return NULL;
+
+  for (int i = 0; i < rows; i++) {
+    DataValue *row = malloc(3 * sizeof(DataValue));
+    if (!row)
+      break;
+    char text[64];
+    snprintf(text, sizeof(text), "file%05d.c", i);
+    row[0].type = TYPE_STRING;
+    row[0].value.str_val = strdup(text);
+    snprintf(text, sizeof(text), "%d.%d KB", (i * 7919) % 1000, i % 10);
+    row[1].type = TYPE_STRING;
+    row[1].value.str_val = strdup(text);
+    row[2].type = TYPE_STRING;
+    row[2].value.str_val = strdup(i % 3 ? "file" : "directory");
+    for (int j = 0; j < 3; j++)
+      row[j].is_highlighted = 0;
+    add_table_row(table, row);
+  }
+  return table;
+}
+
+static void run_update_suggestions(void) {
+  update_suggestions("git c", 5);
+}
+
+static void run_tab_completion_command(void) {
+  char *completion = get_tab_completion("gi");
+  sink += completion != NULL;
+  free(completion);
+}
+
+static void run_tab_completion_path(void) {
+  char *completion = get_tab_completion("ls big/file049");
+  sink += completion != NULL;
+  free(completion);
+}
+
+static void run_history_match(void) {
+  char *match = get_most_recent_history_match("git commit -m 'change 1");
+  sink += match != NULL;
+  free(match);
+}
+
+// A pattern that never occurs, so the whole text is scanned
+static void run_boyer_moore(void) {
+  int position;
+  sink += boyer_moore_search(search_text, BENCH_TEXT_BYTES, "consectetux", 11,
+                             &position, false);
+}
+
+static void run_filter_table(void) {
+  TableData *result = filter_table(filter_input, "size", ">", "500KB");
+  sink += result ? result->row_count : 0;
+  free_table(result);
+}
+
+static void run_sort_by(void) {
+  char *args[] = {"size", "desc", NULL};
+  TableData *result = lsh_sort_by(sort_input, args);
+  sink += result ? result->row_count : 0;
+  free_table(result);
+}
+
+static void run_process_info(void) {
+  sink += get_process_info(processes, BENCH_PROCESSES);
+}
+
+static void run_git_status(void) {
+  char *status = get_git_status();
+  sink += status != NULL;
+  free(status);
+}
+
+static const Benchmark benchmarks[] = {
+    {"update_suggestions", "1000-line history", ".", run_update_suggestions},
+    {"tab_completion_command", "PATH", ".", run_tab_completion_command},
+    {"tab_completion_path", "5000-file directory", ".",
+     run_tab_completion_path},
+    {"history_match", "1000-line history", ".", run_history_match},
+    {"boyer_moore_search", "4 MB text", ".", run_boyer_moore},
+    {"filter_table", "20000 rows", ".", run_filter_table},
+    {"sort_by", "1000 rows", ".", run_sort_by},
+    {"get_process_info", "/proc", ".", run_process_info},
+    {"get_git_status", "50-commit repo", "repo", run_git_status},
+};
+
+// Double the batch size until a batch takes BENCH_MIN_NS, then report the
+// time per call from that batch
+static void run_benchmark(const Benchmark *benchmark) {
+  long long iterations = 1;
+  long long elapsed;
+  for (;;) {
+    long long start = now_ns();
+    for (long long i = 0; i < iterations; i++)
+      benchmark->run();
+    elapsed = now_ns() - start;
+    if (elapsed >= BENCH_MIN_NS)
+      break;
+    iterations *= 2;
+  }
+
+  printf("%s\t%lld\t%.1f\t%s\n", benchmark->name, iterations,
+         (double)elapsed / iterations, benchmark->fixture);
+  fflush(stdout);
+}
+
+static void remove_fixtures(void) {
+  char command[PATH_MAX + 16];
+  snprintf(command, sizeof(command), "rm -rf '%s'", fixture_root);
+  if (system(command) != 0)
+    fprintf(stderr, "bench: could not remove %s\n", fixture_root);
+}
+
+int main(int argc, char **argv) {
+  const char *only = argc > 1 ? argv[1] : NULL;
+
+  snprintf(fixture_root, sizeof(fixture_root), "/tmp/lsh-bench.XXXXXX");
+  if (!mkdtemp(fixture_root)) {
+    perror("bench: mkdtemp");
+    return EXIT_FAILURE;
+  }
+  setenv("HOME", fixture_root, 1);
+
+  fprintf(stderr, "bench: generating fixtures in %s\n", fixture_root);
+  make_history();
+  make_directory();
+  make_repo();
+  make_text();
+  filter_input = make_table(BENCH_FILTER_ROWS);
+  sort_input = make_table(BENCH_SORT_ROWS);
+  processes = malloc(BENCH_PROCESSES * sizeof(ProcessInfo));
+  if (!search_text || !filter_input || !sort_input || !processes) {
+    fprintf(stderr, "bench: allocation error\n");
+    remove_fixtures();
+    return EXIT_FAILURE;
+  }
+
+  init_aliases();
+  init_bookmarks();
+  init_persistent_history();
+  init_tab_completion();
+  init_git_integration();
+  wait_for_history();
+
+  printf("benchmark\titerations\tns_per_op\tfixture\n");
+  int count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  for (int i = 0; i < count; i++) {
+    const Benchmark *benchmark = &benchmarks[i];
+    if (only && !strstr(benchmark->name, only))
+      continue;
+
+    char directory[PATH_MAX];
+    snprintf(directory, sizeof(directory), "%s/%s", fixture_root,
+             benchmark->directory);
+    if (chdir(directory) != 0) {
+      fprintf(stderr, "bench: skipping %s, no %s\n", benchmark->name,
+              benchmark->fixture);
+      continue;
+    }
+
+    fprintf(stderr, "bench: %s\n", benchmark->name);
+    run_benchmark(benchmark);
+  }
+
+  free_table(filter_input);
+  free_table(sort_input);
+  free(search_text);
+  free(processes);
+  remove_fixtures();
+  return EXIT_SUCCESS;
+}
@@ -33,6 +33,10 @@ extern HistoryEntry command_history[HISTORY_SIZE];
 extern int history_count;
 extern int history_index;
 
+// Record that the running builtin failed, for the exit status batch mode
+// returns. Returns 1, to keep the shell running
+int lsh_builtin_failed(void);
+
 // Built-in command declarations
 int lsh_cd(char **args);
 int lsh_help(char **args);
@@ -60,6 +64,7 @@ int lsh_bookmark(char **args);
 int lsh_bookmarks(char **args);
 int lsh_goto(char **args);
 int lsh_unbookmark(char **args);
+int lsh_z(char **args);
 int lsh_focus_timer(char **args);
 int lsh_weather(char **args);
 // Text search command
@@ -55,6 +55,10 @@
 #define ANSI_SAVE_CURSOR  "\x1b[s"
 #define ANSI_RESTORE_CURSOR "\x1b[u"
 
+// Bracketed paste: the terminal wraps pasted text in ESC[200~ ... ESC[201~
+#define ANSI_PASTE_MODE_ON  "\x1b[?2004h"
+#define ANSI_PASTE_MODE_OFF "\x1b[?2004l"
+
 // Key code definitions used by the line reader
 #define KEY_BACKSPACE 127  // Different on Linux
 #define KEY_TAB 9
@@ -69,6 +73,7 @@
 #define KEY_RIGHT 1003
 #define KEY_SHIFT_ENTER 1010
 #define KEY_SHIFT_TAB 1011
+#define KEY_PASTE 1012     // Start of a bracketed paste
 
 // Typedefs for compatibility
 typedef unsigned int UINT;
@@ -46,8 +46,8 @@ int lsh_unalias(char **args);
 // Command handler to list all aliases
 int lsh_aliases(char **args);
 
-// Get alias names for tab completion
-char** get_alias_names(int *count);
+// Iterate alias names for tab completion, without copying
+const char* next_alias_name(int *cursor);
 
 // Expand alias in args array
 char** expand_alias(char **args);
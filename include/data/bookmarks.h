@@ -40,8 +40,8 @@ int lsh_bookmarks(char **args);  // List all bookmarks
 int lsh_goto(char **args);       // Jump to a bookmark
 int lsh_unbookmark(char **args); // Remove a bookmark
 
-// Get bookmarked directories for tab completion
-char **get_bookmark_names(int *count);
+// Iterate bookmark names for tab completion, without copying
+const char *next_bookmark_name(int *cursor);
 
 // Find a matching bookmark by partial name
 char *find_matching_bookmark(const char *partial_name);
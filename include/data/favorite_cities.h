@@ -33,8 +33,8 @@ int remove_favorite_city(const char *name);
 // Find a favorite city by name
 CityEntry *find_favorite_city(const char *name);
 
-// Get favorite city names for tab completion
-char **get_favorite_city_names(int *count);
+// Iterate favorite city names for tab completion, without copying
+const char *next_favorite_city_name(int *cursor);
 
 // Command handlers
 int lsh_cities(char **args); // Main cities command handler
@@ -0,0 +1,38 @@
+
+#ifndef FRECENCY_H
+#define FRECENCY_H
+
+#include "common.h"
+
+// A directory cd has visited. Rank grows by one per visit and is aged
+// down once the ranks add up to FRECENCY_MAX_TOTAL
+typedef struct {
+  char *path;
+  char *folded;       // Lower-case copy of path, for matching
+  int base;           // Offset of the last path component
+  unsigned int chars; // Bit per letter or digit that occurs in folded
+  double rank;
+  time_t last_visit;
+} FrecencyEntry;
+
+#define FRECENCY_MAX_TOTAL 20000.0
+
+// Visits are saved at most this often, in seconds, and at shutdown
+#define FRECENCY_SAVE_INTERVAL 60
+
+// Initialize directory tracking
+void init_frecency(void);
+
+// Shutdown directory tracking
+void shutdown_frecency(void);
+
+// Stop recording visits, for scripts: they can still use z
+void frecency_disable_recording(void);
+
+// Record a visit to a directory
+void frecency_record(const char *path);
+
+// Jump to the best matching visited directory
+int lsh_z(char **args);
+
+#endif // FRECENCY_H
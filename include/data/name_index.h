@@ -0,0 +1,37 @@
+
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include "common.h"
+
+// Reads the name of entry i from a store's array
+typedef const char *(*NameIndexKey)(const void *entries, int i);
+
+typedef struct {
+  unsigned int hash;
+  int position; // Index into the store's array, -1 for an empty slot
+} NameIndexSlot;
+
+// Open-addressing hash index over the names in a store's array. The
+// store keeps owning its entries; the index maps a name to the entry's
+// position with linear probing
+typedef struct {
+  NameIndexSlot *slots;
+  int capacity; // Power of two, at least twice count
+  int count;
+  int ignore_case;
+} NameIndex;
+
+void name_index_init(NameIndex *index, int ignore_case);
+
+void name_index_free(NameIndex *index);
+
+int name_index_find(const NameIndex *index, const char *name,
+                    const void *entries, NameIndexKey key);
+
+int name_index_insert(NameIndex *index, const char *name, int position);
+
+int name_index_rebuild(NameIndex *index, const void *entries, int count,
+                       NameIndexKey key);
+
+#endif // NAME_INDEX_H
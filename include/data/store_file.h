@@ -0,0 +1,28 @@
+
+#ifndef STORE_FILE_H
+#define STORE_FILE_H
+
+#include "common.h"
+#include <sys/stat.h>
+
+// What a store file looked like when this shell last read or wrote it.
+// Another shell saving the file replaces it, which changes the inode or
+// the modification time
+typedef struct {
+  int exists;
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  struct timespec modified;
+} StoreFileStamp;
+
+void store_file_stamp(const char *path, StoreFileStamp *stamp);
+
+int store_file_changed(const char *path, const StoreFileStamp *stamp);
+
+FILE *store_file_begin(const char *path, char *temp_path, size_t temp_size);
+
+int store_file_commit(FILE *fp, const char *temp_path, const char *path,
+                      StoreFileStamp *stamp);
+
+#endif // STORE_FILE_H
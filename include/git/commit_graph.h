@@ -0,0 +1,94 @@
+
+#ifndef COMMIT_GRAPH_H
+#define COMMIT_GRAPH_H
+
+#include "common.h"
+#include "git_batch.h"
+#include <stdint.h>
+
+// A read-only view of .git/objects/info/commit-graph. Only a single SHA-1
+// graph file is understood; split graph chains are treated as missing
+typedef struct {
+  char path[PATH_MAX]; // Where the graph lives, "" outside a repository
+  unsigned char *data; // mmap'd file, NULL when there is no usable graph
+  size_t size;
+  uint32_t count;           // Commits in the graph
+  const unsigned char *fanout; // OIDF: 256 cumulative counts
+  const unsigned char *oids;   // OIDL: count sorted raw oids
+  const unsigned char *cdat;   // CDAT: tree, parents, generation and date
+  const unsigned char *edges;  // EDGE: extra parents of octopus merges
+  size_t edge_count;
+  struct stat file_stat; // To notice a rewritten graph
+} CommitGraph;
+
+// Hex oids seen so far, for commits that aren't in the graph
+typedef struct {
+  char (*slots)[GIT_MAX_OID_HEX_LEN + 1]; // Open addressing, "" marks empty
+  size_t capacity;                    // Power of two
+  size_t count;
+} OidSet;
+
+// One commit waiting in a walk, newest first
+typedef struct {
+  char oid[GIT_MAX_OID_HEX_LEN + 1];
+  time_t time;
+  uint32_t seq; // Insertion order breaks date ties, as git log does
+  uint32_t pos; // Graph position, or COMMIT_GRAPH_NONE
+  char (*parents)[GIT_MAX_OID_HEX_LEN + 1]; // Parents of a commit outside the
+  int parent_count;                      // graph, read from its object
+} CommitWalkEntry;
+
+#define COMMIT_GRAPH_NONE 0xffffffffu
+
+// Walks history from a tip in committer-date order, like git log, handing
+// out one commit at a time so the caller can page through it
+typedef struct {
+  const CommitGraph *graph;
+  CommitWalkEntry *heap;
+  int heap_count;
+  int heap_capacity;
+  uint32_t next_seq;
+  uint64_t *seen_bits; // Graph positions already queued
+  OidSet seen;         // Commits outside the graph already queued
+} CommitWalk;
+
+// Commits reachable from a tip (the upstream branch), computed once per tip
+typedef struct {
+  char tip[GIT_MAX_OID_HEX_LEN + 1];
+  char head[GIT_MAX_OID_HEX_LEN + 1]; // Only used without a graph
+  int valid;
+  int inverted;        // Without a graph: extra lists head's commits that
+                       // are NOT reachable, from one git rev-list
+  uint64_t *bits;      // Reachable graph positions
+  uint32_t bit_count;
+  OidSet extra;        // Reachable commits outside the graph
+} CommitReach;
+
+int commit_graph_open(CommitGraph *graph);
+
+void commit_graph_close(CommitGraph *graph);
+
+int commit_graph_changed(const CommitGraph *graph);
+
+uint32_t commit_graph_find(const CommitGraph *graph, const char *hex_oid);
+
+int commit_walk_start(CommitWalk *walk, const CommitGraph *graph,
+                      const char *tip_oid);
+
+int commit_walk_next(CommitWalk *walk, char *oid_out);
+
+int commit_walk_done(const CommitWalk *walk);
+
+void commit_walk_free(CommitWalk *walk);
+
+void commit_reach_init(CommitReach *reach);
+
+int commit_reach_compute(CommitReach *reach, const CommitGraph *graph,
+                         const char *tip_oid, const char *head_oid);
+
+int commit_reach_contains(const CommitReach *reach, const CommitGraph *graph,
+                          const char *hex_oid);
+
+void commit_reach_free(CommitReach *reach);
+
+#endif // COMMIT_GRAPH_H
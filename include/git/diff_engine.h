@@ -0,0 +1,47 @@
+
+#ifndef DIFF_ENGINE_H
+#define DIFF_ENGINE_H
+
+#include "common.h"
+
+typedef enum {
+  DIFF_ALGORITHM_MYERS,
+  DIFF_ALGORITHM_HISTOGRAM,
+} DiffAlgorithm;
+
+typedef struct {
+  char type;        // ' ' = context, '+' = addition, '-' = deletion
+  const char *text; // Points into the caller's buffers, not NUL-terminated
+  int len;          // Length without the newline
+  int old_line;     // 1-based, -1 for additions
+  int new_line;     // 1-based, -1 for deletions
+  int missing_newline; // Last line of a file without a trailing newline
+} DiffResultLine;
+
+typedef struct {
+  int old_start;
+  int old_count;
+  int new_start;
+  int new_count;
+  int first_line; // Index of the hunk's first entry in DiffResult.lines
+  int line_count;
+} DiffHunk;
+
+typedef struct {
+  DiffResultLine *lines;
+  int line_count;
+  DiffHunk *hunks;
+  int hunk_count;
+} DiffResult;
+
+int diff_buffers(const char *old_buffer, size_t old_len,
+                 const char *new_buffer, size_t new_len, int context,
+                 DiffAlgorithm algorithm, DiffResult *result);
+
+void diff_result_free(DiffResult *result);
+
+int diff_format_hunk_header(const DiffHunk *hunk, char *buffer, size_t size);
+
+int diff_buffer_is_binary(const char *buffer, size_t len);
+
+#endif // DIFF_ENGINE_H
@@ -0,0 +1,76 @@
+
+#ifndef GIT_ASYNC_H
+#define GIT_ASYNC_H
+
+#include "common.h"
+
+#define GIT_OP_MAX_ARGS 12
+#define GIT_OP_QUEUE_LEN 8
+
+// Flags for git_op_enqueue
+#define GIT_OP_NO_PROMPT 1 // Fail instead of asking for credentials
+
+// One queued git command. kind is the caller's own tag, handed back when
+// the command finishes
+typedef struct {
+  int kind;
+  int flags;
+  char *argv[GIT_OP_MAX_ARGS + 1]; // malloc'd copies, NULL-terminated
+  char *input;                     // Fed to the command's stdin, may be NULL
+  size_t input_len;
+} GitOpRequest;
+
+// How a finished command went
+typedef struct {
+  int kind;
+  int success;       // Exited with status 0
+  int cancelled;     // Killed by git_op_cancel
+  char message[256]; // Last line git printed, for error popups
+} GitOpResult;
+
+// Runs queued git commands one at a time in the background. The caller
+// polls input_fd for writing, output_fd and pidfd for reading, and calls
+// git_op_write_input / git_op_read_output / git_op_reap
+typedef struct {
+  GitOpRequest pending[GIT_OP_QUEUE_LEN];
+  int pending_head;
+  int pending_count;
+
+  GitOpRequest current;
+  int running;
+  int cancelled;
+  pid_t pid;
+  int input_fd;  // Its stdin while input is left to write, or -1
+  size_t input_written;
+  int output_fd; // Merged stdout/stderr of the running command, or -1
+  int pidfd;     // pidfd of the running command, -1 if unavailable
+
+  int progress;     // Percentage from git's progress meter, -1 if none yet
+  char phase[64];   // e.g. "Writing objects"
+  char message[256];
+  char partial[256]; // Output line still being received
+  size_t partial_len;
+} GitOpQueue;
+
+int git_op_open_pidfd(pid_t pid);
+
+void git_op_queue_init(GitOpQueue *queue);
+
+void git_op_queue_destroy(GitOpQueue *queue);
+
+int git_op_enqueue(GitOpQueue *queue, int kind, int flags, const char *input,
+                   size_t input_len, ...);
+
+int git_op_start_next(GitOpQueue *queue);
+
+int git_op_busy(const GitOpQueue *queue);
+
+int git_op_write_input(GitOpQueue *queue);
+
+int git_op_read_output(GitOpQueue *queue);
+
+int git_op_reap(GitOpQueue *queue, GitOpResult *result);
+
+void git_op_cancel(GitOpQueue *queue);
+
+#endif // GIT_ASYNC_H
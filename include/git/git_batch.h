@@ -0,0 +1,44 @@
+
+#ifndef GIT_BATCH_H
+#define GIT_BATCH_H
+
+#include "common.h"
+
+#define GIT_OID_HEX_LEN 40
+#define GIT_MAX_OID_HEX_LEN 64 // SHA-256 repositories
+
+// Metadata returned for an object lookup
+typedef struct {
+  char oid[GIT_MAX_OID_HEX_LEN + 1];
+  char type[16]; // "blob", "tree", "commit" or "tag"
+  size_t size;
+} GitObjectInfo;
+
+// A parsed commit object. Strings point into the caller's object buffer
+// except for the parent list, which is owned by the struct
+typedef struct {
+  char tree[GIT_MAX_OID_HEX_LEN + 1];
+  char (*parents)[GIT_MAX_OID_HEX_LEN + 1];
+  int parent_count;
+  const char *author;    // "Name <email>", not NUL-terminated
+  int author_len;
+  time_t author_time;
+  time_t committer_time;
+  const char *message;   // Everything after the header block
+} GitCommit;
+
+int git_batch_start(void);
+
+void git_batch_stop(void);
+
+int git_batch_object_info(const char *object_name, GitObjectInfo *info);
+
+char *git_batch_read_object(const char *object_name, GitObjectInfo *info);
+
+int git_batch_parse_commit(const char *buffer, size_t size, GitCommit *commit);
+
+void git_batch_free_commit(GitCommit *commit);
+
+int git_is_oid_hex(const char *text);
+
+#endif // GIT_BATCH_H
@@ -0,0 +1,20 @@
+#ifndef GIT_COMMAND_H
+#define GIT_COMMAND_H
+
+#include "common.h"
+
+// What a git command printed, and how it exited
+typedef struct {
+  char *data; // Standard output, NUL-terminated
+  size_t len;
+  int status; // Exit status, -1 if git was killed
+} GitOutput;
+
+int git_command_run(const char *const argv[], const char *input,
+                    size_t input_len, GitOutput *output);
+
+int git_output_next_line(GitOutput *output, size_t *offset, char **line);
+
+void git_output_free(GitOutput *output);
+
+#endif // GIT_COMMAND_H
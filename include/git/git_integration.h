@@ -25,7 +25,7 @@ int create_git_stash(void);
 
 int create_git_stash_with_name(const char *stash_name);
 
-int get_git_stashes(char stashed[][512], int max_stashes);
+int get_git_stashes(char (**stashes)[512], int *capacity);
 
 int apply_git_stash(int stash_index);
 
@@ -33,10 +33,13 @@ int pop_git_stash(int stash_index);
 
 int drop_git_stash(int stash_index);
 
-int get_commit_details(const char *commit_hash, char *commit_info, size_t info_size);
+char *get_commit_details(const char *commit_hash);
 
-int get_stash_diff(int stash_index, char *stash_diff, size_t diff_size);
+char *get_stash_diff(int stash_index);
 
-int get_branch_commits(const char *branch_name, char commits[][2048], int max_commits);
+char *get_stash_diff_by_ref(const char *stash_ref);
+
+char *get_branch_commits(const char *branch_name, int max_commits,
+                         int *commit_count);
 
 #endif // GIT_INTEGRATION_H
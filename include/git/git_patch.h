@@ -0,0 +1,28 @@
+
+#ifndef GIT_PATCH_H
+#define GIT_PATCH_H
+
+#include "common.h"
+
+// Flags for git_apply_patch
+#define GIT_APPLY_CACHED 1  // Apply to the index only (--cached)
+#define GIT_APPLY_REVERSE 2 // Undo the patch (-R)
+
+// Length-tracked patch text, grown as lines are added
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+} GitPatch;
+
+void git_patch_init(GitPatch *patch);
+
+void git_patch_free(GitPatch *patch);
+
+int git_patch_append(GitPatch *patch, const char *text, size_t len);
+
+int git_patch_appendf(GitPatch *patch, const char *fmt, ...);
+
+int git_apply_patch(const GitPatch *patch, int flags);
+
+#endif // GIT_PATCH_H
@@ -0,0 +1,73 @@
+
+#ifndef GIT_WATCH_H
+#define GIT_WATCH_H
+
+#include "common.h"
+
+// What changed since the last git_watch_clear
+#define GIT_WATCH_WORKTREE 1 // Files in the work tree, listed in paths
+#define GIT_WATCH_INDEX 2    // The index was rewritten by someone else
+#define GIT_WATCH_REFS 4     // HEAD, branches, remotes or tags moved
+#define GIT_WATCH_STASH 8    // The stash list changed
+#define GIT_WATCH_RESCAN 16  // Too much changed to track path by path
+
+// More changed paths than this and a full status is cheaper
+#define GIT_WATCH_MAX_PATHS 32
+// Changes are handed out once events stop for this long...
+#define GIT_WATCH_SETTLE_MS 150
+// ...or once the first of them is this old, whichever comes first
+#define GIT_WATCH_MAX_DELAY_MS 1000
+
+// One watched directory
+typedef struct {
+  int wd;
+  int kind;           // Work tree, git dir, refs or reflog directory
+  char *path;         // Relative to the work tree ("" or "dir/"), or
+                      // absolute with a trailing slash under .git
+  char *created_root; // Topmost directory created while watching, if any
+} GitWatchDir;
+
+// inotify watches over the work tree and .git, coalescing events into
+// GIT_WATCH_* flags and a list of changed paths
+typedef struct {
+  int fd; // inotify descriptor, -1 when not watching
+  char top[PATH_MAX];
+  char git_dir[PATH_MAX];
+  char common_dir[PATH_MAX];
+
+  GitWatchDir *dirs; // Sorted by wd
+  int dir_count;
+  int dir_capacity;
+
+  char **ignored_dirs; // Sorted "dir/" paths git ignores, never watched
+  int ignored_count;
+
+  int changes; // GIT_WATCH_* flags not yet handled
+  char *paths[GIT_WATCH_MAX_PATHS];
+  int path_count;
+  long long first_change_ms;
+  long long last_change_ms;
+
+  // Index as of the last status we ran ourselves; git status rewrites the
+  // index, which must not look like an outside change
+  struct stat index_stat;
+  int index_stat_valid;
+} GitWatcher;
+
+void git_watch_init(GitWatcher *watch);
+
+int git_watch_start(GitWatcher *watch);
+
+void git_watch_stop(GitWatcher *watch);
+
+int git_watch_active(const GitWatcher *watch);
+
+int git_watch_read(GitWatcher *watch);
+
+int git_watch_ms_until_ready(const GitWatcher *watch);
+
+void git_watch_clear(GitWatcher *watch, int flags);
+
+void git_watch_note_index(GitWatcher *watch);
+
+#endif // GIT_WATCH_H
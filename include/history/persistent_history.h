@@ -24,6 +24,8 @@ typedef struct {
 // Initialize persistent history
 void init_persistent_history(void);
 
+void wait_for_history(void);
+
 // Clean up persistent history
 void cleanup_persistent_history(void);
 
@@ -6,10 +6,6 @@
 #include "line_reader.h"
 #include <limits.h>
 
-int levenshtein_distance(const char *s1, const char *s2);
-
-int min3(int a, int b, int c);
-
 void init_autocorrect(void);
 
 void shutdown_autocorrect(void);
@@ -0,0 +1,26 @@
+
+#ifndef COMMAND_INDEX_H
+#define COMMAND_INDEX_H
+
+#include "common.h"
+#include "edit_distance.h"
+
+// Where a name in the index came from; a name can have several
+#define COMMAND_SOURCE_BUILTIN 1
+#define COMMAND_SOURCE_ALIAS 2
+#define COMMAND_SOURCE_PATH 4
+#define COMMAND_SOURCE_HISTORY 8
+
+// Called for each name within bound of the pattern. Returns the bound for
+// the rest of the search, so callers can narrow it as matches improve
+typedef int (*CommandIndexVisit)(const char *name, int sources, int distance,
+                                 void *context);
+
+void command_index_refresh(void);
+
+int command_index_search(const EditPattern *pattern, int bound,
+                         CommandIndexVisit visit, void *context);
+
+void command_index_free(void);
+
+#endif // COMMAND_INDEX_H
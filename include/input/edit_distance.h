@@ -0,0 +1,23 @@
+
+#ifndef EDIT_DISTANCE_H
+#define EDIT_DISTANCE_H
+
+#include "common.h"
+#include <stdint.h>
+
+// Longest pattern the bit-parallel engine handles: one bit per character
+#define EDIT_PATTERN_MAX 64
+
+// A word prepared once for comparison against many candidates: for each
+// byte value, the positions where it occurs in the word
+typedef struct {
+  uint64_t peq[256];
+  int length;
+} EditPattern;
+
+int edit_pattern_init(EditPattern *pattern, const char *word);
+
+int edit_distance_bounded(const EditPattern *pattern, const char *candidate,
+                          int bound);
+
+#endif // EDIT_DISTANCE_H
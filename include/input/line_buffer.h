@@ -0,0 +1,44 @@
+
+#ifndef LINE_BUFFER_H
+#define LINE_BUFFER_H
+
+#include "common.h"
+
+// The line being edited, as a gap buffer: text before the cursor sits at
+// the start of data, text after it at the end, and the gap between them
+// absorbs inserts and deletes at the cursor. Both halves are kept
+// NUL-terminated so they can be read as C strings without copying
+typedef struct {
+  char *data;
+  size_t capacity;  // Bytes in data, excluding the final NUL
+  size_t gap_start; // Cursor: length of the text before it
+  size_t gap_end;   // Offset of the text after the cursor
+} LineBuffer;
+
+int line_buffer_init(LineBuffer *line);
+
+void line_buffer_free(LineBuffer *line);
+
+int line_buffer_insert(LineBuffer *line, const char *text, size_t len);
+
+int line_buffer_set(LineBuffer *line, const char *text);
+
+int line_buffer_set_before(LineBuffer *line, const char *text);
+
+int line_buffer_delete_before(LineBuffer *line);
+
+int line_buffer_move_left(LineBuffer *line);
+
+int line_buffer_move_right(LineBuffer *line);
+
+const char *line_buffer_before(const LineBuffer *line);
+
+const char *line_buffer_after(const LineBuffer *line);
+
+size_t line_buffer_cursor(const LineBuffer *line);
+
+size_t line_buffer_length(const LineBuffer *line);
+
+char *line_buffer_detach(LineBuffer *line);
+
+#endif // LINE_BUFFER_H
@@ -10,6 +10,8 @@ int read_key(void);
 
 char *lsh_read_line(void);
 
+void update_suggestions(const char *buffer, int position);
+
 void generate_enhanced_prompt(char *prompt_buffer, size_t buffer_size);
 
 char **lsh_split_line(char *line);
@@ -3,9 +3,13 @@
 #define GREP_H
 
 #include "common.h"
+#include <stdbool.h>
 
 void run_interactive_grep_session(void);
 
 int lsh_grep(char **args);
 
+bool boyer_moore_search(const char *text, int text_len, const char *pattern,
+                        int pattern_len, int *match_pos, bool ignore_case);
+
 #endif // GREP_H
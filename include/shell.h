@@ -19,6 +19,12 @@ int lsh_launch(char **args);
 
 void lsh_loop(void);
 
+int lsh_run_line(char *line, int interactive);
+
+int lsh_run_script(FILE *fp);
+
+int lsh_run_command(const char *command);
+
 void free_commands(char ***commands);
 
 int init_status_bar(int fd);
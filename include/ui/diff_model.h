@@ -0,0 +1,28 @@
+
+#ifndef DIFF_MODEL_H
+#define DIFF_MODEL_H
+
+#include "common.h"
+#include "diff_engine.h"
+#include "ncurses_line_store.h"
+
+// Diff loading shared by both diff viewers: every source (the in-process
+// engine, git's unified output, an untracked file) ends up as tagged lines
+// in an NCursesLineStore
+
+DiffAlgorithm diff_model_algorithm_setting(void);
+
+int diff_model_is_new_file(const char *filename);
+
+int diff_model_append_hunks(NCursesLineStore *store, const DiffResult *diff,
+                            int is_staged);
+
+int diff_model_load_worktree(NCursesLineStore *store, const char *object_name,
+                             const char *filename, int context,
+                             DiffAlgorithm algorithm);
+
+int diff_model_load_git(NCursesLineStore *store, const char *const argv[]);
+
+int diff_model_load_new_file(NCursesLineStore *store, const char *filename);
+
+#endif // DIFF_MODEL_H
@@ -3,22 +3,51 @@
 #define NCURSES_DIFF_VIEWER_H
 
 #include "common.h"
+#include "commit_graph.h"
+#include "diff_engine.h"
+#include "git_async.h"
+#include "git_watch.h"
+#include "git_batch.h"
+#include "ncurses_line_store.h"
+#include "ncurses_preview_cache.h"
+#include "syntax_highlight.h"
 #include <ncurses.h>
 
-#define MAX_FILES 100
 #define MAX_FILENAME_LEN 256
-#define MAX_FULL_FILE_LINES 2000
-#define MAX_COMMITS 50
 #define MAX_COMMIT_TITLE_LEN 256
 #define MAX_AUTHOR_INITIALS 3
-#define MAX_STASHES 100
-#define MAX_BRANCHES 5
 #define MAX_BRANCHNAME_LEN 256
 
+// Commits are loaded this many at a time as the commit list scrolls
+#define COMMIT_PAGE_SIZE 50
+// The next page is loaded once the selection is this close to the end
+#define COMMIT_PAGE_MARGIN 10
+
+// Animation tick interval while a sync/push/pull animation is running
+#define SYNC_ANIMATION_TICK_MS 20
+// Seconds between background fetches
+#define SYNC_FETCH_INTERVAL 30
+
+// Dirty flags for the main loop: only windows marked here are re-rendered
+#define DIRTY_TITLE (1 << 0)
+#define DIRTY_FILE_LIST (1 << 1)
+#define DIRTY_FILE_CONTENT (1 << 2)
+#define DIRTY_COMMIT_LIST (1 << 3)
+#define DIRTY_BRANCH_LIST (1 << 4)
+#define DIRTY_STASH_LIST (1 << 5)
+#define DIRTY_STATUS_BAR (1 << 6)
+#define DIRTY_ALL 0x7f
+
 typedef struct {
   char stash_info[512];
 } NCursesStash;
 
+// A grep match: its index in the list being searched and how well it scored
+typedef struct {
+  int item_index;
+  int score;
+} NCursesGrepItem;
+
 typedef struct {
   char filename[MAX_FILENAME_LEN];
   char status;           // 'M' = modified, 'A' = added, 'D' = deleted
@@ -26,23 +55,38 @@ typedef struct {
   int has_staged_changes;
 } NCursesChangedFile;
 
+// Where a hunk of the unstaged pane sits, and how it shows in the staged
+// preview while lines are picked for staging
+typedef struct {
+  int first_line;    // The hunk's @@ line in file_store
+  int end_line;      // One past its last line in file_store
+  int staged_lines;  // Lines of the hunk picked for staging
+  int preview_first; // Its @@ line in staged_store, -1 while not shown
+  int preview_len;   // Lines it takes up in staged_store
+  int preview_delta; // Line balance of the shown hunks before it
+  int old_start;     // Preview header numbers
+  int old_count;
+  int new_count;
+} NCursesHunkIndex;
+
 typedef struct {
   char name[MAX_BRANCHNAME_LEN];
   int status;
   int commits_ahead;
   int commits_behind;
+  // What the counts were computed from; they are reused while none changes
+  char tip[GIT_MAX_OID_HEX_LEN + 1];
+  char compare_ref[MAX_BRANCHNAME_LEN + 32]; // Upstream, else origin/<name>
+  char compare_tip[GIT_MAX_OID_HEX_LEN + 1];
 } NCursesBranches;
 
+// Every ref and the commit it points at, as of the last history load.
+// Previews show these as decorations
 typedef struct {
-  char line[1024];
-  char type; // '+' = addition, '-' = deletion, ' ' = context, '@' = hunk header
-  int is_diff_line; // 1 if this is a diff line, 0 if original file line
-  int hunk_id;
-  int is_staged;
-  int line_number_old;
-  int line_number_new;
-  int is_context;
-} NCursesFileLine;
+  char *text;   // for-each-ref output, split into lines in place
+  char **lines; // "refname\toid\tpeeled oid\tHEAD marker", sorted
+  int count;
+} NCursesRefState;
 
 typedef struct {
   char hash[16]; // Short commit hash
@@ -84,25 +128,42 @@ typedef enum {
   SYNC_STATUS_PULLED_DISAPPEARING
 } SyncStatus;
 
+// Git operations run through the viewer's background queue
+typedef enum {
+  VIEWER_OP_STAGE_MARKED, // git add of the marked files before a commit
+  VIEWER_OP_COMMIT,
+  VIEWER_OP_AMEND,
+  VIEWER_OP_RESET_SOFT,
+  VIEWER_OP_RESET_HARD,
+  VIEWER_OP_PUSH,
+  VIEWER_OP_PUSH_AUTH,     // Retry of a push with entered credentials
+  VIEWER_OP_PUSH_UPSTREAM, // First push of a branch, setting its upstream
+  VIEWER_OP_PULL
+} ViewerGitOp;
+
 typedef struct {
-  NCursesChangedFile files[MAX_FILES];
+  NCursesChangedFile *files; // Growable list of changed files
   int file_count;
+  int file_capacity;
   int selected_file;
-  NCursesFileLine file_lines[MAX_FULL_FILE_LINES];
-  int file_line_count;
+  NCursesLineStore file_store; // Lines shown in the content pane
   int file_scroll_offset;
   int file_cursor_line;
-  NCursesCommit commits[MAX_COMMITS];
+  NCursesCommit *commits; // History loaded so far, newest first
   int commit_count;
+  int commit_capacity;
   int selected_commit;
   int commit_scroll_offset;
-  NCursesStash stashes[MAX_STASHES];
-  NCursesBranches branches[MAX_BRANCHES];
+  NCursesStash *stashes; // Growable list of stashes, newest first
+  int stash_capacity;
+  NCursesBranches *branches; // Growable list of local branches
+  int branch_capacity;
   int stash_count;
   int branch_count;
   int selected_stash;
   int stash_scroll_offset;
   int selected_branch;
+  int branch_scroll_offset;
   WINDOW *file_list_win;
   WINDOW *file_content_win;
   WINDOW *commit_list_win;
@@ -134,10 +195,44 @@ typedef struct {
   // Background fetch management
   pid_t fetch_pid;       // Process ID of background fetch
   int fetch_in_progress; // Flag to track if fetch is running
+  int fetch_pidfd;       // pidfd of the fetch child, -1 if unavailable
+
+  // Paged commit history: the walk continues where the last page ended.
+  // Without the batch helper, pages come from git log --skip instead
+  CommitGraph commit_graph;
+  CommitWalk commit_walk;
+  int commit_log_from_git;
+  int commit_log_done; // No more history to load
+  char commit_log_tip[GIT_MAX_OID_HEX_LEN + 1]; // Where paging started
+  CommitReach pushed_commits; // Reachable from the upstream tip
+  int upstream_known;         // 0: no upstream, every commit shows pushed
+  NCursesRefState ref_state;  // Decides which cached previews stay valid
+
+  // Commit, push, pull, amend and reset run here without blocking input
+  GitOpQueue git_ops;
+
+  // inotify over the work tree and .git; changes are applied file by file
+  // instead of rescanning the repository
+  GitWatcher watch;
+
+  // Event loop state
+  int dirty_windows;     // DIRTY_* flags of windows needing a redraw
+  int animation_timerfd; // timerfd for animation ticks, -1 if unavailable
+  int animation_timer_armed; // 1 while the tick timer is running
+
+  // Algorithm for in-process diffs, from git's diff.algorithm setting
+  DiffAlgorithm diff_algorithm;
+
+  // Parsed commit/branch/stash previews, filled ahead of the cursor
+  PreviewCache preview_cache;
+
+  // Token spans of diff lines already drawn, keyed by line hash
+  SyntaxCache syntax_cache;
 
   // Branch-specific commits for hover functionality
-  char branch_commits[MAX_COMMITS][2048]; // Larger buffer for formatted commits
+  NCursesLineStore branch_commit_store; // Parsed log, one block per commit
   int branch_commit_count;
+  char branch_commits_key[PREVIEW_KEY_LEN]; // Tip the log was loaded from
   char current_branch_for_commits[MAX_BRANCHNAME_LEN];
   int branch_commits_scroll_offset;
   int branch_commits_cursor_line;
@@ -147,9 +242,11 @@ typedef struct {
   int active_pane;             // 0 = unstaged, 1 = staged
   char current_file_path[512]; // Path of currently viewed file
   int total_hunks;             // Total number of hunks in current file
-  NCursesFileLine
-      staged_lines[MAX_FULL_FILE_LINES]; // Separate storage for staged content
-  int staged_line_count;                 // Number of lines in staged view
+  int current_file_is_new;     // 1 if the file isn't in the index yet
+  NCursesHunkIndex *hunks;     // One entry per hunk of file_store
+  int hunk_capacity;
+  int staged_line_total;       // Lines picked for staging, all hunks
+  NCursesLineStore staged_store; // Separate storage for staged content
   int staged_cursor_line;
 
   // Fuzzy search state
@@ -158,10 +255,10 @@ typedef struct {
   int fuzzy_search_query_len;   // Length of current query
 
   // Scored search results
-  struct {
+  struct NCursesScoredFile {
     int file_index;
     int score;
-  } fuzzy_scored_files[MAX_FILES]; // Scored and sorted results
+  } *fuzzy_scored_files; // Scored and sorted results, sized to file_capacity
 
   int fuzzy_filtered_count; // Number of filtered files
   int fuzzy_selected_index; // Currently selected in fuzzy list
@@ -184,12 +281,9 @@ typedef struct {
   char grep_search_query[256];      // Current search query
   int grep_search_query_len;        // Length of current query
 
-  // Scored grep search results
-  struct {
-    int item_index;
-    int score;
-  } grep_scored_items[MAX_COMMITS]; // Scored and sorted results (reuse
-                                    // MAX_COMMITS)
+  // Scored grep search results, sorted best first
+  NCursesGrepItem *grep_scored_items;
+  int grep_scored_capacity;
 
   int grep_filtered_count; // Number of filtered items
   int grep_selected_index; // Currently selected in grep list
@@ -212,6 +306,9 @@ int init_ncurses_diff_viewer(NCursesDiffViewer *viewer);
 
 int get_ncurses_changed_files(NCursesDiffViewer *viewer);
 
+int refresh_changed_file(NCursesDiffViewer *viewer, const char *filename);
+void apply_watched_changes(NCursesDiffViewer *viewer);
+
 int load_full_file_with_diff(NCursesDiffViewer *viewer, const char *filename);
 
 void render_file_list_window(NCursesDiffViewer *viewer);
@@ -224,11 +321,8 @@ int run_ncurses_diff_viewer(void);
 
 void cleanup_ncurses_diff_viewer(NCursesDiffViewer *viewer);
 
-int create_temp_file_with_changes(const char *filename, char *temp_path);
-
-int create_temp_file_git_version(const char *filename, char *temp_path);
-
 int get_commit_history(NCursesDiffViewer *viewer);
+int load_more_commits(NCursesDiffViewer *viewer);
 
 void toggle_file_mark(NCursesDiffViewer *viewer, int file_index);
 
@@ -254,6 +348,14 @@ void render_branch_list_window(NCursesDiffViewer *viewer);
 
 void update_sync_status(NCursesDiffViewer *viewer);
 
+void advance_sync_animation(NCursesDiffViewer *viewer);
+
+int sync_animation_active(NCursesDiffViewer *viewer);
+
+void mark_viewer_dirty(NCursesDiffViewer *viewer, int windows);
+
+void render_dirty_windows(NCursesDiffViewer *viewer);
+
 int get_ncurses_git_stashes(NCursesDiffViewer *viewer);
 
 int get_ncurses_git_branches(NCursesDiffViewer *viewer);
@@ -305,6 +407,8 @@ int parse_branch_commits_to_lines(NCursesDiffViewer *viewer);
 
 void start_background_fetch(NCursesDiffViewer *viewer);
 
+void check_git_operations(NCursesDiffViewer *viewer);
+
 void check_background_fetch(NCursesDiffViewer *viewer);
 
 void move_cursor_smart(NCursesDiffViewer *viewer, int direction);
@@ -331,6 +435,9 @@ int get_single_input(const char *title, const char *prompt, char *input,
 int get_github_credentials(char *username, int username_len, char *token,
                            int token_len);
 
+int build_authenticated_remote_url(const char *username, const char *token,
+                                   char *auth_url, size_t auth_url_size);
+
 int execute_git_with_auth(const char *base_cmd, const char *username,
                           const char *token);
 
@@ -0,0 +1,65 @@
+
+#ifndef NCURSES_LINE_STORE_H
+#define NCURSES_LINE_STORE_H
+
+#include "common.h"
+#include <stdarg.h>
+
+typedef struct {
+  size_t text_offset; // Offset of the line body in the store's text arena
+  int text_len;       // Length of the line body, excluding the NUL
+  char type; // '+' = addition, '-' = deletion, ' ' = context, '@' = hunk header
+  int is_diff_line; // 1 if this is a diff line, 0 if original file line
+  int hunk_id;
+  int is_staged;
+  int line_number_old;
+  int line_number_new;
+  int is_context;
+  int line_id; // Unstaged pane: own index. Staged preview: index of the
+               // unstaged line it shows, -1 for headers
+} NCursesFileLine;
+
+// Growable line storage: line records index into one text arena, so there is
+// no per-line allocation and no cap on line count or line length
+typedef struct {
+  NCursesFileLine *lines;
+  int count;
+  int capacity;
+  char *text;      // NUL-terminated line bodies stored back to back
+  size_t text_len; // Bytes in use in text
+  size_t text_cap; // Bytes allocated for text
+  size_t text_garbage; // Bytes of text no line points at any more
+} NCursesLineStore;
+
+void line_store_init(NCursesLineStore *store);
+
+void line_store_clear(NCursesLineStore *store);
+
+void line_store_truncate(NCursesLineStore *store, int count);
+
+void line_store_free(NCursesLineStore *store);
+
+NCursesFileLine *line_store_append(NCursesLineStore *store, const char *text,
+                                   size_t len);
+
+NCursesFileLine *line_store_appendf(NCursesLineStore *store, const char *fmt,
+                                    ...);
+
+NCursesFileLine *line_store_append_copy(NCursesLineStore *store,
+                                        const NCursesLineStore *src,
+                                        const NCursesFileLine *line);
+
+int line_store_set_text(NCursesLineStore *store, int index, const char *text,
+                        size_t len);
+
+int line_store_copy(NCursesLineStore *dst, const NCursesLineStore *src);
+
+int line_store_splice(NCursesLineStore *store, int index, int remove_count,
+                      const NCursesLineStore *src);
+
+const char *line_store_text(const NCursesLineStore *store,
+                            const NCursesFileLine *line);
+
+int line_store_read_line(FILE *fp, char **buffer, size_t *buffer_size);
+
+#endif // NCURSES_LINE_STORE_H
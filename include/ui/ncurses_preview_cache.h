@@ -0,0 +1,88 @@
+
+#ifndef NCURSES_PREVIEW_CACHE_H
+#define NCURSES_PREVIEW_CACHE_H
+
+#include "common.h"
+#include "ncurses_line_store.h"
+#include <pthread.h>
+
+#define PREVIEW_CACHE_MAX_ENTRIES 64
+#define PREVIEW_CACHE_MAX_BYTES (32 * 1024 * 1024)
+#define PREVIEW_PREFETCH_RADIUS 3
+#define PREVIEW_MAX_JOBS (PREVIEW_PREFETCH_RADIUS * 2)
+#define PREVIEW_KEY_LEN 64
+#define PREVIEW_OBJECT_LEN 256
+
+typedef enum {
+  PREVIEW_COMMIT,
+  PREVIEW_BRANCH,
+  PREVIEW_STASH,
+} PreviewKind;
+
+// A parsed preview, keyed by (object id, kind)
+typedef struct PreviewEntry {
+  PreviewKind kind;
+  char key[PREVIEW_KEY_LEN];
+  NCursesLineStore store;
+  int item_count; // Commits in a branch log, unused otherwise
+  size_t bytes;
+  struct PreviewEntry *prev; // Towards most recently used
+  struct PreviewEntry *next; // Towards least recently used
+} PreviewEntry;
+
+// Object to load in the background; the key is resolved by the worker
+typedef struct {
+  PreviewKind kind;
+  char object[PREVIEW_OBJECT_LEN]; // Commit hash, branch name or stash ref
+} PreviewJob;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_t thread;
+  int thread_running;
+  int stopping;
+
+  PreviewEntry *head; // Most recently used
+  PreviewEntry *tail; // Least recently used
+  int entry_count;
+  size_t total_bytes;
+
+  PreviewJob jobs[PREVIEW_MAX_JOBS];
+  int job_count;
+} PreviewCache;
+
+void preview_cache_init(PreviewCache *cache);
+
+void preview_cache_destroy(PreviewCache *cache);
+
+void preview_cache_clear(PreviewCache *cache);
+
+// Decides whether a cached preview is still good
+typedef int (*PreviewKeep)(PreviewKind kind, const char *key, void *context);
+
+void preview_cache_retain(PreviewCache *cache, PreviewKeep keep,
+                          void *context);
+
+int preview_cache_lookup(PreviewCache *cache, PreviewKind kind,
+                         const char *key, NCursesLineStore *store,
+                         int *item_count);
+
+void preview_cache_insert(PreviewCache *cache, PreviewKind kind,
+                          const char *key, const NCursesLineStore *store,
+                          int item_count);
+
+void preview_cache_prefetch(PreviewCache *cache, const PreviewJob *jobs,
+                            int job_count);
+
+int preview_resolve_key(PreviewKind kind, const char *object, char *key,
+                        size_t key_size);
+
+int preview_load(PreviewKind kind, const char *object, const char *key,
+                 NCursesLineStore *store, int *item_count);
+
+int preview_parse_content(NCursesLineStore *store, const char *content);
+
+int preview_parse_branch_log(NCursesLineStore *store, const char *log);
+
+#endif // NCURSES_PREVIEW_CACHE_H
@@ -0,0 +1,109 @@
+
+#ifndef SCREEN_MODEL_H
+#define SCREEN_MODEL_H
+
+#include "common.h"
+
+// Longest SGR state a cell can carry, e.g. "\033[1;36m\033[7m"
+#define SCREEN_ATTR_MAX 48
+
+// Bytes queued for the terminal, sent with a single write()
+typedef struct {
+  char *data;
+  size_t len;
+  size_t capacity;
+} ScreenFrame;
+
+// One grapheme cluster on screen: its UTF-8 bytes, how many columns it
+// takes and the SGR state it is drawn with
+typedef struct {
+  unsigned int offset; // Start of its bytes in the owning line's text
+  unsigned short len;
+  unsigned char width; // 1, or 2 for wide characters and emoji
+  unsigned char attr;  // Index into the owning line's attrs
+} ScreenCell;
+
+// A row of cells. Text is added with its escape sequences; SGR sequences
+// become per-cell attributes and anything else is dropped
+typedef struct {
+  ScreenCell *cells;
+  int count;
+  int capacity;
+  char *text; // Bytes of all cells, back to back
+  size_t text_len;
+  size_t text_capacity;
+  char (*attrs)[SCREEN_ATTR_MAX]; // Distinct SGR states, attrs[0] is ""
+  int attr_count;
+  int attr_capacity;
+  int current_attr; // State the next added cell is drawn with
+  int cursor;       // Cell the terminal cursor rests on
+} ScreenLine;
+
+// What the line editor last put on the terminal: the input row and the
+// menu rows below it. Callers describe the next frame and screen_model_flush
+// sends only what differs from the last one
+typedef struct {
+  ScreenFrame frame;
+  ScreenLine shown; // Input row as it is on screen
+  ScreenLine next;  // Input row as the caller wants it
+  int shown_valid;  // 0 until the row has been drawn once
+  int line_pending;
+  char **menu_shown; // Rows below the input row, as on screen
+  int menu_shown_count;
+  char **menu_next;
+  int menu_next_count;
+  int menu_capacity;
+  int menu_pending;
+} ScreenModel;
+
+void screen_frame_init(ScreenFrame *frame);
+
+void screen_frame_free(ScreenFrame *frame);
+
+int screen_frame_append(ScreenFrame *frame, const char *data, size_t len);
+
+int screen_frame_appendf(ScreenFrame *frame, const char *fmt, ...);
+
+int screen_frame_write(ScreenFrame *frame, int fd);
+
+void screen_line_init(ScreenLine *line);
+
+void screen_line_free(ScreenLine *line);
+
+void screen_line_clear(ScreenLine *line);
+
+int screen_line_add(ScreenLine *line, const char *text);
+
+int screen_line_fill(ScreenLine *line, int width);
+
+void screen_line_clip(ScreenLine *line, int width);
+
+int screen_line_columns(const ScreenLine *line, int cells);
+
+int screen_line_difference(const ScreenLine *a, const ScreenLine *b);
+
+void screen_line_emit(ScreenFrame *frame, const ScreenLine *line, int from);
+
+void screen_line_swap(ScreenLine *a, ScreenLine *b);
+
+void screen_model_init(ScreenModel *screen);
+
+void screen_model_free(ScreenModel *screen);
+
+void screen_model_reset(ScreenModel *screen);
+
+void screen_model_line_begin(ScreenModel *screen);
+
+void screen_model_line_add(ScreenModel *screen, const char *text);
+
+void screen_model_line_cursor(ScreenModel *screen);
+
+void screen_model_menu_begin(ScreenModel *screen);
+
+void screen_model_menu_add(ScreenModel *screen, const char *row);
+
+void screen_model_end_line(ScreenModel *screen);
+
+int screen_model_flush(ScreenModel *screen, int fd);
+
+#endif // SCREEN_MODEL_H
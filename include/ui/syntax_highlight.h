@@ -0,0 +1,74 @@
+
+#ifndef SYNTAX_HIGHLIGHT_H
+#define SYNTAX_HIGHLIGHT_H
+
+#include "common.h"
+#include <stdint.h>
+
+// Token kinds a span can have; anything else is plain text
+typedef enum {
+  SYNTAX_KEYWORD = 1,
+  SYNTAX_TYPE,
+  SYNTAX_STRING,
+  SYNTAX_COMMENT,
+  SYNTAX_NUMBER,
+  SYNTAX_PREPROC
+} SyntaxKind;
+
+// Where a line ends up: inside a block comment or multi-line string carries
+// over to the next line
+#define SYNTAX_STATE_NORMAL 0
+#define SYNTAX_STATE_COMMENT 1
+#define SYNTAX_STATE_STRING 2
+
+// Cached lines before the cache is emptied and starts over
+#define SYNTAX_CACHE_MAX_ENTRIES 16384
+
+typedef struct {
+  int start; // Byte offset in the line
+  int len;
+  SyntaxKind kind;
+} SyntaxSpan;
+
+// One row of the language table
+typedef struct {
+  const char *name;
+  const char *const *matches; // ".ext" suffixes or exact file names
+  const char *const *keywords; // Sorted, for bsearch
+  const char *const *types;    // Sorted, for bsearch
+  const char *line_comment;    // e.g. "//" or "#"
+  const char *block_open;      // e.g. "/*", may be NULL
+  const char *block_close;
+  const char *multiline_string; // Delimiter of strings that span lines
+  const char *quotes;           // Single-line string delimiters
+  int preprocessor;             // '#' starting a line is a directive
+} SyntaxLanguage;
+
+typedef struct {
+  uint64_t key; // 0 marks an empty slot
+  int out_state;
+  int span_count;
+  SyntaxSpan *spans;
+} SyntaxCacheEntry;
+
+// Spans of tokenized lines keyed by a hash of the text, language and
+// incoming state, so a line is only tokenized the first time it is drawn
+typedef struct {
+  SyntaxCacheEntry *entries; // Open addressing, capacity is a power of two
+  size_t capacity;
+  size_t count;
+} SyntaxCache;
+
+const SyntaxLanguage *syntax_language_for_path(const char *path);
+
+void syntax_cache_init(SyntaxCache *cache);
+
+void syntax_cache_clear(SyntaxCache *cache);
+
+void syntax_cache_free(SyntaxCache *cache);
+
+int syntax_highlight(SyntaxCache *cache, const SyntaxLanguage *language,
+                     const char *text, int in_state, const SyntaxSpan **spans,
+                     int *span_count);
+
+#endif // SYNTAX_HIGHLIGHT_H
@@ -59,6 +59,41 @@ typedef struct {
   char name[32];
 } ShellTheme;
 
+// Parts of the interface drawn in theme colors
+typedef enum {
+  THEME_TEXT,          // Ordinary output
+  THEME_PROMPT_PATH,   // Directory in the prompt
+  THEME_PROMPT_GIT,    // Branch in the prompt
+  THEME_PROMPT_MARK,   // Marker before the input
+  THEME_SUGGESTION,    // Inline history suggestion
+  THEME_MENU_ITEM,     // Completion menu entry
+  THEME_MENU_SELECTED, // Selected completion menu entry
+  THEME_MENU_HINT,     // "(n above)" and "(n below)" in the menu
+  THEME_STATUS_BAR,    // Status bar text and background
+  THEME_RESET,
+  THEME_ROLE_COUNT
+} ThemeRole;
+
+// Colors the terminal can show, from COLORTERM and TERM
+typedef enum {
+  THEME_DEPTH_16,
+  THEME_DEPTH_256,
+  THEME_DEPTH_TRUE,
+} ThemeDepth;
+
+#define THEME_PALETTE_SIZE 512
+
+// The current theme compiled for this terminal: one escape sequence per
+// role, downgraded to the terminal's color depth, resolved when the theme
+// is loaded so drawing only copies bytes
+typedef struct {
+  char bytes[THEME_PALETTE_SIZE]; // Sequences back to back, each NUL-ended
+  unsigned short offset[THEME_ROLE_COUNT];
+  unsigned char len[THEME_ROLE_COUNT];
+  size_t used;
+  ThemeDepth depth;
+} ThemePalette;
+
 // Initialize theme system
 void init_theme_system(void);
 
@@ -77,6 +112,11 @@ void apply_current_theme(void);
 // Get current theme
 const ShellTheme *get_current_theme(void);
 
+// Escape sequence for a role in the current theme, and its length
+const char *theme_color(ThemeRole role);
+
+size_t theme_color_len(ThemeRole role);
+
 // List available themes
 void list_available_themes(void);
 
@@ -89,4 +129,7 @@ int lsh_theme(char **args);
 // Current active theme
 extern ShellTheme current_theme;
 
+// Current theme's compiled colors
+extern ThemePalette theme_palette;
+
 #endif // THEMES_H
\ No newline at end of file
@@ -0,0 +1,22 @@
+
+#ifndef STARTUP_PROFILE_H
+#define STARTUP_PROFILE_H
+
+#include "common.h"
+#include <time.h>
+
+void startup_profile_enable(void);
+
+int startup_profile_enabled(void);
+
+void startup_profile_mark(struct timespec *mark);
+
+void startup_profile_report(const char *step, const struct timespec *mark);
+
+void startup_profile_deferred(const char *step, const struct timespec *mark);
+
+void startup_profile_flush(void);
+
+void startup_profile_finish(void);
+
+#endif // STARTUP_PROFILE_H
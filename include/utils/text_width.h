@@ -0,0 +1,20 @@
+
+#ifndef TEXT_WIDTH_H
+#define TEXT_WIDTH_H
+
+#include "common.h"
+#include <stdint.h>
+
+int utf8_decode(const char *text, size_t len, uint32_t *codepoint);
+
+int codepoint_width(uint32_t codepoint);
+
+size_t grapheme_next(const char *text, size_t len, size_t pos);
+
+size_t grapheme_prev(const char *text, size_t pos);
+
+int grapheme_width(const char *text, size_t len);
+
+int text_width(const char *text);
+
+#endif // TEXT_WIDTH_H
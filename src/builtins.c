@@ -4,6 +4,7 @@
 #include "diff_viewer.h"
 #include "ncurses_diff_viewer.h"
 #include "filters.h"
+#include "frecency.h"
 #include "fzf_native.h"
 #include "git_integration.h"
 #include "grep.h"
@@ -37,7 +38,7 @@ char *builtin_str[] = {
     "bookmark", "bookmarks", "goto",      "unbookmark", "focus_timer",
     "weather",  "grep",      "grep-text", "ripgrep",    "fzf",
     "clip",     "echo",      "theme",     "loc",        "git_status",
-    "gg",       "ls",        "stats",     "monitor",
+    "gg",       "ls",        "stats",     "monitor",    "z",
 };
 
 // Array of function pointers to built-in command implementations
@@ -52,7 +53,7 @@ int (*builtin_func[])(char **) = {
     &lsh_ripgrep,     &lsh_fzf_native, &lsh_clip,       &lsh_echo,
     &lsh_theme,       &lsh_loc,        &lsh_git_status, &lsh_gg,
     lsh_dir,
-    &lsh_stats,       &builtin_monitor,
+    &lsh_stats,       &builtin_monitor, &lsh_z,
 };
 
 void set_color(int color) {
@@ -119,16 +120,24 @@ int lsh_cd(char **args) {
     char *home_dir = getenv("HOME");
     if (home_dir == NULL) {
       fprintf(stderr, "lsh: HOME environment variable not set\n");
-      return 1;
+      return lsh_builtin_failed();
     }
     if (chdir(home_dir) != 0) {
       perror("lsh: cd");
+      return lsh_builtin_failed();
     }
   } else {
     if (chdir(args[1]) != 0) {
       perror("lsh: cd");
+      return lsh_builtin_failed();
     }
   }
+
+  // Remember the visit for z
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) != NULL) {
+    frecency_record(cwd);
+  }
   return 1;
 }
 
@@ -229,6 +238,13 @@ int lsh_help(char **args) {
       printf("goto - Go to bookmarked directory\n");
       printf("Usage: goto <name>\n");
       printf("  Changes to a previously bookmarked directory\n");
+    } else if (strcmp(args[1], "z") == 0) {
+      printf("z - Jump to a frequently used directory\n");
+      printf("Usage: z [term...]\n");
+      printf("  z             - list the top visited directories\n");
+      printf("  z <term...>   - go to the best match for the terms\n");
+      printf("  Terms match the path in order, the last one in its last\n");
+      printf("  component. Directories rank by visits and recency\n");
     } else if (strcmp(args[1], "theme") == 0) {
       printf("theme - Change shell theme\n");
       printf("Usage: theme <theme_name>\n");
@@ -371,20 +387,20 @@ int lsh_dir(char **args) {
   TableData *table = create_table(headers, 4);
   if (!table) {
     fprintf(stderr, "lsh: failed to create table\n");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   if (getcwd(cwd, sizeof(cwd)) == NULL) {
     perror("lsh: getcwd");
     free_table(table);
-    return 1;
+    return lsh_builtin_failed();
   }
 
   dir = opendir(cwd);
   if (dir == NULL) {
     perror("lsh: opendir");
     free_table(table);
-    return 1;
+    return lsh_builtin_failed();
   }
 
   // Collect all entries
@@ -494,10 +510,11 @@ int lsh_clear(char **args) {
 int lsh_mkdir(char **args) {
   if (args[1] == NULL) {
     fprintf(stderr, "lsh: expected argument to \"mkdir\"\n");
-  } else {
-    if (mkdir(args[1], 0755) != 0) {
-      perror("lsh: mkdir");
-    }
+    return lsh_builtin_failed();
+  }
+  if (mkdir(args[1], 0755) != 0) {
+    perror("lsh: mkdir");
+    return lsh_builtin_failed();
   }
   return 1;
 }
@@ -505,10 +522,11 @@ int lsh_mkdir(char **args) {
 int lsh_rmdir(char **args) {
   if (args[1] == NULL) {
     fprintf(stderr, "lsh: expected argument to \"rmdir\"\n");
-  } else {
-    if (rmdir(args[1]) != 0) {
-      perror("lsh: rmdir");
-    }
+    return lsh_builtin_failed();
+  }
+  if (rmdir(args[1]) != 0) {
+    perror("lsh: rmdir");
+    return lsh_builtin_failed();
   }
   return 1;
 }
@@ -516,10 +534,11 @@ int lsh_rmdir(char **args) {
 int lsh_del(char **args) {
   if (args[1] == NULL) {
     fprintf(stderr, "lsh: expected argument to \"del\"\n");
-  } else {
-    if (unlink(args[1]) != 0) {
-      perror("lsh: del");
-    }
+    return lsh_builtin_failed();
+  }
+  if (unlink(args[1]) != 0) {
+    perror("lsh: del");
+    return lsh_builtin_failed();
   }
   return 1;
 }
@@ -527,37 +546,37 @@ int lsh_del(char **args) {
 int lsh_touch(char **args) {
   if (args[1] == NULL) {
     fprintf(stderr, "lsh: expected argument to \"touch\"\n");
-  } else {
-    int fd = open(args[1], O_CREAT | O_WRONLY | O_APPEND, 0644);
-    if (fd == -1) {
-      perror("lsh: touch");
-    } else {
-      close(fd);
-    }
+    return lsh_builtin_failed();
   }
+  int fd = open(args[1], O_CREAT | O_WRONLY | O_APPEND, 0644);
+  if (fd == -1) {
+    perror("lsh: touch");
+    return lsh_builtin_failed();
+  }
+  close(fd);
   return 1;
 }
 
 int lsh_pwd(char **args) {
   char cwd[PATH_MAX];
-  if (getcwd(cwd, sizeof(cwd)) != NULL) {
-    printf("%s\n", cwd);
-  } else {
+  if (getcwd(cwd, sizeof(cwd)) == NULL) {
     perror("lsh: getcwd");
+    return lsh_builtin_failed();
   }
+  printf("%s\n", cwd);
   return 1;
 }
 
 int lsh_cat(char **args) {
   if (args[1] == NULL) {
     fprintf(stderr, "lsh: expected argument to \"cat\"\n");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   FILE *fp = fopen(args[1], "r");
   if (fp == NULL) {
     perror("lsh: cat");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   char buffer[1024];
@@ -591,20 +610,20 @@ int lsh_copy(char **args) {
   if (args[1] == NULL || args[2] == NULL) {
     fprintf(stderr,
             "lsh: expected source and destination arguments to \"copy\"\n");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   FILE *source = fopen(args[1], "rb");
   if (source == NULL) {
     perror("lsh: copy (source)");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   FILE *dest = fopen(args[2], "wb");
   if (dest == NULL) {
     fclose(source);
     perror("lsh: copy (destination)");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   char buffer[4096];
@@ -623,12 +642,12 @@ int lsh_move(char **args) {
   if (args[1] == NULL || args[2] == NULL) {
     fprintf(stderr,
             "lsh: expected source and destination arguments to \"move\"\n");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   if (rename(args[1], args[2]) != 0) {
     perror("lsh: move");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   printf("Moved %s to %s\n", args[1], args[2]);
@@ -644,7 +663,7 @@ int lsh_ps(char **args) {
   FILE *fp = popen("ps -ef", "r");
   if (fp == NULL) {
     perror("lsh: ps");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   char buffer[1024];
@@ -898,13 +917,13 @@ int lsh_echo(char **args) {
 int lsh_loc(char **args) {
   if (args[1] == NULL) {
     fprintf(stderr, "lsh: expected file or directory argument to \"loc\"\n");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   struct stat st;
   if (stat(args[1], &st) != 0) {
     perror("lsh: loc");
-    return 1;
+    return lsh_builtin_failed();
   }
 
   if (S_ISREG(st.st_mode)) {
@@ -912,7 +931,7 @@ int lsh_loc(char **args) {
     FILE *file = fopen(args[1], "r");
     if (!file) {
       perror("lsh: loc");
-      return 1;
+      return lsh_builtin_failed();
     }
 
     int lines = 0, code_lines = 0, blank_lines = 0, comment_lines = 0;
@@ -957,6 +976,7 @@ int lsh_loc(char **args) {
     printf("Directory LOC counting not implemented yet\n");
   } else {
     fprintf(stderr, "lsh: %s is not a file or directory\n", args[1]);
+    return lsh_builtin_failed();
   }
 
   return 1;
@@ -1270,6 +1290,7 @@ int lsh_gg(char **args) {
 }
 
 int lsh_stats(char **args) {
+  wait_for_history();
   printf("Command Statistics\n");
   printf("=================\n\n");
 
@@ -1,6 +1,9 @@
 
 #include "aliases.h"
 #include "builtins.h"
+#include "name_index.h"
+#include "startup_profile.h"
+#include "store_file.h"
 #include <sys/stat.h>
 #include <time.h>
 
@@ -13,7 +16,50 @@ int loading_aliases = 0; // Flag to prevent saving during loading
 // Path to the aliases file
 char aliases_file_path[PATH_MAX];
 
+// Alias names to their position in aliases, so expansion is O(1)
+static NameIndex alias_index;
+
+static const char *alias_key(const void *entries, int i) {
+  return ((const AliasEntry *)entries)[i].name;
+}
+
+// Drop the aliases in memory, keeping the allocations for a reload
+static void clear_aliases(void) {
+  for (int i = 0; i < alias_count; i++) {
+    free(aliases[i].name);
+    free(aliases[i].command);
+  }
+  alias_count = 0;
+  name_index_rebuild(&alias_index, aliases, 0, alias_key);
+}
+
+// The file is read the first time aliases are needed, not at startup, and
+// again when another shell has saved it since. Checking costs one stat()
+static int aliases_loaded = 0;
+static StoreFileStamp aliases_stamp;
+
+static void ensure_aliases_loaded(void) {
+  if (aliases_loaded &&
+      (loading_aliases || !store_file_changed(aliases_file_path,
+                                              &aliases_stamp)))
+    return;
+
+  int reload = aliases_loaded;
+  aliases_loaded = 1;
+  store_file_stamp(aliases_file_path, &aliases_stamp);
+
+  struct timespec mark;
+  startup_profile_mark(&mark);
+  if (reload)
+    clear_aliases();
+  load_aliases();
+  if (!reload)
+    startup_profile_deferred("aliases", &mark);
+}
+
 void init_aliases(void) {
+  name_index_init(&alias_index, 0);
+
   // Set initial capacity
   alias_capacity = 10;
   aliases = (AliasEntry *)malloc(alias_capacity * sizeof(AliasEntry));
@@ -31,9 +77,6 @@ void init_aliases(void) {
     // Fallback to current directory if HOME not available
     strcpy(aliases_file_path, ".lsh_aliases");
   }
-
-  // Load aliases from file
-  load_aliases();
 }
 
 void cleanup_aliases(void) {
@@ -51,6 +94,7 @@ void cleanup_aliases(void) {
   aliases = NULL;
   alias_count = 0;
   alias_capacity = 0;
+  name_index_free(&alias_index);
 }
 
 void shutdown_aliases(void) {
@@ -110,7 +154,8 @@ int load_aliases(void) {
 }
 
 int save_aliases(void) {
-  FILE *fp = fopen(aliases_file_path, "w");
+  char temp_path[PATH_MAX];
+  FILE *fp = store_file_begin(aliases_file_path, temp_path, sizeof(temp_path));
   if (!fp) {
     fprintf(stderr, "lsh: error saving aliases to %s\n", aliases_file_path);
     return 0;
@@ -129,27 +174,29 @@ int save_aliases(void) {
     fprintf(fp, "%s=%s\n", aliases[i].name, aliases[i].command);
   }
 
-  fclose(fp);
+  if (!store_file_commit(fp, temp_path, aliases_file_path, &aliases_stamp)) {
+    fprintf(stderr, "lsh: error saving aliases to %s\n", aliases_file_path);
+    return 0;
+  }
   return 1;
 }
 
 int add_alias(const char *name, const char *command) {
+  ensure_aliases_loaded();
   if (!name || !command) {
     return 0;
   }
 
   // Check if alias already exists, update it if it does
-  for (int i = 0; i < alias_count; i++) {
-    if (strcmp(aliases[i].name, name) == 0) {
-      // Update existing alias
-      free(aliases[i].command);
-      aliases[i].command = strdup(command);
-      // Save aliases immediately after updating (unless loading)
-      if (!loading_aliases) {
-        save_aliases();
-      }
-      return 1;
+  int existing = name_index_find(&alias_index, name, aliases, alias_key);
+  if (existing >= 0) {
+    free(aliases[existing].command);
+    aliases[existing].command = strdup(command);
+    // Save aliases immediately after updating (unless loading)
+    if (!loading_aliases) {
+      save_aliases();
     }
+    return 1;
   }
 
   // Check if we need to expand the array
@@ -167,6 +214,12 @@ int add_alias(const char *name, const char *command) {
   // Add new alias
   aliases[alias_count].name = strdup(name);
   aliases[alias_count].command = strdup(command);
+  if (!name_index_insert(&alias_index, name, alias_count)) {
+    fprintf(stderr, "lsh: allocation error in add_alias\n");
+    free(aliases[alias_count].name);
+    free(aliases[alias_count].command);
+    return 0;
+  }
   alias_count++;
 
   // Save aliases immediately after adding (unless loading)
@@ -178,43 +231,42 @@ int add_alias(const char *name, const char *command) {
 }
 
 int remove_alias(const char *name) {
+  ensure_aliases_loaded();
   if (!name) {
     return 0;
   }
 
-  for (int i = 0; i < alias_count; i++) {
-    if (strcmp(aliases[i].name, name) == 0) {
-      // Free memory for this alias
-      free(aliases[i].name);
-      free(aliases[i].command);
-
-      // Shift remaining aliases down
-      for (int j = i; j < alias_count - 1; j++) {
-        aliases[j] = aliases[j + 1];
-      }
+  int i = name_index_find(&alias_index, name, aliases, alias_key);
+  if (i < 0) {
+    return 0; // Alias not found
+  }
 
-      alias_count--;
-      // Save aliases immediately after removing (unless loading)
-      if (!loading_aliases) {
-        save_aliases();
-      }
-      return 1;
-    }
+  // Free memory for this alias
+  free(aliases[i].name);
+  free(aliases[i].command);
+
+  // Shift remaining aliases down; their positions change, so re-index
+  for (int j = i; j < alias_count - 1; j++) {
+    aliases[j] = aliases[j + 1];
   }
+  alias_count--;
+  name_index_rebuild(&alias_index, aliases, alias_count, alias_key);
 
-  return 0; // Alias not found
+  // Save aliases immediately after removing (unless loading)
+  if (!loading_aliases) {
+    save_aliases();
+  }
+  return 1;
 }
 
 AliasEntry *find_alias(const char *name) {
-  for (int i = 0; i < alias_count; i++) {
-    if (strcmp(aliases[i].name, name) == 0) {
-      return &aliases[i];
-    }
-  }
-  return NULL;
+  ensure_aliases_loaded();
+  int i = name_index_find(&alias_index, name, aliases, alias_key);
+  return i >= 0 ? &aliases[i] : NULL;
 }
 
 char *expand_aliases(const char *command) {
+  ensure_aliases_loaded();
   if (!command) {
     return NULL;
   }
@@ -263,6 +315,7 @@ char *expand_aliases(const char *command) {
 }
 
 int lsh_alias(char **args) {
+  ensure_aliases_loaded();
   // No arguments - list all aliases
   if (args[1] == NULL) {
     for (int i = 0; i < alias_count; i++) {
@@ -363,6 +416,7 @@ int lsh_alias(char **args) {
 }
 
 int lsh_unalias(char **args) {
+  ensure_aliases_loaded();
   if (args[1] == NULL) {
     printf("unalias: missing argument\n");
     return 1;
@@ -378,33 +432,27 @@ int lsh_unalias(char **args) {
 }
 
 int lsh_aliases(char **args) {
+  ensure_aliases_loaded();
   for (int i = 0; i < alias_count; i++) {
     printf("alias %s='%s'\n", aliases[i].name, aliases[i].command);
   }
   return 1;
 }
 
-char **get_alias_names(int *count) {
-  if (alias_count == 0 || !count) {
-    *count = 0;
-    return NULL;
+// Walk the alias names without copying them: start *cursor at 0 and call
+// until NULL. Names stay valid until the aliases change
+const char *next_alias_name(int *cursor) {
+  if (*cursor == 0) {
+    ensure_aliases_loaded();
   }
-
-  char **names = (char **)malloc(alias_count * sizeof(char *));
-  if (!names) {
-    *count = 0;
+  if (*cursor < 0 || *cursor >= alias_count) {
     return NULL;
   }
-
-  for (int i = 0; i < alias_count; i++) {
-    names[i] = strdup(aliases[i].name);
-  }
-
-  *count = alias_count;
-  return names;
+  return aliases[(*cursor)++].name;
 }
 
 char **expand_alias(char **args) {
+  ensure_aliases_loaded();
   if (!args || !args[0]) {
     return NULL;
   }
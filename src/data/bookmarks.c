@@ -1,5 +1,9 @@
 
 #include "bookmarks.h"
+#include "frecency.h"
+#include "name_index.h"
+#include "startup_profile.h"
+#include "store_file.h"
 #include <fcntl.h>
 #include <termios.h>
 
@@ -11,7 +15,53 @@ int bookmark_capacity = 0;
 // Path to the bookmarks file
 char bookmarks_file_path[PATH_MAX];
 
+// Bookmark names to their position in bookmarks
+static NameIndex bookmark_index;
+
+static const char *bookmark_key(const void *entries, int i) {
+  return ((const BookmarkEntry *)entries)[i].name;
+}
+
+// Drop the bookmarks in memory, keeping the allocations for a reload
+static void clear_bookmarks(void) {
+  for (int i = 0; i < bookmark_count; i++) {
+    free(bookmarks[i].name);
+    free(bookmarks[i].path);
+  }
+  bookmark_count = 0;
+  name_index_rebuild(&bookmark_index, bookmarks, 0, bookmark_key);
+}
+
+// The file is read the first time bookmarks are needed, not at startup,
+// and again when another shell has saved it since
+static int bookmarks_loaded = 0;
+static int loading_bookmarks = 0;
+static StoreFileStamp bookmarks_stamp;
+
+static void ensure_bookmarks_loaded(void) {
+  if (bookmarks_loaded &&
+      (loading_bookmarks || !store_file_changed(bookmarks_file_path,
+                                                &bookmarks_stamp)))
+    return;
+
+  int reload = bookmarks_loaded;
+  bookmarks_loaded = 1;
+  store_file_stamp(bookmarks_file_path, &bookmarks_stamp);
+
+  struct timespec mark;
+  startup_profile_mark(&mark);
+  if (reload)
+    clear_bookmarks();
+  loading_bookmarks = 1;
+  load_bookmarks();
+  loading_bookmarks = 0;
+  if (!reload)
+    startup_profile_deferred("bookmarks", &mark);
+}
+
 void init_bookmarks(void) {
+  name_index_init(&bookmark_index, 0);
+
   // Set initial capacity
   bookmark_capacity = 10;
   bookmarks =
@@ -30,9 +80,6 @@ void init_bookmarks(void) {
     // Fallback to current directory if HOME not available
     strcpy(bookmarks_file_path, ".lsh_bookmarks");
   }
-
-  // Load bookmarks from file
-  load_bookmarks();
 }
 
 void cleanup_bookmarks(void) {
@@ -50,13 +97,12 @@ void cleanup_bookmarks(void) {
   bookmarks = NULL;
   bookmark_count = 0;
   bookmark_capacity = 0;
+  name_index_free(&bookmark_index);
 }
 
 void shutdown_bookmarks(void) {
-  // Save bookmarks to file
-  save_bookmarks();
-
-  // Clean up
+  // Changes are saved as they are made; saving again here could overwrite
+  // what another shell saved since
   cleanup_bookmarks();
 }
 
@@ -106,7 +152,9 @@ int load_bookmarks(void) {
 }
 
 int save_bookmarks(void) {
-  FILE *fp = fopen(bookmarks_file_path, "w");
+  char temp_path[PATH_MAX];
+  FILE *fp =
+      store_file_begin(bookmarks_file_path, temp_path, sizeof(temp_path));
   if (!fp) {
     fprintf(stderr, "lsh: error saving bookmarks to %s\n", bookmarks_file_path);
     return 0;
@@ -125,23 +173,29 @@ int save_bookmarks(void) {
     fprintf(fp, "%s\t%s\n", bookmarks[i].name, bookmarks[i].path);
   }
 
-  fclose(fp);
+  if (!store_file_commit(fp, temp_path, bookmarks_file_path,
+                         &bookmarks_stamp)) {
+    fprintf(stderr, "lsh: error saving bookmarks to %s\n",
+            bookmarks_file_path);
+    return 0;
+  }
   return 1;
 }
 
 int add_bookmark(const char *name, const char *path) {
+  ensure_bookmarks_loaded();
   if (!name || !path) {
     return 0;
   }
 
   // Check if bookmark already exists
-  for (int i = 0; i < bookmark_count; i++) {
-    if (strcmp(bookmarks[i].name, name) == 0) {
-      // Update existing bookmark
-      free(bookmarks[i].path);
-      bookmarks[i].path = strdup(path);
-      return 1;
-    }
+  int existing =
+      name_index_find(&bookmark_index, name, bookmarks, bookmark_key);
+  if (existing >= 0) {
+    // Update existing bookmark
+    free(bookmarks[existing].path);
+    bookmarks[existing].path = strdup(path);
+    return 1;
   }
 
   // Check if we need to expand the array
@@ -159,45 +213,50 @@ int add_bookmark(const char *name, const char *path) {
   // Add new bookmark
   bookmarks[bookmark_count].name = strdup(name);
   bookmarks[bookmark_count].path = strdup(path);
+  if (!name_index_insert(&bookmark_index, name, bookmark_count)) {
+    fprintf(stderr, "lsh: allocation error in add_bookmark\n");
+    free(bookmarks[bookmark_count].name);
+    free(bookmarks[bookmark_count].path);
+    return 0;
+  }
   bookmark_count++;
 
   return 1;
 }
 
 int remove_bookmark(const char *name) {
+  ensure_bookmarks_loaded();
   if (!name) {
     return 0;
   }
 
-  for (int i = 0; i < bookmark_count; i++) {
-    if (strcmp(bookmarks[i].name, name) == 0) {
-      // Free memory for this bookmark
-      free(bookmarks[i].name);
-      free(bookmarks[i].path);
-
-      // Shift remaining bookmarks down
-      for (int j = i; j < bookmark_count - 1; j++) {
-        bookmarks[j] = bookmarks[j + 1];
-      }
-
-      bookmark_count--;
-      return 1;
-    }
+  int i = name_index_find(&bookmark_index, name, bookmarks, bookmark_key);
+  if (i < 0) {
+    return 0; // Bookmark not found
   }
 
-  return 0; // Bookmark not found
+  // Free memory for this bookmark
+  free(bookmarks[i].name);
+  free(bookmarks[i].path);
+
+  // Shift remaining bookmarks down; their positions change, so re-index
+  for (int j = i; j < bookmark_count - 1; j++) {
+    bookmarks[j] = bookmarks[j + 1];
+  }
+  bookmark_count--;
+  name_index_rebuild(&bookmark_index, bookmarks, bookmark_count,
+                     bookmark_key);
+  return 1;
 }
 
 BookmarkEntry *find_bookmark(const char *name) {
-  for (int i = 0; i < bookmark_count; i++) {
-    if (strcmp(bookmarks[i].name, name) == 0) {
-      return &bookmarks[i];
-    }
-  }
-  return NULL;
+  ensure_bookmarks_loaded();
+  int i = name_index_find(&bookmark_index, name, bookmarks, bookmark_key);
+  return i >= 0 ? &bookmarks[i] : NULL;
 }
 
 int lsh_bookmark(char **args) {
+  ensure_bookmarks_loaded();
   char cwd[PATH_MAX];
 
   // No arguments - add bookmark for current directory
@@ -227,6 +286,7 @@ int lsh_bookmark(char **args) {
 }
 
 int lsh_bookmarks(char **args) {
+  ensure_bookmarks_loaded();
   if (bookmark_count == 0) {
     printf("No bookmarks defined.\n");
     printf("Use 'bookmark <name> [path]' to add a bookmark.\n");
@@ -289,6 +349,7 @@ int lsh_bookmarks(char **args) {
 }
 
 int lsh_goto(char **args) {
+  ensure_bookmarks_loaded();
   if (args[1] == NULL) {
     printf("Usage: goto <bookmark_name>\n");
     return 1;
@@ -300,6 +361,10 @@ int lsh_goto(char **args) {
       perror("lsh: chdir");
       return 1;
     }
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+      frecency_record(cwd);
+    }
     printf("Changed directory to: %s\n", bookmark->path);
   } else {
     printf("Bookmark '%s' not found.\n", args[1]);
@@ -309,6 +374,7 @@ int lsh_goto(char **args) {
 }
 
 int lsh_unbookmark(char **args) {
+  ensure_bookmarks_loaded();
   if (args[1] == NULL) {
     printf("Usage: unbookmark <bookmark_name>\n");
     return 1;
@@ -324,36 +390,24 @@ int lsh_unbookmark(char **args) {
   return 1;
 }
 
-char **get_bookmark_names(int *count) {
-  if (bookmark_count == 0 || !count) {
-    *count = 0;
-    return NULL;
+// Walk the bookmark names without copying them: start *cursor at 0 and
+// call until NULL. Names stay valid until the bookmarks change
+const char *next_bookmark_name(int *cursor) {
+  if (*cursor == 0) {
+    ensure_bookmarks_loaded();
   }
-
-  char **names = (char **)malloc(bookmark_count * sizeof(char *));
-  if (!names) {
-    *count = 0;
+  if (*cursor < 0 || *cursor >= bookmark_count) {
     return NULL;
   }
-
-  for (int i = 0; i < bookmark_count; i++) {
-    names[i] = strdup(bookmarks[i].name);
-  }
-
-  *count = bookmark_count;
-  return names;
+  return bookmarks[(*cursor)++].name;
 }
 
 char *find_matching_bookmark(const char *partial_name) {
+  ensure_bookmarks_loaded();
   if (!partial_name || strlen(partial_name) == 0) {
     return NULL;
   }
 
-  // If only one bookmark exists, return it if there's any match
-  if (bookmark_count == 1) {
-    return strdup(bookmarks[0].name);
-  }
-
   // Look for partial matches
   for (int i = 0; i < bookmark_count; i++) {
     if (strncasecmp(bookmarks[i].name, partial_name, strlen(partial_name)) ==
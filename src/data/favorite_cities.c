@@ -2,6 +2,8 @@
 #include "favorite_cities.h"
 #include "builtins.h"
 #include "common.h"
+#include "name_index.h"
+#include "startup_profile.h"
 
 // Global variables for favorite cities storage
 CityEntry *favorite_cities = NULL;
@@ -11,7 +13,41 @@ int favorite_city_capacity = 0;
 // Path to the favorite cities file
 char favorite_cities_file_path[PATH_MAX];
 
+// City names, case-insensitively, to their position in favorite_cities
+static NameIndex city_index;
+
+static const char *city_key(const void *entries, int i) {
+  return ((const CityEntry *)entries)[i].name;
+}
+
+// The file is read the first time the cities are needed, not at startup.
+// An empty list is seeded with a few defaults
+static int favorite_cities_loaded = 0;
+
+static void ensure_favorite_cities_loaded(void) {
+  if (favorite_cities_loaded)
+    return;
+  favorite_cities_loaded = 1;
+
+  struct timespec mark;
+  startup_profile_mark(&mark);
+  load_favorite_cities();
+
+  // Add some default cities if none exist
+  if (favorite_city_count == 0) {
+    add_favorite_city("New York");
+    add_favorite_city("London");
+    add_favorite_city("Tokyo");
+    add_favorite_city("Paris");
+    add_favorite_city("Sydney");
+    save_favorite_cities();
+  }
+  startup_profile_deferred("favorite cities", &mark);
+}
+
 void init_favorite_cities(void) {
+  name_index_init(&city_index, 1);
+
   // Set initial capacity
   favorite_city_capacity = 10;
   favorite_cities =
@@ -31,19 +67,6 @@ void init_favorite_cities(void) {
     // Fallback to current directory if HOME not available
     strcpy(favorite_cities_file_path, ".lsh_favorite_cities");
   }
-
-  // Load favorite cities from file
-  load_favorite_cities();
-
-  // Add some default cities if none exist
-  if (favorite_city_count == 0) {
-    add_favorite_city("New York");
-    add_favorite_city("London");
-    add_favorite_city("Tokyo");
-    add_favorite_city("Paris");
-    add_favorite_city("Sydney");
-    save_favorite_cities();
-  }
 }
 
 void cleanup_favorite_cities(void) {
@@ -54,11 +77,13 @@ void cleanup_favorite_cities(void) {
   favorite_cities = NULL;
   favorite_city_count = 0;
   favorite_city_capacity = 0;
+  name_index_free(&city_index);
 }
 
 void shutdown_favorite_cities(void) {
-  // Save to file first
-  save_favorite_cities();
+  // Save to file first, unless it was never read
+  if (favorite_cities_loaded)
+    save_favorite_cities();
 
   // Then clean up resources
   cleanup_favorite_cities();
@@ -73,6 +98,7 @@ int load_favorite_cities(void) {
 
   // Clear existing favorite cities
   favorite_city_count = 0;
+  name_index_rebuild(&city_index, favorite_cities, 0, city_key);
 
   char line[128];
   int line_number = 0;
@@ -122,6 +148,7 @@ int save_favorite_cities(void) {
 }
 
 int add_favorite_city(const char *name) {
+  ensure_favorite_cities_loaded();
   if (!name)
     return 0;
 
@@ -138,11 +165,8 @@ int add_favorite_city(const char *name) {
   }
 
   // Check if the city already exists
-  for (int i = 0; i < favorite_city_count; i++) {
-    if (strcasecmp(favorite_cities[i].name, name) == 0) {
-      // City already exists
-      return 1;
-    }
+  if (name_index_find(&city_index, name, favorite_cities, city_key) >= 0) {
+    return 1;
   }
 
   // Add new city
@@ -150,64 +174,56 @@ int add_favorite_city(const char *name) {
           sizeof(favorite_cities[favorite_city_count].name) - 1);
   favorite_cities[favorite_city_count]
       .name[sizeof(favorite_cities[favorite_city_count].name) - 1] = '\0';
+  if (!name_index_insert(&city_index,
+                         favorite_cities[favorite_city_count].name,
+                         favorite_city_count)) {
+    fprintf(stderr, "lsh: allocation error in add_favorite_city\n");
+    return 0;
+  }
   favorite_city_count++;
 
   return 1;
 }
 
 int remove_favorite_city(const char *name) {
+  ensure_favorite_cities_loaded();
   if (!name)
     return 0;
 
-  for (int i = 0; i < favorite_city_count; i++) {
-    if (strcasecmp(favorite_cities[i].name, name) == 0) {
-      // Shift remaining cities
-      for (int j = i; j < favorite_city_count - 1; j++) {
-        strcpy(favorite_cities[j].name, favorite_cities[j + 1].name);
-      }
+  int i = name_index_find(&city_index, name, favorite_cities, city_key);
+  if (i < 0)
+    return 0; // City not found
 
-      favorite_city_count--;
-      return 1;
-    }
+  // Shift remaining cities; their positions change, so re-index
+  for (int j = i; j < favorite_city_count - 1; j++) {
+    strcpy(favorite_cities[j].name, favorite_cities[j + 1].name);
   }
-
-  return 0; // City not found
+  favorite_city_count--;
+  name_index_rebuild(&city_index, favorite_cities, favorite_city_count,
+                     city_key);
+  return 1;
 }
 
 CityEntry *find_favorite_city(const char *name) {
+  ensure_favorite_cities_loaded();
   if (!name)
     return NULL;
 
-  for (int i = 0; i < favorite_city_count; i++) {
-    if (strcasecmp(favorite_cities[i].name, name) == 0) {
-      return &favorite_cities[i];
-    }
-  }
-
-  return NULL;
+  int i = name_index_find(&city_index, name, favorite_cities, city_key);
+  return i >= 0 ? &favorite_cities[i] : NULL;
 }
 
-char **get_favorite_city_names(int *count) {
-  if (favorite_city_count == 0) {
-    *count = 0;
-    return NULL;
-  }
-
-  char **names = (char **)malloc(favorite_city_count * sizeof(char *));
-  if (!names) {
-    *count = 0;
+// Walk the city names without copying them: start *cursor at 0 and call
+// until NULL. Names stay valid until the cities change
+const char *next_favorite_city_name(int *cursor) {
+  ensure_favorite_cities_loaded();
+  if (*cursor < 0 || *cursor >= favorite_city_count)
     return NULL;
-  }
-
-  for (int i = 0; i < favorite_city_count; i++) {
-    names[i] = strdup(favorite_cities[i].name);
-  }
-
-  *count = favorite_city_count;
-  return names;
+  return favorite_cities[(*cursor)++].name;
 }
 
 int lsh_cities(char **args) {
+  ensure_favorite_cities_loaded();
   if (args[1] == NULL) {
     // No subcommand - show usage
     printf("Usage: cities <command> [arguments]\n");
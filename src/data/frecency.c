@@ -0,0 +1,464 @@
+#include "frecency.h"
+#include "builtins.h"
+#include "name_index.h"
+#include "startup_profile.h"
+#include "store_file.h"
+
+// Visited directories, in no particular order
+static FrecencyEntry *entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+static double rank_total = 0;
+
+// Path to the directory database
+static char frecency_file_path[PATH_MAX];
+
+// Paths to their position in entries, so a visit is found without a scan
+static NameIndex entry_index;
+
+// Visits not saved yet. They are replayed when another shell's save is
+// read in, so neither shell's visits are lost
+typedef struct {
+  char *path;
+  time_t when;
+} PendingVisit;
+
+static PendingVisit *pending = NULL;
+static int pending_count = 0;
+static int pending_capacity = 0;
+static time_t last_save = 0;
+static int record_visits = 1;
+
+static const char *entry_key(const void *list, int i) {
+  return ((const FrecencyEntry *)list)[i].path;
+}
+
+// Bit for a folded character; digits share the six bits left after the
+// letters. A query can only match an entry holding all of its bits
+static unsigned int char_bit(unsigned char c) {
+  if (c >= 'a' && c <= 'z')
+    return 1u << (c - 'a');
+  if (c >= '0' && c <= '9')
+    return 1u << (26 + (c - '0') % 6);
+  return 0;
+}
+
+static unsigned int fold_text(char *text) {
+  unsigned int chars = 0;
+  for (unsigned char *p = (unsigned char *)text; *p; p++) {
+    *p = tolower(*p);
+    chars |= char_bit(*p);
+  }
+  return chars;
+}
+
+static int add_entry(const char *path, double rank, time_t last_visit) {
+  if (entry_count >= entry_capacity) {
+    int capacity = entry_capacity ? entry_capacity * 2 : 64;
+    FrecencyEntry *grown = realloc(entries, capacity * sizeof(FrecencyEntry));
+    if (!grown)
+      return 0;
+    entries = grown;
+    entry_capacity = capacity;
+  }
+
+  FrecencyEntry *entry = &entries[entry_count];
+  entry->path = strdup(path);
+  entry->folded = strdup(path);
+  if (!entry->path || !entry->folded ||
+      !name_index_insert(&entry_index, path, entry_count)) {
+    free(entry->path);
+    free(entry->folded);
+    return 0;
+  }
+  entry->chars = fold_text(entry->folded);
+  const char *slash = strrchr(path, '/');
+  entry->base = slash ? (int)(slash - path) + 1 : 0;
+  entry->rank = rank;
+  entry->last_visit = last_visit;
+  entry_count++;
+  rank_total += rank;
+  return 1;
+}
+
+static void free_entry(FrecencyEntry *entry) {
+  free(entry->path);
+  free(entry->folded);
+}
+
+static void clear_entries(void) {
+  for (int i = 0; i < entry_count; i++)
+    free_entry(&entries[i]);
+  entry_count = 0;
+  rank_total = 0;
+  name_index_rebuild(&entry_index, entries, 0, entry_key);
+}
+
+static void clear_pending(void) {
+  for (int i = 0; i < pending_count; i++)
+    free(pending[i].path);
+  pending_count = 0;
+}
+
+// Count one visit in the loaded entries
+static int apply_visit(const char *path, time_t when) {
+  int i = name_index_find(&entry_index, path, entries, entry_key);
+  if (i >= 0) {
+    entries[i].rank += 1;
+    if (when > entries[i].last_visit)
+      entries[i].last_visit = when;
+    rank_total += 1;
+  } else if (!add_entry(path, 1, when)) {
+    return 0;
+  }
+  return 1;
+}
+
+static void load_frecency(void) {
+  FILE *fp = fopen(frecency_file_path, "r");
+  if (!fp)
+    return;
+
+  // Each line is: rank, last visit, path, separated by tabs
+  char line[PATH_MAX + 64];
+  while (fgets(line, sizeof(line), fp)) {
+    char *end;
+    double rank = strtod(line, &end);
+    if (*end != '\t')
+      continue;
+    time_t last_visit = (time_t)strtoll(end + 1, &end, 10);
+    if (*end != '\t' || rank <= 0)
+      continue;
+
+    char *path = end + 1;
+    path[strcspn(path, "\n")] = '\0';
+    if (path[0] == '/' &&
+        name_index_find(&entry_index, path, entries, entry_key) < 0)
+      add_entry(path, rank, last_visit);
+  }
+  fclose(fp);
+}
+
+// Like bookmarks, the database is read on first use and again when
+// another shell has saved it since
+static int frecency_loaded = 0;
+static StoreFileStamp frecency_stamp;
+
+static void ensure_frecency_loaded(void) {
+  if (frecency_loaded &&
+      !store_file_changed(frecency_file_path, &frecency_stamp))
+    return;
+
+  int reload = frecency_loaded;
+  frecency_loaded = 1;
+  store_file_stamp(frecency_file_path, &frecency_stamp);
+
+  struct timespec mark;
+  startup_profile_mark(&mark);
+  if (reload)
+    clear_entries();
+  load_frecency();
+  for (int i = 0; i < pending_count; i++)
+    apply_visit(pending[i].path, pending[i].when);
+  if (!reload)
+    startup_profile_deferred("directories", &mark);
+}
+
+static void save_frecency(void) {
+  last_save = time(NULL);
+  clear_pending();
+
+  char temp_path[PATH_MAX];
+  FILE *fp =
+      store_file_begin(frecency_file_path, temp_path, sizeof(temp_path));
+  if (!fp) {
+    fprintf(stderr, "lsh: error saving directories to %s\n",
+            frecency_file_path);
+    return;
+  }
+
+  for (int i = 0; i < entry_count; i++) {
+    fprintf(fp, "%.3f\t%lld\t%s\n", entries[i].rank,
+            (long long)entries[i].last_visit, entries[i].path);
+  }
+
+  if (!store_file_commit(fp, temp_path, frecency_file_path,
+                         &frecency_stamp)) {
+    fprintf(stderr, "lsh: error saving directories to %s\n",
+            frecency_file_path);
+  }
+}
+
+// Forget one directory; the last entry takes its place, so re-index
+static void remove_entry(int i) {
+  rank_total -= entries[i].rank;
+  free_entry(&entries[i]);
+  entries[i] = entries[--entry_count];
+  name_index_rebuild(&entry_index, entries, entry_count, entry_key);
+}
+
+// Once the ranks add up to FRECENCY_MAX_TOTAL, scale them all down so
+// old favourites fade, and forget directories that fall below one visit
+static void age_entries(void) {
+  int kept = 0;
+  rank_total = 0;
+  for (int i = 0; i < entry_count; i++) {
+    entries[i].rank *= 0.9;
+    if (entries[i].rank < 1.0) {
+      free_entry(&entries[i]);
+      continue;
+    }
+    rank_total += entries[i].rank;
+    entries[kept++] = entries[i];
+  }
+  entry_count = kept;
+  name_index_rebuild(&entry_index, entries, entry_count, entry_key);
+}
+
+// Visits count for more the more recent the last one was
+static double frecency_score(const FrecencyEntry *entry, time_t now) {
+  time_t age = now - entry->last_visit;
+  if (age < 3600)
+    return entry->rank * 4;
+  if (age < 86400)
+    return entry->rank * 2;
+  if (age < 604800)
+    return entry->rank / 2;
+  return entry->rank / 4;
+}
+
+void init_frecency(void) {
+  name_index_init(&entry_index, 0);
+
+  char *home_dir = getenv("HOME");
+  if (home_dir) {
+    snprintf(frecency_file_path, PATH_MAX, "%s/.lsh_dirs", home_dir);
+  } else {
+    strcpy(frecency_file_path, ".lsh_dirs");
+  }
+  last_save = time(NULL);
+}
+
+void shutdown_frecency(void) {
+  // Visits since the last save, merged with any another shell has saved
+  if (pending_count > 0) {
+    ensure_frecency_loaded();
+    save_frecency();
+  }
+  clear_pending();
+  free(pending);
+  pending = NULL;
+  pending_capacity = 0;
+  clear_entries();
+  free(entries);
+  entries = NULL;
+  entry_capacity = 0;
+  name_index_free(&entry_index);
+  frecency_loaded = 0;
+}
+
+void frecency_disable_recording(void) {
+  record_visits = 0;
+}
+
+// Count a visit now and save it later: at shutdown, or with a visit once
+// FRECENCY_SAVE_INTERVAL has passed, so a cd doesn't wait on a disk sync
+void frecency_record(const char *path) {
+  if (!record_visits || !frecency_file_path[0] || !path || path[0] != '/')
+    return;
+  ensure_frecency_loaded();
+
+  if (pending_count >= pending_capacity) {
+    int capacity = pending_capacity ? pending_capacity * 2 : 16;
+    PendingVisit *grown = realloc(pending, capacity * sizeof(PendingVisit));
+    if (!grown)
+      return;
+    pending = grown;
+    pending_capacity = capacity;
+  }
+
+  time_t now = time(NULL);
+  char *copy = strdup(path);
+  if (!copy || !apply_visit(path, now)) {
+    free(copy);
+    return;
+  }
+  pending[pending_count].path = copy;
+  pending[pending_count].when = now;
+  pending_count++;
+
+  if (rank_total > FRECENCY_MAX_TOTAL)
+    age_entries();
+  if (now - last_save >= FRECENCY_SAVE_INTERVAL)
+    save_frecency();
+}
+
+// Match one query term: a substring of text, or failing that the term's
+// characters in order within a single path component. Returns where the
+// match ends, clearing *exact for a component match
+static const char *match_term(const char *text, const char *term,
+                              int *exact) {
+  const char *found = strstr(text, term);
+  if (found)
+    return found + strlen(term);
+
+  const char *component = text;
+  while (*component) {
+    const char *end = strchr(component, '/');
+    if (!end)
+      end = component + strlen(component);
+
+    const char *t = term;
+    const char *p = component;
+    while (p < end && *t) {
+      if (*p == *t)
+        t++;
+      p++;
+    }
+    if (!*t) {
+      *exact = 0;
+      return p;
+    }
+    component = *end ? end + 1 : end;
+  }
+  return NULL;
+}
+
+// Terms must match in order, and the last one within the last component,
+// so "z src" prefers .../src over .../src/foo
+static int entry_matches(const FrecencyEntry *entry, char **terms, int count,
+                         int *exact) {
+  *exact = 1;
+  const char *pos = entry->folded;
+  for (int i = 0; i < count - 1; i++) {
+    pos = match_term(pos, terms[i], exact);
+    if (!pos)
+      return 0;
+  }
+
+  const char *last = entry->folded + entry->base;
+  if (pos > last)
+    last = pos;
+  return match_term(last, terms[count - 1], exact) != NULL;
+}
+
+static int change_directory(const char *path) {
+  if (chdir(path) != 0) {
+    perror("lsh: z");
+    return 0;
+  }
+  frecency_record(path);
+  printf("%s\n", path);
+  return 1;
+}
+
+static time_t sort_time;
+
+static int compare_scores(const void *a, const void *b) {
+  double sa = frecency_score(&entries[*(const int *)a], sort_time);
+  double sb = frecency_score(&entries[*(const int *)b], sort_time);
+  return (sa < sb) - (sa > sb);
+}
+
+static void list_directories(void) {
+  if (entry_count == 0) {
+    printf("No directories visited yet.\n");
+    return;
+  }
+
+  int *order = malloc(entry_count * sizeof(int));
+  if (!order)
+    return;
+  for (int i = 0; i < entry_count; i++)
+    order[i] = i;
+  sort_time = time(NULL);
+  qsort(order, entry_count, sizeof(int), compare_scores);
+
+  int shown = entry_count < 10 ? entry_count : 10;
+  for (int i = 0; i < shown; i++) {
+    const FrecencyEntry *entry = &entries[order[i]];
+    printf("  " ANSI_COLOR_GREEN "%8.1f" ANSI_COLOR_RESET "  %s\n",
+           frecency_score(entry, sort_time), entry->path);
+  }
+  free(order);
+}
+
+int lsh_z(char **args) {
+  ensure_frecency_loaded();
+  if (args[1] == NULL) {
+    list_directories();
+    return 1;
+  }
+
+  // A directory that exists is entered directly, like cd
+  struct stat st;
+  if (args[2] == NULL && stat(args[1], &st) == 0 && S_ISDIR(st.st_mode)) {
+    char resolved[PATH_MAX];
+    if (!realpath(args[1], resolved) || !change_directory(resolved))
+      return lsh_builtin_failed();
+    return 1;
+  }
+
+  char *terms[LSH_TOK_BUFSIZE];
+  int count = 0;
+  unsigned int query_chars = 0;
+  int found = 0;
+  for (int i = 1; args[i] != NULL && count < LSH_TOK_BUFSIZE; i++) {
+    terms[count] = strdup(args[i]);
+    if (!terms[count])
+      break;
+    query_chars |= fold_text(terms[count]);
+    count++;
+  }
+
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd)))
+    cwd[0] = '\0';
+
+  // Highest score among full substring matches, else among component
+  // matches. A best match that no longer exists is forgotten and the
+  // search runs again
+  time_t now = time(NULL);
+  for (;;) {
+    int best = -1;
+    int best_exact = 0;
+    double best_score = 0;
+    for (int i = 0; i < entry_count && count > 0; i++) {
+      const FrecencyEntry *entry = &entries[i];
+      if ((entry->chars & query_chars) != query_chars ||
+          strcmp(entry->path, cwd) == 0)
+        continue;
+
+      int exact;
+      if (!entry_matches(entry, terms, count, &exact))
+        continue;
+      double score = frecency_score(entry, now);
+      if (best < 0 || exact > best_exact ||
+          (exact == best_exact && score > best_score)) {
+        best = i;
+        best_exact = exact;
+        best_score = score;
+      }
+    }
+
+    if (best < 0) {
+      printf("No visited directory matches");
+      for (int i = 1; args[i] != NULL; i++)
+        printf(" '%s'", args[i]);
+      printf(".\n");
+      break;
+    }
+    if (stat(entries[best].path, &st) == 0 && S_ISDIR(st.st_mode)) {
+      char path[PATH_MAX];
+      snprintf(path, sizeof(path), "%s", entries[best].path);
+      found = change_directory(path);
+      break;
+    }
+    remove_entry(best);
+    save_frecency();
+  }
+
+  for (int i = 0; i < count; i++)
+    free(terms[i]);
+  return found ? 1 : lsh_builtin_failed();
+}
@@ -0,0 +1,111 @@
+#include "name_index.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define NAME_INDEX_MIN_CAPACITY 16
+
+// FNV-1a, folded to lower case for case-insensitive stores
+static unsigned int hash_name(const char *name, int ignore_case) {
+  unsigned int hash = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+    hash ^= ignore_case ? (unsigned int)tolower(*p) : *p;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+void name_index_init(NameIndex *index, int ignore_case) {
+  index->slots = NULL;
+  index->capacity = 0;
+  index->count = 0;
+  index->ignore_case = ignore_case;
+}
+
+void name_index_free(NameIndex *index) {
+  free(index->slots);
+  index->slots = NULL;
+  index->capacity = 0;
+  index->count = 0;
+}
+
+static void place(NameIndexSlot *slots, int capacity, NameIndexSlot slot) {
+  int mask = capacity - 1;
+  int i = slot.hash & mask;
+  while (slots[i].position >= 0)
+    i = (i + 1) & mask;
+  slots[i] = slot;
+}
+
+// Grow to hold one more name while keeping the load factor at most 1/2.
+// Slots carry their hash, so nothing has to be re-read from the store
+static int reserve(NameIndex *index) {
+  if ((index->count + 1) * 2 <= index->capacity)
+    return 1;
+
+  int capacity =
+      index->capacity ? index->capacity * 2 : NAME_INDEX_MIN_CAPACITY;
+  NameIndexSlot *slots = malloc(capacity * sizeof(NameIndexSlot));
+  if (!slots)
+    return 0;
+  for (int i = 0; i < capacity; i++)
+    slots[i].position = -1;
+
+  for (int i = 0; i < index->capacity; i++) {
+    if (index->slots[i].position >= 0)
+      place(slots, capacity, index->slots[i]);
+  }
+
+  free(index->slots);
+  index->slots = slots;
+  index->capacity = capacity;
+  return 1;
+}
+
+// Position of the entry called name, or -1
+int name_index_find(const NameIndex *index, const char *name,
+                    const void *entries, NameIndexKey key) {
+  if (!name || index->count == 0)
+    return -1;
+
+  unsigned int hash = hash_name(name, index->ignore_case);
+  int mask = index->capacity - 1;
+  for (int i = hash & mask; index->slots[i].position >= 0;
+       i = (i + 1) & mask) {
+    const NameIndexSlot *slot = &index->slots[i];
+    if (slot->hash != hash)
+      continue;
+    const char *candidate = key(entries, slot->position);
+    if (index->ignore_case ? strcasecmp(candidate, name) == 0
+                           : strcmp(candidate, name) == 0)
+      return slot->position;
+  }
+  return -1;
+}
+
+// Record a new entry; the caller has checked the name isn't there yet
+int name_index_insert(NameIndex *index, const char *name, int position) {
+  if (!reserve(index))
+    return 0;
+
+  NameIndexSlot slot = {hash_name(name, index->ignore_case), position};
+  place(index->slots, index->capacity, slot);
+  index->count++;
+  return 1;
+}
+
+// Index the store from scratch, e.g. after entries were removed and the
+// ones behind them moved down
+int name_index_rebuild(NameIndex *index, const void *entries, int count,
+                       NameIndexKey key) {
+  for (int i = 0; i < index->capacity; i++)
+    index->slots[i].position = -1;
+  index->count = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (!name_index_insert(index, key(entries, i), i))
+      return 0;
+  }
+  return 1;
+}
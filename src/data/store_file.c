@@ -0,0 +1,92 @@
+#include "store_file.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void stamp_from_stat(const struct stat *st, StoreFileStamp *stamp) {
+  stamp->exists = 1;
+  stamp->device = st->st_dev;
+  stamp->inode = st->st_ino;
+  stamp->size = st->st_size;
+  stamp->modified = st->st_mtim;
+}
+
+// Record the file as it is now, before reading it
+void store_file_stamp(const char *path, StoreFileStamp *stamp) {
+  struct stat st;
+  memset(stamp, 0, sizeof(StoreFileStamp));
+  if (stat(path, &st) == 0)
+    stamp_from_stat(&st, stamp);
+}
+
+// One stat(): has the file been replaced, edited, created or removed
+// since the stamp was taken?
+int store_file_changed(const char *path, const StoreFileStamp *stamp) {
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return stamp->exists;
+  if (!stamp->exists)
+    return 1;
+  return st.st_dev != stamp->device || st.st_ino != stamp->inode ||
+         st.st_size != stamp->size ||
+         st.st_mtim.tv_sec != stamp->modified.tv_sec ||
+         st.st_mtim.tv_nsec != stamp->modified.tv_nsec;
+}
+
+#define TEMP_SUFFIX ".XXXXXX"
+
+// Start an atomic save: the new contents go to a temporary file next to
+// path, which store_file_commit renames over it. Readers see either the
+// old file or the new one, never a partial write. A symlinked store (say,
+// into a dotfiles repo) is saved at its target, so the link survives, and
+// the file keeps its permissions
+FILE *store_file_begin(const char *path, char *temp_path, size_t temp_size) {
+  char target[PATH_MAX];
+  if (!realpath(path, target))
+    snprintf(target, sizeof(target), "%s", path);
+  if ((size_t)snprintf(temp_path, temp_size, "%s" TEMP_SUFFIX, target) >=
+      temp_size) {
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+
+  int fd = mkstemp(temp_path);
+  if (fd == -1)
+    return NULL;
+  struct stat st;
+  fchmod(fd, stat(target, &st) == 0 ? st.st_mode & 07777 : 0644);
+
+  FILE *fp = fdopen(fd, "w");
+  if (!fp) {
+    close(fd);
+    unlink(temp_path);
+  }
+  return fp;
+}
+
+// Finish an atomic save: flush and fsync the temporary file, then rename
+// it into place, over the file store_file_begin resolved path to. On
+// failure the old file is left untouched
+int store_file_commit(FILE *fp, const char *temp_path, const char *path,
+                      StoreFileStamp *stamp) {
+  char target[PATH_MAX];
+  size_t target_len = strlen(temp_path) - strlen(TEMP_SUFFIX);
+  snprintf(target, sizeof(target), "%.*s", (int)target_len, temp_path);
+
+  int ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  if (fclose(fp) != 0)
+    ok = 0;
+  if (ok && rename(temp_path, target) != 0)
+    ok = 0;
+  if (!ok) {
+    unlink(temp_path);
+    return 0;
+  }
+
+  // Our own write shouldn't look like someone else's change
+  if (stamp)
+    store_file_stamp(path, stamp);
+  return 1;
+}
@@ -0,0 +1,624 @@
+#include "commit_graph.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define GRAPH_HASH_LEN 20
+#define GRAPH_CDAT_LEN (GRAPH_HASH_LEN + 16)
+#define GRAPH_PARENT_NONE 0x70000000u
+#define GRAPH_EXTRA_EDGES 0x80000000u
+#define GRAPH_LAST_EDGE 0x80000000u
+#define GRAPH_MAX_PARENTS 64
+
+#define CHUNK_OIDF 0x4f494446u
+#define CHUNK_OIDL 0x4f49444cu
+#define CHUNK_CDAT 0x43444154u
+#define CHUNK_EDGE 0x45444745u
+
+static uint32_t get_be32(const unsigned char *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t get_be64(const unsigned char *p) {
+  return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static int hex_to_raw(const char *hex, unsigned char *raw) {
+  for (int i = 0; i < GRAPH_HASH_LEN; i++) {
+    int hi = hex_value(hex[2 * i]);
+    int lo = hi < 0 ? -1 : hex_value(hex[2 * i + 1]);
+    if (lo < 0)
+      return 0;
+    raw[i] = (unsigned char)(hi << 4 | lo);
+  }
+  return hex[2 * GRAPH_HASH_LEN] == '\0';
+}
+
+static void raw_to_hex(const unsigned char *raw, char *hex) {
+  static const char digits[] = "0123456789abcdef";
+  for (int i = 0; i < GRAPH_HASH_LEN; i++) {
+    hex[2 * i] = digits[raw[i] >> 4];
+    hex[2 * i + 1] = digits[raw[i] & 0xf];
+  }
+  hex[GIT_OID_HEX_LEN] = '\0';
+}
+
+// Map the commit-graph file and locate its chunks. Returns 0 when there is
+// none or it is in a form we don't read; callers then read commit objects
+int commit_graph_open(CommitGraph *graph) {
+  if (!graph)
+    return 0;
+  memset(graph, 0, sizeof(CommitGraph));
+
+  FILE *fp = popen("git rev-parse --git-path objects/info/commit-graph "
+                   "2>/dev/null",
+                   "r");
+  if (!fp)
+    return 0;
+  if (!fgets(graph->path, sizeof(graph->path), fp))
+    graph->path[0] = '\0';
+  pclose(fp);
+  graph->path[strcspn(graph->path, "\n")] = '\0';
+  if (!graph->path[0])
+    return 0;
+
+  int fd = open(graph->path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return 0;
+  if (fstat(fd, &graph->file_stat) == -1 || graph->file_stat.st_size < 8) {
+    close(fd);
+    return 0;
+  }
+  size_t size = (size_t)graph->file_stat.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return 0;
+  graph->data = data;
+  graph->size = size;
+
+  // "CGPH", version 1, SHA-1, chunk count, no base graphs
+  const unsigned char *p = graph->data;
+  int chunks = p[6];
+  if (memcmp(p, "CGPH", 4) != 0 || p[4] != 1 || p[5] != 1 || p[7] != 0 ||
+      8 + (size_t)(chunks + 1) * 12 > size) {
+    commit_graph_close(graph);
+    return 0;
+  }
+
+  size_t oidl_len = 0, cdat_len = 0;
+  for (int i = 0; i < chunks; i++) {
+    const unsigned char *entry = p + 8 + i * 12;
+    uint64_t offset = get_be64(entry + 4);
+    uint64_t end = get_be64(entry + 16);
+    if (offset > end || end > size) {
+      commit_graph_close(graph);
+      return 0;
+    }
+
+    switch (get_be32(entry)) {
+    case CHUNK_OIDF:
+      if (end - offset >= 256 * 4)
+        graph->fanout = p + offset;
+      break;
+    case CHUNK_OIDL:
+      graph->oids = p + offset;
+      oidl_len = end - offset;
+      break;
+    case CHUNK_CDAT:
+      graph->cdat = p + offset;
+      cdat_len = end - offset;
+      break;
+    case CHUNK_EDGE:
+      graph->edges = p + offset;
+      graph->edge_count = (end - offset) / 4;
+      break;
+    }
+  }
+
+  if (!graph->fanout || !graph->oids || !graph->cdat) {
+    commit_graph_close(graph);
+    return 0;
+  }
+  graph->count = get_be32(graph->fanout + 255 * 4);
+  if ((size_t)graph->count * GRAPH_HASH_LEN > oidl_len ||
+      (size_t)graph->count * GRAPH_CDAT_LEN > cdat_len) {
+    commit_graph_close(graph);
+    return 0;
+  }
+  return 1;
+}
+
+void commit_graph_close(CommitGraph *graph) {
+  if (!graph)
+    return;
+  if (graph->data)
+    munmap(graph->data, graph->size);
+  graph->data = NULL;
+  graph->size = 0;
+  graph->count = 0;
+  graph->fanout = graph->oids = graph->cdat = graph->edges = NULL;
+  graph->edge_count = 0;
+}
+
+// Whether the graph file was written, replaced or removed since it was
+// opened (gc and fetch rewrite it)
+int commit_graph_changed(const CommitGraph *graph) {
+  if (!graph || !graph->path[0])
+    return 0;
+
+  struct stat st;
+  int exists = stat(graph->path, &st) == 0;
+  if (!graph->data)
+    return exists;
+  return !exists || st.st_ino != graph->file_stat.st_ino ||
+         st.st_size != graph->file_stat.st_size ||
+         st.st_mtim.tv_sec != graph->file_stat.st_mtim.tv_sec ||
+         st.st_mtim.tv_nsec != graph->file_stat.st_mtim.tv_nsec;
+}
+
+// Position of a commit in the graph, or COMMIT_GRAPH_NONE
+uint32_t commit_graph_find(const CommitGraph *graph, const char *hex_oid) {
+  unsigned char raw[GRAPH_HASH_LEN];
+  if (!graph || !graph->data || !hex_oid || !hex_to_raw(hex_oid, raw))
+    return COMMIT_GRAPH_NONE;
+
+  uint32_t lo = raw[0] ? get_be32(graph->fanout + (raw[0] - 1) * 4) : 0;
+  uint32_t hi = get_be32(graph->fanout + raw[0] * 4);
+  if (hi > graph->count)
+    hi = graph->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    int cmp = memcmp(graph->oids + (size_t)mid * GRAPH_HASH_LEN, raw,
+                     GRAPH_HASH_LEN);
+    if (cmp == 0)
+      return mid;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return COMMIT_GRAPH_NONE;
+}
+
+static time_t graph_commit_time(const CommitGraph *graph, uint32_t pos) {
+  const unsigned char *entry = graph->cdat + (size_t)pos * GRAPH_CDAT_LEN;
+  uint64_t high = get_be32(entry + GRAPH_HASH_LEN + 8) & 0x3;
+  return (time_t)(high << 32 | get_be32(entry + GRAPH_HASH_LEN + 12));
+}
+
+static void graph_oid(const CommitGraph *graph, uint32_t pos, char *hex) {
+  raw_to_hex(graph->oids + (size_t)pos * GRAPH_HASH_LEN, hex);
+}
+
+// Parent positions of a graph commit; octopus merges continue in EDGE
+static int graph_parents(const CommitGraph *graph, uint32_t pos,
+                         uint32_t *parents) {
+  const unsigned char *entry = graph->cdat + (size_t)pos * GRAPH_CDAT_LEN;
+  uint32_t first = get_be32(entry + GRAPH_HASH_LEN);
+  uint32_t second = get_be32(entry + GRAPH_HASH_LEN + 4);
+  int count = 0;
+
+  if (first == GRAPH_PARENT_NONE)
+    return 0;
+  if (first < graph->count)
+    parents[count++] = first;
+  if (second == GRAPH_PARENT_NONE)
+    return count;
+
+  if (!(second & GRAPH_EXTRA_EDGES)) {
+    if (second < graph->count)
+      parents[count++] = second;
+    return count;
+  }
+
+  for (size_t edge = second & ~GRAPH_EXTRA_EDGES;
+       edge < graph->edge_count && count < GRAPH_MAX_PARENTS; edge++) {
+    uint32_t value = get_be32(graph->edges + edge * 4);
+    uint32_t parent = value & ~GRAPH_LAST_EDGE;
+    if (parent < graph->count)
+      parents[count++] = parent;
+    if (value & GRAPH_LAST_EDGE)
+      break;
+  }
+  return count;
+}
+
+static size_t oid_slot(const OidSet *set, const char *hex) {
+  uint64_t hash = 0;
+  for (int i = 0; i < 16 && hex[i]; i++)
+    hash = hash << 4 | (uint64_t)(hex_value(hex[i]) & 0xf);
+  return (size_t)hash & (set->capacity - 1);
+}
+
+static int oid_set_contains(const OidSet *set, const char *hex) {
+  if (set->count == 0)
+    return 0;
+  for (size_t i = oid_slot(set, hex);; i = (i + 1) & (set->capacity - 1)) {
+    if (!set->slots[i][0])
+      return 0;
+    if (strcmp(set->slots[i], hex) == 0)
+      return 1;
+  }
+}
+
+static int oid_set_grow(OidSet *set) {
+  size_t new_capacity = set->capacity ? set->capacity * 2 : 64;
+  OidSet grown = {calloc(new_capacity, sizeof(*set->slots)), new_capacity, 0};
+  if (!grown.slots)
+    return 0;
+
+  for (size_t i = 0; i < set->capacity; i++) {
+    if (!set->slots[i][0])
+      continue;
+    size_t slot = oid_slot(&grown, set->slots[i]);
+    while (grown.slots[slot][0])
+      slot = (slot + 1) & (new_capacity - 1);
+    strcpy(grown.slots[slot], set->slots[i]);
+    grown.count++;
+  }
+  free(set->slots);
+  *set = grown;
+  return 1;
+}
+
+// Returns 1 if the oid was added, 0 if it was already there or on failure
+static int oid_set_add(OidSet *set, const char *hex) {
+  if ((set->count + 1) * 10 > set->capacity * 7 && !oid_set_grow(set))
+    return 0;
+
+  size_t slot = oid_slot(set, hex);
+  while (set->slots[slot][0]) {
+    if (strcmp(set->slots[slot], hex) == 0)
+      return 0;
+    slot = (slot + 1) & (set->capacity - 1);
+  }
+  snprintf(set->slots[slot], sizeof(set->slots[slot]), "%s", hex);
+  set->count++;
+  return 1;
+}
+
+static void oid_set_free(OidSet *set) {
+  free(set->slots);
+  memset(set, 0, sizeof(OidSet));
+}
+
+static uint64_t *alloc_bits(const CommitGraph *graph) {
+  size_t words = graph && graph->data ? (graph->count + 63) / 64 : 0;
+  return words ? calloc(words, sizeof(uint64_t)) : NULL;
+}
+
+static int test_and_set_bit(uint64_t *bits, uint32_t pos) {
+  uint64_t mask = (uint64_t)1 << (pos % 64);
+  int was_set = (bits[pos / 64] & mask) != 0;
+  bits[pos / 64] |= mask;
+  return was_set;
+}
+
+// Read a commit outside the graph. Its parents are handed to the caller
+static int read_commit(const char *hex, char *oid_out, time_t *time_out,
+                       char (**parents)[GIT_MAX_OID_HEX_LEN + 1],
+                       int *parent_count) {
+  GitObjectInfo info;
+  char *object = git_batch_read_object(hex, &info);
+  if (!object)
+    return 0;
+
+  GitCommit commit;
+  int ok = strcmp(info.type, "commit") == 0 &&
+           git_batch_parse_commit(object, info.size, &commit);
+  if (ok) {
+    strcpy(oid_out, info.oid);
+    *time_out = commit.committer_time;
+    *parents = commit.parents;
+    *parent_count = commit.parent_count;
+  }
+  free(object);
+  return ok;
+}
+
+static int entry_newer(const CommitWalkEntry *a, const CommitWalkEntry *b) {
+  return a->time != b->time ? a->time > b->time : a->seq < b->seq;
+}
+
+static int heap_push(CommitWalk *walk, const CommitWalkEntry *entry) {
+  if (walk->heap_count == walk->heap_capacity) {
+    int new_capacity = walk->heap_capacity ? walk->heap_capacity * 2 : 64;
+    CommitWalkEntry *grown =
+        realloc(walk->heap, new_capacity * sizeof(CommitWalkEntry));
+    if (!grown)
+      return 0;
+    walk->heap = grown;
+    walk->heap_capacity = new_capacity;
+  }
+
+  int i = walk->heap_count++;
+  while (i > 0 && entry_newer(entry, &walk->heap[(i - 1) / 2])) {
+    walk->heap[i] = walk->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  walk->heap[i] = *entry;
+  return 1;
+}
+
+static CommitWalkEntry heap_pop(CommitWalk *walk) {
+  CommitWalkEntry top = walk->heap[0];
+  CommitWalkEntry last = walk->heap[--walk->heap_count];
+
+  int i = 0;
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= walk->heap_count)
+      break;
+    if (child + 1 < walk->heap_count &&
+        entry_newer(&walk->heap[child + 1], &walk->heap[child]))
+      child++;
+    if (!entry_newer(&walk->heap[child], &last))
+      break;
+    walk->heap[i] = walk->heap[child];
+    i = child;
+  }
+  if (walk->heap_count > 0)
+    walk->heap[i] = last;
+  return top;
+}
+
+static void queue_graph_commit(CommitWalk *walk, uint32_t pos) {
+  if (test_and_set_bit(walk->seen_bits, pos))
+    return;
+
+  CommitWalkEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  graph_oid(walk->graph, pos, entry.oid);
+  entry.time = graph_commit_time(walk->graph, pos);
+  entry.seq = walk->next_seq++;
+  entry.pos = pos;
+  heap_push(walk, &entry);
+}
+
+static void queue_commit(CommitWalk *walk, const char *hex) {
+  uint32_t pos = commit_graph_find(walk->graph, hex);
+  if (pos != COMMIT_GRAPH_NONE && walk->seen_bits) {
+    queue_graph_commit(walk, pos);
+    return;
+  }
+  if (!oid_set_add(&walk->seen, hex))
+    return;
+
+  CommitWalkEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  if (!read_commit(hex, entry.oid, &entry.time, &entry.parents,
+                   &entry.parent_count))
+    return;
+  entry.seq = walk->next_seq++;
+  entry.pos = COMMIT_GRAPH_NONE;
+  if (!heap_push(walk, &entry))
+    free(entry.parents);
+}
+
+// Begin walking history from tip_oid. The graph may be closed (no graph
+// file), in which case every commit is read through the batch helper
+int commit_walk_start(CommitWalk *walk, const CommitGraph *graph,
+                      const char *tip_oid) {
+  if (!walk)
+    return 0;
+  memset(walk, 0, sizeof(CommitWalk));
+  walk->graph = graph;
+  walk->seen_bits = alloc_bits(graph);
+  if (tip_oid)
+    queue_commit(walk, tip_oid);
+  return walk->heap_count > 0;
+}
+
+// Hand out the next commit, newest first. Returns 0 when history runs out
+int commit_walk_next(CommitWalk *walk, char *oid_out) {
+  if (!walk || walk->heap_count == 0)
+    return 0;
+
+  CommitWalkEntry entry = heap_pop(walk);
+  strcpy(oid_out, entry.oid);
+
+  if (entry.pos != COMMIT_GRAPH_NONE) {
+    uint32_t parents[GRAPH_MAX_PARENTS];
+    int count = graph_parents(walk->graph, entry.pos, parents);
+    for (int i = 0; i < count; i++)
+      queue_graph_commit(walk, parents[i]);
+  } else {
+    for (int i = 0; i < entry.parent_count; i++)
+      queue_commit(walk, entry.parents[i]);
+    free(entry.parents);
+  }
+  return 1;
+}
+
+int commit_walk_done(const CommitWalk *walk) {
+  return !walk || walk->heap_count == 0;
+}
+
+void commit_walk_free(CommitWalk *walk) {
+  if (!walk)
+    return;
+  for (int i = 0; i < walk->heap_count; i++)
+    free(walk->heap[i].parents);
+  free(walk->heap);
+  free(walk->seen_bits);
+  oid_set_free(&walk->seen);
+  memset(walk, 0, sizeof(CommitWalk));
+}
+
+void commit_reach_init(CommitReach *reach) {
+  if (reach)
+    memset(reach, 0, sizeof(CommitReach));
+}
+
+void commit_reach_free(CommitReach *reach) {
+  if (!reach)
+    return;
+  free(reach->bits);
+  oid_set_free(&reach->extra);
+  commit_reach_init(reach);
+}
+
+typedef struct {
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} PositionStack;
+
+static int position_push(PositionStack *stack, uint32_t pos) {
+  if (stack->count == stack->capacity) {
+    size_t new_capacity = stack->capacity ? stack->capacity * 2 : 1024;
+    uint32_t *grown = realloc(stack->items, new_capacity * sizeof(uint32_t));
+    if (!grown)
+      return 0;
+    stack->items = grown;
+    stack->capacity = new_capacity;
+  }
+  stack->items[stack->count++] = pos;
+  return 1;
+}
+
+// Mark everything reachable from tip in the bitmap. Commits newer than the
+// graph are read from their objects until the walk reaches the graph, which
+// then needs nothing but the mapped file
+static int mark_reachable(CommitReach *reach, const CommitGraph *graph,
+                          const char *tip) {
+  PositionStack stack = {NULL, 0, 0};
+  char (*pending)[GIT_MAX_OID_HEX_LEN + 1] = NULL;
+  int pending_count = 0, pending_capacity = 0;
+  int ok = 1;
+
+  // Commits outside the graph first
+  char start[GIT_MAX_OID_HEX_LEN + 1];
+  snprintf(start, sizeof(start), "%s", tip);
+  const char *next = start;
+  while (ok && next) {
+    uint32_t pos = commit_graph_find(graph, next);
+    if (pos != COMMIT_GRAPH_NONE) {
+      if (!test_and_set_bit(reach->bits, pos))
+        ok = position_push(&stack, pos);
+    } else if (oid_set_add(&reach->extra, next)) {
+      char oid[GIT_MAX_OID_HEX_LEN + 1];
+      time_t time;
+      char(*parents)[GIT_MAX_OID_HEX_LEN + 1] = NULL;
+      int parent_count = 0;
+      if (read_commit(next, oid, &time, &parents, &parent_count)) {
+        for (int i = 0; ok && i < parent_count; i++) {
+          if (pending_count == pending_capacity) {
+            int new_capacity = pending_capacity ? pending_capacity * 2 : 16;
+            void *grown = realloc(pending, new_capacity * sizeof(*pending));
+            if (!grown) {
+              ok = 0;
+              break;
+            }
+            pending = grown;
+            pending_capacity = new_capacity;
+          }
+          strcpy(pending[pending_count++], parents[i]);
+        }
+        free(parents);
+      }
+    }
+
+    if (pending_count > 0) {
+      snprintf(start, sizeof(start), "%s", pending[--pending_count]);
+      next = start;
+    } else {
+      next = NULL;
+    }
+  }
+  free(pending);
+
+  // Then the graph itself
+  uint32_t parents[GRAPH_MAX_PARENTS];
+  while (ok && stack.count > 0) {
+    uint32_t pos = stack.items[--stack.count];
+    int count = graph_parents(graph, pos, parents);
+    for (int i = 0; ok && i < count; i++) {
+      if (!test_and_set_bit(reach->bits, parents[i]))
+        ok = position_push(&stack, parents[i]);
+    }
+  }
+  free(stack.items);
+  return ok;
+}
+
+// Without a graph, a full walk would read every object in history; one
+// rev-list of head's commits the tip lacks gives the same answer for the
+// commits the caller shows
+static int list_unreachable(CommitReach *reach, const char *tip,
+                            const char *head) {
+  char cmd[256];
+  snprintf(cmd, sizeof(cmd), "git rev-list %s ^%s 2>/dev/null", head, tip);
+  FILE *fp = popen(cmd, "r");
+  if (!fp)
+    return 0;
+
+  char line[128];
+  while (fgets(line, sizeof(line), fp)) {
+    line[strcspn(line, "\n")] = '\0';
+    if (git_is_oid_hex(line))
+      oid_set_add(&reach->extra, line);
+  }
+  return pclose(fp) == 0;
+}
+
+// Work out which commits tip_oid reaches. Kept until the tip moves (or,
+// without a graph, until head does); the caller drops it when the graph
+// file changes
+int commit_reach_compute(CommitReach *reach, const CommitGraph *graph,
+                         const char *tip_oid, const char *head_oid) {
+  if (!reach || !tip_oid || !head_oid)
+    return 0;
+
+  int have_graph = graph && graph->data;
+  if (reach->valid && strcmp(reach->tip, tip_oid) == 0 &&
+      reach->inverted == !have_graph &&
+      (have_graph || strcmp(reach->head, head_oid) == 0))
+    return 1;
+
+  commit_reach_free(reach);
+  snprintf(reach->tip, sizeof(reach->tip), "%s", tip_oid);
+  snprintf(reach->head, sizeof(reach->head), "%s", head_oid);
+
+  if (have_graph) {
+    reach->bits = alloc_bits(graph);
+    reach->bit_count = graph->count;
+    reach->valid = reach->bits && mark_reachable(reach, graph, tip_oid);
+  } else {
+    reach->inverted = 1;
+    reach->valid = list_unreachable(reach, tip_oid, head_oid);
+  }
+
+  if (!reach->valid)
+    commit_reach_free(reach);
+  return reach->valid;
+}
+
+// Whether the tip reaches a commit. Without a graph this only holds for
+// commits in head's history
+int commit_reach_contains(const CommitReach *reach, const CommitGraph *graph,
+                          const char *hex_oid) {
+  if (!reach || !reach->valid || !hex_oid)
+    return 0;
+  if (reach->inverted)
+    return !oid_set_contains(&reach->extra, hex_oid);
+
+  uint32_t pos = commit_graph_find(graph, hex_oid);
+  if (pos != COMMIT_GRAPH_NONE && pos < reach->bit_count)
+    return (reach->bits[pos / 64] >> (pos % 64)) & 1;
+  return oid_set_contains(&reach->extra, hex_oid);
+}
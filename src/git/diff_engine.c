@@ -0,0 +1,679 @@
+#include "diff_engine.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Histogram matching ignores lines repeated more often than this, like git
+#define HISTOGRAM_MAX_CHAIN 64
+
+// Below this many edits Myers always finds the minimal diff; above it the
+// search settles for a good split so pathological inputs stay fast
+#define MYERS_MIN_COST_LIMIT 256
+
+typedef struct {
+  const char *text;
+  int len;
+  int has_newline;
+  uint64_t hash;
+} LineRecord;
+
+typedef struct {
+  int a_start, a_end, b_start, b_end;
+  int use_histogram;
+} DiffRange;
+
+typedef struct {
+  int *a; // Equivalence class of each old line
+  int *b; // Equivalence class of each new line
+  int a_count, b_count;
+  char *changed_a;
+  char *changed_b;
+  int class_count;
+
+  // Work stack of ranges still to compare
+  DiffRange *ranges;
+  int range_count, range_capacity;
+
+  // Myers scratch, sized for the largest range
+  int *forward, *backward;
+
+  // Histogram scratch
+  int *occurrences; // Per class, occurrences in the current old range
+  int *chain_head;  // Per class, last old line in the current range
+  int *chain_next;  // Per old line, previous line of the same class
+} DiffContext;
+
+int diff_buffer_is_binary(const char *buffer, size_t len) {
+  // Same rule as git: a NUL in the first 8000 bytes
+  size_t scan = len < 8000 ? len : 8000;
+  return buffer && memchr(buffer, '\0', scan) != NULL;
+}
+
+static uint64_t hash_line(const char *text, int len) {
+  uint64_t hash = 1469598103934665603ULL; // FNV-1a
+  for (int i = 0; i < len; i++) {
+    hash ^= (unsigned char)text[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static LineRecord *split_lines(const char *buffer, size_t len, int *count) {
+  *count = 0;
+  if (!buffer || len == 0)
+    return calloc(1, sizeof(LineRecord));
+
+  int capacity = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (buffer[i] == '\n')
+      capacity++;
+  }
+  capacity++;
+
+  LineRecord *records = malloc(capacity * sizeof(LineRecord));
+  if (!records)
+    return NULL;
+
+  const char *p = buffer;
+  const char *end = buffer + len;
+  while (p < end) {
+    const char *newline = memchr(p, '\n', end - p);
+    const char *line_end = newline ? newline : end;
+    LineRecord *record = &records[(*count)++];
+    record->text = p;
+    record->len = (int)(line_end - p);
+    record->has_newline = newline != NULL;
+    record->hash = hash_line(p, record->len);
+    p = newline ? newline + 1 : end;
+  }
+  return records;
+}
+
+static int records_equal(const LineRecord *x, const LineRecord *y) {
+  return x->hash == y->hash && x->len == y->len &&
+         x->has_newline == y->has_newline &&
+         memcmp(x->text, y->text, x->len) == 0;
+}
+
+// Replace every line by a small integer so comparisons are a single compare
+static int assign_classes(DiffContext *ctx, const LineRecord *old_lines,
+                          const LineRecord *new_lines) {
+  int total = ctx->a_count + ctx->b_count;
+  size_t table_size = 64;
+  while (table_size < (size_t)total * 2)
+    table_size *= 2;
+
+  const LineRecord **table = calloc(table_size, sizeof(LineRecord *));
+  int *table_class = malloc(table_size * sizeof(int));
+  if (!table || !table_class) {
+    free(table);
+    free(table_class);
+    return 0;
+  }
+
+  for (int side = 0; side < 2; side++) {
+    const LineRecord *lines = side == 0 ? old_lines : new_lines;
+    int count = side == 0 ? ctx->a_count : ctx->b_count;
+    int *classes = side == 0 ? ctx->a : ctx->b;
+
+    for (int i = 0; i < count; i++) {
+      size_t slot = lines[i].hash & (table_size - 1);
+      while (table[slot] && !records_equal(table[slot], &lines[i]))
+        slot = (slot + 1) & (table_size - 1);
+      if (!table[slot]) {
+        table[slot] = &lines[i];
+        table_class[slot] = ctx->class_count++;
+      }
+      classes[i] = table_class[slot];
+    }
+  }
+
+  free(table);
+  free(table_class);
+  return 1;
+}
+
+static int push_range(DiffContext *ctx, int a_start, int a_end, int b_start,
+                      int b_end, int use_histogram) {
+  if (ctx->range_count == ctx->range_capacity) {
+    int new_capacity = ctx->range_capacity ? ctx->range_capacity * 2 : 64;
+    DiffRange *grown =
+        realloc(ctx->ranges, new_capacity * sizeof(DiffRange));
+    if (!grown)
+      return 0;
+    ctx->ranges = grown;
+    ctx->range_capacity = new_capacity;
+  }
+  DiffRange *range = &ctx->ranges[ctx->range_count++];
+  range->a_start = a_start;
+  range->a_end = a_end;
+  range->b_start = b_start;
+  range->b_end = b_end;
+  range->use_histogram = use_histogram;
+  return 1;
+}
+
+static void mark_changed(DiffContext *ctx, int a_start, int a_end,
+                         int b_start, int b_end) {
+  for (int i = a_start; i < a_end; i++)
+    ctx->changed_a[i] = 1;
+  for (int j = b_start; j < b_end; j++)
+    ctx->changed_b[j] = 1;
+}
+
+// Find the middle snake of the range (Myers' linear-space bisection) and
+// store the split point. Returns 0 if the range should be treated as one
+// replaced block
+static int myers_split(DiffContext *ctx, const DiffRange *range, int *split_a,
+                       int *split_b) {
+  const int *a = ctx->a + range->a_start;
+  const int *b = ctx->b + range->b_start;
+  int n = range->a_end - range->a_start;
+  int m = range->b_end - range->b_start;
+
+  int max_d = (n + m + 1) / 2;
+  int offset = max_d;
+  int length = 2 * max_d + 2;
+  int *v1 = ctx->forward;
+  int *v2 = ctx->backward;
+  for (int i = 0; i < length; i++) {
+    v1[i] = -1;
+    v2[i] = -1;
+  }
+  v1[offset + 1] = 0;
+  v2[offset + 1] = 0;
+
+  int delta = n - m;
+  int front = (delta % 2 != 0);
+  int k1_start = 0, k1_end = 0, k2_start = 0, k2_end = 0;
+
+  int cost_limit = MYERS_MIN_COST_LIMIT;
+  while ((long)cost_limit * cost_limit < (long)(n + m))
+    cost_limit *= 2;
+
+  for (int d = 0; d < max_d; d++) {
+    for (int k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2) {
+      int k1_offset = offset + k1;
+      int x1;
+      if (k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1]))
+        x1 = v1[k1_offset + 1];
+      else
+        x1 = v1[k1_offset - 1] + 1;
+      int y1 = x1 - k1;
+      while (x1 < n && y1 < m && a[x1] == b[y1]) {
+        x1++;
+        y1++;
+      }
+      v1[k1_offset] = x1;
+      if (x1 > n) {
+        k1_end += 2;
+      } else if (y1 > m) {
+        k1_start += 2;
+      } else if (front) {
+        int k2_offset = offset + delta - k1;
+        if (k2_offset >= 0 && k2_offset < length && v2[k2_offset] != -1) {
+          int x2 = n - v2[k2_offset];
+          if (x1 >= x2) {
+            *split_a = x1;
+            *split_b = y1;
+            return 1;
+          }
+        }
+      }
+    }
+
+    for (int k2 = -d + k2_start; k2 <= d - k2_end; k2 += 2) {
+      int k2_offset = offset + k2;
+      int x2;
+      if (k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1]))
+        x2 = v2[k2_offset + 1];
+      else
+        x2 = v2[k2_offset - 1] + 1;
+      int y2 = x2 - k2;
+      while (x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1]) {
+        x2++;
+        y2++;
+      }
+      v2[k2_offset] = x2;
+      if (x2 > n) {
+        k2_end += 2;
+      } else if (y2 > m) {
+        k2_start += 2;
+      } else if (!front) {
+        int k1_offset = offset + delta - k2;
+        if (k1_offset >= 0 && k1_offset < length && v1[k1_offset] != -1) {
+          int x1 = v1[k1_offset];
+          int y1 = offset + x1 - k1_offset;
+          if (x1 >= n - x2) {
+            *split_a = x1;
+            *split_b = y1;
+            return 1;
+          }
+        }
+      }
+    }
+
+    // Too expensive to stay minimal: split at the forward path that got
+    // furthest, which keeps the diff correct if not always the shortest
+    if (d >= cost_limit) {
+      int best = -1;
+      for (int k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2) {
+        int x1 = v1[offset + k1];
+        int y1 = x1 - k1;
+        if (x1 < 0 || x1 > n || y1 < 0 || y1 > m)
+          continue;
+        if (x1 + y1 > best) {
+          best = x1 + y1;
+          *split_a = x1;
+          *split_b = y1;
+        }
+      }
+      return best > 0 && best < n + m;
+    }
+  }
+  return 0;
+}
+
+static void compare_myers(DiffContext *ctx, const DiffRange *range) {
+  int split_a, split_b;
+  int n = range->a_end - range->a_start;
+  int m = range->b_end - range->b_start;
+
+  // A split at either end would compare the same range again
+  if (!myers_split(ctx, range, &split_a, &split_b) ||
+      (split_a == 0 && split_b == 0) || (split_a == n && split_b == m)) {
+    mark_changed(ctx, range->a_start, range->a_end, range->b_start,
+                 range->b_end);
+    return;
+  }
+
+  push_range(ctx, range->a_start, range->a_start + split_a, range->b_start,
+             range->b_start + split_b, 0);
+  push_range(ctx, range->a_start + split_a, range->a_end,
+             range->b_start + split_b, range->b_end, 0);
+}
+
+// Histogram diff: anchor on the longest run around the rarest line the two
+// sides share, then compare what is left on either side of it
+static void compare_histogram(DiffContext *ctx, const DiffRange *range) {
+  const int *a = ctx->a;
+  const int *b = ctx->b;
+
+  for (int i = range->a_start; i < range->a_end; i++) {
+    int cls = a[i];
+    if (ctx->occurrences[cls] == 0)
+      ctx->chain_head[cls] = -1;
+    ctx->chain_next[i] = ctx->chain_head[cls];
+    ctx->chain_head[cls] = i;
+    ctx->occurrences[cls]++;
+  }
+
+  int best_len = 0, best_count = HISTOGRAM_MAX_CHAIN + 1;
+  int best_a = 0, best_b = 0;
+
+  for (int j = range->b_start; j < range->b_end;) {
+    int cls = b[j];
+    int next_j = j + 1;
+    if (ctx->occurrences[cls] == 0 ||
+        ctx->occurrences[cls] > HISTOGRAM_MAX_CHAIN) {
+      j = next_j;
+      continue;
+    }
+
+    for (int i = ctx->chain_head[cls]; i != -1; i = ctx->chain_next[i]) {
+      int as = i, bs = j, ae = i + 1, be = j + 1;
+      int rarest = ctx->occurrences[cls];
+      while (as > range->a_start && bs > range->b_start &&
+             a[as - 1] == b[bs - 1]) {
+        as--;
+        bs--;
+        if (ctx->occurrences[a[as]] < rarest)
+          rarest = ctx->occurrences[a[as]];
+      }
+      while (ae < range->a_end && be < range->b_end && a[ae] == b[be]) {
+        if (ctx->occurrences[a[ae]] < rarest)
+          rarest = ctx->occurrences[a[ae]];
+        ae++;
+        be++;
+      }
+      if (be > next_j)
+        next_j = be;
+
+      if (rarest < best_count ||
+          (rarest == best_count && ae - as > best_len)) {
+        best_count = rarest;
+        best_len = ae - as;
+        best_a = as;
+        best_b = bs;
+      }
+    }
+    j = next_j;
+  }
+
+  for (int i = range->a_start; i < range->a_end; i++)
+    ctx->occurrences[a[i]] = 0;
+
+  if (best_len == 0) {
+    compare_myers(ctx, range);
+    return;
+  }
+
+  push_range(ctx, range->a_start, best_a, range->b_start, best_b, 1);
+  push_range(ctx, best_a + best_len, range->a_end, best_b + best_len,
+             range->b_end, 1);
+}
+
+static void run_comparison(DiffContext *ctx) {
+  while (ctx->range_count > 0) {
+    DiffRange range = ctx->ranges[--ctx->range_count];
+
+    // Trim the common prefix and suffix before doing any real work
+    while (range.a_start < range.a_end && range.b_start < range.b_end &&
+           ctx->a[range.a_start] == ctx->b[range.b_start]) {
+      range.a_start++;
+      range.b_start++;
+    }
+    while (range.a_end > range.a_start && range.b_end > range.b_start &&
+           ctx->a[range.a_end - 1] == ctx->b[range.b_end - 1]) {
+      range.a_end--;
+      range.b_end--;
+    }
+
+    if (range.a_start == range.a_end || range.b_start == range.b_end) {
+      mark_changed(ctx, range.a_start, range.a_end, range.b_start,
+                   range.b_end);
+    } else if (range.use_histogram) {
+      compare_histogram(ctx, &range);
+    } else {
+      compare_myers(ctx, &range);
+    }
+  }
+}
+
+// Turn the changed-line maps into hunks with the requested context, merging
+// hunks whose context would overlap
+static int build_hunks(DiffContext *ctx, const LineRecord *old_lines,
+                       const LineRecord *new_lines, int context,
+                       DiffResult *result) {
+  int script_len = 0;
+  DiffResultLine *script =
+      malloc((ctx->a_count + ctx->b_count + 1) * sizeof(DiffResultLine));
+  if (!script)
+    return 0;
+
+  int i = 0, j = 0;
+  while (i < ctx->a_count || j < ctx->b_count) {
+    DiffResultLine *entry = &script[script_len++];
+    if (i < ctx->a_count && ctx->changed_a[i]) {
+      entry->type = '-';
+      entry->text = old_lines[i].text;
+      entry->len = old_lines[i].len;
+      entry->old_line = i + 1;
+      entry->new_line = -1;
+      entry->missing_newline = !old_lines[i].has_newline;
+      i++;
+    } else if (j < ctx->b_count && ctx->changed_b[j]) {
+      entry->type = '+';
+      entry->text = new_lines[j].text;
+      entry->len = new_lines[j].len;
+      entry->old_line = -1;
+      entry->new_line = j + 1;
+      entry->missing_newline = !new_lines[j].has_newline;
+      j++;
+    } else {
+      entry->type = ' ';
+      entry->text = new_lines[j].text;
+      entry->len = new_lines[j].len;
+      entry->old_line = i + 1;
+      entry->new_line = j + 1;
+      entry->missing_newline = !new_lines[j].has_newline;
+      i++;
+      j++;
+    }
+  }
+
+  int line_capacity = 0, hunk_capacity = 0;
+  int pos = 0;
+  while (pos < script_len) {
+    while (pos < script_len && script[pos].type == ' ')
+      pos++;
+    if (pos >= script_len)
+      break;
+
+    int start = pos - context < 0 ? 0 : pos - context;
+    int last_change = pos;
+    int scan = pos + 1;
+    while (scan < script_len) {
+      if (script[scan].type != ' ') {
+        last_change = scan;
+      } else if (scan - last_change > 2 * context) {
+        break;
+      }
+      scan++;
+    }
+    int end = last_change + context + 1;
+    if (end > script_len)
+      end = script_len;
+
+    if (result->hunk_count == hunk_capacity) {
+      hunk_capacity = hunk_capacity ? hunk_capacity * 2 : 16;
+      DiffHunk *grown =
+          realloc(result->hunks, hunk_capacity * sizeof(DiffHunk));
+      if (!grown) {
+        free(script);
+        return 0;
+      }
+      result->hunks = grown;
+    }
+    if (result->line_count + (end - start) > line_capacity) {
+      while (result->line_count + (end - start) > line_capacity)
+        line_capacity = line_capacity ? line_capacity * 2 : 256;
+      DiffResultLine *grown =
+          realloc(result->lines, line_capacity * sizeof(DiffResultLine));
+      if (!grown) {
+        free(script);
+        return 0;
+      }
+      result->lines = grown;
+    }
+
+    DiffHunk *hunk = &result->hunks[result->hunk_count++];
+    memset(hunk, 0, sizeof(DiffHunk));
+    hunk->first_line = result->line_count;
+    hunk->line_count = end - start;
+
+    // Empty sides start at the line before, as in unified diff
+    int old_before = 0, new_before = 0;
+    for (int k = start; k < end; k++) {
+      if (script[k].type != '+') {
+        if (hunk->old_count++ == 0)
+          hunk->old_start = script[k].old_line;
+      }
+      if (script[k].type != '-') {
+        if (hunk->new_count++ == 0)
+          hunk->new_start = script[k].new_line;
+      }
+      result->lines[result->line_count++] = script[k];
+    }
+    for (int k = start - 1; k >= 0 && (!old_before || !new_before); k--) {
+      if (!old_before && script[k].old_line > 0)
+        old_before = script[k].old_line;
+      if (!new_before && script[k].new_line > 0)
+        new_before = script[k].new_line;
+    }
+    if (hunk->old_count == 0)
+      hunk->old_start = old_before;
+    if (hunk->new_count == 0)
+      hunk->new_start = new_before;
+
+    pos = end;
+  }
+
+  free(script);
+  return 1;
+}
+
+static void free_context(DiffContext *ctx) {
+  free(ctx->a);
+  free(ctx->b);
+  free(ctx->changed_a);
+  free(ctx->changed_b);
+  free(ctx->ranges);
+  free(ctx->forward);
+  free(ctx->backward);
+  free(ctx->occurrences);
+  free(ctx->chain_head);
+  free(ctx->chain_next);
+}
+
+// Diff two buffers line by line. Lines in the result point into the input
+// buffers, which must outlive it
+int diff_buffers(const char *old_buffer, size_t old_len,
+                 const char *new_buffer, size_t new_len, int context,
+                 DiffAlgorithm algorithm, DiffResult *result) {
+  if (!result)
+    return 0;
+  memset(result, 0, sizeof(DiffResult));
+  if (context < 0)
+    context = 0;
+
+  DiffContext ctx;
+  memset(&ctx, 0, sizeof(ctx));
+
+  int *a_map = NULL, *b_map = NULL;
+  char *in_old = NULL, *in_new = NULL;
+  char *full_changed_a = NULL, *full_changed_b = NULL;
+  int full_a_count = 0, full_b_count = 0;
+
+  LineRecord *old_lines = split_lines(old_buffer, old_len, &ctx.a_count);
+  LineRecord *new_lines = split_lines(new_buffer, new_len, &ctx.b_count);
+  int ok = 0;
+  if (!old_lines || !new_lines)
+    goto done;
+
+  int total = ctx.a_count + ctx.b_count;
+  ctx.a = malloc((ctx.a_count + 1) * sizeof(int));
+  ctx.b = malloc((ctx.b_count + 1) * sizeof(int));
+  ctx.changed_a = calloc(ctx.a_count + 1, 1);
+  ctx.changed_b = calloc(ctx.b_count + 1, 1);
+  ctx.forward = malloc((total + 4) * sizeof(int));
+  ctx.backward = malloc((total + 4) * sizeof(int));
+  if (!ctx.a || !ctx.b || !ctx.changed_a || !ctx.changed_b || !ctx.forward ||
+      !ctx.backward || !assign_classes(&ctx, old_lines, new_lines))
+    goto done;
+
+  // Lines with no counterpart on the other side can only be changes; drop
+  // them up front so completely rewritten regions cost nothing to compare
+  a_map = malloc((ctx.a_count + 1) * sizeof(int));
+  b_map = malloc((ctx.b_count + 1) * sizeof(int));
+  in_old = calloc(ctx.class_count + 1, 1);
+  in_new = calloc(ctx.class_count + 1, 1);
+  if (!a_map || !b_map || !in_old || !in_new)
+    goto done;
+  for (int i = 0; i < ctx.a_count; i++)
+    in_old[ctx.a[i]] = 1;
+  for (int j = 0; j < ctx.b_count; j++)
+    in_new[ctx.b[j]] = 1;
+
+  full_changed_a = ctx.changed_a;
+  full_changed_b = ctx.changed_b;
+  int kept_a = 0, kept_b = 0;
+  for (int i = 0; i < ctx.a_count; i++) {
+    if (in_new[ctx.a[i]]) {
+      a_map[kept_a] = i;
+      ctx.a[kept_a++] = ctx.a[i];
+    } else {
+      full_changed_a[i] = 1;
+    }
+  }
+  for (int j = 0; j < ctx.b_count; j++) {
+    if (in_old[ctx.b[j]]) {
+      b_map[kept_b] = j;
+      ctx.b[kept_b++] = ctx.b[j];
+    } else {
+      full_changed_b[j] = 1;
+    }
+  }
+  full_a_count = ctx.a_count;
+  full_b_count = ctx.b_count;
+  ctx.a_count = kept_a;
+  ctx.b_count = kept_b;
+  ctx.changed_a = calloc(kept_a + 1, 1);
+  ctx.changed_b = calloc(kept_b + 1, 1);
+  if (!ctx.changed_a || !ctx.changed_b)
+    goto done;
+
+  int use_histogram = (algorithm == DIFF_ALGORITHM_HISTOGRAM);
+  if (use_histogram) {
+    ctx.occurrences = calloc(ctx.class_count + 1, sizeof(int));
+    ctx.chain_head = malloc((ctx.class_count + 1) * sizeof(int));
+    ctx.chain_next = malloc((ctx.a_count + 1) * sizeof(int));
+    if (!ctx.occurrences || !ctx.chain_head || !ctx.chain_next)
+      goto done;
+  }
+
+  if (!push_range(&ctx, 0, ctx.a_count, 0, ctx.b_count, use_histogram))
+    goto done;
+  run_comparison(&ctx);
+
+  // Map the compared lines back onto the full files
+  for (int i = 0; i < ctx.a_count; i++)
+    full_changed_a[a_map[i]] = ctx.changed_a[i];
+  for (int j = 0; j < ctx.b_count; j++)
+    full_changed_b[b_map[j]] = ctx.changed_b[j];
+  free(ctx.changed_a);
+  free(ctx.changed_b);
+  ctx.changed_a = full_changed_a;
+  ctx.changed_b = full_changed_b;
+  ctx.a_count = full_a_count;
+  ctx.b_count = full_b_count;
+  full_changed_a = full_changed_b = NULL;
+
+  ok = build_hunks(&ctx, old_lines, new_lines, context, result);
+
+done:
+  if (full_changed_a) {
+    free(ctx.changed_a);
+    free(ctx.changed_b);
+    ctx.changed_a = full_changed_a;
+    ctx.changed_b = full_changed_b;
+  }
+  free_context(&ctx);
+  free(a_map);
+  free(b_map);
+  free(in_old);
+  free(in_new);
+  free(old_lines);
+  free(new_lines);
+  if (!ok)
+    diff_result_free(result);
+  return ok;
+}
+
+void diff_result_free(DiffResult *result) {
+  if (!result)
+    return;
+  free(result->lines);
+  free(result->hunks);
+  memset(result, 0, sizeof(DiffResult));
+}
+
+// "@@ -a,b +c,d @@", leaving out counts of 1 the way git does
+int diff_format_hunk_header(const DiffHunk *hunk, char *buffer, size_t size) {
+  if (!hunk || !buffer || size == 0)
+    return 0;
+
+  char old_range[32], new_range[32];
+  if (hunk->old_count == 1)
+    snprintf(old_range, sizeof(old_range), "%d", hunk->old_start);
+  else
+    snprintf(old_range, sizeof(old_range), "%d,%d", hunk->old_start,
+             hunk->old_count);
+  if (hunk->new_count == 1)
+    snprintf(new_range, sizeof(new_range), "%d", hunk->new_start);
+  else
+    snprintf(new_range, sizeof(new_range), "%d,%d", hunk->new_start,
+             hunk->new_count);
+
+  return snprintf(buffer, size, "@@ -%s +%s @@", old_range, new_range);
+}
@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+#include "git_async.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Returns a pidfd for the child or -1 when the kernel lacks pidfd_open, in
+// which case callers rely on SIGCHLD to notice the exit
+int git_op_open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+  if (fd >= 0) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+  }
+#else
+  (void)pid;
+#endif
+  return -1;
+}
+
+static void free_request(GitOpRequest *request) {
+  for (int i = 0; request->argv[i]; i++)
+    free(request->argv[i]);
+  free(request->input);
+  memset(request, 0, sizeof(GitOpRequest));
+}
+
+void git_op_queue_init(GitOpQueue *queue) {
+  if (!queue)
+    return;
+  memset(queue, 0, sizeof(GitOpQueue));
+  queue->pid = -1;
+  queue->input_fd = -1;
+  queue->output_fd = -1;
+  queue->pidfd = -1;
+  queue->progress = -1;
+}
+
+// Queue a git command; the varargs are its argv, ending with NULL. input is
+// input_len bytes for its stdin and may hold NULs. Returns 0 if the queue is
+// full
+int git_op_enqueue(GitOpQueue *queue, int kind, int flags, const char *input,
+                   size_t input_len, ...) {
+  if (!queue || queue->pending_count >= GIT_OP_QUEUE_LEN)
+    return 0;
+
+  GitOpRequest request;
+  memset(&request, 0, sizeof(request));
+  request.kind = kind;
+  request.flags = flags;
+
+  va_list args;
+  va_start(args, input_len);
+  int argc = 0;
+  const char *arg;
+  while ((arg = va_arg(args, const char *)) != NULL) {
+    if (argc >= GIT_OP_MAX_ARGS || !(request.argv[argc] = strdup(arg))) {
+      va_end(args);
+      free_request(&request);
+      return 0;
+    }
+    argc++;
+  }
+  va_end(args);
+
+  if (argc == 0 || (input && !(request.input = malloc(input_len + 1)))) {
+    free_request(&request);
+    return 0;
+  }
+  if (input) {
+    memcpy(request.input, input, input_len);
+    request.input_len = input_len;
+  }
+
+  int slot = (queue->pending_head + queue->pending_count) % GIT_OP_QUEUE_LEN;
+  queue->pending[slot] = request;
+  queue->pending_count++;
+  return 1;
+}
+
+int git_op_busy(const GitOpQueue *queue) {
+  return queue && (queue->running || queue->pending_count > 0);
+}
+
+static void close_op_fds(GitOpQueue *queue) {
+  if (queue->input_fd >= 0)
+    close(queue->input_fd);
+  if (queue->output_fd >= 0)
+    close(queue->output_fd);
+  if (queue->pidfd >= 0)
+    close(queue->pidfd);
+  queue->input_fd = -1;
+  queue->output_fd = -1;
+  queue->pidfd = -1;
+}
+
+// Feed the running command as much of its input as the pipe takes without
+// blocking; stdin is closed once it is all written or git stops reading.
+// Returns 1 while input remains
+int git_op_write_input(GitOpQueue *queue) {
+  if (!queue || queue->input_fd < 0)
+    return 0;
+
+  // git may exit before reading everything
+  struct sigaction ignore_pipe, old_pipe;
+  memset(&ignore_pipe, 0, sizeof(ignore_pipe));
+  ignore_pipe.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &ignore_pipe, &old_pipe);
+
+  const char *input = queue->current.input;
+  size_t len = queue->current.input_len;
+  while (queue->input_written < len) {
+    ssize_t n = write(queue->input_fd, input + queue->input_written,
+                      len - queue->input_written);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN)
+        queue->input_written = len;
+      break;
+    }
+    queue->input_written += n;
+  }
+
+  sigaction(SIGPIPE, &old_pipe, NULL);
+
+  if (queue->input_written < len)
+    return 1;
+  close(queue->input_fd);
+  queue->input_fd = -1;
+  return 0;
+}
+
+// Pipes are close-on-exec from the start, so commands the shell or a
+// fetch forks meanwhile never hold them open
+static pid_t spawn_request(GitOpQueue *queue, const GitOpRequest *request) {
+  int output[2];
+  int input[2] = {-1, -1};
+  if (pipe2(output, O_CLOEXEC) == -1)
+    return -1;
+  if (request->input && pipe2(input, O_CLOEXEC) == -1) {
+    close(output[0]);
+    close(output[1]);
+    return -1;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    // Own process group, so cancelling also stops ssh and credential helpers
+    setpgid(0, 0);
+
+    if (request->input) {
+      dup2(input[0], STDIN_FILENO);
+      close(input[0]);
+      close(input[1]);
+    } else {
+      int devnull = open("/dev/null", O_RDONLY);
+      if (devnull != -1) {
+        dup2(devnull, STDIN_FILENO);
+        close(devnull);
+      }
+    }
+    dup2(output[1], STDOUT_FILENO);
+    dup2(output[1], STDERR_FILENO);
+    close(output[0]);
+    close(output[1]);
+
+    if (request->flags & GIT_OP_NO_PROMPT) {
+      setenv("GIT_ASKPASS", "/bin/false", 1);
+      setenv("SSH_ASKPASS", "/bin/false", 1);
+      setenv("GIT_TERMINAL_PROMPT", "0", 1);
+    }
+    execvp(request->argv[0], request->argv);
+    _exit(127);
+  }
+
+  close(output[1]);
+  if (request->input)
+    close(input[0]);
+
+  if (pid == -1) {
+    close(output[0]);
+    if (request->input)
+      close(input[1]);
+    return -1;
+  }
+
+  setpgid(pid, pid);
+  fcntl(output[0], F_SETFL, fcntl(output[0], F_GETFL) | O_NONBLOCK);
+  queue->output_fd = output[0];
+  queue->pidfd = git_op_open_pidfd(pid);
+  if (request->input) {
+    fcntl(input[1], F_SETFL, fcntl(input[1], F_GETFL) | O_NONBLOCK);
+    queue->input_fd = input[1];
+    queue->input_written = 0;
+    git_op_write_input(queue);
+  }
+  return pid;
+}
+
+// Start the next queued command if none is running. Returns 1 while a
+// command is in flight. A command that could not be started still counts:
+// git_op_reap reports it as failed
+int git_op_start_next(GitOpQueue *queue) {
+  if (!queue)
+    return 0;
+  if (queue->running || queue->pending_count == 0)
+    return queue->running;
+
+  queue->current = queue->pending[queue->pending_head];
+  memset(&queue->pending[queue->pending_head], 0, sizeof(GitOpRequest));
+  queue->pending_head = (queue->pending_head + 1) % GIT_OP_QUEUE_LEN;
+  queue->pending_count--;
+
+  queue->running = 1;
+  queue->cancelled = 0;
+  queue->progress = -1;
+  queue->phase[0] = '\0';
+  queue->message[0] = '\0';
+  queue->partial_len = 0;
+  queue->pid = spawn_request(queue, &queue->current);
+  return 1;
+}
+
+// Pick "Phase: NN% (x/y)" out of a progress line. Returns 1 if it was one
+static int parse_progress(GitOpQueue *queue, const char *line, int *changed) {
+  const char *percent = strchr(line, '%');
+  if (!percent || percent == line || !isdigit((unsigned char)percent[-1]))
+    return 0;
+
+  const char *digits = percent;
+  while (digits > line && isdigit((unsigned char)digits[-1]))
+    digits--;
+  int value = atoi(digits);
+
+  if (strncmp(line, "remote: ", 8) == 0)
+    line += 8;
+  const char *colon = strchr(line, ':');
+  char phase[sizeof(queue->phase)] = "";
+  if (colon && colon < digits) {
+    size_t len = colon - line;
+    if (len >= sizeof(phase))
+      len = sizeof(phase) - 1;
+    memcpy(phase, line, len);
+    phase[len] = '\0';
+  }
+
+  if (value != queue->progress || strcmp(phase, queue->phase) != 0) {
+    queue->progress = value;
+    snprintf(queue->phase, sizeof(queue->phase), "%s", phase);
+    *changed = 1;
+  }
+  return 1;
+}
+
+static void finish_line(GitOpQueue *queue, int *changed) {
+  queue->partial[queue->partial_len] = '\0';
+  if (queue->partial_len > 0 &&
+      !parse_progress(queue, queue->partial, changed)) {
+    snprintf(queue->message, sizeof(queue->message), "%s", queue->partial);
+  }
+  queue->partial_len = 0;
+}
+
+// Consume whatever the running command has printed. Progress meters end
+// each update with '\r', so both '\r' and '\n' finish a line. Returns 1 if
+// the progress or phase changed
+int git_op_read_output(GitOpQueue *queue) {
+  if (!queue || queue->output_fd < 0)
+    return 0;
+
+  int changed = 0;
+  char buf[4096];
+  for (;;) {
+    ssize_t n = read(queue->output_fd, buf, sizeof(buf));
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      if (n == 0 || errno != EAGAIN) {
+        // EOF: the command (and anything it spawned) closed its output
+        finish_line(queue, &changed);
+        close(queue->output_fd);
+        queue->output_fd = -1;
+      }
+      break;
+    }
+
+    for (ssize_t i = 0; i < n; i++) {
+      if (buf[i] == '\r' || buf[i] == '\n') {
+        finish_line(queue, &changed);
+      } else if (queue->partial_len < sizeof(queue->partial) - 1) {
+        queue->partial[queue->partial_len++] = buf[i];
+      }
+    }
+  }
+  return changed;
+}
+
+// Collect the running command if it has exited. Returns 1 and fills result
+// when it has; the next queued command is not started automatically
+int git_op_reap(GitOpQueue *queue, GitOpResult *result) {
+  if (!queue || !queue->running)
+    return 0;
+
+  int status = 0;
+  int exited = 0;
+  if (queue->pid > 0) {
+    pid_t reaped = waitpid(queue->pid, &status, WNOHANG);
+    if (reaped == 0 || (reaped == -1 && errno == EINTR))
+      return 0;
+    exited = reaped == queue->pid;
+  }
+
+  int changed = 0;
+  git_op_read_output(queue);
+  finish_line(queue, &changed);
+  close_op_fds(queue);
+
+  if (result) {
+    result->kind = queue->current.kind;
+    result->cancelled = queue->cancelled;
+    result->success =
+        exited && !queue->cancelled && WIFEXITED(status) &&
+        WEXITSTATUS(status) == 0;
+    snprintf(result->message, sizeof(result->message), "%s", queue->message);
+  }
+
+  free_request(&queue->current);
+  queue->running = 0;
+  queue->cancelled = 0;
+  queue->pid = -1;
+  return 1;
+}
+
+// Drop everything still queued and stop the running command; its result
+// comes back from git_op_reap marked cancelled
+void git_op_cancel(GitOpQueue *queue) {
+  if (!queue)
+    return;
+
+  while (queue->pending_count > 0) {
+    free_request(&queue->pending[queue->pending_head]);
+    queue->pending_head = (queue->pending_head + 1) % GIT_OP_QUEUE_LEN;
+    queue->pending_count--;
+  }
+
+  if (queue->running && queue->pid > 0 && !queue->cancelled) {
+    kill(-queue->pid, SIGTERM);
+    queue->cancelled = 1;
+  }
+}
+
+void git_op_queue_destroy(GitOpQueue *queue) {
+  if (!queue)
+    return;
+
+  git_op_cancel(queue);
+  if (queue->running && queue->pid > 0) {
+    while (waitpid(queue->pid, NULL, 0) == -1 && errno == EINTR)
+      ;
+  }
+  close_op_fds(queue);
+  free_request(&queue->current);
+  git_op_queue_init(queue);
+}
@@ -0,0 +1,385 @@
+#include "git_batch.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// One long-lived `git cat-file --batch-command` process answers every object
+// lookup, so a selection change costs a pipe round-trip instead of a fork+exec
+static pid_t batch_pid = -1;
+static FILE *batch_request = NULL;
+static FILE *batch_response = NULL;
+static int batch_unavailable = 0; // Set when git can't run the helper
+
+// A name git can't resolve without a repository setting (@{upstream} with
+// none configured) kills the helper; only a helper that keeps dying, with
+// no reply in between, is given up on
+#define BATCH_MAX_DEATHS 3
+static int batch_deaths = 0;
+
+// The helper reads the index once, so index paths (":path") are only valid
+// until the index file changes; we restart the helper when it does
+static char index_path[PATH_MAX] = "";
+static struct stat index_stat;
+static int index_stat_valid = 0;
+
+// Lookups may come from the viewer and its prefetch thread; one request and
+// its reply must not interleave with another
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *header_line = NULL;
+static size_t header_size = 0;
+
+static void locate_index_file(void) {
+  if (index_path[0])
+    return;
+
+  FILE *fp = popen("git rev-parse --git-path index 2>/dev/null", "r");
+  if (!fp)
+    return;
+  if (fgets(index_path, sizeof(index_path), fp)) {
+    index_path[strcspn(index_path, "\n")] = '\0';
+  } else {
+    index_path[0] = '\0';
+  }
+  pclose(fp);
+}
+
+static int index_changed(void) {
+  struct stat st;
+  int exists = index_path[0] && stat(index_path, &st) == 0;
+  if (!exists)
+    return index_stat_valid;
+  if (!index_stat_valid)
+    return 1;
+  return st.st_mtim.tv_sec != index_stat.st_mtim.tv_sec ||
+         st.st_mtim.tv_nsec != index_stat.st_mtim.tv_nsec ||
+         st.st_size != index_stat.st_size || st.st_ino != index_stat.st_ino;
+}
+
+static int start_helper(void) {
+  if (batch_pid > 0)
+    return 1;
+  if (batch_unavailable)
+    return 0;
+
+  // Snapshot the index before the helper loads it
+  locate_index_file();
+  index_stat_valid = index_path[0] && stat(index_path, &index_stat) == 0;
+
+  int to_git[2], from_git[2];
+  if (pipe(to_git) == -1)
+    return 0;
+  if (pipe(from_git) == -1) {
+    close(to_git[0]);
+    close(to_git[1]);
+    return 0;
+  }
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(to_git[0]);
+    close(to_git[1]);
+    close(from_git[0]);
+    close(from_git[1]);
+    return 0;
+  }
+
+  if (pid == 0) {
+    dup2(to_git[0], STDIN_FILENO);
+    dup2(from_git[1], STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull != -1) {
+      dup2(devnull, STDERR_FILENO);
+      close(devnull);
+    }
+    close(to_git[0]);
+    close(to_git[1]);
+    close(from_git[0]);
+    close(from_git[1]);
+    execlp("git", "git", "cat-file", "--batch-command", (char *)NULL);
+    _exit(127);
+  }
+
+  close(to_git[0]);
+  close(from_git[1]);
+
+  // Keep our ends out of later children (e.g. the background fetch), or the
+  // helper would never see EOF when we close its stdin
+  fcntl(to_git[1], F_SETFD, FD_CLOEXEC);
+  fcntl(from_git[0], F_SETFD, FD_CLOEXEC);
+
+  batch_request = fdopen(to_git[1], "w");
+  batch_response = fdopen(from_git[0], "r");
+  if (!batch_request || !batch_response) {
+    if (batch_request)
+      fclose(batch_request);
+    else
+      close(to_git[1]);
+    if (batch_response)
+      fclose(batch_response);
+    else
+      close(from_git[0]);
+    batch_request = batch_response = NULL;
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return 0;
+  }
+
+  batch_pid = pid;
+  return 1;
+}
+
+static void stop_helper(void) {
+  if (batch_request)
+    fclose(batch_request); // EOF on stdin makes the helper exit
+  if (batch_response)
+    fclose(batch_response);
+  batch_request = batch_response = NULL;
+
+  if (batch_pid > 0) {
+    while (waitpid(batch_pid, NULL, 0) == -1 && errno == EINTR)
+      ;
+  }
+  batch_pid = -1;
+}
+
+int git_batch_start(void) {
+  pthread_mutex_lock(&batch_lock);
+  int started = start_helper();
+  pthread_mutex_unlock(&batch_lock);
+  return started;
+}
+
+// End the session; the next lookup starts over, possibly in another repo
+void git_batch_stop(void) {
+  pthread_mutex_lock(&batch_lock);
+  stop_helper();
+  batch_unavailable = 0;
+  batch_deaths = 0;
+  index_path[0] = '\0';
+  index_stat_valid = 0;
+
+  free(header_line);
+  header_line = NULL;
+  header_size = 0;
+  pthread_mutex_unlock(&batch_lock);
+}
+
+// The helper died or never started properly; don't respawn it for every
+// lookup, callers fall back to their one-shot commands
+static void mark_batch_broken(void) {
+  stop_helper();
+  batch_unavailable = 1;
+}
+
+// The helper exited while answering a lookup. That lookup fails and the
+// next one starts a new helper, unless this keeps happening. Returns what
+// the lookup reports: 0 for a missing object, -1 once the helper is given
+// up on
+static int batch_helper_died(void) {
+  stop_helper();
+  if (++batch_deaths < BATCH_MAX_DEATHS)
+    return 0;
+  batch_unavailable = 1;
+  return -1;
+}
+
+// Send one command and parse the "<oid> <type> <size>" reply header.
+// Returns 1 if the object exists, 0 if it is missing or the helper died on
+// it, -1 on helper failure
+static int batch_query(const char *command, const char *object_name,
+                       GitObjectInfo *info) {
+  if (!object_name || !*object_name || strchr(object_name, '\n'))
+    return 0;
+
+  // Restart the helper so index lookups see the latest staging
+  if (batch_pid > 0 && object_name[0] == ':' && index_changed()) {
+    stop_helper();
+  }
+  if (!start_helper())
+    return -1;
+
+  // A dead helper must not take the shell down with SIGPIPE
+  struct sigaction ignore_pipe, old_pipe;
+  memset(&ignore_pipe, 0, sizeof(ignore_pipe));
+  ignore_pipe.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &ignore_pipe, &old_pipe);
+
+  int sent = fprintf(batch_request, "%s %s\n", command, object_name) > 0 &&
+             fflush(batch_request) == 0;
+
+  sigaction(SIGPIPE, &old_pipe, NULL);
+
+  if (!sent)
+    return batch_helper_died();
+
+  ssize_t len = getline(&header_line, &header_size, batch_response);
+  if (len <= 0)
+    return batch_helper_died();
+  batch_deaths = 0;
+  if (header_line[len - 1] == '\n')
+    header_line[--len] = '\0';
+
+  // "<name> missing" / "<name> ambiguous" have no body to consume
+  const char *last_space = strrchr(header_line, ' ');
+  if (!last_space || strcmp(last_space, " missing") == 0 ||
+      strcmp(last_space, " ambiguous") == 0)
+    return 0;
+
+  // The width is GIT_MAX_OID_HEX_LEN, so SHA-1 and SHA-256 ids both fit
+  GitObjectInfo parsed;
+  if (sscanf(header_line, "%64s %15s %zu", parsed.oid, parsed.type,
+             &parsed.size) != 3 ||
+      !git_is_oid_hex(parsed.oid)) {
+    mark_batch_broken();
+    return -1;
+  }
+
+  if (info)
+    *info = parsed;
+  return 1;
+}
+
+// Look up an object by any name git understands ("HEAD", ":path",
+// "refs/remotes/origin/main", ...). Returns 1 if it exists, 0 if not and -1
+// when the helper is unavailable
+int git_batch_object_info(const char *object_name, GitObjectInfo *info) {
+  pthread_mutex_lock(&batch_lock);
+  int found = batch_query("info", object_name, info);
+  pthread_mutex_unlock(&batch_lock);
+  return found;
+}
+
+// Returns the object's contents as a malloc'd, NUL-terminated buffer (the
+// size is in info->size), or NULL if it is missing or the helper failed
+static char *read_object(const char *object_name, GitObjectInfo *info) {
+  GitObjectInfo parsed;
+  if (batch_query("contents", object_name, &parsed) != 1)
+    return NULL;
+
+  // The body has to be consumed even if we can't keep it, or every later
+  // reply would be out of sync
+  char *buffer = malloc(parsed.size + 1);
+  size_t got = 0;
+  if (buffer) {
+    got = fread(buffer, 1, parsed.size, batch_response);
+  } else {
+    char discard[4096];
+    while (got < parsed.size) {
+      size_t chunk = parsed.size - got;
+      size_t n = fread(discard, 1,
+                       chunk < sizeof(discard) ? chunk : sizeof(discard),
+                       batch_response);
+      if (n == 0)
+        break;
+      got += n;
+    }
+  }
+
+  if (got != parsed.size || fgetc(batch_response) != '\n') {
+    free(buffer);
+    mark_batch_broken();
+    return NULL;
+  }
+  if (!buffer)
+    return NULL;
+
+  buffer[parsed.size] = '\0';
+  if (info)
+    *info = parsed;
+  return buffer;
+}
+
+char *git_batch_read_object(const char *object_name, GitObjectInfo *info) {
+  pthread_mutex_lock(&batch_lock);
+  char *buffer = read_object(object_name, info);
+  pthread_mutex_unlock(&batch_lock);
+  return buffer;
+}
+
+// Parse "<name> <email> <timestamp> <tz>" and return the timestamp
+static time_t parse_signature_time(const char *line, const char *line_end) {
+  const char *email_end = line_end;
+  while (email_end > line && *email_end != '>')
+    email_end--;
+  if (*email_end != '>')
+    return 0;
+  return (time_t)strtoll(email_end + 1, NULL, 10);
+}
+
+// Copy the oid running from start to line_end, SHA-1 or SHA-256. Leaves
+// dest empty and returns 0 when it is neither
+static int copy_oid(char *dest, const char *start, const char *line_end) {
+  size_t len = line_end - start;
+  dest[0] = '\0';
+  if (len != GIT_OID_HEX_LEN && len != GIT_MAX_OID_HEX_LEN)
+    return 0;
+  memcpy(dest, start, len);
+  dest[len] = '\0';
+  if (git_is_oid_hex(dest))
+    return 1;
+  dest[0] = '\0';
+  return 0;
+}
+
+int git_batch_parse_commit(const char *buffer, size_t size, GitCommit *commit) {
+  if (!buffer || !commit)
+    return 0;
+
+  memset(commit, 0, sizeof(GitCommit));
+  const char *end = buffer + size;
+  const char *line = buffer;
+
+  while (line < end && *line != '\n') {
+    const char *line_end = memchr(line, '\n', end - line);
+    if (!line_end)
+      line_end = end;
+
+    if (strncmp(line, "tree ", 5) == 0) {
+      copy_oid(commit->tree, line + 5, line_end);
+    } else if (strncmp(line, "parent ", 7) == 0) {
+      void *grown = realloc(commit->parents, (commit->parent_count + 1) *
+                                                 sizeof(*commit->parents));
+      if (!grown) {
+        git_batch_free_commit(commit);
+        return 0;
+      }
+      commit->parents = grown;
+      if (copy_oid(commit->parents[commit->parent_count], line + 7,
+                   line_end))
+        commit->parent_count++;
+    } else if (strncmp(line, "author ", 7) == 0) {
+      commit->author = line + 7;
+      const char *email_end = memchr(commit->author, '>', line_end - line - 7);
+      commit->author_len =
+          email_end ? (int)(email_end + 1 - commit->author)
+                    : (int)(line_end - commit->author);
+      commit->author_time = parse_signature_time(line, line_end);
+    } else if (strncmp(line, "committer ", 10) == 0) {
+      commit->committer_time = parse_signature_time(line, line_end);
+    }
+
+    line = line_end < end ? line_end + 1 : end;
+  }
+
+  // Skip the blank line separating headers from the message
+  commit->message = line < end ? line + 1 : end;
+  return commit->tree[0] != '\0';
+}
+
+void git_batch_free_commit(GitCommit *commit) {
+  if (!commit)
+    return;
+  free(commit->parents);
+  commit->parents = NULL;
+  commit->parent_count = 0;
+}
+
+// Whether text is a full object id, SHA-1 or SHA-256
+int git_is_oid_hex(const char *text) {
+  size_t len = strspn(text, "0123456789abcdef");
+  return text[len] == '\0' &&
+         (len == GIT_OID_HEX_LEN || len == GIT_MAX_OID_HEX_LEN);
+}
@@ -0,0 +1,169 @@
+#define _GNU_SOURCE
+#include "git_command.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static int append_output(GitOutput *output, size_t *cap, const char *data,
+                         size_t len) {
+  if (output->len + len + 1 > *cap) {
+    size_t new_cap = *cap ? *cap : 4096;
+    while (new_cap < output->len + len + 1)
+      new_cap *= 2;
+    char *grown = realloc(output->data, new_cap);
+    if (!grown)
+      return 0;
+    output->data = grown;
+    *cap = new_cap;
+  }
+  memcpy(output->data + output->len, data, len);
+  output->len += len;
+  output->data[output->len] = '\0';
+  return 1;
+}
+
+// Run git from an argv array, never through a shell, so paths from the work
+// tree reach it as plain arguments whatever characters they hold. input,
+// if given, is fed to its stdin while its stdout is collected, so neither
+// side can fill a pipe and stall the other. Returns 1 once git has exited
+int git_command_run(const char *const argv[], const char *input,
+                    size_t input_len, GitOutput *output) {
+  memset(output, 0, sizeof(GitOutput));
+  output->status = -1;
+
+  // Close-on-exec from the start: a thread forking meanwhile must not
+  // inherit our ends, or git would never see EOF on its stdin
+  int to_git[2] = {-1, -1}, from_git[2];
+  if (input && pipe2(to_git, O_CLOEXEC) == -1)
+    return 0;
+  if (pipe2(from_git, O_CLOEXEC) == -1) {
+    if (input) {
+      close(to_git[0]);
+      close(to_git[1]);
+    }
+    return 0;
+  }
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    if (input) {
+      close(to_git[0]);
+      close(to_git[1]);
+    }
+    close(from_git[0]);
+    close(from_git[1]);
+    return 0;
+  }
+
+  if (pid == 0) {
+    int devnull = open("/dev/null", O_RDWR);
+    dup2(input ? to_git[0] : devnull, STDIN_FILENO);
+    dup2(from_git[1], STDOUT_FILENO);
+    if (devnull != -1)
+      dup2(devnull, STDERR_FILENO);
+    execvp("git", (char *const *)argv);
+    _exit(127);
+  }
+
+  if (input) {
+    close(to_git[0]);
+    fcntl(to_git[1], F_SETFL, O_NONBLOCK);
+  }
+  close(from_git[1]);
+
+  // git may exit before reading all of its input
+  struct sigaction ignore_pipe, old_pipe;
+  memset(&ignore_pipe, 0, sizeof(ignore_pipe));
+  ignore_pipe.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &ignore_pipe, &old_pipe);
+
+  size_t cap = 0;
+  size_t written = 0;
+  int input_fd = input ? to_git[1] : -1;
+  if (input_fd >= 0 && input_len == 0) {
+    close(input_fd);
+    input_fd = -1;
+  }
+  int output_fd = from_git[0];
+  char buffer[4096];
+  while (output_fd >= 0) {
+    struct pollfd fds[2];
+    int nfds = 0;
+    fds[nfds].fd = output_fd;
+    fds[nfds++].events = POLLIN;
+    if (input_fd >= 0) {
+      fds[nfds].fd = input_fd;
+      fds[nfds++].events = POLLOUT;
+    }
+    if (poll(fds, nfds, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (input_fd >= 0 && fds[1].revents) {
+      ssize_t n = write(input_fd, input + written, input_len - written);
+      if (n > 0)
+        written += n;
+      if ((n == -1 && errno != EAGAIN && errno != EINTR) ||
+          written == input_len) {
+        close(input_fd);
+        input_fd = -1;
+      }
+    }
+
+    if (fds[0].revents) {
+      ssize_t n = read(output_fd, buffer, sizeof(buffer));
+      if (n > 0) {
+        if (!append_output(output, &cap, buffer, n))
+          n = 0; // Out of memory: stop reading, let git finish
+      }
+      if (n == 0 || (n == -1 && errno != EINTR && errno != EAGAIN)) {
+        close(output_fd);
+        output_fd = -1;
+      }
+    }
+  }
+  if (input_fd >= 0)
+    close(input_fd);
+  if (output_fd >= 0)
+    close(output_fd);
+
+  sigaction(SIGPIPE, &old_pipe, NULL);
+
+  int status;
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR) {
+      git_output_free(output);
+      return 0;
+    }
+  }
+  if (WIFEXITED(status))
+    output->status = WEXITSTATUS(status);
+  if (!output->data)
+    append_output(output, &cap, "", 0);
+  return 1;
+}
+
+// Step through the output a line at a time, like line_store_read_line:
+// the newline is cut off in place and the length returned, -1 at the end
+int git_output_next_line(GitOutput *output, size_t *offset, char **line) {
+  if (!output->data || *offset >= output->len)
+    return -1;
+
+  char *start = output->data + *offset;
+  char *end = memchr(start, '\n', output->len - *offset);
+  size_t len = end ? (size_t)(end - start) : output->len - *offset;
+  start[len] = '\0';
+  *offset += len + 1;
+  *line = start;
+  return (int)len;
+}
+
+void git_output_free(GitOutput *output) {
+  free(output->data);
+  output->data = NULL;
+  output->len = 0;
+}
@@ -1,5 +1,6 @@
 
 #include "git_integration.h"
+#include "git_batch.h"
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -342,13 +343,15 @@ int create_git_stash_with_name(const char *stash_name) {
   return (result == 0) ? 1 : 0;
 }
 
-int get_git_stashes(char stashes[][512], int max_stashes) {
-  if (!stashes || max_stashes <= 0) {
+// Read the stash list into *stashes, growing it (and *capacity) as needed.
+// Returns how many stashes were read
+int get_git_stashes(char (**stashes)[512], int *capacity) {
+  if (!stashes || !capacity) {
     return 0;
   }
 
   FILE *fp =
-      popen("git stash list --all --format=\"%cr: %gs\" 2>/dev/null | sed 's/ "
+      popen("git stash list --format=\"%cr: %gs\" 2>/dev/null | sed 's/ "
             "ago://' | sed 's/ minutes/m/' | sed 's/ minute/m/' | sed 's/ "
             "hours/h/' | sed 's/ hour/h/' | sed 's/ days/d/' | sed 's/ day/d/' "
             "| sed 's/ weeks/w/' | sed 's/ week/w/' | sed 's/WIP on /On /'",
@@ -360,14 +363,23 @@ int get_git_stashes(char stashes[][512], int max_stashes) {
   int count = 0;
   char line[512];
 
-  while (fgets(line, sizeof(line), fp) != NULL && count < max_stashes) {
+  while (fgets(line, sizeof(line), fp) != NULL) {
     char *newline = strchr(line, '\n');
     if (newline) {
       *newline = '\0';
     }
 
-    strncpy(stashes[count], line, 511);
-    stashes[count][511] = '\0';
+    if (count == *capacity) {
+      int new_capacity = *capacity ? *capacity * 2 : 16;
+      char(*grown)[512] = realloc(*stashes, new_capacity * sizeof(**stashes));
+      if (!grown)
+        break;
+      *stashes = grown;
+      *capacity = new_capacity;
+    }
+
+    strncpy((*stashes)[count], line, 511);
+    (*stashes)[count][511] = '\0';
     count++;
   }
 
@@ -414,12 +426,74 @@ int drop_git_stash(int stash_index) {
   return (result == 0) ? 1 : 0;
 }
 
-int get_commit_details(const char *commit_hash, char *commit_info,
-                       size_t info_size) {
-  if (!commit_hash || !commit_info || info_size == 0) {
+// Append the complete output of cmd to a growable, NUL-terminated buffer
+static int append_command_output(const char *cmd, char **buffer, size_t *len,
+                                 size_t *cap) {
+  FILE *fp = popen(cmd, "r");
+  if (!fp) {
     return 0;
   }
 
+  char chunk[8192];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+    if (*len + n + 1 > *cap) {
+      size_t new_cap = *cap ? *cap : 16384;
+      while (*len + n + 1 > new_cap) {
+        new_cap *= 2;
+      }
+      char *new_buffer = realloc(*buffer, new_cap);
+      if (!new_buffer) {
+        pclose(fp);
+        return 0;
+      }
+      *buffer = new_buffer;
+      *cap = new_cap;
+    }
+    memcpy(*buffer + *len, chunk, n);
+    *len += n;
+    (*buffer)[*len] = '\0';
+  }
+
+  pclose(fp);
+  return 1;
+}
+
+static int append_bytes(const char *text, size_t n, char **buffer,
+                        size_t *len, size_t *cap) {
+  if (*len + n + 1 > *cap) {
+    size_t new_cap = *cap ? *cap * 2 : 256;
+    while (*len + n + 1 > new_cap) {
+      new_cap *= 2;
+    }
+    char *new_buffer = realloc(*buffer, new_cap);
+    if (!new_buffer) {
+      return 0;
+    }
+    *buffer = new_buffer;
+    *cap = new_cap;
+  }
+  memcpy(*buffer + *len, text, n);
+  *len += n;
+  (*buffer)[*len] = '\0';
+  return 1;
+}
+
+static int append_text(const char *text, char **buffer, size_t *len,
+                       size_t *cap) {
+  return append_bytes(text, strlen(text), buffer, len, cap);
+}
+
+// Returns a malloc'd buffer with the commit header, stats and full diff, or
+// NULL on failure. The caller frees it
+char *get_commit_details(const char *commit_hash) {
+  if (!commit_hash) {
+    return NULL;
+  }
+
+  char *commit_info = NULL;
+  size_t len = 0, cap = 0;
+
   char cmd[512];
   snprintf(
       cmd, sizeof(cmd),
@@ -427,141 +501,415 @@ int get_commit_details(const char *commit_hash, char *commit_info,
       "<%%ae>%%nDate: %%ad%%n%%n    %%s%%n%%n    %%b %%n --\" %s 2>/dev/null",
       commit_hash);
 
-  FILE *fp = popen(cmd, "r");
-  if (!fp) {
-    return 0;
-  }
-
-  size_t total_read = 0;
-  char buffer[1024];
-
-  while (fgets(buffer, sizeof(buffer), fp) != NULL &&
-         total_read < info_size - 1) {
-    size_t line_len = strlen(buffer);
-    if (total_read + line_len < info_size - 1) {
-      strcpy(commit_info + total_read, buffer);
-      total_read += line_len;
-    } else {
-      break;
-    }
+  if (!append_command_output(cmd, &commit_info, &len, &cap) || len == 0) {
+    free(commit_info);
+    return NULL;
   }
 
-  commit_info[total_read] = '\0';
-  pclose(fp);
+  // Add spacing after file stats, before diff content
+  append_text("\n\n", &commit_info, &len, &cap);
 
   // Now get the full diff content with all the @@ hunks and +/- lines
   snprintf(cmd, sizeof(cmd), "git diff %s^..%s 2>/dev/null", commit_hash,
            commit_hash);
-  fp = popen(cmd, "r");
-  if (!fp) {
-    return total_read > 0 ? 1 : 0;
+  append_command_output(cmd, &commit_info, &len, &cap);
+
+  return commit_info;
+}
+
+// Returns a malloc'd buffer with the stash patch, or NULL if it is empty
+char *get_stash_diff(int stash_index) {
+  if (stash_index < 0) {
+    return NULL;
   }
 
-  // Add spacing after file stats, before diff content
-  if (total_read < info_size - 4) {
-    strcat(commit_info, "\n\n");
-    total_read += 2;
-  }
-
-  // Read all the diff content (this includes diff --git headers, @@ hunks, and
-  // +/- lines)
-  while (fgets(buffer, sizeof(buffer), fp) != NULL &&
-         total_read < info_size - 1) {
-    size_t line_len = strlen(buffer);
-    if (total_read + line_len < info_size - 1) {
-      strcpy(commit_info + total_read, buffer);
-      total_read += line_len;
-    } else {
-      break;
-    }
+  char stash_ref[64];
+  snprintf(stash_ref, sizeof(stash_ref), "stash@{%d}", stash_index);
+  return get_stash_diff_by_ref(stash_ref);
+}
+
+// Same as get_stash_diff, for a stash given by ref or commit id
+char *get_stash_diff_by_ref(const char *stash_ref) {
+  if (!stash_ref || strchr(stash_ref, '"')) {
+    return NULL;
   }
 
-  commit_info[total_read] = '\0';
-  pclose(fp);
+  char cmd[512];
+  snprintf(cmd, sizeof(cmd), "git stash show -p \"%s\" 2>/dev/null",
+           stash_ref);
 
-  return 1;
+  char *stash_diff = NULL;
+  size_t len = 0, cap = 0;
+  if (!append_command_output(cmd, &stash_diff, &len, &cap) || len == 0) {
+    free(stash_diff);
+    return NULL;
+  }
+
+  return stash_diff;
 }
 
-int get_stash_diff(int stash_index, char *stash_diff, size_t diff_size) {
-  if (stash_index < 0 || !stash_diff || diff_size == 0) {
-    return 0;
+// Spawns `git log` for the branch; used when the batch helper is unavailable
+static char *get_branch_commits_from_log(const char *branch_name,
+                                         int max_commits) {
+  char cmd[1024];
+  snprintf(cmd, sizeof(cmd),
+           "git log %s --format=\"commit %%H%%d%%nAuthor: %%an <%%ae>%%nDate: "
+           "%%ar%%n%%n    %%s%%n%%n%%b%%n---END-COMMIT---\" -%d 2>/dev/null",
+           branch_name, max_commits);
+
+  char *log = NULL;
+  size_t len = 0, cap = 0;
+  if (!append_command_output(cmd, &log, &len, &cap) || len == 0) {
+    free(log);
+    return NULL;
   }
+  return log;
+}
 
-  char cmd[256];
-  snprintf(cmd, sizeof(cmd), "git stash show -p stash@{%d} 2>/dev/null",
-           stash_index);
+// Same wording and rounding as git's %ar
+static void format_relative_date(time_t then, char *buffer, size_t size) {
+  time_t now = time(NULL);
+  if (then > now) {
+    snprintf(buffer, size, "in the future");
+    return;
+  }
+
+  long diff = (long)(now - then);
+  if (diff < 90) {
+    snprintf(buffer, size, "%ld second%s ago", diff, diff == 1 ? "" : "s");
+    return;
+  }
+  diff = (diff + 30) / 60;
+  if (diff < 90) {
+    snprintf(buffer, size, "%ld minute%s ago", diff, diff == 1 ? "" : "s");
+    return;
+  }
+  diff = (diff + 30) / 60;
+  if (diff < 36) {
+    snprintf(buffer, size, "%ld hour%s ago", diff, diff == 1 ? "" : "s");
+    return;
+  }
+  diff = (diff + 12) / 24;
+  if (diff < 14) {
+    snprintf(buffer, size, "%ld day%s ago", diff, diff == 1 ? "" : "s");
+    return;
+  }
+  if (diff < 70) {
+    long weeks = (diff + 3) / 7;
+    snprintf(buffer, size, "%ld week%s ago", weeks, weeks == 1 ? "" : "s");
+    return;
+  }
+  if (diff < 365) {
+    long months = (diff + 15) / 30;
+    snprintf(buffer, size, "%ld month%s ago", months, months == 1 ? "" : "s");
+    return;
+  }
+  if (diff < 1825) {
+    long total_months = (diff * 12 * 2 + 365) / (365 * 2);
+    long years = total_months / 12;
+    long months = total_months % 12;
+    if (months) {
+      snprintf(buffer, size, "%ld year%s, %ld month%s ago", years,
+               years == 1 ? "" : "s", months, months == 1 ? "" : "s");
+    } else {
+      snprintf(buffer, size, "%ld year%s ago", years, years == 1 ? "" : "s");
+    }
+    return;
+  }
+  long years = (diff + 183) / 365;
+  snprintf(buffer, size, "%ld year%s ago", years, years == 1 ? "" : "s");
+}
 
-  FILE *fp = popen(cmd, "r");
+typedef struct {
+  char oid[GIT_MAX_OID_HEX_LEN + 1];
+  char label[256];
+  int is_head;
+} RefDecoration;
+
+// One for-each-ref call labels every commit in the walk the way %d does
+static RefDecoration *load_ref_decorations(int *count) {
+  *count = 0;
+  FILE *fp = popen("git for-each-ref "
+                   "--format='%(objectname)%09%(*objectname)%09%(HEAD)%09%("
+                   "refname)' 2>/dev/null",
+                   "r");
   if (!fp) {
-    return 0;
+    return NULL;
   }
 
-  size_t total_read = 0;
-  char buffer[1024];
+  RefDecoration *refs = NULL;
+  int capacity = 0;
+  int head_found = 0;
+  char line[1024];
+
+  while (fgets(line, sizeof(line), fp)) {
+    line[strcspn(line, "\n")] = '\0';
+
+    char *fields[4];
+    char *cursor = line;
+    int field_count = 0;
+    while (field_count < 4) {
+      fields[field_count++] = cursor;
+      char *tab = strchr(cursor, '\t');
+      if (!tab)
+        break;
+      *tab = '\0';
+      cursor = tab + 1;
+    }
+    if (field_count < 4) {
+      continue;
+    }
+
+    if (*count == capacity) {
+      int new_capacity = capacity ? capacity * 2 : 32;
+      RefDecoration *grown =
+          realloc(refs, new_capacity * sizeof(RefDecoration));
+      if (!grown)
+        break;
+      refs = grown;
+      capacity = new_capacity;
+    }
 
-  while (fgets(buffer, sizeof(buffer), fp) != NULL &&
-         total_read < diff_size - 1) {
-    size_t line_len = strlen(buffer);
-    if (total_read + line_len < diff_size - 1) {
-      strcpy(stash_diff + total_read, buffer);
-      total_read += line_len;
+    // Annotated tags decorate the commit they point at
+    const char *oid = *fields[1] ? fields[1] : fields[0];
+    const char *refname = fields[3];
+    RefDecoration *ref = &refs[*count];
+    snprintf(ref->oid, sizeof(ref->oid), "%.*s", GIT_MAX_OID_HEX_LEN, oid);
+    ref->is_head = (fields[2][0] == '*');
+
+    if (strncmp(refname, "refs/heads/", 11) == 0) {
+      snprintf(ref->label, sizeof(ref->label), "%s%s",
+               ref->is_head ? "HEAD -> " : "", refname + 11);
+    } else if (strncmp(refname, "refs/remotes/", 13) == 0) {
+      snprintf(ref->label, sizeof(ref->label), "%s", refname + 13);
+    } else if (strncmp(refname, "refs/tags/", 10) == 0) {
+      snprintf(ref->label, sizeof(ref->label), "tag: %s", refname + 10);
     } else {
-      break;
+      snprintf(ref->label, sizeof(ref->label), "%s", refname);
     }
+    head_found |= ref->is_head;
+    (*count)++;
   }
-
-  stash_diff[total_read] = '\0';
   pclose(fp);
 
-  return total_read > 0 ? 1 : 0;
+  // Detached HEAD still gets its own label
+  GitObjectInfo head;
+  if (!head_found && git_batch_object_info("HEAD", &head) == 1) {
+    RefDecoration *grown = realloc(refs, (*count + 1) * sizeof(RefDecoration));
+    if (grown) {
+      refs = grown;
+      strcpy(refs[*count].oid, head.oid);
+      strcpy(refs[*count].label, "HEAD");
+      refs[*count].is_head = 1;
+      (*count)++;
+    }
+  }
+
+  return refs;
 }
 
-int get_branch_commits(const char *branch_name, char commits[][2048],
-                       int max_commits) {
-  if (!branch_name || !commits || max_commits <= 0) {
-    return 0;
+static void append_decoration(const RefDecoration *refs, int ref_count,
+                              const char *oid, char **buffer, size_t *len,
+                              size_t *cap) {
+  int written = 0;
+  // HEAD comes first, then the other refs newest-loaded first, as in git's
+  // own output
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = ref_count - 1; i >= 0; i--) {
+      if (refs[i].is_head != (pass == 0) || strcmp(refs[i].oid, oid) != 0)
+        continue;
+      append_text(written ? ", " : " (", buffer, len, cap);
+      append_text(refs[i].label, buffer, len, cap);
+      written = 1;
+    }
   }
+  if (written) {
+    append_text(")", buffer, len, cap);
+  }
+}
 
-  char cmd[1024];
-  snprintf(cmd, sizeof(cmd),
-           "git log %s --format=\"commit %%H%%d%%nAuthor: %%an <%%ae>%%nDate: "
-           "%%ar%%n%%n    %%s%%n%%n%%b%%n---END-COMMIT---\" -%d 2>/dev/null",
-           branch_name, max_commits);
+// Write one commit in the "---END-COMMIT---" block layout
+static void append_commit_block(const char *oid, const GitCommit *commit,
+                                const RefDecoration *refs, int ref_count,
+                                char **buffer, size_t *len, size_t *cap) {
+  char date[64];
+  format_relative_date(commit->author_time, date, sizeof(date));
+
+  append_text("commit ", buffer, len, cap);
+  append_text(oid, buffer, len, cap);
+  append_decoration(refs, ref_count, oid, buffer, len, cap);
+  append_text("\nAuthor: ", buffer, len, cap);
+  append_bytes(commit->author, commit->author_len, buffer, len, cap);
+  append_text("\nDate: ", buffer, len, cap);
+  append_text(date, buffer, len, cap);
+  append_text("\n\n    ", buffer, len, cap);
+
+  // The subject is the first paragraph folded onto one line
+  const char *p = commit->message;
+  while (*p == '\n')
+    p++;
+  int first_line = 1;
+  while (*p && *p != '\n') {
+    const char *line_end = strchr(p, '\n');
+    if (!line_end)
+      line_end = p + strlen(p);
+    if (!first_line)
+      append_text(" ", buffer, len, cap);
+    append_bytes(p, line_end - p, buffer, len, cap);
+    first_line = 0;
+    p = *line_end ? line_end + 1 : line_end;
+  }
+  append_text("\n\n", buffer, len, cap);
+
+  // The body follows the blank lines after the subject
+  while (*p == '\n')
+    p++;
+  size_t body_len = strlen(p);
+  while (body_len > 0 && p[body_len - 1] == '\n')
+    body_len--;
+  if (body_len > 0) {
+    append_bytes(p, body_len, buffer, len, cap);
+    append_text("\n", buffer, len, cap);
+  }
+  append_text("\n---END-COMMIT---\n", buffer, len, cap);
+}
 
-  FILE *fp = popen(cmd, "r");
-  if (!fp) {
+typedef struct {
+  char oid[GIT_MAX_OID_HEX_LEN + 1];
+  char *object;
+  GitCommit commit;
+} PendingCommit;
+
+// Queue a commit for the walk unless it has been seen already
+static int queue_commit(const char *oid, PendingCommit **pending,
+                        int *pending_count, int *pending_capacity,
+                        char (**seen)[GIT_MAX_OID_HEX_LEN + 1], int *seen_count,
+                        int *seen_capacity) {
+  for (int i = 0; i < *seen_count; i++) {
+    if (strcmp((*seen)[i], oid) == 0)
+      return 1;
+  }
+
+  GitObjectInfo info;
+  char *object = git_batch_read_object(oid, &info);
+  if (!object)
     return 0;
+
+  if (*seen_count == *seen_capacity) {
+    int new_capacity = *seen_capacity ? *seen_capacity * 2 : 64;
+    void *grown = realloc(*seen, new_capacity * sizeof(**seen));
+    if (!grown) {
+      free(object);
+      return 0;
+    }
+    *seen = grown;
+    *seen_capacity = new_capacity;
+  }
+  if (*pending_count == *pending_capacity) {
+    int new_capacity = *pending_capacity ? *pending_capacity * 2 : 16;
+    void *grown = realloc(*pending, new_capacity * sizeof(PendingCommit));
+    if (!grown) {
+      free(object);
+      return 0;
+    }
+    *pending = grown;
+    *pending_capacity = new_capacity;
   }
 
-  int count = 0;
-  char buffer[8192];
-  char current_commit[4096] = "";
-
-  while (fgets(buffer, sizeof(buffer), fp) != NULL && count < max_commits) {
-    // Check for commit delimiter
-    if (strstr(buffer, "---END-COMMIT---")) {
-      if (strlen(current_commit) > 0) {
-        strncpy(commits[count], current_commit, 2047);
-        commits[count][2047] = '\0';
-        count++;
-        current_commit[0] = '\0';
+  PendingCommit *entry = &(*pending)[*pending_count];
+  if (strcmp(info.type, "commit") != 0 ||
+      !git_batch_parse_commit(object, info.size, &entry->commit)) {
+    free(object);
+    return 0;
+  }
+  strcpy(entry->oid, info.oid);
+  entry->object = object;
+  (*pending_count)++;
+
+  strcpy((*seen)[(*seen_count)++], info.oid);
+  return 1;
+}
+
+// Returns a malloc'd log of up to max_commits commits, each block terminated
+// by a "---END-COMMIT---" line, and stores the commit count in *commit_count.
+// The history is walked through the batch helper in committer-date order,
+// which matches `git log`'s default ordering
+char *get_branch_commits(const char *branch_name, int max_commits,
+                         int *commit_count) {
+  if (commit_count) {
+    *commit_count = 0;
+  }
+  if (!branch_name || max_commits <= 0) {
+    return NULL;
+  }
+
+  char tip_name[512];
+  snprintf(tip_name, sizeof(tip_name), "%s^{commit}", branch_name);
+  GitObjectInfo tip;
+  int tip_found = git_batch_object_info(tip_name, &tip);
+
+  char *log = NULL;
+  size_t len = 0, cap = 0;
+
+  if (tip_found == -1) {
+    log = get_branch_commits_from_log(branch_name, max_commits);
+  } else if (tip_found == 1) {
+    int ref_count = 0;
+    RefDecoration *refs = load_ref_decorations(&ref_count);
+
+    PendingCommit *pending = NULL;
+    int pending_count = 0, pending_capacity = 0;
+    char(*seen)[GIT_MAX_OID_HEX_LEN + 1] = NULL;
+    int seen_count = 0, seen_capacity = 0;
+    int emitted = 0;
+
+    queue_commit(tip.oid, &pending, &pending_count, &pending_capacity, &seen,
+                 &seen_count, &seen_capacity);
+
+    while (pending_count > 0 && emitted < max_commits) {
+      // Newest first; ties keep queue order
+      int newest = 0;
+      for (int i = 1; i < pending_count; i++) {
+        if (pending[i].commit.committer_time >
+            pending[newest].commit.committer_time)
+          newest = i;
       }
-    } else {
-      // Accumulate commit content
-      if (strlen(current_commit) + strlen(buffer) <
-          sizeof(current_commit) - 1) {
-        strcat(current_commit, buffer);
+      PendingCommit current = pending[newest];
+      memmove(&pending[newest], &pending[newest + 1],
+              (pending_count - newest - 1) * sizeof(PendingCommit));
+      pending_count--;
+
+      append_commit_block(current.oid, &current.commit, refs, ref_count, &log,
+                          &len, &cap);
+      emitted++;
+
+      for (int i = 0; i < current.commit.parent_count; i++) {
+        queue_commit(current.commit.parents[i], &pending, &pending_count,
+                     &pending_capacity, &seen, &seen_count, &seen_capacity);
       }
+      git_batch_free_commit(&current.commit);
+      free(current.object);
+    }
+
+    for (int i = 0; i < pending_count; i++) {
+      git_batch_free_commit(&pending[i].commit);
+      free(pending[i].object);
     }
+    free(pending);
+    free(seen);
+    free(refs);
   }
 
-  // Handle last commit if it doesn't end with delimiter
-  if (strlen(current_commit) > 0 && count < max_commits) {
-    strncpy(commits[count], current_commit, 2047);
-    commits[count][2047] = '\0';
-    count++;
+  if (!log || !*log) {
+    free(log);
+    return NULL;
   }
 
-  pclose(fp);
-  return count;
+  if (commit_count) {
+    for (const char *p = log; (p = strstr(p, "---END-COMMIT---")); p++) {
+      (*commit_count)++;
+    }
+  }
+
+  return log;
 }
@@ -0,0 +1,82 @@
+#include "git_patch.h"
+#include "git_command.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+void git_patch_init(GitPatch *patch) {
+  patch->data = NULL;
+  patch->len = 0;
+  patch->cap = 0;
+}
+
+void git_patch_free(GitPatch *patch) {
+  free(patch->data);
+  git_patch_init(patch);
+}
+
+static int reserve_patch(GitPatch *patch, size_t extra) {
+  if (patch->len + extra + 1 <= patch->cap)
+    return 1;
+
+  size_t new_cap = patch->cap ? patch->cap : 4096;
+  while (new_cap < patch->len + extra + 1)
+    new_cap *= 2;
+
+  char *grown = realloc(patch->data, new_cap);
+  if (!grown)
+    return 0;
+  patch->data = grown;
+  patch->cap = new_cap;
+  return 1;
+}
+
+// Append raw bytes; the buffer is kept NUL-terminated
+int git_patch_append(GitPatch *patch, const char *text, size_t len) {
+  if (!reserve_patch(patch, len))
+    return 0;
+  memcpy(patch->data + patch->len, text, len);
+  patch->len += len;
+  patch->data[patch->len] = '\0';
+  return 1;
+}
+
+int git_patch_appendf(GitPatch *patch, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int needed = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+  if (needed < 0 || !reserve_patch(patch, needed))
+    return 0;
+
+  va_start(args, fmt);
+  vsnprintf(patch->data + patch->len, needed + 1, fmt, args);
+  va_end(args);
+  patch->len += needed;
+  return 1;
+}
+
+// Feed the patch to `git apply` on its stdin; nothing touches the disk but
+// the index. Returns 1 if git accepted the patch
+int git_apply_patch(const GitPatch *patch, int flags) {
+  if (!patch || patch->len == 0)
+    return 0;
+
+  const char *argv[6];
+  int argc = 0;
+  argv[argc++] = "git";
+  argv[argc++] = "apply";
+  if (flags & GIT_APPLY_CACHED)
+    argv[argc++] = "--cached";
+  if (flags & GIT_APPLY_REVERSE)
+    argv[argc++] = "-R";
+  argv[argc++] = "-";
+  argv[argc] = NULL;
+
+  GitOutput output;
+  if (!git_command_run(argv, patch->data, patch->len, &output))
+    return 0;
+  int applied = output.status == 0;
+  git_output_free(&output);
+  return applied;
+}
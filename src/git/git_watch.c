@@ -0,0 +1,539 @@
+#include "git_watch.h"
+#include "git_command.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Kinds of watched directory
+#define WATCH_WORKTREE 0
+#define WATCH_GIT_DIR 1 // .git itself: index, HEAD, packed-refs
+#define WATCH_REFS 2    // refs/ and everything below it
+#define WATCH_LOGS 3    // logs/refs/, for the stash reflog
+
+#define WORKTREE_MASK                                                          \
+  (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |      \
+   IN_ATTRIB)
+#define GIT_DIR_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE)
+#define REFS_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_CREATE)
+
+static long long monotonic_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void git_watch_init(GitWatcher *watch) {
+  if (!watch)
+    return;
+  memset(watch, 0, sizeof(GitWatcher));
+  watch->fd = -1;
+}
+
+int git_watch_active(const GitWatcher *watch) {
+  return watch && watch->fd >= 0;
+}
+
+// Read one line of git output into buf, without the newline
+static int read_git_line(const char *cmd, char *buf, size_t size) {
+  FILE *fp = popen(cmd, "r");
+  if (!fp)
+    return 0;
+  int ok = fgets(buf, size, fp) != NULL;
+  pclose(fp);
+  if (ok)
+    buf[strcspn(buf, "\n")] = '\0';
+  return ok && buf[0];
+}
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Directories git ignores as a whole ("build/", "node_modules/"), so the
+// walk can skip them instead of watching every file in them
+static void load_ignored_dirs(GitWatcher *watch) {
+  FILE *fp = popen("git ls-files --others --ignored --exclude-standard "
+                   "--directory 2>/dev/null",
+                   "r");
+  if (!fp)
+    return;
+
+  int capacity = 0;
+  char line[PATH_MAX];
+  while (fgets(line, sizeof(line), fp)) {
+    size_t len = strcspn(line, "\n");
+    line[len] = '\0';
+    if (len == 0 || line[len - 1] != '/')
+      continue;
+
+    if (watch->ignored_count == capacity) {
+      int new_capacity = capacity ? capacity * 2 : 32;
+      char **grown =
+          realloc(watch->ignored_dirs, new_capacity * sizeof(char *));
+      if (!grown)
+        break;
+      watch->ignored_dirs = grown;
+      capacity = new_capacity;
+    }
+    char *copy = strdup(line);
+    if (!copy)
+      break;
+    watch->ignored_dirs[watch->ignored_count++] = copy;
+  }
+  pclose(fp);
+
+  if (watch->ignored_count > 1)
+    qsort(watch->ignored_dirs, watch->ignored_count, sizeof(char *),
+          compare_strings);
+}
+
+static int is_ignored_dir(const GitWatcher *watch, const char *rel_dir) {
+  return watch->ignored_count > 0 &&
+         bsearch(&rel_dir, watch->ignored_dirs, watch->ignored_count,
+                 sizeof(char *), compare_strings) != NULL;
+}
+
+static int find_dir(const GitWatcher *watch, int wd) {
+  int lo = 0, hi = watch->dir_count - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (watch->dirs[mid].wd == wd)
+      return mid;
+    if (watch->dirs[mid].wd < wd)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return -1;
+}
+
+static void free_dir(GitWatchDir *dir) {
+  free(dir->path);
+  free(dir->created_root);
+}
+
+static void remove_dir(GitWatcher *watch, int index) {
+  free_dir(&watch->dirs[index]);
+  memmove(&watch->dirs[index], &watch->dirs[index + 1],
+          (watch->dir_count - index - 1) * sizeof(GitWatchDir));
+  watch->dir_count--;
+}
+
+// Watch one directory. Returns 0 only when the kernel is out of watches,
+// in which case the caller gives up on watching
+static int add_dir(GitWatcher *watch, const char *abs_path, const char *path,
+                   int kind, const char *created_root) {
+  uint32_t mask = kind == WATCH_WORKTREE ? WORKTREE_MASK
+                  : kind == WATCH_REFS   ? REFS_MASK
+                                         : GIT_DIR_MASK;
+  int wd = inotify_add_watch(watch->fd, abs_path, mask | IN_ONLYDIR);
+  if (wd == -1)
+    return errno != ENOSPC && errno != ENOMEM;
+
+  // The same directory again (e.g. re-created) keeps its wd
+  int existing = find_dir(watch, wd);
+  if (existing != -1)
+    remove_dir(watch, existing);
+
+  if (watch->dir_count == watch->dir_capacity) {
+    int new_capacity = watch->dir_capacity ? watch->dir_capacity * 2 : 256;
+    GitWatchDir *grown =
+        realloc(watch->dirs, new_capacity * sizeof(GitWatchDir));
+    if (!grown)
+      return 0;
+    watch->dirs = grown;
+    watch->dir_capacity = new_capacity;
+  }
+
+  GitWatchDir dir;
+  dir.wd = wd;
+  dir.kind = kind;
+  dir.path = strdup(path);
+  dir.created_root = created_root ? strdup(created_root) : NULL;
+  if (!dir.path || (created_root && !dir.created_root)) {
+    free_dir(&dir);
+    return 0;
+  }
+
+  // wds are handed out in increasing order, so this is nearly always an
+  // append
+  int pos = watch->dir_count;
+  while (pos > 0 && watch->dirs[pos - 1].wd > wd)
+    pos--;
+  memmove(&watch->dirs[pos + 1], &watch->dirs[pos],
+          (watch->dir_count - pos) * sizeof(GitWatchDir));
+  watch->dirs[pos] = dir;
+  watch->dir_count++;
+  return 1;
+}
+
+static int is_directory(const char *path, const struct dirent *entry) {
+  if (entry->d_type == DT_DIR)
+    return 1;
+  if (entry->d_type != DT_UNKNOWN)
+    return 0;
+  struct stat st;
+  return lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Watch a work tree directory and everything below it that git doesn't
+// ignore. Nested repositories (submodules) are left to themselves
+static int add_worktree_tree(GitWatcher *watch, const char *rel_dir,
+                             const char *created_root) {
+  char abs_path[PATH_MAX];
+  snprintf(abs_path, sizeof(abs_path), "%s/%s", watch->top, rel_dir);
+  if (!add_dir(watch, abs_path, rel_dir, WATCH_WORKTREE, created_root))
+    return 0;
+
+  DIR *dir = opendir(abs_path);
+  if (!dir)
+    return 1;
+
+  int ok = 1;
+  struct dirent *entry;
+  while (ok && (entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+        strcmp(entry->d_name, ".git") == 0)
+      continue;
+
+    char child_abs[PATH_MAX], child_rel[PATH_MAX], nested_git[PATH_MAX];
+    snprintf(child_abs, sizeof(child_abs), "%s%s", abs_path, entry->d_name);
+    if (!is_directory(child_abs, entry))
+      continue;
+    snprintf(child_rel, sizeof(child_rel), "%s%s/", rel_dir, entry->d_name);
+    snprintf(nested_git, sizeof(nested_git), "%s/.git", child_abs);
+    if (is_ignored_dir(watch, child_rel) || access(nested_git, F_OK) == 0)
+      continue;
+
+    ok = add_worktree_tree(watch, child_rel, created_root);
+  }
+  closedir(dir);
+  return ok;
+}
+
+static int add_refs_tree(GitWatcher *watch, const char *abs_dir) {
+  if (!add_dir(watch, abs_dir, abs_dir, WATCH_REFS, NULL))
+    return 0;
+
+  DIR *dir = opendir(abs_dir);
+  if (!dir)
+    return 1;
+
+  int ok = 1;
+  struct dirent *entry;
+  while (ok && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.')
+      continue;
+    char child[PATH_MAX];
+    snprintf(child, sizeof(child), "%s%s/", abs_dir, entry->d_name);
+    if (is_directory(child, entry))
+      ok = add_refs_tree(watch, child);
+  }
+  closedir(dir);
+  return ok;
+}
+
+// Start watching the repository the shell is in. Returns 0 when there is
+// no repository or inotify can't cover it; the viewer then keeps rescanning
+// after fetches as before
+int git_watch_start(GitWatcher *watch) {
+  if (!watch)
+    return 0;
+  git_watch_init(watch);
+
+  if (!read_git_line("git rev-parse --show-toplevel 2>/dev/null", watch->top,
+                     sizeof(watch->top)) ||
+      !read_git_line("git rev-parse --absolute-git-dir 2>/dev/null",
+                     watch->git_dir, sizeof(watch->git_dir)))
+    return 0;
+  if (!read_git_line("git rev-parse --path-format=absolute --git-common-dir "
+                     "2>/dev/null",
+                     watch->common_dir, sizeof(watch->common_dir)))
+    snprintf(watch->common_dir, sizeof(watch->common_dir), "%s",
+             watch->git_dir);
+
+  watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch->fd == -1)
+    return 0;
+
+  load_ignored_dirs(watch);
+
+  char dir[PATH_MAX];
+  int ok = add_worktree_tree(watch, "", NULL);
+
+  snprintf(dir, sizeof(dir), "%s/", watch->git_dir);
+  ok = ok && add_dir(watch, dir, dir, WATCH_GIT_DIR, NULL);
+  if (ok && strcmp(watch->common_dir, watch->git_dir) != 0) {
+    snprintf(dir, sizeof(dir), "%s/", watch->common_dir);
+    ok = add_dir(watch, dir, dir, WATCH_GIT_DIR, NULL);
+  }
+  snprintf(dir, sizeof(dir), "%s/refs/", watch->common_dir);
+  ok = ok && add_refs_tree(watch, dir);
+  snprintf(dir, sizeof(dir), "%s/logs/refs/", watch->common_dir);
+  ok = ok && add_dir(watch, dir, dir, WATCH_LOGS, NULL);
+
+  if (!ok) {
+    git_watch_stop(watch);
+    return 0;
+  }
+  return 1;
+}
+
+void git_watch_stop(GitWatcher *watch) {
+  if (!watch)
+    return;
+
+  if (watch->fd >= 0)
+    close(watch->fd);
+  for (int i = 0; i < watch->dir_count; i++)
+    free_dir(&watch->dirs[i]);
+  free(watch->dirs);
+  for (int i = 0; i < watch->ignored_count; i++)
+    free(watch->ignored_dirs[i]);
+  free(watch->ignored_dirs);
+  for (int i = 0; i < watch->path_count; i++)
+    free(watch->paths[i]);
+  git_watch_init(watch);
+}
+
+static void note_change(GitWatcher *watch, int flag) {
+  long long now = monotonic_ms();
+  if (!watch->changes)
+    watch->first_change_ms = now;
+  watch->last_change_ms = now;
+  watch->changes |= flag;
+}
+
+static void drop_paths(GitWatcher *watch) {
+  for (int i = 0; i < watch->path_count; i++)
+    free(watch->paths[i]);
+  watch->path_count = 0;
+}
+
+static void note_path(GitWatcher *watch, const char *path) {
+  note_change(watch, GIT_WATCH_WORKTREE);
+  if (watch->changes & GIT_WATCH_RESCAN)
+    return;
+
+  for (int i = 0; i < watch->path_count; i++) {
+    if (strcmp(watch->paths[i], path) == 0)
+      return;
+  }
+
+  char *copy = NULL;
+  if (watch->path_count == GIT_WATCH_MAX_PATHS || !(copy = strdup(path))) {
+    drop_paths(watch);
+    note_change(watch, GIT_WATCH_RESCAN);
+    return;
+  }
+  watch->paths[watch->path_count++] = copy;
+}
+
+static int is_lock_file(const char *name) {
+  size_t len = strlen(name);
+  return len >= 5 && strcmp(name + len - 5, ".lock") == 0;
+}
+
+// A directory appeared in the work tree. git lists a new untracked
+// directory as "dir/", so changes anywhere below it are reported against
+// the topmost new directory
+static void worktree_dir_created(GitWatcher *watch, const GitWatchDir *parent,
+                                 const char *name) {
+  char rel_dir[PATH_MAX];
+  snprintf(rel_dir, sizeof(rel_dir), "%s%s/", parent->path, name);
+
+  char root[PATH_MAX];
+  if (parent->created_root) {
+    snprintf(root, sizeof(root), "%s", parent->created_root);
+  } else {
+    // Don't follow a freshly created ignored directory (a build output,
+    // node_modules) down. The name is whatever was created, so it goes to
+    // git as an argument, never through a shell
+    const char *argv[] = {"git", "-C", watch->top, "check-ignore", "-q", "--",
+                          rel_dir, NULL};
+    GitOutput output;
+    if (git_command_run(argv, NULL, 0, &output)) {
+      int ignored = output.status == 0;
+      git_output_free(&output);
+      if (ignored)
+        return;
+    }
+    snprintf(root, sizeof(root), "%s", rel_dir);
+  }
+
+  if (!add_worktree_tree(watch, rel_dir, root))
+    note_change(watch, GIT_WATCH_RESCAN);
+  note_path(watch, root);
+}
+
+static void handle_event(GitWatcher *watch, const struct inotify_event *event) {
+  if (event->mask & IN_Q_OVERFLOW) {
+    drop_paths(watch);
+    note_change(watch, GIT_WATCH_RESCAN);
+    return;
+  }
+
+  int index = find_dir(watch, event->wd);
+  if (index == -1)
+    return;
+  if (event->mask & IN_IGNORED) {
+    remove_dir(watch, index);
+    return;
+  }
+  if (event->len == 0 || event->name[0] == '\0')
+    return;
+
+  // The entry may move while new watches are added below
+  GitWatchDir dir = watch->dirs[index];
+  const char *name = event->name;
+  int is_dir = (event->mask & IN_ISDIR) != 0;
+
+  switch (dir.kind) {
+  case WATCH_WORKTREE: {
+    if (strcmp(name, ".git") == 0)
+      return;
+
+    if (is_dir && (event->mask & (IN_MOVED_FROM | IN_MOVED_TO))) {
+      // A directory moved as a whole: no per-file events follow
+      if (event->mask & IN_MOVED_TO) {
+        char rel_dir[PATH_MAX];
+        snprintf(rel_dir, sizeof(rel_dir), "%s%s/", dir.path, name);
+        add_worktree_tree(watch, rel_dir, dir.created_root);
+      }
+      drop_paths(watch);
+      note_change(watch, GIT_WATCH_RESCAN);
+      return;
+    }
+    if (is_dir && (event->mask & IN_DELETE)) {
+      // Status of what was in it can't be asked for path by path
+      drop_paths(watch);
+      note_change(watch, GIT_WATCH_RESCAN);
+      return;
+    }
+    if (is_dir && (event->mask & IN_CREATE)) {
+      worktree_dir_created(watch, &dir, name);
+      return;
+    }
+
+    char path[PATH_MAX];
+    if (dir.created_root) {
+      snprintf(path, sizeof(path), "%s", dir.created_root);
+    } else {
+      snprintf(path, sizeof(path), "%s%s", dir.path, name);
+    }
+    note_path(watch, path);
+    return;
+  }
+
+  case WATCH_GIT_DIR:
+    if (strcmp(name, "index") == 0) {
+      // Our own git status refreshes the index; only outside writes count
+      struct stat st;
+      char index_path[PATH_MAX];
+      snprintf(index_path, sizeof(index_path), "%s/index", watch->git_dir);
+      int exists = stat(index_path, &st) == 0;
+      if (watch->index_stat_valid && exists &&
+          st.st_mtim.tv_sec == watch->index_stat.st_mtim.tv_sec &&
+          st.st_mtim.tv_nsec == watch->index_stat.st_mtim.tv_nsec &&
+          st.st_size == watch->index_stat.st_size &&
+          st.st_ino == watch->index_stat.st_ino)
+        return;
+      note_change(watch, GIT_WATCH_INDEX);
+    } else if (strcmp(name, "HEAD") == 0 ||
+               strcmp(name, "packed-refs") == 0) {
+      note_change(watch, GIT_WATCH_REFS);
+    }
+    return;
+
+  case WATCH_REFS:
+    if (is_lock_file(name))
+      return;
+    if (is_dir) {
+      if (event->mask & IN_CREATE) {
+        char child[PATH_MAX];
+        snprintf(child, sizeof(child), "%s%s/", dir.path, name);
+        add_refs_tree(watch, child);
+      }
+      return;
+    }
+    {
+      char stash_dir[PATH_MAX];
+      snprintf(stash_dir, sizeof(stash_dir), "%s/refs/", watch->common_dir);
+      note_change(watch, strcmp(dir.path, stash_dir) == 0 &&
+                                 strcmp(name, "stash") == 0
+                             ? GIT_WATCH_STASH
+                             : GIT_WATCH_REFS);
+    }
+    return;
+
+  case WATCH_LOGS:
+    // Dropping an older stash entry only rewrites the reflog
+    if (strcmp(name, "stash") == 0)
+      note_change(watch, GIT_WATCH_STASH);
+    return;
+  }
+}
+
+// Drain pending inotify events. Returns 1 if any of them recorded a change
+int git_watch_read(GitWatcher *watch) {
+  if (!git_watch_active(watch))
+    return 0;
+
+  int before = watch->changes;
+  int before_paths = watch->path_count;
+  char buf[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  for (;;) {
+    ssize_t len = read(watch->fd, buf, sizeof(buf));
+    if (len == -1 && errno == EINTR)
+      continue;
+    if (len <= 0)
+      break;
+
+    for (char *ptr = buf; ptr < buf + len;) {
+      const struct inotify_event *event = (const struct inotify_event *)ptr;
+      handle_event(watch, event);
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  return watch->changes != before || watch->path_count != before_paths;
+}
+
+// Milliseconds until the recorded changes should be handled: 0 if due now,
+// -1 if nothing is pending
+int git_watch_ms_until_ready(const GitWatcher *watch) {
+  if (!watch || !watch->changes)
+    return -1;
+
+  long long due = watch->last_change_ms + GIT_WATCH_SETTLE_MS;
+  if (due > watch->first_change_ms + GIT_WATCH_MAX_DELAY_MS)
+    due = watch->first_change_ms + GIT_WATCH_MAX_DELAY_MS;
+
+  long long remaining = due - monotonic_ms();
+  return remaining > 0 ? (int)remaining : 0;
+}
+
+// Forget changes the caller has caught up on
+void git_watch_clear(GitWatcher *watch, int flags) {
+  if (!watch)
+    return;
+
+  if (flags & (GIT_WATCH_WORKTREE | GIT_WATCH_RESCAN))
+    drop_paths(watch);
+  watch->changes &= ~flags;
+}
+
+// Remember the index as it is after a status we ran, so the index refresh
+// git status does along the way isn't taken for an outside change
+void git_watch_note_index(GitWatcher *watch) {
+  if (!git_watch_active(watch))
+    return;
+
+  char index_path[PATH_MAX];
+  snprintf(index_path, sizeof(index_path), "%s/index", watch->git_dir);
+  watch->index_stat_valid = stat(index_path, &watch->index_stat) == 0;
+}
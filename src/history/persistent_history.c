@@ -1,8 +1,10 @@
 
 #include "persistent_history.h"
+#include "startup_profile.h"
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +27,29 @@ static int frequency_capacity = 0;
 static char history_file_path[PATH_MAX];
 static char frequency_file_path[PATH_MAX];
 
+// The files are read on a thread started by init_persistent_history, so
+// the first prompt doesn't wait for them. Everything that touches the
+// entries calls wait_for_history first
+static pthread_t history_loader;
+static int history_loader_running = 0;
+
+static void *load_history_files(void *arg) {
+  (void)arg;
+  struct timespec mark;
+  startup_profile_mark(&mark);
+  load_history_from_file();
+  load_frequencies_from_file();
+  startup_profile_deferred("history", &mark);
+  return NULL;
+}
+
+void wait_for_history(void) {
+  if (!history_loader_running)
+    return;
+  pthread_join(history_loader, NULL);
+  history_loader_running = 0;
+}
+
 void init_persistent_history(void) {
   // Allocate initial history capacity
   history_capacity = PERSISTENT_HISTORY_SIZE;
@@ -73,12 +98,15 @@ void init_persistent_history(void) {
     strcpy(frequency_file_path, ".lsh_frequency");
   }
 
-  // Load history and frequency data
-  load_history_from_file();
-  load_frequencies_from_file();
+  // Load history and frequency data in the background
+  if (pthread_create(&history_loader, NULL, load_history_files, NULL) == 0)
+    history_loader_running = 1;
+  else
+    load_history_files(NULL);
 }
 
 char *get_most_recent_history_match(const char *prefix) {
+  wait_for_history();
   if (!prefix || !history_entries || strlen(prefix) == 0) {
     return NULL;
   }
@@ -135,12 +163,14 @@ void cleanup_persistent_history(void) {
 }
 
 void shutdown_persistent_history(void) {
+  wait_for_history();
   save_history_to_file();
   save_frequencies_to_file();
   cleanup_persistent_history();
 }
 
 void add_to_history(const char *command) {
+  wait_for_history();
   if (!command || !*command || !history_entries) {
     return; // Skip empty commands
   }
@@ -330,15 +360,20 @@ void load_frequencies_from_file(void) {
 }
 
 PersistentHistoryEntry *get_history_entry(int index) {
+  wait_for_history();
   if (index < 0 || index >= history_size) {
     return NULL;
   }
   return &history_entries[index];
 }
 
-int get_history_count(void) { return history_size; }
+int get_history_count(void) {
+  wait_for_history();
+  return history_size;
+}
 
 char *find_best_frequency_match(const char *prefix) {
+  wait_for_history();
   if (!prefix || !*prefix || !command_frequencies) {
     return NULL;
   }
@@ -365,6 +400,7 @@ char *find_best_frequency_match(const char *prefix) {
 }
 
 void debug_print_frequencies(void) {
+  wait_for_history();
   printf("Command Frequencies:\n");
   for (int i = 0; i < frequency_count; i++) {
     printf("%3d: %s (%d)\n", i + 1, command_frequencies[i].command,
@@ -407,6 +443,7 @@ char *_stristr(const char *haystack, const char *needle) {
 }
 
 char *get_previous_history_entry(int *position) {
+  wait_for_history();
   if (!history_entries || history_size == 0) {
     return NULL;
   }
@@ -426,6 +463,7 @@ char *get_previous_history_entry(int *position) {
 }
 
 char *get_next_history_entry(int *position) {
+  wait_for_history();
   if (!history_entries || history_size == 0 || *position < 0) {
     return NULL;
   }
@@ -443,6 +481,7 @@ char *get_next_history_entry(int *position) {
 }
 
 char **get_matching_history_entries(const char *prefix) {
+  wait_for_history();
   if (!prefix || !history_entries) {
     return NULL;
   }
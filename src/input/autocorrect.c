@@ -1,74 +1,82 @@
 
 #include "autocorrect.h"
 #include "builtins.h"
-
-int levenshtein_distance(const char *s1, const char *s2) {
-  int len1 = strlen(s1);
-  int len2 = strlen(s2);
-
-  // Create a matrix to store distances
-  int **matrix = (int **)malloc((len1 + 1) * sizeof(int *));
-  if (!matrix)
-    return -1;
-
-  for (int i = 0; i <= len1; i++) {
-    matrix[i] = (int *)malloc((len2 + 1) * sizeof(int));
-    if (!matrix[i]) {
-      for (int j = 0; j < i; j++) {
-        free(matrix[j]);
-      }
-      free(matrix);
-      return -1;
-    }
-  }
-
-  // Initialize the matrix
-  for (int i = 0; i <= len1; i++) {
-    matrix[i][0] = i;
-  }
-  for (int j = 0; j <= len2; j++) {
-    matrix[0][j] = j;
-  }
-
-  // Fill the matrix
-  for (int i = 1; i <= len1; i++) {
-    for (int j = 1; j <= len2; j++) {
-      int cost = (s1[i - 1] == s2[j - 1]) ? 0 : 1;
-      matrix[i][j] = min3(matrix[i - 1][j] + 1,       // deletion
-                          matrix[i][j - 1] + 1,       // insertion
-                          matrix[i - 1][j - 1] + cost // substitution
-      );
-    }
-  }
-
-  // Get the result and free the matrix
-  int result = matrix[len1][len2];
-  for (int i = 0; i <= len1; i++) {
-    free(matrix[i]);
-  }
-  free(matrix);
-
-  return result;
-}
-
-int min3(int a, int b, int c) {
-  int min = a;
-  if (b < min)
-    min = b;
-  if (c < min)
-    min = c;
-  return min;
-}
+#include "command_index.h"
+#include "persistent_history.h"
 
 void init_autocorrect(void) {
   // No initialization required currently
 }
 
-void shutdown_autocorrect(void) {
-  // No cleanup required currently
+void shutdown_autocorrect(void) { command_index_free(); }
+
+// Largest number of edits a suggestion may be away from what was typed
+#define CORRECTION_BOUND 2
+
+// Best suggestion seen so far. Ties on distance go to the command used
+// most often, then to builtins and aliases over PATH programs
+typedef struct {
+  char name[256];
+  int distance;
+  int weight;
+  int preferred;
+} Correction;
+
+typedef struct {
+  const char *command;
+  Correction best;
+} CorrectionSearch;
+
+// Times a command was run, summed over history lines that start with it
+static int history_weight(const char *name) {
+  size_t len = strlen(name);
+  int weight = 0;
+  for (int i = 0; i < frequency_count; i++) {
+    const char *line = command_frequencies[i].command;
+    if (strncmp(line, name, len) == 0 &&
+        (line[len] == '\0' || line[len] == ' '))
+      weight += command_frequencies[i].count;
+  }
+  return weight;
 }
 
+static int better_than_best(const Correction *best, int distance, int weight,
+                            int preferred) {
+  if (!best->name[0] || distance < best->distance)
+    return 1;
+  if (distance > best->distance)
+    return 0;
+  if (weight != best->weight)
+    return weight > best->weight;
+  return preferred > best->preferred;
+}
 
+// Offered by the index for each name within the current best distance.
+// Names that no longer resolve are skipped; the returned bound lets the
+// search stop looking for anything worse than the best so far
+static int consider(const char *name, int sources, int distance,
+                    void *context) {
+  CorrectionSearch *search = context;
+  Correction *best = &search->best;
+  int bound = best->name[0] ? best->distance : CORRECTION_BOUND;
+
+  if (strcmp(name, search->command) == 0 || strlen(name) >= sizeof(best->name))
+    return bound;
+
+  int weight = history_weight(name);
+  int preferred =
+      (sources & (COMMAND_SOURCE_BUILTIN | COMMAND_SOURCE_ALIAS)) != 0;
+  if (!better_than_best(best, distance, weight, preferred))
+    return bound;
+  if (!(sources & COMMAND_SOURCE_BUILTIN) && !is_valid_command(name))
+    return bound;
+
+  strcpy(best->name, name);
+  best->distance = distance;
+  best->weight = weight;
+  best->preferred = preferred;
+  return distance;
+}
 
 char **check_for_corrections(char **args) {
   if (!args || !args[0]) {
@@ -88,45 +96,22 @@ char **check_for_corrections(char **args) {
     return NULL;
   }
 
-  // List of common commands to check against
-  const char *common_commands[] = {
-      "ls",     "cd",      "grep",     "find",   "cat",        "mv",
-      "cp",     "rm",      "mkdir",    "rmdir",  "chmod",      "chown",
-      "ps",     "top",     "df",       "du",     "free",       "mount",
-      "umount", "tar",     "zip",      "unzip",  "ssh",        "scp",
-      "ping",   "netstat", "ifconfig", "route",  "traceroute", "wget",
-      "curl",   "apt",     "apt-get",  "yum",    "dnf",        "pacman",
-      "git",    "make",    "gcc",      "g++",    "python",     "python3",
-      "node",   "npm",     "vim",      "nano",   "history",    "clear",
-      "exit",   "alias",   "man",      "help",   "touch",      "echo",
-      "pwd",    "sudo",    "shutdown", "reboot", NULL};
-
-  // Check built-in commands too
-  int best_distance = 3; // Maximum edit distance to consider a correction
-  const char *best_match = NULL;
-
-  // First check among built-in commands
-  for (int i = 0; i < lsh_num_builtins(); i++) {
-    int distance = levenshtein_distance(command, builtin_str[i]);
-    if (distance < best_distance) {
-      best_distance = distance;
-      best_match = builtin_str[i];
-    }
+  EditPattern pattern;
+  if (!edit_pattern_init(&pattern, command)) {
+    return NULL;
   }
 
-  // Then check common commands
-  for (int i = 0; common_commands[i] != NULL; i++) {
-    int distance = levenshtein_distance(command, common_commands[i]);
-    if (distance < best_distance) {
-      best_distance = distance;
-      best_match = common_commands[i];
-    }
-  }
+  CorrectionSearch search;
+  search.command = command;
+  search.best.name[0] = '\0';
+
+  command_index_refresh();
+  command_index_search(&pattern, CORRECTION_BOUND, consider, &search);
 
   // If we found a good match, suggest it
-  if (best_match) {
-    printf("Command '%s' not found. Did you mean '%s'?\n", command, best_match);
-    // No longer waiting for input - just return NULL
+  if (search.best.name[0]) {
+    printf("Command '%s' not found. Did you mean '%s'?\n", command,
+           search.best.name);
   }
 
   return NULL;
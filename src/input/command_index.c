@@ -0,0 +1,288 @@
+#include "command_index.h"
+#include "aliases.h"
+#include "builtins.h"
+#include "name_index.h"
+#include "persistent_history.h"
+#include "store_file.h"
+#include <dirent.h>
+
+// One name in the BK-tree. Children hang off their parent by the edit
+// distance between the two names, so a search for names within k of a
+// word only descends into children whose edge is within k of the
+// distance to the parent
+typedef struct {
+  char *name;
+  int first_child;
+  int next_sibling;
+  unsigned char edge;     // Distance to the parent
+  unsigned char max_edge; // Largest edge among the children
+  unsigned char sources;  // COMMAND_SOURCE_* bits
+} CommandIndexNode;
+
+// A PATH directory as it was when its names were added
+typedef struct {
+  char *path;
+  StoreFileStamp stamp;
+  int scanned;
+} CommandIndexDir;
+
+static CommandIndexNode *nodes = NULL;
+static int node_count = 0;
+static int node_capacity = 0;
+static NameIndex node_names; // Name to node, for adding sources to a name
+
+static CommandIndexDir *dirs = NULL;
+static int dir_count = 0;
+static int dir_capacity = 0;
+
+static int indexed_frequencies = 0;
+
+static int *search_stack = NULL;
+static int search_capacity = 0;
+
+static const char *node_key(const void *entries, int i) {
+  return ((const CommandIndexNode *)entries)[i].name;
+}
+
+static void add_name(const char *name, int source) {
+  size_t len = strlen(name);
+  if (len == 0 || len > EDIT_PATTERN_MAX)
+    return;
+
+  int existing = name_index_find(&node_names, name, nodes, node_key);
+  if (existing >= 0) {
+    nodes[existing].sources |= source;
+    return;
+  }
+
+  if (node_count >= node_capacity) {
+    int capacity = node_capacity ? node_capacity * 2 : 256;
+    CommandIndexNode *grown =
+        realloc(nodes, capacity * sizeof(CommandIndexNode));
+    if (!grown)
+      return;
+    nodes = grown;
+    node_capacity = capacity;
+  }
+
+  CommandIndexNode *node = &nodes[node_count];
+  node->name = strdup(name);
+  if (!node->name)
+    return;
+  if (!name_index_insert(&node_names, name, node_count)) {
+    free(node->name);
+    return;
+  }
+  node->first_child = -1;
+  node->next_sibling = -1;
+  node->edge = 0;
+  node->max_edge = 0;
+  node->sources = source;
+  int added = node_count++;
+  if (added == 0)
+    return;
+
+  // Walk down from the root along edges equal to the distance until a
+  // node has no child at that distance. Names are at most
+  // EDIT_PATTERN_MAX bytes, so that bound always gives the exact distance
+  EditPattern pattern;
+  edit_pattern_init(&pattern, name);
+  int current = 0;
+  for (;;) {
+    int distance = edit_distance_bounded(&pattern, nodes[current].name,
+                                         EDIT_PATTERN_MAX);
+    int child = nodes[current].first_child;
+    while (child >= 0 && nodes[child].edge != distance)
+      child = nodes[child].next_sibling;
+
+    if (child < 0) {
+      nodes[added].edge = distance;
+      nodes[added].next_sibling = nodes[current].first_child;
+      nodes[current].first_child = added;
+      if (distance > nodes[current].max_edge)
+        nodes[current].max_edge = distance;
+      return;
+    }
+    current = child;
+  }
+}
+
+static void add_directory(const char *path) {
+  DIR *d = opendir(path);
+  if (!d)
+    return;
+
+  char full_path[PATH_MAX];
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    if (entry->d_name[0] == '.')
+      continue;
+    int known = name_index_find(&node_names, entry->d_name, nodes, node_key);
+    if (known >= 0 && (nodes[known].sources & COMMAND_SOURCE_PATH))
+      continue;
+
+    snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+    if (access(full_path, X_OK) == 0)
+      add_name(entry->d_name, COMMAND_SOURCE_PATH);
+  }
+  closedir(d);
+}
+
+static CommandIndexDir *find_directory(const char *path) {
+  for (int i = 0; i < dir_count; i++) {
+    if (strcmp(dirs[i].path, path) == 0)
+      return &dirs[i];
+  }
+  return NULL;
+}
+
+// Scan PATH directories that are new, e.g. after PATH was changed, or
+// whose contents changed since they were last read. A directory's mtime
+// moves whenever an entry is added or removed, so one stat() per
+// directory is all an unchanged PATH costs
+static void refresh_path(void) {
+  const char *path = getenv("PATH");
+  if (!path)
+    path = "";
+
+  char dir[PATH_MAX];
+  const char *p = path;
+  while (*p) {
+    size_t len = strcspn(p, ":");
+    if (len > 0 && len < sizeof(dir)) {
+      memcpy(dir, p, len);
+      dir[len] = '\0';
+
+      CommandIndexDir *known = find_directory(dir);
+      if (!known && dir_count >= dir_capacity) {
+        int capacity = dir_capacity ? dir_capacity * 2 : 16;
+        CommandIndexDir *grown =
+            realloc(dirs, capacity * sizeof(CommandIndexDir));
+        if (grown) {
+          dirs = grown;
+          dir_capacity = capacity;
+        }
+      }
+      if (!known && dir_count < dir_capacity) {
+        known = &dirs[dir_count];
+        known->path = strdup(dir);
+        known->scanned = 0;
+        if (known->path)
+          dir_count++;
+        else
+          known = NULL;
+      }
+
+      if (known &&
+          (!known->scanned || store_file_changed(dir, &known->stamp))) {
+        store_file_stamp(dir, &known->stamp);
+        known->scanned = 1;
+        add_directory(dir);
+      }
+    }
+    p += len;
+    if (*p == ':')
+      p++;
+  }
+}
+
+// Bring the index up to date. Names are only ever added: ones that no
+// longer resolve, like a removed alias or a program deleted from PATH,
+// stay in the tree and are filtered out by the caller
+void command_index_refresh(void) {
+  if (node_count == 0) {
+    name_index_init(&node_names, 0);
+    for (int i = 0; i < lsh_num_builtins(); i++)
+      add_name(builtin_str[i], COMMAND_SOURCE_BUILTIN);
+  }
+
+  int cursor = 0;
+  const char *alias;
+  while ((alias = next_alias_name(&cursor)) != NULL)
+    add_name(alias, COMMAND_SOURCE_ALIAS);
+
+  // New commands are appended to the frequency table; a reload starts over
+  wait_for_history();
+  if (frequency_count < indexed_frequencies)
+    indexed_frequencies = 0;
+  char word[EDIT_PATTERN_MAX + 1];
+  for (int i = indexed_frequencies; i < frequency_count; i++) {
+    const char *line = command_frequencies[i].command;
+    size_t len = strcspn(line, " ");
+    if (len == 0 || len >= sizeof(word))
+      continue;
+    memcpy(word, line, len);
+    word[len] = '\0';
+    add_name(word, COMMAND_SOURCE_HISTORY);
+  }
+  indexed_frequencies = frequency_count;
+
+  refresh_path();
+}
+
+static int push_node(int *depth, int node) {
+  if (*depth >= search_capacity) {
+    int capacity = search_capacity ? search_capacity * 2 : 64;
+    int *grown = realloc(search_stack, capacity * sizeof(int));
+    if (!grown)
+      return 0;
+    search_stack = grown;
+    search_capacity = capacity;
+  }
+  search_stack[(*depth)++] = node;
+  return 1;
+}
+
+// Visit every name within bound of the pattern. The distance to a node
+// only needs to be exact up to bound + its largest edge: past that, no
+// child can be close enough, so edit_distance_bounded stops early there.
+// Returns the final bound
+int command_index_search(const EditPattern *pattern, int bound,
+                         CommandIndexVisit visit, void *context) {
+  if (node_count == 0)
+    return bound;
+
+  int depth = 0;
+  push_node(&depth, 0);
+  while (depth > 0) {
+    const CommandIndexNode *node = &nodes[search_stack[--depth]];
+    int limit = bound + node->max_edge;
+    int distance = edit_distance_bounded(pattern, node->name, limit);
+
+    if (distance <= bound)
+      bound = visit(node->name, node->sources, distance, context);
+    if (distance > limit)
+      continue;
+
+    for (int child = node->first_child; child >= 0;
+         child = nodes[child].next_sibling) {
+      int edge = nodes[child].edge;
+      if (edge >= distance - bound && edge <= distance + bound &&
+          !push_node(&depth, child))
+        return bound;
+    }
+  }
+  return bound;
+}
+
+void command_index_free(void) {
+  for (int i = 0; i < node_count; i++)
+    free(nodes[i].name);
+  free(nodes);
+  nodes = NULL;
+  node_count = 0;
+  node_capacity = 0;
+  name_index_free(&node_names);
+
+  for (int i = 0; i < dir_count; i++)
+    free(dirs[i].path);
+  free(dirs);
+  dirs = NULL;
+  dir_count = 0;
+  dir_capacity = 0;
+  indexed_frequencies = 0;
+
+  free(search_stack);
+  search_stack = NULL;
+  search_capacity = 0;
+}
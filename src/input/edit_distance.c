@@ -0,0 +1,58 @@
+#include "edit_distance.h"
+#include <string.h>
+
+// Returns 0 when the word is empty or longer than EDIT_PATTERN_MAX
+int edit_pattern_init(EditPattern *pattern, const char *word) {
+  size_t length = strlen(word);
+  if (length == 0 || length > EDIT_PATTERN_MAX)
+    return 0;
+
+  memset(pattern->peq, 0, sizeof(pattern->peq));
+  for (size_t i = 0; i < length; i++)
+    pattern->peq[(unsigned char)word[i]] |= (uint64_t)1 << i;
+  pattern->length = (int)length;
+  return 1;
+}
+
+// Levenshtein distance between the pattern and candidate, or bound + 1 as
+// soon as it is certain to exceed bound. Myers' bit-vector algorithm in
+// Hyyrö's form for whole-string distance: each candidate character updates
+// a column of the DP matrix, encoded as vertical +1/-1 deltas, in a few
+// word operations. No allocation; the column lives in four registers
+int edit_distance_bounded(const EditPattern *pattern, const char *candidate,
+                          int bound) {
+  int m = pattern->length;
+  int n = (int)strlen(candidate);
+  if (n - m > bound || m - n > bound)
+    return bound + 1;
+
+  uint64_t last = (uint64_t)1 << (m - 1);
+  uint64_t pv = ~(uint64_t)0;
+  uint64_t mv = 0;
+  int score = m; // Distance from the whole pattern to candidate[0..j)
+
+  for (int j = 0; j < n; j++) {
+    uint64_t eq = pattern->peq[(unsigned char)candidate[j]];
+    uint64_t xv = eq | mv;
+    uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+    uint64_t ph = mv | ~(xh | pv);
+    uint64_t mh = pv & xh;
+
+    if (ph & last)
+      score++;
+    else if (mh & last)
+      score--;
+
+    // The top row of the matrix grows by one per column, so a +1 shifts in
+    ph = (ph << 1) | 1;
+    mh <<= 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+
+    // Each remaining column can lower the score by at most one
+    if (score - (n - j - 1) > bound)
+      return bound + 1;
+  }
+
+  return score <= bound ? score : bound + 1;
+}
@@ -0,0 +1,138 @@
+#include "line_buffer.h"
+#include "text_width.h"
+#include <stdlib.h>
+#include <string.h>
+
+int line_buffer_init(LineBuffer *line) {
+  line->capacity = LSH_RL_BUFSIZE;
+  line->data = malloc(line->capacity + 1);
+  if (!line->data)
+    return 0;
+
+  line->gap_start = 0;
+  line->gap_end = line->capacity;
+  line->data[0] = '\0';
+  line->data[line->capacity] = '\0';
+  return 1;
+}
+
+void line_buffer_free(LineBuffer *line) {
+  free(line->data);
+  line->data = NULL;
+  line->capacity = 0;
+  line->gap_start = 0;
+  line->gap_end = 0;
+}
+
+// Make room for len more bytes, keeping one byte of gap for the NUL that
+// ends the text before the cursor. Capacity doubles, so inserts are
+// amortised O(1)
+static int reserve_gap(LineBuffer *line, size_t len) {
+  if (line->gap_end - line->gap_start > len)
+    return 1;
+
+  size_t after = line->capacity - line->gap_end;
+  size_t needed = line->gap_start + len + 1 + after;
+  size_t new_capacity = line->capacity * 2;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  char *grown = realloc(line->data, new_capacity + 1);
+  if (!grown)
+    return 0;
+
+  memmove(grown + new_capacity - after, grown + line->gap_end, after + 1);
+  line->data = grown;
+  line->gap_end = new_capacity - after;
+  line->capacity = new_capacity;
+  return 1;
+}
+
+int line_buffer_insert(LineBuffer *line, const char *text, size_t len) {
+  if (!reserve_gap(line, len))
+    return 0;
+  memcpy(line->data + line->gap_start, text, len);
+  line->gap_start += len;
+  line->data[line->gap_start] = '\0';
+  return 1;
+}
+
+// Replace the whole line; the cursor ends up after it
+int line_buffer_set(LineBuffer *line, const char *text) {
+  line->gap_start = 0;
+  line->gap_end = line->capacity;
+  line->data[0] = '\0';
+  return line_buffer_insert(line, text, strlen(text));
+}
+
+// Replace the text before the cursor, e.g. with an accepted completion
+int line_buffer_set_before(LineBuffer *line, const char *text) {
+  line->gap_start = 0;
+  line->data[0] = '\0';
+  return line_buffer_insert(line, text, strlen(text));
+}
+
+// Backspace: remove the grapheme cluster before the cursor
+int line_buffer_delete_before(LineBuffer *line) {
+  if (line->gap_start == 0)
+    return 0;
+  line->gap_start = grapheme_prev(line->data, line->gap_start);
+  line->data[line->gap_start] = '\0';
+  return 1;
+}
+
+// Move the cursor one grapheme cluster; the bytes crossed move to the
+// other side of the gap
+int line_buffer_move_left(LineBuffer *line) {
+  if (line->gap_start == 0)
+    return 0;
+
+  size_t start = grapheme_prev(line->data, line->gap_start);
+  size_t len = line->gap_start - start;
+  line->gap_end -= len;
+  memmove(line->data + line->gap_end, line->data + start, len);
+  line->gap_start = start;
+  line->data[line->gap_start] = '\0';
+  return 1;
+}
+
+int line_buffer_move_right(LineBuffer *line) {
+  if (line->gap_end == line->capacity)
+    return 0;
+
+  size_t end = grapheme_next(line->data + line->gap_end,
+                             line->capacity - line->gap_end, 0);
+  memmove(line->data + line->gap_start, line->data + line->gap_end, end);
+  line->gap_start += end;
+  line->gap_end += end;
+  line->data[line->gap_start] = '\0';
+  return 1;
+}
+
+const char *line_buffer_before(const LineBuffer *line) {
+  return line->data;
+}
+
+const char *line_buffer_after(const LineBuffer *line) {
+  return line->data + line->gap_end;
+}
+
+size_t line_buffer_cursor(const LineBuffer *line) {
+  return line->gap_start;
+}
+
+size_t line_buffer_length(const LineBuffer *line) {
+  return line->gap_start + (line->capacity - line->gap_end);
+}
+
+// Close the gap and hand the line over as a malloc'd string; the buffer is
+// left empty and must be initialised again before reuse
+char *line_buffer_detach(LineBuffer *line) {
+  size_t after = line->capacity - line->gap_end;
+  memmove(line->data + line->gap_start, line->data + line->gap_end,
+          after + 1);
+  char *text = line->data;
+  line->data = NULL;
+  line_buffer_free(line);
+  return text;
+}
@@ -1,11 +1,14 @@
 
 #include "line_reader.h"
+#include "line_buffer.h"
 #include "aliases.h"
 #include "bookmarks.h" // Added for bookmark support
 #include "builtins.h"  // Added for history access
 #include "common.h"
 #include "git_integration.h"
 #include "persistent_history.h"
+#include "screen_model.h"
+#include "startup_profile.h"
 #include "tab_complete.h"
 #include "themes.h"
 #include <dirent.h>
@@ -30,20 +33,39 @@ static int suggestion_count = 0;
 static char full_suggestion[LSH_RL_BUFSIZE] = {0};
 static int prefix_start = 0;
 static int menu_mode = 0;
-static int menu_start_line = 0;
-static int max_menu_lines = 0;
 static int cycling_mode = 0;
 static char cycle_prefix[LSH_RL_BUFSIZE] = {0};
 
+// The input row and menu as last sent to the terminal
+static ScreenModel screen;
+
+// The line being edited. Completion works on the text before the cursor
+static LineBuffer input;
+
 // history suggestion state
 static char *history_suggestion = NULL;
 static int has_history_suggestion = 0;
 
-// Define colors for suggestions
-#define SUGGESTION_COLOR "\033[2;37m" // Dim white color for suggestions
-#define HIGHLIGHT_COLOR "\033[7;36m" // Highlighted background for selected item
-#define NORMAL_COLOR "\033[0;36m"    // Normal color for menu items
-#define RESET_COLOR "\033[0m"
+// Append to a fixed-size row, dropping what does not fit
+static void append_bytes(char *row, size_t size, size_t *len,
+                         const char *text, size_t text_len) {
+  if (*len + text_len >= size)
+    text_len = *len + 1 < size ? size - *len - 1 : 0;
+  memcpy(row + *len, text, text_len);
+  *len += text_len;
+  row[*len] = '\0';
+}
+
+static void append_text(char *row, size_t size, size_t *len,
+                        const char *text) {
+  append_bytes(row, size, len, text, strlen(text));
+}
+
+// Theme colors are compiled once per theme; drawing just copies them
+static void append_color(char *row, size_t size, size_t *len,
+                         ThemeRole role) {
+  append_bytes(row, size, len, theme_color(role), theme_color_len(role));
+}
 
 int is_valid_command(const char *cmd) {
   if (!cmd || cmd[0] == '\0') {
@@ -167,19 +189,54 @@ int is_valid_command(const char *cmd) {
   return 0; // Command not found
 }
 
+// Bytes read from the terminal but not handed out yet. Fast typing and
+// pastes arrive as one read() instead of one per byte
+static unsigned char input_bytes[4096];
+static int input_bytes_len = 0;
+static int input_bytes_pos = 0;
+
+static int input_pending(void) { return input_bytes_pos < input_bytes_len; }
+
+// Next byte of input. With wait_us >= 0, give up with -1 when nothing
+// arrives in that many microseconds
+static int read_byte(long wait_us) {
+  if (input_bytes_pos < input_bytes_len)
+    return input_bytes[input_bytes_pos++];
+
+  if (wait_us >= 0) {
+    fd_set readfds;
+    struct timeval timeout;
+    FD_ZERO(&readfds);
+    FD_SET(STDIN_FILENO, &readfds);
+    timeout.tv_sec = 0;
+    timeout.tv_usec = wait_us;
+    if (select(STDIN_FILENO + 1, &readfds, NULL, NULL, &timeout) <= 0)
+      return -1;
+  }
+
+  ssize_t nread;
+  while ((nread = read(STDIN_FILENO, input_bytes, sizeof(input_bytes))) <
+         1) {
+    if (nread == -1 && errno != EAGAIN && errno != EINTR)
+      return -1;
+    if (wait_us >= 0)
+      return -1;
+  }
+  input_bytes_len = nread;
+  input_bytes_pos = 1;
+  return input_bytes[0];
+}
+
 int read_key(void) {
-  unsigned char c;
-  int nread;
+  int c;
   char seq[6];
 
 // Define local constants for special keys
 #define LOCAL_KEY_SHIFT_ENTER 1010
 
   // Read a character
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-    if (nread == -1 && errno != EAGAIN)
-      return -1;
-  }
+  if ((c = read_byte(-1)) < 0)
+    return -1;
 
   // Handle carriage return (CR) as enter
   if (c == 13) {
@@ -188,26 +245,13 @@ int read_key(void) {
 
   // Handle escape sequences for arrow keys and other special keys
   if (c == KEY_ESCAPE) {
-    // Read up to 5 additional chars
+    // Read up to 5 additional chars, with a timeout to avoid blocking
     int i = 0;
-    fd_set readfds;
-    struct timeval timeout;
-
-    FD_ZERO(&readfds);
-    FD_SET(STDIN_FILENO, &readfds);
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 50000; // 50ms timeout
-
-    // Try to read the sequence with timeout to avoid blocking
     while (i < 5) {
-      int select_result =
-          select(STDIN_FILENO + 1, &readfds, NULL, NULL, &timeout);
-      if (select_result <= 0)
+      int next = read_byte(50000); // 50ms timeout
+      if (next < 0)
         break; // Timeout or error
-
-      if (read(STDIN_FILENO, &seq[i], 1) != 1)
-        break;
-      i++;
+      seq[i++] = next;
 
       // Check for known sequences
       if (i >= 2 && seq[0] == '[') {
@@ -238,6 +282,10 @@ int read_key(void) {
           return LOCAL_KEY_SHIFT_ENTER;
         }
       }
+
+      // Bracketed paste start: ESC [ 200 ~
+      if (i == 5 && memcmp(seq, "[200~", 5) == 0)
+        return KEY_PASTE;
     }
 
     return KEY_ESCAPE;
@@ -246,6 +294,119 @@ int read_key(void) {
   return c;
 }
 
+// Collect the text of a bracketed paste, up to its ESC [ 201 ~ terminator,
+// as a malloc'd string. Line breaks are kept as '\n', whatever the terminal
+// sent, and trailing ones dropped; other control characters become spaces
+static char *read_paste(size_t *length) {
+  static const char end_marker[] = "\033[201~";
+  size_t marker_len = sizeof(end_marker) - 1;
+  size_t capacity = LSH_RL_BUFSIZE;
+  size_t len = 0;
+  char *text = malloc(capacity);
+  if (!text)
+    return NULL;
+
+  while (1) {
+    int c = read_byte(-1);
+    if (c < 0)
+      break;
+
+    if (len + 1 >= capacity) {
+      capacity *= 2;
+      char *grown = realloc(text, capacity);
+      if (!grown) {
+        free(text);
+        return NULL;
+      }
+      text = grown;
+    }
+    text[len++] = c;
+
+    if (len >= marker_len &&
+        memcmp(text + len - marker_len, end_marker, marker_len) == 0) {
+      len -= marker_len;
+      break;
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < len; i++) {
+    char c = text[i];
+    if (c == '\r') {
+      if (i + 1 < len && text[i + 1] == '\n')
+        continue;
+      c = '\n';
+    } else if (c != '\n' && ((unsigned char)c < 0x20 || c == 0x7f)) {
+      c = ' ';
+    }
+    text[kept++] = c;
+  }
+  while (kept > 0 && text[kept - 1] == '\n')
+    kept--;
+  text[kept] = '\0';
+  *length = kept;
+  return text;
+}
+
+// Lines of a multi-line paste still to come, '\n'-separated. Each is put
+// on a prompt of its own for Enter to run, so a paste never runs anything
+// by itself and its lines are never joined into one command
+static char *pasted_lines = NULL;
+
+// Queue the lines of a paste that follow the one going into the input.
+// They go ahead of any left from an earlier paste, since they follow the
+// line being edited
+static int queue_pasted_lines(const char *lines) {
+  size_t len = strlen(lines);
+  size_t queued = pasted_lines ? strlen(pasted_lines) : 0;
+  char *text = malloc(len + queued + 2);
+  if (!text)
+    return 0;
+
+  memcpy(text, lines, len);
+  if (queued) {
+    text[len] = '\n';
+    memcpy(text + len + 1, pasted_lines, queued + 1);
+  } else {
+    text[len] = '\0';
+  }
+  free(pasted_lines);
+  pasted_lines = text;
+  return 1;
+}
+
+// Move the next queued line into the empty input
+static void take_pasted_line(void) {
+  if (!pasted_lines)
+    return;
+
+  char *rest = strchr(pasted_lines, '\n');
+  if (rest)
+    *rest++ = '\0';
+  if (!line_buffer_insert(&input, pasted_lines, strlen(pasted_lines))) {
+    fprintf(stderr, "lsh: allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (rest) {
+    memmove(pasted_lines, rest, strlen(rest) + 1);
+  } else {
+    free(pasted_lines);
+    pasted_lines = NULL;
+  }
+}
+
+static void drop_pasted_lines(void) {
+  free(pasted_lines);
+  pasted_lines = NULL;
+}
+
+// Keys that insert text into the line: printable ASCII, or the lead byte
+// of a UTF-8 sequence
+static int is_text_key(int c) {
+  return (c >= 0 && c < 0x80 && isprint(c)) || (c >= 0xc0 && c < 0xf8);
+}
+
 void update_suggestions(const char *buffer, int position) {
   // Free previous suggestions if any
   if (suggestions) {
@@ -267,6 +428,11 @@ void update_suggestions(const char *buffer, int position) {
   has_suggestion = 0;
   has_history_suggestion = 0;
 
+  // Lines longer than the completion buffers (usually pastes) get no
+  // suggestions
+  if (position >= LSH_RL_BUFSIZE)
+    return;
+
   // Parse command line
   prefix_start = 0;
 
@@ -354,6 +520,31 @@ void update_suggestions(const char *buffer, int position) {
   }
 }
 
+// The completion code reads the text before the cursor as a C string
+static const char *input_before(int *position) {
+  *position = line_buffer_cursor(&input);
+  return line_buffer_before(&input);
+}
+
+// Describe the input row: prompt, the text before the cursor, then what
+// follows it - the rest of the line, or a dimmed hint at the end of it.
+// It reaches the terminal with the next screen_model_flush
+static void draw_input_line(const char *prompt_buffer, const char *text,
+                            const char *hint) {
+  const char *after = line_buffer_after(&input);
+  screen_model_line_begin(&screen);
+  screen_model_line_add(&screen, prompt_buffer);
+  screen_model_line_add(&screen, text);
+  screen_model_line_cursor(&screen);
+  if (after[0]) {
+    screen_model_line_add(&screen, after);
+  } else if (hint[0]) {
+    screen_model_line_add(&screen, theme_color(THEME_SUGGESTION));
+    screen_model_line_add(&screen, hint);
+    screen_model_line_add(&screen, theme_color(THEME_RESET));
+  }
+}
+
 void display_inline_suggestion(const char *prompt_buffer, const char *buffer,
                                int position) {
   // Prioritize history suggestions when available, tab suggestions as fallback
@@ -363,12 +554,8 @@ void display_inline_suggestion(const char *prompt_buffer, const char *buffer,
   if (show_history || show_tab) {
     // Determine what part should be in normal text and what part in suggestion
     // color
-    char current_text[LSH_RL_BUFSIZE] = "";
     char suggestion_text[LSH_RL_BUFSIZE] = "";
 
-    strncpy(current_text, buffer, position);
-    current_text[position] = '\0';
-
     if (show_history) {
       // Show history suggestion
       if (strlen(buffer) < strlen(history_suggestion) &&
@@ -381,7 +568,7 @@ void display_inline_suggestion(const char *prompt_buffer, const char *buffer,
       // Extract just the suggestion part (after what user typed)
       int current_len = 0;
 
-      if (prefix_start > 0) {
+      if (prefix_start > 0 && position - prefix_start < LSH_RL_BUFSIZE) {
         char current_arg[LSH_RL_BUFSIZE] = "";
         strncpy(current_arg, &buffer[prefix_start], position - prefix_start);
         current_arg[position - prefix_start] = '\0';
@@ -430,81 +617,28 @@ void display_inline_suggestion(const char *prompt_buffer, const char *buffer,
 
     // If there's no suggestion text (exact match), then don't show suggestion
     if (strlen(suggestion_text) == 0) {
-      // Clear the current line
-      printf("\r\033[K");
-
-      // Display prompt and current text without suggestion
-      printf("%s%s", prompt_buffer, buffer);
-      fflush(stdout);
+      draw_input_line(prompt_buffer, buffer, "");
     } else {
-      // Clear the current line
-      printf("\r\033[K");
-
-      // Display prompt and current text
-      printf("%s%s", prompt_buffer, current_text);
-
-      // Display the suggestion part in dim color
-      printf("%s%s%s", SUGGESTION_COLOR, suggestion_text, RESET_COLOR);
-
-      // Move cursor back to end of actual input
-      int suggestion_len = strlen(suggestion_text);
-      for (int i = 0; i < suggestion_len; i++) {
-        printf("\b");
-      }
-
-      fflush(stdout);
+      draw_input_line(prompt_buffer, buffer, suggestion_text);
     }
   } else {
     // No suggestions, just redraw the current line
-    printf("\r\033[K%s%s", prompt_buffer, buffer);
-    fflush(stdout);
+    draw_input_line(prompt_buffer, buffer, "");
   }
 }
 
 void clear_menu() {
-  if (max_menu_lines > 0) {
-    // Save current cursor position
-    printf("\033[s");
-
-    // Move cursor to where the menu starts (one line below input)
-    printf("\033[1B\r");
-
-    // Clear a generous number of lines to ensure we get everything
-    // Add extra buffer to handle spacing and indicators
-    int lines_to_clear = max_menu_lines + 5; // Extra buffer for safety
-
-    for (int i = 0; i < lines_to_clear; i++) {
-      printf("\033[K"); // Clear entire line
-      if (i < lines_to_clear - 1) {
-        printf("\033[1B\r"); // Move down to next line if not the last
-      }
-    }
-
-    // Restore cursor position (back to input line)
-    printf("\033[u");
-    fflush(stdout);
-
-    menu_start_line = 0;
-    max_menu_lines = 0; // Reset after clearing is complete
-  }
+  // An empty menu: the next flush blanks whatever rows were shown
+  screen_model_menu_begin(&screen);
 }
-// this is a test
-
 
 void display_menu(const char *prompt_buffer, const char *buffer, int position) {
+  screen_model_menu_begin(&screen);
   if (!has_suggestion || suggestion_count == 0) {
     // No suggestions to show
     return;
   }
 
-  // First, clear any existing menu
-  if (max_menu_lines > 0) {
-    clear_menu();
-  }
-
-  // Save current cursor position (should be at end of input)
-  printf("\033[s");
-
   // Calculate scrolling window
 
   int max_display = 10;
@@ -521,109 +655,81 @@ void display_menu(const char *prompt_buffer, const char *buffer, int position) {
     end_idx = start_idx + max_display;
   }
 
-  int show_count = end_idx - start_idx;
+  char row[LSH_RL_BUFSIZE + 128];
+  char count[32];
+  size_t len;
 
-  // Move to the beginning of the next line (below input)
-  printf("\n\n\r");
+  // Blank spacer row between the input and the menu
+  screen_model_menu_add(&screen, "");
 
   // Show "above" indicator if needed
   if (suggestion_count > max_display && start_idx > 0) {
-    printf("\033[2m(%d above)\033[0m\n\r", start_idx);
+    len = 0;
+    snprintf(count, sizeof(count), "(%d above)", start_idx);
+    append_color(row, sizeof(row), &len, THEME_MENU_HINT);
+    append_text(row, sizeof(row), &len, count);
+    append_color(row, sizeof(row), &len, THEME_RESET);
+    screen_model_menu_add(&screen, row);
   }
 
-  // Display each suggestion in the visible window
+  // One row per suggestion in the visible window, the selected one
+  // highlighted
   for (int i = start_idx; i < end_idx; i++) {
-    if (i > start_idx) {
-      printf("\n\r"); // New line for each suggestion after the first
-    }
-
-    if (i == suggestion_index) {
-      // Highlight the selected item
-      printf("%s%s%s", HIGHLIGHT_COLOR, suggestions[i], RESET_COLOR);
-    } else {
-      // Normal color for non-selected items
-      printf("%s%s%s", NORMAL_COLOR, suggestions[i], RESET_COLOR);
-    }
+    len = 0;
+    append_color(row, sizeof(row), &len,
+                 i == suggestion_index ? THEME_MENU_SELECTED
+                                       : THEME_MENU_ITEM);
+    append_text(row, sizeof(row), &len, suggestions[i]);
+    append_color(row, sizeof(row), &len, THEME_RESET);
+    screen_model_menu_add(&screen, row);
   }
 
   // Show "below" indicator if needed
   if (suggestion_count > max_display && end_idx < suggestion_count) {
-    int below_count = suggestion_count - end_idx;
-    printf("\n\r\033[2m(%d below)\033[0m", below_count);
-  }
-
-  // Store number of menu lines displayed
-  menu_start_line = show_count;
-
-  // Calculate total lines used by the menu (including all spacing and
-  // indicators)
-  int total_lines = 0;
-
-  // Initial spacing (2 lines)
-  total_lines += 2;
-
-  // "Above" indicator and its spacing
-  if (suggestion_count > max_display && start_idx > 0) {
-    total_lines += 2; // indicator line + spacing line
-  }
-
-  // Menu items
-  total_lines += show_count;
-
-  // "Below" indicator and its spacing
-  if (suggestion_count > max_display && end_idx < suggestion_count) {
-    total_lines += 2; // spacing line + indicator line
-  }
-
-  // Update max_menu_lines if this is larger
-  if (total_lines > max_menu_lines) {
-    max_menu_lines = total_lines;
+    len = 0;
+    snprintf(count, sizeof(count), "(%d below)", suggestion_count - end_idx);
+    append_color(row, sizeof(row), &len, THEME_MENU_HINT);
+    append_text(row, sizeof(row), &len, count);
+    append_color(row, sizeof(row), &len, THEME_RESET);
+    screen_model_menu_add(&screen, row);
   }
-
-  // Restore cursor to original position (back to input line)
-  printf("\033[u");
-  fflush(stdout);
 }
 
 
 void refresh_display(const char *prompt_buffer, const char *buffer,
                      int position) {
-  // Always clear any existing menu first
-  clear_menu();
-
   // Always show inline suggestion - even in menu mode
   display_inline_suggestion(prompt_buffer, buffer, position);
 
   if (menu_mode) {
     // Also show menu of options below the input line
     display_menu(prompt_buffer, buffer, position);
+  } else {
+    clear_menu();
   }
 }
 
 char *lsh_read_line(void) {
-  int bufsize = LSH_RL_BUFSIZE;
   int position = 0;
-  char *buffer = malloc(sizeof(char) * bufsize);
+  const char *buffer;
   int c;
   int history_position = -1;
+  int suggestions_stale = 0; // Text went in without updating suggestions
 
   // Prompt buffer for enhanced prompt
   char prompt_buffer[LSH_RL_BUFSIZE];
 
   // Reset menu and cycling modes
   menu_mode = 0;
-  menu_start_line = 0;
-  max_menu_lines = 0;
   cycling_mode = 0;
   strcpy(cycle_prefix, "");
 
-  if (!buffer) {
+  if (!line_buffer_init(&input)) {
     fprintf(stderr, "lsh: allocation error\n");
     exit(EXIT_FAILURE);
   }
-
-  // Clear the buffer
-  buffer[0] = '\0';
+  take_pasted_line();
+  buffer = input_before(&position);
 
   // Generate enhanced prompt - INLINED CODE
   {
@@ -639,12 +745,22 @@ char *lsh_read_line(void) {
       strcpy(current_dir, "dir");
     }
 
+    size_t len = 0;
+    prompt_buffer[0] = '\0';
+    append_color(prompt_buffer, sizeof(prompt_buffer), &len,
+                 THEME_PROMPT_PATH);
+    append_text(prompt_buffer, sizeof(prompt_buffer), &len, parent_dir);
+    append_text(prompt_buffer, sizeof(prompt_buffer), &len, "/");
+    append_text(prompt_buffer, sizeof(prompt_buffer), &len, current_dir);
+    append_color(prompt_buffer, sizeof(prompt_buffer), &len, THEME_RESET);
+
     // Get Git information
-    char git_display[LSH_RL_BUFSIZE] = {0};
     char *git_status_info = get_git_status();
     if (git_status_info != NULL) {
-      // Extract just the branch name from git status info
+      // Extract just the branch name from git status info; if it can't
+      // be parsed, show the whole status
       char branch_name[LSH_RL_BUFSIZE] = {0};
+      const char *branch = git_status_info;
       char *paren_open = strchr(git_status_info, '(');
       char *paren_close = strchr(git_status_info, ')');
 
@@ -654,38 +770,60 @@ char *lsh_read_line(void) {
         if (branch_len < sizeof(branch_name)) {
           strncpy(branch_name, paren_open + 1, branch_len);
           branch_name[branch_len] = '\0';
-          snprintf(git_display, sizeof(git_display),
-                   " \033[1;35mgit:(%s)\033[0m", branch_name);
+          branch = branch_name;
         } else {
           // Fallback if branch name is too long
-          snprintf(git_display, sizeof(git_display),
-                   " \033[1;35mgit:(?)\033[0m");
+          branch = "?";
         }
-      } else {
-        // If we can't parse the branch name, just use the whole status
-        snprintf(git_display, sizeof(git_display), " \033[1;35mgit:(%s)\033[0m",
-                 git_status_info);
       }
 
+      append_text(prompt_buffer, sizeof(prompt_buffer), &len, " ");
+      append_color(prompt_buffer, sizeof(prompt_buffer), &len,
+                   THEME_PROMPT_GIT);
+      append_text(prompt_buffer, sizeof(prompt_buffer), &len, "git:(");
+      append_text(prompt_buffer, sizeof(prompt_buffer), &len, branch);
+      append_text(prompt_buffer, sizeof(prompt_buffer), &len, ")");
+      append_color(prompt_buffer, sizeof(prompt_buffer), &len, THEME_RESET);
       free(git_status_info);
     }
 
-    // Format the prompt
-    snprintf(prompt_buffer, sizeof(prompt_buffer),
-             "\033[1;36m%s/%s\033[0m%s \033[1;31m✗\033[0m ", parent_dir,
-             current_dir, git_display);
+    append_text(prompt_buffer, sizeof(prompt_buffer), &len, " ");
+    append_color(prompt_buffer, sizeof(prompt_buffer), &len,
+                 THEME_PROMPT_MARK);
+    append_text(prompt_buffer, sizeof(prompt_buffer), &len, "✗");
+    append_color(prompt_buffer, sizeof(prompt_buffer), &len, THEME_RESET);
+    append_text(prompt_buffer, sizeof(prompt_buffer), &len, " ");
   }
 
-  // Display prompt
-  printf("%s", prompt_buffer);
-  fflush(stdout);
+  // Display prompt on a fresh row, with pastes marked by the terminal
+  screen_model_reset(&screen);
+  screen_frame_append(&screen.frame, ANSI_PASTE_MODE_ON,
+                      strlen(ANSI_PASTE_MODE_ON));
+  draw_input_line(prompt_buffer, buffer, "");
 
   // Initialize suggestions
   update_suggestions(buffer, position);
+  startup_profile_finish();
 
   while (1) {
+    // Text typed ahead of the screen is all in; catch the suggestions up
+    if (suggestions_stale && !input_pending()) {
+      suggestions_stale = 0;
+      update_suggestions(buffer, position);
+      display_inline_suggestion(prompt_buffer, buffer, position);
+    }
+
+    // Everything the last key changed goes out as one frame
+    screen_model_flush(&screen, STDOUT_FILENO);
     c = read_key();
 
+    // Other keys act on the suggestions for the line as it is now
+    if (suggestions_stale && !is_text_key(c)) {
+      suggestions_stale = 0;
+      update_suggestions(buffer, position);
+      display_inline_suggestion(prompt_buffer, buffer, position);
+    }
+
     if (c == KEY_ENTER || c == '\n' || c == '\r') {
       if (menu_mode) {
         // In menu mode: accept the highlighted suggestion without executing
@@ -726,21 +864,19 @@ char *lsh_read_line(void) {
                       LSH_RL_BUFSIZE - strlen(temp) - 1);
             }
 
-            strncpy(buffer, temp, bufsize - 1);
+            line_buffer_set_before(&input, temp);
           } else {
             // We're completing a command
-            strncpy(buffer, suggestions[suggestion_index], bufsize - 1);
+            line_buffer_set_before(&input, suggestions[suggestion_index]);
           }
-          buffer[bufsize - 1] = '\0';
-          position = strlen(buffer);
+          buffer = input_before(&position);
 
           // Clear the menu
           clear_menu();
           menu_mode = 0;
 
           // Redraw the line with accepted suggestion
-          printf("\r\033[K%s%s", prompt_buffer, buffer);
-          fflush(stdout);
+          draw_input_line(prompt_buffer, buffer, "");
 
           // Check if the accepted suggestion is a directory
           if (strlen(buffer) > 0 && buffer[strlen(buffer) - 1] == '/') {
@@ -754,10 +890,16 @@ char *lsh_read_line(void) {
           display_inline_suggestion(prompt_buffer, buffer, position);
         }
       } else {
-        // Not in menu mode: execute the command as is
-        buffer[position] = '\0';
-        printf("\n");
-        fflush(stdout);
+        // Not in menu mode: execute the command as is. The cursor goes to
+        // the end of the line first so nothing typed is cleared with the hint
+        while (line_buffer_move_right(&input))
+          ;
+        buffer = input_before(&position);
+        draw_input_line(prompt_buffer, buffer, "");
+        screen_frame_append(&screen.frame, ANSI_PASTE_MODE_OFF,
+                            strlen(ANSI_PASTE_MODE_OFF));
+        screen_model_end_line(&screen);
+        screen_model_flush(&screen, STDOUT_FILENO);
         break;
       }
     } else if (c == KEY_ESCAPE) {
@@ -765,14 +907,15 @@ char *lsh_read_line(void) {
         // Exit menu mode
         menu_mode = 0;
         clear_menu();
-        max_menu_lines = 0; // Reset max menu lines when exiting menu mode
         display_inline_suggestion(prompt_buffer, buffer, position);
+      } else {
+        // Don't bring up the rest of a paste
+        drop_pasted_lines();
       }
     } else if (c == KEY_BACKSPACE || c == 127) {
       // Handle backspace
-      if (position > 0) {
-        position--;
-        buffer[position] = '\0';
+      if (line_buffer_delete_before(&input)) {
+        buffer = input_before(&position);
 
         // Store whether we were in menu mode
         int was_in_menu_mode = menu_mode;
@@ -794,8 +937,7 @@ char *lsh_read_line(void) {
           // No suggestions or only one - exit menu mode
           menu_mode = 0;
           clear_menu();
-          max_menu_lines = 0; // Reset max menu lines when exiting menu mode
-          display_inline_suggestion(prompt_buffer, buffer, position);
+            display_inline_suggestion(prompt_buffer, buffer, position);
         } else {
           // Wasn't in menu mode - just show inline suggestion
           display_inline_suggestion(prompt_buffer, buffer, position);
@@ -835,17 +977,15 @@ char *lsh_read_line(void) {
                     LSH_RL_BUFSIZE - strlen(temp) - 1);
 
             // Update the buffer
-            strncpy(buffer, temp, bufsize - 1);
+            line_buffer_set_before(&input, temp);
           } else {
             // We're cycling commands
-            strncpy(buffer, suggestions[suggestion_index], bufsize - 1);
+            line_buffer_set_before(&input, suggestions[suggestion_index]);
           }
-          buffer[bufsize - 1] = '\0';
-          position = strlen(buffer);
+          buffer = input_before(&position);
 
           // Redraw with the current suggestion
-          printf("\r\033[K%s%s", prompt_buffer, buffer);
-          fflush(stdout);
+          draw_input_line(prompt_buffer, buffer, "");
         }
       } else if (menu_mode) {
         // Already in menu mode: cycle to next suggestion
@@ -935,17 +1075,15 @@ char *lsh_read_line(void) {
                       LSH_RL_BUFSIZE - strlen(temp) - 1);
             }
 
-            strncpy(buffer, temp, bufsize - 1);
+            line_buffer_set_before(&input, temp);
           } else {
             // We're completing a command
-            strncpy(buffer, suggestions[suggestion_index], bufsize - 1);
+            line_buffer_set_before(&input, suggestions[suggestion_index]);
           }
-          buffer[bufsize - 1] = '\0';
-          position = strlen(buffer);
+          buffer = input_before(&position);
 
           // Redraw the line with accepted suggestion
-          printf("\r\033[K%s%s", prompt_buffer, buffer);
-          fflush(stdout);
+          draw_input_line(prompt_buffer, buffer, "");
 
           // Check if the accepted suggestion is a directory
           if (strlen(buffer) > 0 && buffer[strlen(buffer) - 1] == '/') {
@@ -1125,33 +1263,31 @@ char *lsh_read_line(void) {
       // Navigate history upward when not in menu mode
       char *history_entry = get_previous_history_entry(&history_position);
       if (history_entry) {
-        // Clear current line
-        printf("\r\033[K");
-
         // Copy history entry to buffer
-        strncpy(buffer, history_entry, bufsize - 1);
-        buffer[bufsize - 1] = '\0';
-        position = strlen(buffer);
+        line_buffer_set(&input, history_entry);
+        buffer = input_before(&position);
 
         // Display the history entry and update suggestions
-        printf("%s%s", prompt_buffer, buffer);
-        fflush(stdout);
+        draw_input_line(prompt_buffer, buffer, "");
 
         // Update suggestions after loading history
         update_suggestions(buffer, position);
         display_inline_suggestion(prompt_buffer, buffer, position);
       }
     } else if (c == KEY_RIGHT && !menu_mode) {
-      // Accept inline suggestion with right arrow
-      if (has_history_suggestion) {
+      // Inside the line, step forward; at its end, accept the inline
+      // suggestion
+      if (line_buffer_move_right(&input)) {
+        buffer = input_before(&position);
+        update_suggestions(buffer, position);
+        display_inline_suggestion(prompt_buffer, buffer, position);
+      } else if (has_history_suggestion) {
         // Accept history suggestion
-        strncpy(buffer, history_suggestion, bufsize - 1);
-        buffer[bufsize - 1] = '\0';
-        position = strlen(buffer);
+        line_buffer_set(&input, history_suggestion);
+        buffer = input_before(&position);
 
         // Redraw the line with accepted suggestion
-        printf("\r\033[K%s%s", prompt_buffer, buffer);
-        fflush(stdout);
+        draw_input_line(prompt_buffer, buffer, "");
 
         // Clear history suggestion after accepting
         if (history_suggestion) {
@@ -1199,17 +1335,15 @@ char *lsh_read_line(void) {
                     LSH_RL_BUFSIZE - strlen(temp) - 1);
           }
 
-          strncpy(buffer, temp, bufsize - 1);
+          line_buffer_set_before(&input, temp);
         } else {
           // We're completing a command
-          strncpy(buffer, suggestions[suggestion_index], bufsize - 1);
+          line_buffer_set_before(&input, suggestions[suggestion_index]);
         }
-        buffer[bufsize - 1] = '\0';
-        position = strlen(buffer);
+        buffer = input_before(&position);
 
         // Redraw the line with accepted suggestion
-        printf("\r\033[K%s%s", prompt_buffer, buffer);
-        fflush(stdout);
+        draw_input_line(prompt_buffer, buffer, "");
 
         // Check if the accepted suggestion is a directory
         if (strlen(buffer) > 0 && buffer[strlen(buffer) - 1] == '/') {
@@ -1234,26 +1368,21 @@ char *lsh_read_line(void) {
       // Navigate history downward when not in menu mode
       char *history_entry = get_next_history_entry(&history_position);
       if (history_entry) {
-        // Clear current line
-        printf("\r\033[K");
-
         // Copy history entry to buffer
-        strncpy(buffer, history_entry, bufsize - 1);
-        buffer[bufsize - 1] = '\0';
-        position = strlen(buffer);
+        line_buffer_set(&input, history_entry);
+        buffer = input_before(&position);
 
         // Display the history entry and update suggestions
-        printf("%s%s", prompt_buffer, buffer);
-        fflush(stdout);
+        draw_input_line(prompt_buffer, buffer, "");
 
         // Update suggestions after loading history
         update_suggestions(buffer, position);
         display_inline_suggestion(prompt_buffer, buffer, position);
       } else {
         // At the end of history, clear the line
-        printf("\r\033[K%s", prompt_buffer);
-        buffer[0] = '\0';
-        position = 0;
+        line_buffer_set(&input, "");
+        buffer = input_before(&position);
+        draw_input_line(prompt_buffer, buffer, "");
 
         // Clear suggestions since we have an empty line
         if (suggestions) {
@@ -1267,22 +1396,67 @@ char *lsh_read_line(void) {
         }
         has_suggestion = 0;
       }
-    } else if (isprint(c)) {
-      // Regular character - add it to the buffer
-      if (position >= bufsize - 1) {
-        bufsize += LSH_RL_BUFSIZE;
-        char *new_buffer = realloc(buffer, bufsize);
-        if (!new_buffer) {
-          fprintf(stderr, "lsh: allocation error\n");
-          free(buffer);
-          exit(EXIT_FAILURE);
-        }
-        buffer = new_buffer;
+    } else if (c == KEY_LEFT && !menu_mode) {
+      // Step back one character (grapheme cluster); the hint only shows at
+      // the end of the line
+      if (line_buffer_move_left(&input)) {
+        buffer = input_before(&position);
+        update_suggestions(buffer, position);
+        display_inline_suggestion(prompt_buffer, buffer, position);
+      }
+    } else if (c == KEY_PASTE) {
+      // Pasted text goes in as one insert, with suggestions worked out
+      // once. Only its first line: the others wait for prompts of their own
+      size_t len;
+      char *paste = read_paste(&len);
+      char *more = paste ? strchr(paste, '\n') : NULL;
+      if (more) {
+        *more = '\0';
+        len = more - paste;
+      }
+      if (!paste || !line_buffer_insert(&input, paste, len) ||
+          (more && !queue_pasted_lines(more + 1))) {
+        fprintf(stderr, "lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+      }
+      free(paste);
+      buffer = input_before(&position);
+
+      cycling_mode = 0;
+      if (menu_mode) {
+        menu_mode = 0;
+        clear_menu();
+      }
+      update_suggestions(buffer, position);
+      display_inline_suggestion(prompt_buffer, buffer, position);
+    } else if (is_text_key(c)) {
+      // Regular character - insert it at the cursor. A UTF-8 lead byte
+      // brings its continuation bytes with it
+      char bytes[4] = {(char)c};
+      int len = 1;
+      int need = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+      while (len < need) {
+        int next = read_key();
+        if (next < 0x80 || next > 0xbf)
+          break;
+        bytes[len++] = (char)next;
+      }
+      if (len < need)
+        continue; // Broken sequence
+
+      if (!line_buffer_insert(&input, bytes, len)) {
+        fprintf(stderr, "lsh: allocation error\n");
+        exit(EXIT_FAILURE);
       }
+      buffer = input_before(&position);
 
-      buffer[position] = c;
-      position++;
-      buffer[position] = '\0';
+      // More input is already waiting, e.g. a paste in a terminal without
+      // bracketed paste: keep inserting and update suggestions after it
+      if (input_pending() && !menu_mode) {
+        cycling_mode = 0;
+        suggestions_stale = 1;
+        continue;
+      }
 
       // Store whether we were in menu mode
       int was_in_menu_mode = menu_mode;
@@ -1331,7 +1505,7 @@ char *lsh_read_line(void) {
   has_suggestion = 0;
   has_history_suggestion = 0;
 
-  return buffer;
+  return line_buffer_detach(&input);
 }
 
 char **lsh_split_line(char *line) {
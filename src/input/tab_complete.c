@@ -44,6 +44,7 @@ static CommandArgInfo command_arg_info[] = {
     {"bookmarks", ARG_TYPE_ANY, "List all bookmarks", 0},
     {"goto", ARG_TYPE_BOOKMARK, "Jump to a bookmark", 1},
     {"unbookmark", ARG_TYPE_BOOKMARK, "Remove a bookmark", 1},
+    {"z", ARG_TYPE_ANY, "Jump to a visited directory", 0},
 
     // Other utilities
     {"focus_timer", ARG_TYPE_ANY, "Start a focus timer", 0},
@@ -288,29 +289,12 @@ static char *complete_command(const char *prefix) {
   }
 
   // Then check for aliases
-  int alias_count;
-  char **aliases = get_alias_names(&alias_count);
-
-  if (aliases) {
-    for (int i = 0; i < alias_count; i++) {
-      if (strncasecmp(aliases[i], prefix, strlen(prefix)) == 0) {
-        char *result = strdup(aliases[i]);
-
-        // Free the alias names
-        for (int j = 0; j < alias_count; j++) {
-          free(aliases[j]);
-        }
-        free(aliases);
-
-        return result;
-      }
-    }
-
-    // Free the alias names if we didn't find a match
-    for (int i = 0; i < alias_count; i++) {
-      free(aliases[i]);
+  int cursor = 0;
+  const char *alias_name;
+  while ((alias_name = next_alias_name(&cursor)) != NULL) {
+    if (strncasecmp(alias_name, prefix, strlen(prefix)) == 0) {
+      return strdup(alias_name);
     }
-    free(aliases);
   }
 
   // Finally check for executables in PATH
@@ -351,6 +335,38 @@ static char *complete_command(const char *prefix) {
   return result;
 }
 
+// Copy the names from a store's iterator that start with token (all of
+// them for an empty token). Only the matches are copied; NULL when none
+static char **collect_matching_names(const char *(*next)(int *cursor),
+                                     const char *token, int *matched_count) {
+  size_t token_len = strlen(token);
+  const char *name;
+  int cursor = 0;
+
+  *matched_count = 0;
+  while ((name = next(&cursor)) != NULL) {
+    if (strncasecmp(name, token, token_len) == 0)
+      (*matched_count)++;
+  }
+  if (*matched_count == 0)
+    return NULL;
+
+  char **items = (char **)malloc(*matched_count * sizeof(char *));
+  if (!items) {
+    *matched_count = 0;
+    return NULL;
+  }
+
+  int idx = 0;
+  cursor = 0;
+  while ((name = next(&cursor)) != NULL && idx < *matched_count) {
+    if (strncasecmp(name, token, token_len) == 0)
+      items[idx++] = strdup(name);
+  }
+  *matched_count = idx;
+  return items;
+}
+
 static SuggestionList *get_suggestions_by_type(ArgumentType arg_type,
                                                const char *token) {
   if (!token)
@@ -574,149 +590,18 @@ static SuggestionList *get_suggestions_by_type(ArgumentType arg_type,
     break;
   }
 
-  case ARG_TYPE_BOOKMARK: {
-    // Get all bookmarks
-    int bookmark_count;
-    char **bookmarks = get_bookmark_names(&bookmark_count);
-
-    if (bookmarks) {
-      // Count matching bookmarks
-      for (int i = 0; i < bookmark_count; i++) {
-        if (token[0] == '\0' ||
-            strncasecmp(bookmarks[i], token, strlen(token)) == 0) {
-          matched_count++;
-        }
-      }
-
-      // Allocate items array
-      if (matched_count > 0) {
-        items = (char **)malloc(matched_count * sizeof(char *));
-        if (!items) {
-          // Free bookmarks
-          for (int i = 0; i < bookmark_count; i++) {
-            free(bookmarks[i]);
-          }
-          free(bookmarks);
-          return NULL;
-        }
-
-        // Fill items array
-        int idx = 0;
-        for (int i = 0; i < bookmark_count && idx < matched_count; i++) {
-          if (token[0] == '\0' ||
-              strncasecmp(bookmarks[i], token, strlen(token)) == 0) {
-            items[idx++] = strdup(bookmarks[i]);
-          }
-        }
-
-        // Update actual match count
-        matched_count = idx;
-      }
-
-      // Free bookmarks
-      for (int i = 0; i < bookmark_count; i++) {
-        free(bookmarks[i]);
-      }
-      free(bookmarks);
-    }
+  case ARG_TYPE_BOOKMARK:
+    items = collect_matching_names(next_bookmark_name, token, &matched_count);
     break;
-  }
-
-  case ARG_TYPE_ALIAS: {
-    // Get all aliases
-    int alias_count;
-    char **aliases = get_alias_names(&alias_count);
-
-    if (aliases) {
-      // Count matching aliases
-      for (int i = 0; i < alias_count; i++) {
-        if (token[0] == '\0' ||
-            strncasecmp(aliases[i], token, strlen(token)) == 0) {
-          matched_count++;
-        }
-      }
 
-      // Allocate items array
-      if (matched_count > 0) {
-        items = (char **)malloc(matched_count * sizeof(char *));
-        if (!items) {
-          // Free aliases
-          for (int i = 0; i < alias_count; i++) {
-            free(aliases[i]);
-          }
-          free(aliases);
-          return NULL;
-        }
-
-        // Fill items array
-        int idx = 0;
-        for (int i = 0; i < alias_count && idx < matched_count; i++) {
-          if (token[0] == '\0' ||
-              strncasecmp(aliases[i], token, strlen(token)) == 0) {
-            items[idx++] = strdup(aliases[i]);
-          }
-        }
-
-        // Update actual match count
-        matched_count = idx;
-      }
-
-      // Free aliases
-      for (int i = 0; i < alias_count; i++) {
-        free(aliases[i]);
-      }
-      free(aliases);
-    }
+  case ARG_TYPE_ALIAS:
+    items = collect_matching_names(next_alias_name, token, &matched_count);
     break;
-  }
-
-  case ARG_TYPE_FAVORITE_CITY: {
-    // Get all cities
-    int city_count;
-    char **cities = get_favorite_city_names(&city_count);
-
-    if (cities) {
-      // Count matching cities
-      for (int i = 0; i < city_count; i++) {
-        if (token[0] == '\0' ||
-            strncasecmp(cities[i], token, strlen(token)) == 0) {
-          matched_count++;
-        }
-      }
-
-      // Allocate items array
-      if (matched_count > 0) {
-        items = (char **)malloc(matched_count * sizeof(char *));
-        if (!items) {
-          // Free cities
-          for (int i = 0; i < city_count; i++) {
-            free(cities[i]);
-          }
-          free(cities);
-          return NULL;
-        }
-
-        // Fill items array
-        int idx = 0;
-        for (int i = 0; i < city_count && idx < matched_count; i++) {
-          if (token[0] == '\0' ||
-              strncasecmp(cities[i], token, strlen(token)) == 0) {
-            items[idx++] = strdup(cities[i]);
-          }
-        }
-
-        // Update actual match count
-        matched_count = idx;
-      }
 
-      // Free cities
-      for (int i = 0; i < city_count; i++) {
-        free(cities[i]);
-      }
-      free(cities);
-    }
+  case ARG_TYPE_FAVORITE_CITY:
+    items = collect_matching_names(next_favorite_city_name, token,
+                                   &matched_count);
     break;
-  }
 
   case ARG_TYPE_THEME: {
     // Get all themes
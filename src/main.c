@@ -1,9 +1,56 @@
 #include "common.h"
 #include "shell.h"
+#include "startup_profile.h"
+#include <errno.h>
 #include <locale.h>
 
+static void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--startup-profile] [-c command | script]\n"
+          "  -c command  run one command line and exit\n"
+          "  script      run each line of a file and exit; with no\n"
+          "              script and stdin not a terminal, read stdin\n",
+          program);
+}
+
 int main(int argc, char **argv) {
-  setlocale(LC_ALL, "en_US.UTF-8");
+  const char *command = NULL;
+  const char *script = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--startup-profile") == 0) {
+      startup_profile_enable();
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      command = argv[++i];
+    } else if (argv[i][0] != '-' && !script && !command) {
+      script = argv[i];
+    } else {
+      fprintf(stderr, "lsh: unknown option: %s\n", argv[i]);
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The line editor measures text with wcwidth, which needs a UTF-8 ctype
+  if (!setlocale(LC_ALL, "en_US.UTF-8") && MB_CUR_MAX == 1)
+    setlocale(LC_CTYPE, "C.UTF-8");
+
+  // Batch mode: no terminal setup, prompt or status bar
+  if (command)
+    return lsh_run_command(command);
+  if (script) {
+    FILE *fp = fopen(script, "r");
+    if (!fp) {
+      fprintf(stderr, "lsh: %s: %s\n", script, strerror(errno));
+      return 127;
+    }
+    int status = lsh_run_script(fp);
+    fclose(fp);
+    return status;
+  }
+  if (!isatty(STDIN_FILENO))
+    return lsh_run_script(stdin);
+
   printf("\033%%G");
   lsh_loop();
   return EXIT_SUCCESS;
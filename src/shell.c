@@ -6,10 +6,13 @@
 #include "builtins.h"
 #include "countdown_timer.h"
 #include "favorite_cities.h"
+#include "frecency.h"
 #include "filters.h"
 #include "git_integration.h" // Added for Git repository detection
 #include "line_reader.h"
 #include "persistent_history.h"
+#include "screen_model.h"
+#include "startup_profile.h"
 #include "structured_data.h"
 #include "tab_complete.h" // Added for tab completion support
 #include "themes.h"
@@ -19,6 +22,7 @@
 #include <sys/ioctl.h>
 #include <signal.h>
 #include <dirent.h> // For DIR, opendir, readdir
+#include <errno.h>
 #include <sys/stat.h> // For stat
 
 // Global variables for status bar
@@ -28,6 +32,33 @@ static int g_normal_attributes = 7; // Default white on black
 static int g_status_attributes = 12; // Red
 static int g_status_bar_enabled = 0; // Flag to track if status bar is enabled
 static struct termios g_orig_termios; // Original terminal settings
+static ScreenLine g_status_shown;     // Status bar as last drawn
+static ScreenLine g_status_next;
+static int g_status_shown_width = 0; // 0 until the bar has been drawn
+
+// Exit status of the last command, returned by batch mode. Builtins
+// succeed unless they call lsh_builtin_failed
+static int g_last_exit_status = 0;
+
+static void record_exit_status(int status) {
+    if (WIFEXITED(status))
+        g_last_exit_status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        g_last_exit_status = 128 + WTERMSIG(status);
+}
+
+int lsh_builtin_failed(void) {
+    g_last_exit_status = 1;
+    return 1;
+}
+
+// What the child exits with when exec fails: 127 when there is no such
+// command, 126 when it can't be run, as in sh
+static void exit_exec_failed(const char *message) {
+    int error = errno;
+    perror(message);
+    _exit(error == ENOENT ? 127 : 126);
+}
 
 int init_terminal(struct termios *orig_termios) {
     int fd = STDIN_FILENO;
@@ -107,6 +138,7 @@ void hide_status_bar(int fd) {
     // Restore cursor position
     printf(ANSI_RESTORE_CURSOR);
     fflush(stdout);
+    g_status_shown_width = 0; // The bar row is blank now
 }
 
 void ensure_status_bar_space(int fd) {
@@ -129,6 +161,7 @@ void ensure_status_bar_space(int fd) {
     // Restore cursor position
     printf(ANSI_RESTORE_CURSOR);
     fflush(stdout);
+    g_status_shown_width = 0; // The bar row is blank now
 }
 
 int init_status_bar(int fd) {
@@ -147,6 +180,7 @@ int init_status_bar(int fd) {
     printf("\033[2K"); // Clear entire line
     printf(ANSI_RESTORE_CURSOR);
     fflush(stdout);
+    g_status_shown_width = 0; // The bar row is blank now
     
     return 1;
 }
@@ -203,36 +237,49 @@ void update_status_bar(int fd, const char *git_info) {
         strcpy(current_dir, "dir");
     }
     
-    printf(ANSI_SAVE_CURSOR);
-    
-    // Move cursor to status line
-    printf("\033[%d;1H", height);
-    
-    // Clear the status line
-    printf("\033[2K");
-    
-    // Set status bar color (cyan background)
-    printf(ANSI_BG_CYAN ANSI_COLOR_BLACK);
-    
-    // Format: [time] parent_dir/current_dir [git_info]
-    printf(" %s ", time_buffer);
-    printf(" %s/%s ", parent_dir, current_dir);
-    
-    if (git_info != NULL && strlen(git_info) > 0) {
-        printf(" %s ", git_info);
+    // Format: [time] parent_dir/current_dir [git_info], on a bar in the
+    // theme's status colors that fills the whole line
+    char text[LSH_RL_BUFSIZE * 3];
+    int len = snprintf(text, sizeof(text), " %s  %s/%s ", time_buffer,
+                       parent_dir, current_dir);
+    if (git_info != NULL && strlen(git_info) > 0 && len >= 0 &&
+        len < (int)sizeof(text)) {
+        snprintf(text + len, sizeof(text) - len, " %s ", git_info);
     }
     
-    // Fill the rest of line with space to color the entire bar
-    printf("%*s", width - (int)strlen(time_buffer) - 
-           (int)strlen(parent_dir) - (int)strlen(current_dir) - 
-           (git_info ? (int)strlen(git_info) + 3 : 0) - 8, "");
-           
-    // Reset color
-    printf(ANSI_COLOR_RESET);
+    screen_line_clear(&g_status_next);
+    screen_line_add(&g_status_next, theme_color(THEME_STATUS_BAR));
+    screen_line_add(&g_status_next, text);
+    
+    // Fit the bar to the terminal by display columns, not bytes, so
+    // multibyte directory names don't push it out of line
+    screen_line_clip(&g_status_next, width);
+    screen_line_fill(&g_status_next, width);
+    
+    // Only the cells from the first change onward are rewritten; after a
+    // resize the whole bar is
+    int first = 0;
+    if (g_status_shown_width == width) {
+        first = screen_line_difference(&g_status_shown, &g_status_next);
+        if (first < 0)
+            return;
+    }
     
-    // Restore cursor position
-    printf(ANSI_RESTORE_CURSOR);
-    fflush(stdout);
+    ScreenFrame frame;
+    screen_frame_init(&frame);
+    // first counts cells; wide characters take two columns each
+    screen_frame_appendf(&frame, ANSI_SAVE_CURSOR "\033[%d;%dH", height,
+                         screen_line_columns(&g_status_next, first) + 1);
+    if (first == 0)
+        screen_frame_append(&frame, "\033[2K", 4);
+    screen_line_emit(&frame, &g_status_next, first);
+    screen_frame_append(&frame, ANSI_RESTORE_CURSOR,
+                        strlen(ANSI_RESTORE_CURSOR));
+    screen_frame_write(&frame, fd);
+    screen_frame_free(&frame);
+    
+    screen_line_swap(&g_status_shown, &g_status_next);
+    g_status_shown_width = width;
 }
 
 
@@ -610,23 +657,26 @@ int lsh_launch(char **args) {
     pid_t pid, wpid;
     int status;
     
+    // Anything a builtin printed must come out before the child's output
+    fflush(stdout);
+    
     // Fork a child process
     pid = fork();
     
     if (pid == 0) {
         // Child process
-        if (execvp(args[0], args) == -1) {
-            perror("lsh");
-        }
-        exit(EXIT_FAILURE);
+        execvp(args[0], args);
+        exit_exec_failed("lsh");
     } else if (pid < 0) {
         // Error forking
         perror("lsh");
+        g_last_exit_status = 1;
     } else {
         // Parent process
         do {
             wpid = waitpid(pid, &status, WUNTRACED);
         } while (!WIFEXITED(status) && !WIFSIGNALED(status));
+        record_exit_status(status);
     }
     
     return 1;
@@ -641,6 +691,7 @@ int lsh_execute(char **args) {
     // Check if it's a built-in command
     for (int i = 0; i < lsh_num_builtins(); i++) {
         if (strcmp(args[0], builtin_str[i]) == 0) {
+            g_last_exit_status = 0;
             return (*builtin_func[i])(args);
         }
     }
@@ -674,9 +725,10 @@ int lsh_execute_piped(char ***commands) {
     // Check if this is a table operation starting with ls/dir
     if (strcmp(commands[0][0], "ls") == 0 || strcmp(commands[0][0], "dir") == 0) {
         // Create a table from ls command
+        g_last_exit_status = 0;
         TableData *table = create_ls_table(commands[0]);
         if (!table) {
-            return 1; // Error already printed
+            return lsh_builtin_failed(); // Error already printed
         }
         
         // Apply filters from the pipeline
@@ -695,7 +747,7 @@ int lsh_execute_piped(char ***commands) {
             if (filter_idx == -1) {
                 fprintf(stderr, "lsh: unknown filter command: %s\n", filter_cmd);
                 free_table(table);
-                return 1;
+                return lsh_builtin_failed();
             }
             
             // Apply the filter
@@ -703,7 +755,7 @@ int lsh_execute_piped(char ***commands) {
             free_table(table); // Free the old table
             
             if (!filtered_table) {
-                return 1; // Error already printed
+                return lsh_builtin_failed(); // Error already printed
             }
             
             table = filtered_table;
@@ -732,6 +784,7 @@ int lsh_execute_piped(char ***commands) {
     
     // Create processes
     pid_t pids[cmd_count];
+    fflush(stdout);
     for (int i = 0; i < cmd_count; i++) {
         pids[i] = fork();
         
@@ -745,7 +798,7 @@ int lsh_execute_piped(char ***commands) {
             if (i > 0) {
                 if (dup2(pipes[i - 1][0], STDIN_FILENO) == -1) {
                     perror("dup2");
-                    exit(EXIT_FAILURE);
+                    _exit(EXIT_FAILURE);
                 }
             }
             
@@ -753,7 +806,7 @@ int lsh_execute_piped(char ***commands) {
             if (i < cmd_count - 1) {
                 if (dup2(pipes[i][1], STDOUT_FILENO) == -1) {
                     perror("dup2");
-                    exit(EXIT_FAILURE);
+                    _exit(EXIT_FAILURE);
                 }
             }
             
@@ -764,10 +817,8 @@ int lsh_execute_piped(char ***commands) {
             }
             
             // Execute the command
-            if (execvp(commands[i][0], commands[i]) == -1) {
-                perror("execvp");
-                exit(EXIT_FAILURE);
-            }
+            execvp(commands[i][0], commands[i]);
+            exit_exec_failed("execvp");
         }
     }
     
@@ -777,10 +828,12 @@ int lsh_execute_piped(char ***commands) {
         close(pipes[i][1]);
     }
     
-    // Wait for all children
+    // Wait for all children; the pipeline's status is its last command's
     for (int i = 0; i < cmd_count; i++) {
         int status;
         waitpid(pids[i], &status, 0);
+        if (i == cmd_count - 1)
+            record_exit_status(status);
     }
     
     return 1;
@@ -806,29 +859,185 @@ void display_welcome_banner(void) {
     printf(ANSI_COLOR_RESET);
 }
 
-void lsh_loop(void) {
-    char *line;
+// Run one command line: pipelines, && groups or a single command. Typo
+// corrections are only offered to interactive users. Returns 0 when the
+// shell should exit
+int lsh_run_line(char *line, int interactive) {
     char **args;
     char ***commands = NULL;
     int status = 1;
+    
+    // Check for pipes or && and parse into multiple commands if present
+    if (strchr(line, '|') != NULL || strchr(line, '&') != NULL) {
+        commands = lsh_split_commands(line);
+        
+        // Find if there are command groups (&&)
+        int has_cmd_groups = 0;
+        char **remaining_cmd_groups = NULL;
+        char **marker = NULL;
+        int cmd_count = 0;
+        
+        // Count commands and check for the special command groups marker
+        while (commands[cmd_count] != NULL) {
+            cmd_count++;
+        }
+        
+        // We need at least 2 positions for command groups:
+        // 1. The groups themselves
+        // 2. The marker with "&&_COMMAND_GROUPS"
+        if (cmd_count > 1) {
+            // Get the last non-null command
+            marker = commands[cmd_count-1];
+            
+            // Check if it's the marker
+            if (marker != NULL && marker[0] != NULL && 
+                strcmp(marker[0], "&&_COMMAND_GROUPS") == 0) {
+                
+                has_cmd_groups = 1;
+                
+                // Get the command groups from the previous position
+                remaining_cmd_groups = commands[cmd_count-2];
+                
+                // Set these positions to NULL so they don't get processed
+                // as regular commands
+                commands[cmd_count-1] = NULL;
+                commands[cmd_count-2] = NULL;
+            }
+        }
+        
+        // Execute the first command or pipeline
+        status = lsh_execute_piped(commands);
+        
+        // If successful and we have command groups, execute them sequentially
+        if (status && g_last_exit_status == 0 && has_cmd_groups &&
+            remaining_cmd_groups != NULL) {
+            for (int i = 0; remaining_cmd_groups[i] != NULL; i++) {
+                char *cmd_group = remaining_cmd_groups[i];
+                
+                // Parse this command group
+                char *cmd_copy = strdup(cmd_group);
+                
+                // Check if it contains pipes
+                if (strchr(cmd_copy, '|') != NULL) {
+                    char ***cmd_commands = lsh_split_commands(cmd_copy);
+                    if (cmd_commands) {
+                        status = lsh_execute_piped(cmd_commands);
+                        free_commands(cmd_commands);
+                    }
+                } else {
+                    // Simple command without pipes
+                    char **args = lsh_split_line(cmd_copy);
+                    
+                    // Check for corrections before executing
+                    char **corrected_args =
+                        interactive ? check_for_corrections(args) : NULL;
+                    if (corrected_args != NULL) {
+                        for (int j = 0; args[j] != NULL; j++) {
+                            free(args[j]);
+                        }
+                        free(args);
+                        args = corrected_args;
+                    }
+                    
+                    // Execute command
+                    status = lsh_execute(args);
+                    
+                    // Free allocated memory
+                    for (int j = 0; args[j] != NULL; j++) {
+                        free(args[j]);
+                    }
+                    free(args);
+                }
+                
+                free(cmd_copy);
+                
+                // If a command failed, stop execution
+                if (!status || g_last_exit_status != 0) {
+                    break;
+                }
+            }
+        }
+        
+        // Clean up marker and command groups if they exist
+        if (has_cmd_groups && marker) {
+            // Free marker
+            if (marker[0]) free(marker[0]);
+            free(marker);
+            
+            // Free command groups
+            if (remaining_cmd_groups) {
+                for (int i = 0; remaining_cmd_groups[i] != NULL; i++) {
+                    free(remaining_cmd_groups[i]);
+                }
+                free(remaining_cmd_groups);
+            }
+        }
+        
+        free_commands(commands);
+    } else {
+        // Normal command parsing
+        args = lsh_split_line(line);
+        
+        // Check for corrections before executing
+        char **corrected_args =
+            interactive ? check_for_corrections(args) : NULL;
+        if (corrected_args != NULL) {
+            // Free the original args
+            for (int i = 0; args[i] != NULL; i++) {
+                free(args[i]);
+            }
+            free(args);
+            args = corrected_args;
+        }
+        
+        // Execute command
+        status = lsh_execute(args);
+        
+        // Free allocated memory
+        for (int i = 0; args[i] != NULL; i++) {
+            free(args[i]);
+        }
+        free(args);
+    }
+    
+    return status;
+}
+
+// Run one initialisation step, timed for --startup-profile
+static void startup_step(const char *name, void (*init)(void)) {
+    struct timespec mark;
+    startup_profile_mark(&mark);
+    init();
+    startup_profile_report(name, &mark);
+}
+
+void lsh_loop(void) {
+    char *line;
+    int status = 1;
     char git_info[LSH_RL_BUFSIZE] = {0};
     int terminal_fd;
     
     // Initialize terminal for raw mode
+    struct timespec mark;
+    startup_profile_mark(&mark);
     terminal_fd = init_terminal(&g_orig_termios);
+    startup_profile_report("terminal", &mark);
     
     // Initialize the status bar
     //init_status_bar(STDOUT_FILENO);
     
-    // Initialize subsystems
-    init_aliases();
-    init_bookmarks();
-    init_tab_completion();
-    init_persistent_history();
-    init_favorite_cities();
-    init_themes();
-    init_autocorrect();
-    init_git_integration();
+    // Initialize subsystems. These only get ready: aliases, bookmarks,
+    // visited directories and cities read their files on first use, and
+    // history loads on a thread
+    startup_step("aliases", init_aliases);
+    startup_step("bookmarks", init_bookmarks);
+    startup_step("directories", init_frecency);
+    startup_step("tab completion", init_tab_completion);
+    startup_step("history", init_persistent_history);
+    startup_step("favorite cities", init_favorite_cities);
+    startup_step("themes", init_themes);
+    startup_step("autocorrect", init_autocorrect);
+    startup_step("git integration", init_git_integration);
     
     // Display the welcome banner
     display_welcome_banner();
@@ -837,8 +1046,12 @@ void lsh_loop(void) {
         // Check for console resize
         check_console_resize(STDOUT_FILENO);
         
+        // Report files that were loaded while the last line was typed
+        startup_profile_flush();
+        
         // Get Git status for current directory
         // If git_status() returns null, git_info[0] will remain 0
+        startup_profile_mark(&mark);
         char *git_status_info = get_git_status();
         if (git_status_info != NULL) {
             strncpy(git_info, git_status_info, LSH_RL_BUFSIZE - 1);
@@ -848,6 +1061,8 @@ void lsh_loop(void) {
             git_info[0] = '\0';
         }
         
+        startup_profile_report("git status", &mark);
+        
         // Update status bar with Git information
         update_status_bar(STDOUT_FILENO, git_info);
         
@@ -865,135 +1080,7 @@ void lsh_loop(void) {
         // Add line to persistent history
         add_to_history(line);
         
-        // Check for pipes or && and parse into multiple commands if present
-        if (strchr(line, '|') != NULL || strchr(line, '&') != NULL) {
-            commands = lsh_split_commands(line);
-            
-            // Find if there are command groups (&&)
-            int has_cmd_groups = 0;
-            char **remaining_cmd_groups = NULL;
-            char **marker = NULL;
-            int cmd_count = 0;
-            
-            // Count commands and check for the special command groups marker
-            while (commands[cmd_count] != NULL) {
-                cmd_count++;
-            }
-            
-            // We need at least 2 positions for command groups:
-            // 1. The groups themselves
-            // 2. The marker with "&&_COMMAND_GROUPS"
-            if (cmd_count > 1) {
-                // Get the last non-null command
-                marker = commands[cmd_count-1];
-                
-                // Check if it's the marker
-                if (marker != NULL && marker[0] != NULL && 
-                    strcmp(marker[0], "&&_COMMAND_GROUPS") == 0) {
-                    
-                    has_cmd_groups = 1;
-                    
-                    // Get the command groups from the previous position
-                    remaining_cmd_groups = commands[cmd_count-2];
-                    
-                    // Set these positions to NULL so they don't get processed
-                    // as regular commands
-                    commands[cmd_count-1] = NULL;
-                    commands[cmd_count-2] = NULL;
-                }
-            }
-            
-            // Execute the first command or pipeline
-            status = lsh_execute_piped(commands);
-            
-            // If successful and we have command groups, execute them sequentially
-            if (status && has_cmd_groups && remaining_cmd_groups != NULL) {
-                for (int i = 0; remaining_cmd_groups[i] != NULL; i++) {
-                    char *cmd_group = remaining_cmd_groups[i];
-                    
-                    // Parse this command group
-                    char *cmd_copy = strdup(cmd_group);
-                    
-                    // Check if it contains pipes
-                    if (strchr(cmd_copy, '|') != NULL) {
-                        char ***cmd_commands = lsh_split_commands(cmd_copy);
-                        if (cmd_commands) {
-                            status = lsh_execute_piped(cmd_commands);
-                            free_commands(cmd_commands);
-                        }
-                    } else {
-                        // Simple command without pipes
-                        char **args = lsh_split_line(cmd_copy);
-                        
-                        // Check for corrections before executing
-                        char **corrected_args = check_for_corrections(args);
-                        if (corrected_args != NULL) {
-                            for (int j = 0; args[j] != NULL; j++) {
-                                free(args[j]);
-                            }
-                            free(args);
-                            args = corrected_args;
-                        }
-                        
-                        // Execute command
-                        status = lsh_execute(args);
-                        
-                        // Free allocated memory
-                        for (int j = 0; args[j] != NULL; j++) {
-                            free(args[j]);
-                        }
-                        free(args);
-                    }
-                    
-                    free(cmd_copy);
-                    
-                    // If a command failed, stop execution
-                    if (!status) {
-                        break;
-                    }
-                }
-            }
-            
-            // Clean up marker and command groups if they exist
-            if (has_cmd_groups && marker) {
-                // Free marker
-                if (marker[0]) free(marker[0]);
-                free(marker);
-                
-                // Free command groups
-                if (remaining_cmd_groups) {
-                    for (int i = 0; remaining_cmd_groups[i] != NULL; i++) {
-                        free(remaining_cmd_groups[i]);
-                    }
-                    free(remaining_cmd_groups);
-                }
-            }
-            
-            free_commands(commands);
-        } else {
-            // Normal command parsing
-            args = lsh_split_line(line);
-            
-            // Check for corrections before executing
-            char **corrected_args = check_for_corrections(args);
-            if (corrected_args != NULL) {
-                // Free the original args
-                for (int i = 0; args[i] != NULL; i++) {
-                    free(args[i]);
-                }
-                free(args);
-                args = corrected_args;
-            }
-            
-            // Execute command
-            status = lsh_execute(args);
-            
-            // Free allocated memory
-            for (int i = 0; args[i] != NULL; i++) {
-                free(args[i]);
-            }
-            free(args);
-        }
+        status = lsh_run_line(line, 1);
         
         free(line);
     } while (status);
@@ -1001,6 +1088,7 @@ void lsh_loop(void) {
     // Shutdown subsystems
     shutdown_aliases();
     shutdown_bookmarks();
+    shutdown_frecency();
     shutdown_tab_completion();
     shutdown_persistent_history();
     shutdown_favorite_cities();
@@ -1010,3 +1098,69 @@ void lsh_loop(void) {
     // Restore terminal
     restore_terminal(terminal_fd, &g_orig_termios);
 }
+
+// Subsystems a script can use. Themes stay off since they write escape
+// sequences to stdout, and history since scripts don't add to it
+static void init_batch_subsystems(void) {
+    startup_step("aliases", init_aliases);
+    startup_step("bookmarks", init_bookmarks);
+    startup_step("directories", init_frecency);
+    startup_step("favorite cities", init_favorite_cities);
+    startup_step("git integration", init_git_integration);
+    
+    // Visits from scripts would crowd out the user's own
+    frecency_disable_recording();
+}
+
+static void shutdown_batch_subsystems(void) {
+    shutdown_aliases();
+    shutdown_bookmarks();
+    shutdown_frecency();
+    shutdown_favorite_cities();
+}
+
+// Batch mode: run each line of a script back to back, with no raw mode,
+// banner, prompt or status bar. Blank lines and # comments are skipped.
+// Returns the exit status of the last external command
+int lsh_run_script(FILE *fp) {
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+    int status = 1;
+    
+    init_batch_subsystems();
+    
+    while (status && (len = getline(&line, &capacity, fp)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        
+        char *start = line;
+        while (*start == ' ' || *start == '\t')
+            start++;
+        if (*start == '\0' || *start == '#')
+            continue;
+        
+        status = lsh_run_line(start, 0);
+    }
+    
+    free(line);
+    fflush(stdout);
+    shutdown_batch_subsystems();
+    return g_last_exit_status;
+}
+
+// Batch mode for a single command line (-c)
+int lsh_run_command(const char *command) {
+    char *line = strdup(command);
+    if (!line) {
+        fprintf(stderr, "lsh: allocation error\n");
+        return EXIT_FAILURE;
+    }
+    
+    init_batch_subsystems();
+    lsh_run_line(line, 0);
+    free(line);
+    fflush(stdout);
+    shutdown_batch_subsystems();
+    return g_last_exit_status;
+}
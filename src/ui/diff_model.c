@@ -0,0 +1,351 @@
+#define _GNU_SOURCE
+#include "diff_model.h"
+#include "git_batch.h"
+#include "git_command.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// diff.algorithm selects histogram (patience is close enough to share it);
+// anything else uses Myers, git's default
+DiffAlgorithm diff_model_algorithm_setting(void) {
+  FILE *fp = popen("git config --get diff.algorithm 2>/dev/null", "r");
+  if (!fp)
+    return DIFF_ALGORITHM_MYERS;
+
+  char value[64] = "";
+  if (!fgets(value, sizeof(value), fp))
+    value[0] = '\0';
+  pclose(fp);
+
+  if (strncmp(value, "histogram", 9) == 0 ||
+      strncmp(value, "patience", 8) == 0)
+    return DIFF_ALGORITHM_HISTOGRAM;
+  return DIFF_ALGORITHM_MYERS;
+}
+
+int diff_model_is_new_file(const char *filename) {
+  // Tracked files have an index entry (stage 2 covers unmerged paths)
+  char object_name[1024];
+  snprintf(object_name, sizeof(object_name), ":%s", filename);
+  int tracked = git_batch_object_info(object_name, NULL);
+  if (tracked == 0) {
+    snprintf(object_name, sizeof(object_name), ":2:%s", filename);
+    tracked = git_batch_object_info(object_name, NULL);
+  }
+  if (tracked != -1)
+    return !tracked;
+
+  const char *argv[] = {"git", "--literal-pathspecs", "ls-files",
+                        "--error-unmatch", "--", filename, NULL};
+  GitOutput output;
+  if (!git_command_run(argv, NULL, 0, &output))
+    return 1; // Assume new if we can't check
+
+  int is_tracked = output.status == 0 && output.len > 0;
+  git_output_free(&output);
+  return !is_tracked; // Return 1 if not tracked (new file)
+}
+
+// Add the hunks of an in-process diff to a store, tagged the same way as
+// lines parsed from git's output
+int diff_model_append_hunks(NCursesLineStore *store, const DiffResult *diff,
+                            int is_staged) {
+  for (int h = 0; h < diff->hunk_count; h++) {
+    const DiffHunk *hunk = &diff->hunks[h];
+    char header[128];
+    diff_format_hunk_header(hunk, header, sizeof(header));
+
+    NCursesFileLine *file_line =
+        line_store_append(store, header, strlen(header));
+    if (!file_line)
+      return 0;
+    file_line->type = '@';
+    file_line->hunk_id = h;
+    file_line->is_staged = is_staged;
+    file_line->line_number_old = hunk->old_start;
+    file_line->line_number_new = hunk->new_start;
+
+    for (int i = 0; i < hunk->line_count; i++) {
+      const DiffResultLine *diff_line = &diff->lines[hunk->first_line + i];
+      file_line = line_store_appendf(store, "%c%.*s", diff_line->type,
+                                     diff_line->len, diff_line->text);
+      if (!file_line)
+        return 0;
+      file_line->type = diff_line->type;
+      file_line->is_diff_line = (diff_line->type != ' ');
+      file_line->is_context = (diff_line->type == ' ');
+      file_line->hunk_id = h;
+      file_line->is_staged = is_staged;
+      file_line->line_number_old = diff_line->old_line;
+      file_line->line_number_new = diff_line->new_line;
+
+      // Both views are turned into patches, so they keep git's marker
+      if (diff_line->missing_newline) {
+        file_line = line_store_appendf(store, "\\ No newline at end of file");
+        if (!file_line)
+          return 0;
+        file_line->type = ' ';
+        file_line->hunk_id = h;
+        file_line->is_staged = is_staged;
+      }
+    }
+  }
+  return 1;
+}
+
+// Map a working-tree file read-only. A missing file maps as empty so a
+// deletion diffs against nothing; symlinks and special files are refused
+static int map_worktree_file(const char *filename, const char **data,
+                             size_t *size) {
+  *data = NULL;
+  *size = 0;
+
+  struct stat st;
+  if (lstat(filename, &st) == -1)
+    return errno == ENOENT;
+  if (!S_ISREG(st.st_mode))
+    return 0;
+  if (st.st_size == 0)
+    return 1;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return 0;
+  void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+    return 0;
+
+  *data = mapped;
+  *size = st.st_size;
+  return 1;
+}
+
+// Whether git rewrites the working copy of a file on its way into the
+// index, in which case its raw bytes can't be diffed against a blob. Clean
+// filters (LFS among them), ident and working-tree-encoding always count.
+// End-of-line conversion, from the eol and text attributes or from
+// core.autocrlf, only changes CRLF line endings, so it counts when the
+// file has any and the text attribute isn't unset
+static int worktree_is_converted(const char *filename, const char *data,
+                                 size_t size) {
+  const char *argv[] = {"git", "check-attr", "-z", "filter", "ident",
+                        "working-tree-encoding", "text", "--", filename,
+                        NULL};
+  GitOutput output;
+  if (!git_command_run(argv, NULL, 0, &output))
+    return 1;
+  if (output.status != 0) {
+    git_output_free(&output);
+    return 1;
+  }
+
+  // -z output is path, attribute and value, each NUL-terminated
+  int converted = 0;
+  int text_unset = 0;
+  const char *p = output.data;
+  const char *end = output.data + output.len;
+  while (p < end) {
+    const char *attribute = p + strlen(p) + 1;
+    if (attribute >= end)
+      break;
+    const char *value = attribute + strlen(attribute) + 1;
+    if (value >= end)
+      break;
+    p = value + strlen(value) + 1;
+
+    if (strcmp(attribute, "text") == 0)
+      text_unset = strcmp(value, "unset") == 0;
+    else if (strcmp(value, "unspecified") != 0 && strcmp(value, "unset") != 0)
+      converted = 1;
+  }
+  git_output_free(&output);
+
+  if (!converted && !text_unset && size > 0 &&
+      memmem(data, size, "\r\n", 2))
+    converted = 1;
+  return converted;
+}
+
+// Changes from a blob (":path" for the index, "HEAD:path" for the last
+// commit) to the mmap'd working file. Returns the hunk count, or -1 without
+// touching the store when git's diff has to be used: binary, symlinked or
+// converted files
+int diff_model_load_worktree(NCursesLineStore *store, const char *object_name,
+                             const char *filename, int context,
+                             DiffAlgorithm algorithm) {
+  GitObjectInfo info;
+  char *blob = git_batch_read_object(object_name, &info);
+  if (!blob)
+    return -1;
+
+  const char *work_data;
+  size_t work_size;
+  if (strcmp(info.type, "blob") != 0 ||
+      diff_buffer_is_binary(blob, info.size) ||
+      !map_worktree_file(filename, &work_data, &work_size)) {
+    free(blob);
+    return -1;
+  }
+
+  int hunks = -1;
+  int first_line = store->count;
+  DiffResult diff;
+  if (!diff_buffer_is_binary(work_data, work_size) &&
+      !worktree_is_converted(filename, work_data, work_size) &&
+      diff_buffers(blob, info.size, work_data, work_size, context, algorithm,
+                   &diff)) {
+    if (diff_model_append_hunks(store, &diff, 0))
+      hunks = diff.hunk_count;
+    else
+      line_store_truncate(store, first_line);
+    diff_result_free(&diff);
+  }
+
+  if (work_data)
+    munmap((void *)work_data, work_size);
+  free(blob);
+  return hunks;
+}
+
+// Changes parsed from the output of a `git diff` command, run from argv so
+// paths never pass through a shell. File headers are dropped; returns the
+// hunk count, or -1 when the command can't be run
+int diff_model_load_git(NCursesLineStore *store, const char *const argv[]) {
+  GitOutput output;
+  if (!git_command_run(argv, NULL, 0, &output))
+    return -1;
+
+  char *diff_line;
+  size_t offset = 0;
+  int diff_line_len;
+  int current_hunk = -1;
+  int old_line_num = 0, new_line_num = 0;
+
+  while ((diff_line_len = git_output_next_line(&output, &offset,
+                                               &diff_line)) >= 0) {
+
+    // Skip file headers
+    if (strncmp(diff_line, "diff --git", 10) == 0 ||
+        strncmp(diff_line, "index ", 6) == 0 ||
+        strncmp(diff_line, "--- ", 4) == 0 ||
+        strncmp(diff_line, "+++ ", 4) == 0) {
+      continue;
+    }
+
+    // Only hunk headers, +/-/context lines and missing newline markers are
+    // kept
+    if (!(diff_line[0] == '@' && diff_line[1] == '@') && diff_line[0] != '+' &&
+        diff_line[0] != '-' && diff_line[0] != ' ' && diff_line[0] != '\\') {
+      continue;
+    }
+
+    NCursesFileLine *file_line =
+        line_store_append(store, diff_line, diff_line_len);
+    if (!file_line)
+      break;
+    file_line->is_staged = 0;
+
+    // Process hunk headers and content
+    if (diff_line[0] == '@' && diff_line[1] == '@') {
+      // Parse hunk header: @@ -old_start,old_count +new_start,new_count @@
+      current_hunk++;
+      sscanf(diff_line, "@@ -%d,%*d +%d,%*d @@", &old_line_num, &new_line_num);
+
+      file_line->type = '@';
+      file_line->is_diff_line = 0;
+      file_line->hunk_id = current_hunk;
+      file_line->line_number_old = old_line_num;
+      file_line->line_number_new = new_line_num;
+      file_line->is_context = 0;
+    } else if (diff_line[0] == '+') {
+      file_line->type = '+';
+      file_line->is_diff_line = 1;
+      file_line->hunk_id = current_hunk;
+      file_line->line_number_old = -1;
+      file_line->line_number_new = new_line_num++;
+      file_line->is_context = 0;
+    } else if (diff_line[0] == '-') {
+      file_line->type = '-';
+      file_line->is_diff_line = 1;
+      file_line->hunk_id = current_hunk;
+      file_line->line_number_old = old_line_num++;
+      file_line->line_number_new = -1;
+      file_line->is_context = 0;
+    } else if (diff_line[0] == ' ') {
+      file_line->type = ' ';
+      file_line->is_diff_line = 0;
+      file_line->hunk_id = current_hunk;
+      file_line->line_number_old = old_line_num++;
+      file_line->line_number_new = new_line_num++;
+      file_line->is_context = 1;
+    } else {
+      file_line->type = ' ';
+      file_line->is_diff_line = 0;
+      file_line->hunk_id = current_hunk;
+      file_line->is_context = 0;
+    }
+  }
+
+  git_output_free(&output);
+  return current_hunk + 1;
+}
+
+// An untracked file shown as one hunk adding every line. Returns the number
+// of lines read, or -1 when the file can't be opened
+int diff_model_load_new_file(NCursesLineStore *store, const char *filename) {
+  FILE *fp = fopen(filename, "r");
+  if (!fp)
+    return -1;
+
+  // The header's count is patched in below once the whole file has been
+  // read
+  int header_index = store->count;
+  NCursesFileLine *hunk_line = line_store_appendf(store, "@@ -0,0 +1 @@");
+  if (!hunk_line) {
+    fclose(fp);
+    return -1;
+  }
+  hunk_line->type = '@';
+  hunk_line->is_diff_line = 0;
+  hunk_line->hunk_id = 0;
+  hunk_line->is_staged = 0;
+  hunk_line->line_number_old = 0;
+  hunk_line->line_number_new = 1;
+  hunk_line->is_context = 0;
+
+  char *line = NULL;
+  size_t line_size = 0;
+  int line_len;
+  int line_count = 0;
+
+  while ((line_len = line_store_read_line(fp, &line, &line_size)) >= 0) {
+    NCursesFileLine *file_line =
+        line_store_appendf(store, "+%.*s", line_len, line);
+    if (!file_line)
+      break;
+    file_line->type = '+';
+    file_line->is_diff_line = 1;
+    file_line->hunk_id = 0;
+    file_line->is_staged = 0;
+    file_line->line_number_old = -1;
+    file_line->line_number_new = line_count + 1;
+    file_line->is_context = 0;
+
+    line_count++;
+  }
+
+  free(line);
+  fclose(fp);
+
+  char header[64];
+  snprintf(header, sizeof(header), "@@ -0,0 +1,%d @@", line_count);
+  line_store_set_text(store, header_index, header, strlen(header));
+  return line_count;
+}
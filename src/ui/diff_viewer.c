@@ -2,12 +2,16 @@
 
 #include "diff_viewer.h"
 #include <ctype.h>
+#include <locale.h>
+#include <ncurses.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <termios.h>
-#include <unistd.h>
+
+#define DIFF_COLOR_ADDED 1
+#define DIFF_COLOR_DELETED 2
+#define DIFF_COLOR_HEADER 3
+#define DIFF_COLOR_MODIFIED 4
 
 int init_diff_viewer(DiffViewer *viewer) {
   if (!viewer)
@@ -17,19 +21,35 @@ int init_diff_viewer(DiffViewer *viewer) {
   viewer->selected_file = 0;
   viewer->diff_scroll_offset = 0;
   viewer->current_mode = MODE_FILE_LIST; // Start in file list mode
+  line_store_init(&viewer->diff_store);
+  viewer->diff_algorithm = diff_model_algorithm_setting();
+
+  return 1;
+}
 
-  get_terminal_size(&viewer->terminal_width, &viewer->terminal_height);
+// Size the panels from the current terminal; also called on KEY_RESIZE
+static void update_layout(DiffViewer *viewer) {
+  getmaxyx(stdscr, viewer->terminal_height, viewer->terminal_width);
   viewer->file_panel_width =
       viewer->terminal_width * 0.3; // 30% of screen width
-
-  return 1;
 }
 
-void get_terminal_size(int *width, int *height) {
-  struct winsize w;
-  ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-  *width = w.ws_col;
-  *height = w.ws_row;
+static int ensure_file_capacity(DiffViewer *viewer, int needed) {
+  if (needed <= viewer->file_capacity)
+    return 1;
+
+  int new_capacity = viewer->file_capacity ? viewer->file_capacity * 2 : 64;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  ChangedFile *new_files =
+      realloc(viewer->files, new_capacity * sizeof(ChangedFile));
+  if (!new_files)
+    return 0;
+
+  viewer->files = new_files;
+  viewer->file_capacity = new_capacity;
+  return 1;
 }
 
 int get_changed_files(DiffViewer *viewer) {
@@ -41,318 +61,203 @@ int get_changed_files(DiffViewer *viewer) {
     return 0;
 
   viewer->file_count = 0;
-  char line[512];
-
-  while (fgets(line, sizeof(line), fp) != NULL &&
-         viewer->file_count < MAX_FILES) {
-    // Remove newline
-    char *newline = strchr(line, '\n');
-    if (newline)
-      *newline = '\0';
+  char *line = NULL;
+  size_t line_size = 0;
+  int line_len;
 
-    if (strlen(line) < 3)
+  while ((line_len = line_store_read_line(fp, &line, &line_size)) >= 0) {
+    if (line_len < 3)
       continue;
+    if (!ensure_file_capacity(viewer, viewer->file_count + 1))
+      break;
 
     // Parse git status format: "XY filename"
     char status = line[0];
     if (status == ' ')
       status = line[1]; // Check second column if first is space
 
-    // Skip the status characters and space
-    char *filename = line + 3;
-
-    // Store file info
-    viewer->files[viewer->file_count].status = status;
-    strncpy(viewer->files[viewer->file_count].filename, filename,
-            MAX_FILENAME_LEN - 1);
-    viewer->files[viewer->file_count].filename[MAX_FILENAME_LEN - 1] = '\0';
+    ChangedFile *file = &viewer->files[viewer->file_count];
+    file->status = status;
+    strncpy(file->filename, line + 3, MAX_FILENAME_LEN - 1);
+    file->filename[MAX_FILENAME_LEN - 1] = '\0';
 
     viewer->file_count++;
   }
 
+  free(line);
   pclose(fp);
   return viewer->file_count;
 }
 
-int is_new_file(const char *filename) {
-  char cmd[1024];
-  snprintf(cmd, sizeof(cmd), "git ls-files --error-unmatch \"%s\" 2>/dev/null",
-           filename);
-
-  FILE *fp = popen(cmd, "r");
-  if (!fp)
-    return 1; // Assume new if we can't check
-
-  char output[256];
-  int is_tracked = (fgets(output, sizeof(output), fp) != NULL);
-  pclose(fp);
-
-  return !is_tracked; // Return 1 if not tracked (new file)
-}
-
-int load_new_file_content(DiffViewer *viewer, const char *filename) {
+int load_file_diff(DiffViewer *viewer, const char *filename) {
   if (!viewer || !filename)
     return 0;
 
-  FILE *fp = fopen(filename, "r");
-  if (!fp)
-    return 0;
-
-  viewer->diff_line_count = 0;
+  line_store_clear(&viewer->diff_store);
   viewer->diff_scroll_offset = 0;
 
-  // Add header line
-  DiffLine *header = &viewer->diff_lines[viewer->diff_line_count++];
-  snprintf(header->line, sizeof(header->line), "@@ New file: %s @@", filename);
-  header->type = '@';
-  header->line_number_old = 0;
-  header->line_number_new = 0;
-
-  char line[1024];
-  int line_number = 1;
+  // Untracked files show every line as an addition
+  if (diff_model_is_new_file(filename))
+    return diff_model_load_new_file(&viewer->diff_store, filename) >= 0;
 
-  while (fgets(line, sizeof(line), fp) != NULL &&
-         viewer->diff_line_count < MAX_DIFF_LINES) {
-    // Remove newline
-    char *newline_pos = strchr(line, '\n');
-    if (newline_pos)
-      *newline_pos = '\0';
-
-    DiffLine *diff_line = &viewer->diff_lines[viewer->diff_line_count];
-
-    // Format as addition
-    snprintf(diff_line->line, sizeof(diff_line->line), "+%s", line);
-    diff_line->type = '+';
-    diff_line->line_number_old = 0;
-    diff_line->line_number_new = line_number++;
-
-    viewer->diff_line_count++;
-  }
+  // Staged and unstaged changes together: the HEAD blob against the working
+  // file, or `git diff HEAD` when the engine can't take the path
+  char object_name[1024];
+  snprintf(object_name, sizeof(object_name), "HEAD:%s", filename);
+  if (diff_model_load_worktree(&viewer->diff_store, object_name, filename, 3,
+                               viewer->diff_algorithm) >= 0)
+    return 1;
 
-  fclose(fp);
-  return viewer->diff_line_count;
+  const char *argv[] = {"git", "--literal-pathspecs", "diff", "HEAD", "--",
+                        filename, NULL};
+  return diff_model_load_git(&viewer->diff_store, argv) >= 0;
 }
 
-int load_file_diff(DiffViewer *viewer, const char *filename) {
-  if (!viewer || !filename)
-    return 0;
-
-  // Check if this is a new untracked file
-  if (is_new_file(filename)) {
-    return load_new_file_content(viewer, filename);
+// Draw text from column x, tabs expanded, clipped to width columns
+static void draw_clipped(int y, int x, const char *text, int width) {
+  move(y, x);
+  int col = 0;
+  for (const char *p = text; *p && col < width; p++) {
+    if (*p == '\t') {
+      int spaces = 4 - (col % 4);
+      while (spaces-- > 0 && col < width) {
+        addch(' ');
+        col++;
+      }
+    } else {
+      addch((unsigned char)*p);
+      col++;
+    }
   }
+}
 
-  char cmd[1024];
-  snprintf(cmd, sizeof(cmd), "git diff HEAD -- \"%s\" 2>/dev/null", filename);
+static int diff_panel_height(const DiffViewer *viewer) {
+  return viewer->terminal_height - 3;
+}
 
-  FILE *fp = popen(cmd, "r");
-  if (!fp)
-    return 0;
+static void render_file_panel(DiffViewer *viewer, int start_row,
+                              int available_height) {
+  int name_width = viewer->file_panel_width - 5;
 
-  viewer->diff_line_count = 0;
-  viewer->diff_scroll_offset = 0;
+  for (int i = 0; i < available_height && i < viewer->file_count; i++) {
+    int y = start_row + i;
 
-  char line[1024];
-  int old_line = 0, new_line = 0;
-
-  while (fgets(line, sizeof(line), fp) != NULL &&
-         viewer->diff_line_count < MAX_DIFF_LINES) {
-    // Remove newline
-    char *newline_pos = strchr(line, '\n');
-    if (newline_pos)
-      *newline_pos = '\0';
-
-    DiffLine *diff_line = &viewer->diff_lines[viewer->diff_line_count];
-
-    // Parse diff line
-    if (line[0] == '@' && line[1] == '@') {
-      // Hunk header: @@-old_start,old_count +new_start,new_count@@
-      sscanf(line, "@@-%d,%*d +%d,%*d@@", &old_line, &new_line);
-      old_line--; // Will be incremented before use
-      new_line--;
-
-      strncpy(diff_line->line, line, sizeof(diff_line->line) - 1);
-      diff_line->line[sizeof(diff_line->line) - 1] = '\0';
-      diff_line->type = '@';
-      diff_line->line_number_old = old_line;
-      diff_line->line_number_new = new_line;
-    } else if (line[0] == '+') {
-      new_line++;
-      strncpy(diff_line->line, line, sizeof(diff_line->line) - 1);
-      diff_line->line[sizeof(diff_line->line) - 1] = '\0';
-      diff_line->type = '+';
-      diff_line->line_number_old = old_line;
-      diff_line->line_number_new = new_line;
-    } else if (line[0] == '-') {
-      old_line++;
-      strncpy(diff_line->line, line, sizeof(diff_line->line) - 1);
-      diff_line->line[sizeof(diff_line->line) - 1] = '\0';
-      diff_line->type = '-';
-      diff_line->line_number_old = old_line;
-      diff_line->line_number_new = new_line;
-    } else if (line[0] == ' ') {
-      old_line++;
-      new_line++;
-      strncpy(diff_line->line, line, sizeof(diff_line->line) - 1);
-      diff_line->line[sizeof(diff_line->line) - 1] = '\0';
-      diff_line->type = ' ';
-      diff_line->line_number_old = old_line;
-      diff_line->line_number_new = new_line;
-    } else {
-      // Skip other lines (file headers, etc.)
-      continue;
+    if (i == viewer->selected_file) {
+      int pair = viewer->current_mode == MODE_FILE_LIST ? DIFF_COLOR_HEADER
+                                                         : DIFF_COLOR_ADDED;
+      attron(COLOR_PAIR(pair));
+      mvaddstr(y, 0, "> ");
+      attroff(COLOR_PAIR(pair));
     }
 
-    viewer->diff_line_count++;
+    // Status indicator
+    char status = viewer->files[i].status;
+    int pair = status == 'M'   ? DIFF_COLOR_MODIFIED
+               : status == 'A' ? DIFF_COLOR_ADDED
+               : status == 'D' ? DIFF_COLOR_DELETED
+                               : 0;
+    if (pair)
+      attron(COLOR_PAIR(pair));
+    mvaddch(y, 2, status);
+    if (pair)
+      attroff(COLOR_PAIR(pair));
+
+    draw_clipped(y, 4, viewer->files[i].filename, name_width);
   }
 
-  pclose(fp);
+  // Vertical separator
+  mvvline(start_row, viewer->file_panel_width, ACS_VLINE, available_height);
+}
+
+static void render_diff_panel(DiffViewer *viewer, int start_row,
+                              int available_height) {
+  int diff_panel_start = viewer->file_panel_width + 2;
+  int diff_panel_width = viewer->terminal_width - diff_panel_start;
 
-  // If no diff content but file exists, it might be a new file added to git
-  if (viewer->diff_line_count == 0) {
-    return load_new_file_content(viewer, filename);
+  if (viewer->current_mode == MODE_FILE_LIST) {
+    // Show help text in the right panel when in file list mode
+    attron(COLOR_PAIR(DIFF_COLOR_MODIFIED));
+    draw_clipped(start_row + 1, diff_panel_start + 2,
+                 "Select a file and press Enter to view its diff",
+                 diff_panel_width - 2);
+    attroff(COLOR_PAIR(DIFF_COLOR_MODIFIED));
+    return;
   }
 
-  return viewer->diff_line_count;
+  const NCursesLineStore *store = &viewer->diff_store;
+  for (int i = 0; i < available_height &&
+                  i + viewer->diff_scroll_offset < store->count;
+       i++) {
+    const NCursesFileLine *line = &store->lines[i + viewer->diff_scroll_offset];
+
+    // Color code based on line type
+    int pair = line->type == '+'   ? DIFF_COLOR_ADDED
+               : line->type == '-' ? DIFF_COLOR_DELETED
+               : line->type == '@' ? DIFF_COLOR_HEADER
+                                   : 0;
+    if (pair)
+      attron(COLOR_PAIR(pair));
+    draw_clipped(start_row + i, diff_panel_start, line_store_text(store, line),
+                 diff_panel_width);
+    if (pair)
+      attroff(COLOR_PAIR(pair));
+  }
 }
 
+// Lay the whole frame out in curses' buffer; refresh() then sends only the
+// cells that differ from what is already on the terminal
 void render_diff_viewer(DiffViewer *viewer) {
   if (!viewer)
     return;
 
-  // Clear screen
-  printf("\033[2J\033[H");
+  erase();
 
   // Title bar
-  printf(ANSI_COLOR_CYAN "Git Diff Viewer" ANSI_COLOR_RESET);
+  attron(COLOR_PAIR(DIFF_COLOR_HEADER));
+  mvaddstr(0, 0, "Git Diff Viewer");
+  attroff(COLOR_PAIR(DIFF_COLOR_HEADER));
   if (viewer->current_mode == MODE_FILE_LIST) {
-    printf(" - Use ↑/↓ to navigate files, Enter to view, q to quit\n");
+    addstr(" - Use Up/Down to navigate files, Enter to view, q to quit");
   } else {
-    printf(" - Use ↑/↓ to scroll, ESC to return to file list, q to quit\n");
+    addstr(" - Use Up/Down to scroll, ESC to return to file list, q to quit");
   }
-  printf("─%.0*s\n", viewer->terminal_width - 1,
-         "─────────────────────────────────────────────────────────────────────"
-         "───────────");
+  mvhline(1, 0, ACS_HLINE, viewer->terminal_width);
 
   int start_row = 2;
-  int available_height = viewer->terminal_height - start_row - 1;
-
-  // Render file list (left panel)
-  for (int i = 0; i < available_height && i < viewer->file_count; i++) {
-    printf("\033[%d;1H", start_row + i + 1); // Position cursor
-
-    if (i == viewer->selected_file) {
-      if (viewer->current_mode == MODE_FILE_LIST) {
-        printf(ANSI_COLOR_CYAN "► " ANSI_COLOR_RESET);
-      } else {
-        printf(ANSI_COLOR_GREEN "► " ANSI_COLOR_RESET);
-      }
-    } else {
-      printf("  ");
-    }
-
-    // Status indicator
-    char status = viewer->files[i].status;
-    if (status == 'M') {
-      printf(ANSI_COLOR_YELLOW "M" ANSI_COLOR_RESET);
-    } else if (status == 'A') {
-      printf(ANSI_COLOR_GREEN "A" ANSI_COLOR_RESET);
-    } else if (status == 'D') {
-      printf(ANSI_COLOR_RED "D" ANSI_COLOR_RESET);
-    } else {
-      printf("%c", status);
-    }
-
-    printf(" ");
-
-    // Filename (truncated to fit panel)
-    char truncated_name[256];
-    int max_name_len = viewer->file_panel_width - 6;
-    if ((int)strlen(viewer->files[i].filename) > max_name_len) {
-      strncpy(truncated_name, viewer->files[i].filename, max_name_len - 3);
-      truncated_name[max_name_len - 3] = '\0';
-      strcat(truncated_name, "...");
-    } else {
-      strcpy(truncated_name, viewer->files[i].filename);
-    }
-
-    printf("%-*s", max_name_len, truncated_name);
-
-    // Vertical separator
-    printf("│");
-  }
-
-  // Render diff content (right panel)
-  if (viewer->current_mode == MODE_FILE_CONTENT && viewer->file_count > 0 &&
-      viewer->selected_file < viewer->file_count) {
-    int diff_panel_start = viewer->file_panel_width + 1;
-    int diff_panel_width = viewer->terminal_width - diff_panel_start;
-
-    for (int i = 0; i < available_height &&
-                    (i + viewer->diff_scroll_offset) < viewer->diff_line_count;
-         i++) {
-
-      int line_idx = i + viewer->diff_scroll_offset;
-      DiffLine *line = &viewer->diff_lines[line_idx];
+  int available_height = diff_panel_height(viewer);
 
-      printf("\033[%d;%dH", start_row + i + 1, diff_panel_start + 1);
-
-      // Color code based on line type
-      if (line->type == '+') {
-        printf(ANSI_COLOR_GREEN);
-      } else if (line->type == '-') {
-        printf(ANSI_COLOR_RED);
-      } else if (line->type == '@') {
-        printf(ANSI_COLOR_CYAN);
-      }
-
-      // Truncate line to fit panel
-      char display_line[1024];
-      int max_len = diff_panel_width - 1;
-      if ((int)strlen(line->line) > max_len) {
-        strncpy(display_line, line->line, max_len - 3);
-        display_line[max_len - 3] = '\0';
-        strcat(display_line, "...");
-      } else {
-        strcpy(display_line, line->line);
-      }
-
-      printf("%-*s", max_len, display_line);
-      printf(ANSI_COLOR_RESET);
-    }
-  } else if (viewer->current_mode == MODE_FILE_LIST) {
-    // Show help text in the right panel when in file list mode
-    int diff_panel_start = viewer->file_panel_width + 1;
-    printf("\033[%d;%dH", start_row + 2, diff_panel_start + 3);
-    printf(ANSI_COLOR_YELLOW
-           "Select a file and press Enter to view its diff" ANSI_COLOR_RESET);
-  }
+  render_file_panel(viewer, start_row, available_height);
+  render_diff_panel(viewer, start_row, available_height);
 
   // Status line at bottom
-  printf("\033[%d;1H", viewer->terminal_height);
+  char status[MAX_FILENAME_LEN + 128];
   if (viewer->file_count > 0) {
+    const char *filename = viewer->files[viewer->selected_file].filename;
     if (viewer->current_mode == MODE_FILE_LIST) {
-      printf("File %d/%d: %s [File List Mode]", viewer->selected_file + 1,
-             viewer->file_count, viewer->files[viewer->selected_file].filename);
+      snprintf(status, sizeof(status), "File %d/%d: %s [File List Mode]",
+               viewer->selected_file + 1, viewer->file_count, filename);
     } else {
-      printf("File %d/%d: %s [Content Mode - Line %d/%d]",
-             viewer->selected_file + 1, viewer->file_count,
-             viewer->files[viewer->selected_file].filename,
-             viewer->diff_scroll_offset + 1,
-             viewer->diff_line_count > 0 ? viewer->diff_line_count : 1);
+      int line_count = viewer->diff_store.count;
+      snprintf(status, sizeof(status),
+               "File %d/%d: %s [Content Mode - Line %d/%d]",
+               viewer->selected_file + 1, viewer->file_count, filename,
+               viewer->diff_scroll_offset + 1,
+               line_count > 0 ? line_count : 1);
     }
   } else {
-    printf("No changed files found");
+    snprintf(status, sizeof(status), "No changed files found");
   }
+  draw_clipped(viewer->terminal_height - 1, 0, status,
+               viewer->terminal_width);
 
-  fflush(stdout);
+  refresh();
 }
 
-int handle_diff_input(DiffViewer *viewer, char key) {
+int handle_diff_input(DiffViewer *viewer, int key) {
   if (!viewer)
     return 0;
 
-  int available_height = viewer->terminal_height - 3;
+  int available_height = diff_panel_height(viewer);
 
   switch (key) {
   case 'q':
@@ -368,7 +273,7 @@ int handle_diff_input(DiffViewer *viewer, char key) {
     break;
 
   case 'k':
-  case 65: // Up arrow
+  case KEY_UP:
     if (viewer->current_mode == MODE_FILE_LIST) {
       // Navigate file list
       if (viewer->selected_file > 0) {
@@ -383,7 +288,7 @@ int handle_diff_input(DiffViewer *viewer, char key) {
     break;
 
   case 'j':
-  case 66: // Down arrow
+  case KEY_DOWN:
     if (viewer->current_mode == MODE_FILE_LIST) {
       // Navigate file list
       if (viewer->selected_file < viewer->file_count - 1) {
@@ -391,9 +296,8 @@ int handle_diff_input(DiffViewer *viewer, char key) {
       }
     } else {
       // Scroll diff content down
-      if (viewer->diff_line_count > available_height &&
-          viewer->diff_scroll_offset <
-              viewer->diff_line_count - available_height) {
+      if (viewer->diff_scroll_offset <
+          viewer->diff_store.count - available_height) {
         viewer->diff_scroll_offset++;
       }
     }
@@ -401,36 +305,24 @@ int handle_diff_input(DiffViewer *viewer, char key) {
 
   case '\n':
   case '\r':
+  case KEY_ENTER:
     if (viewer->current_mode == MODE_FILE_LIST && viewer->file_count > 0) {
       // Enter file content mode and load diff
       viewer->current_mode = MODE_FILE_CONTENT;
-      viewer->diff_scroll_offset = 0; // Reset scroll position
       load_file_diff(viewer, viewer->files[viewer->selected_file].filename);
     }
     break;
+
+  case KEY_RESIZE:
+    update_layout(viewer);
+    break;
   }
 
   return 1; // Continue
 }
 
-void set_raw_mode(struct termios *orig_termios) {
-  tcgetattr(STDIN_FILENO, orig_termios);
-
-  struct termios raw = *orig_termios;
-  raw.c_lflag &= ~(ICANON | ECHO);
-  raw.c_cc[VTIME] = 0;
-  raw.c_cc[VMIN] = 1;
-
-  tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
-}
-
-void restore_terminal_mode(struct termios *orig_termios) {
-  tcsetattr(STDIN_FILENO, TCSAFLUSH, orig_termios);
-}
-
 int run_diff_viewer(void) {
   DiffViewer viewer;
-  struct termios orig_termios;
 
   if (!init_diff_viewer(&viewer)) {
     printf("Failed to initialize diff viewer\n");
@@ -439,42 +331,48 @@ int run_diff_viewer(void) {
 
   if (get_changed_files(&viewer) == 0) {
     printf("No changed files found\n");
+    cleanup_diff_viewer(&viewer);
     return 1;
   }
 
   // Don't load initial file diff - start in file list mode
 
-  set_raw_mode(&orig_termios);
+  setlocale(LC_ALL, "");
+  initscr();
+  cbreak();
+  noecho();
+  keypad(stdscr, TRUE);
+  curs_set(0);
+  set_escdelay(25);
+  if (has_colors()) {
+    start_color();
+    use_default_colors();
+    init_pair(DIFF_COLOR_ADDED, COLOR_GREEN, -1);
+    init_pair(DIFF_COLOR_DELETED, COLOR_RED, -1);
+    init_pair(DIFF_COLOR_HEADER, COLOR_CYAN, -1);
+    init_pair(DIFF_COLOR_MODIFIED, COLOR_YELLOW, -1);
+  }
+  update_layout(&viewer);
 
   int running = 1;
   while (running) {
     render_diff_viewer(&viewer);
-
-    char c = getchar();
-
-    // Handle escape sequences for arrow keys
-    if (c == 27) {
-      char seq[3];
-      if (read(STDIN_FILENO, &seq[0], 1) == 1 && seq[0] == '[') {
-        if (read(STDIN_FILENO, &seq[1], 1) == 1) {
-          running = handle_diff_input(&viewer, seq[1]);
-        }
-      } else {
-        running = handle_diff_input(&viewer, c);
-      }
-    } else {
-      running = handle_diff_input(&viewer, c);
-    }
+    running = handle_diff_input(&viewer, getch());
   }
 
-  restore_terminal_mode(&orig_termios);
-  printf("\033[2J\033[H"); // Clear screen
+  endwin();
 
   cleanup_diff_viewer(&viewer);
   return 0;
 }
 
 void cleanup_diff_viewer(DiffViewer *viewer) {
-  // Nothing to clean up for now, but good to have for future expansion
-  (void)viewer;
+  if (!viewer)
+    return;
+
+  free(viewer->files);
+  viewer->files = NULL;
+  viewer->file_count = 0;
+  viewer->file_capacity = 0;
+  line_store_free(&viewer->diff_store);
 }
@@ -1,25 +1,106 @@
-// this is a change
-// this is another change
-
 #include "ncurses_diff_viewer.h"
+#include "diff_model.h"
+#include "git_async.h"
+#include "git_batch.h"
+#include "git_command.h"
 #include "git_integration.h"
+#include "git_patch.h"
 #include <ctype.h>
+#include <errno.h>
 #include <locale.h>
 #include <ncurses.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
 static volatile int terminal_resized = 0;
 
+// Self-pipe used to wake the main loop from signal handlers
+static int wake_pipe[2] = {-1, -1};
+
+static void write_wake_byte(char byte) {
+  if (wake_pipe[1] >= 0) {
+    int saved_errno = errno;
+    ssize_t ignored = write(wake_pipe[1], &byte, 1);
+    (void)ignored;
+    errno = saved_errno;
+  }
+}
+
 void handle_sigwinch(int sig) {
   (void)sig;
   terminal_resized = 1;
+  write_wake_byte('w');
+}
+
+static void handle_sigchld(int sig) {
+  (void)sig;
+  write_wake_byte('c');
+}
+
+static int open_wake_pipe(void) {
+  if (pipe(wake_pipe) == -1) {
+    wake_pipe[0] = wake_pipe[1] = -1;
+    return 0;
+  }
+  for (int i = 0; i < 2; i++) {
+    fcntl(wake_pipe[i], F_SETFL, fcntl(wake_pipe[i], F_GETFL) | O_NONBLOCK);
+    fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+  return 1;
+}
+
+static void close_wake_pipe(void) {
+  for (int i = 0; i < 2; i++) {
+    if (wake_pipe[i] >= 0)
+      close(wake_pipe[i]);
+    wake_pipe[i] = -1;
+  }
+}
+
+static void drain_fd(int fd) {
+  char buf[64];
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+}
+
+static void close_fetch_pidfd(NCursesDiffViewer *viewer) {
+  if (viewer->fetch_pidfd >= 0) {
+    close(viewer->fetch_pidfd);
+    viewer->fetch_pidfd = -1;
+  }
+}
+
+static const char *file_line_text(NCursesDiffViewer *viewer, int index) {
+  return line_store_text(&viewer->file_store, &viewer->file_store.lines[index]);
+}
+
+static const char *staged_line_text(NCursesDiffViewer *viewer, int index) {
+  return line_store_text(&viewer->staged_store,
+                         &viewer->staged_store.lines[index]);
+}
+
+static void set_animation_timer(NCursesDiffViewer *viewer, int armed) {
+  if (viewer->animation_timerfd < 0 || viewer->animation_timer_armed == armed)
+    return;
+
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  if (armed) {
+    spec.it_interval.tv_nsec = SYNC_ANIMATION_TICK_MS * 1000000L;
+    spec.it_value = spec.it_interval;
+  }
+  timerfd_settime(viewer->animation_timerfd, 0, &spec, NULL);
+  viewer->animation_timer_armed = armed;
 }
 
 void handle_terminal_resize(NCursesDiffViewer *viewer) {
@@ -89,6 +170,7 @@ void handle_terminal_resize(NCursesDiffViewer *viewer) {
 
   // Force complete redraw
   terminal_resized = 0;
+  viewer->dirty_windows = DIRTY_ALL;
 }
 
 int init_ncurses_diff_viewer(NCursesDiffViewer *viewer) {
@@ -130,7 +212,7 @@ int init_ncurses_diff_viewer(NCursesDiffViewer *viewer) {
   viewer->staged_scroll_offset = 0;
   viewer->active_pane = 0;
   viewer->total_hunks = 0;
-  viewer->staged_line_count = 0;
+  line_store_clear(&viewer->staged_store);
   memset(viewer->current_file_path, 0, sizeof(viewer->current_file_path));
 
   // Initialize branch commits
@@ -139,6 +221,16 @@ int init_ncurses_diff_viewer(NCursesDiffViewer *viewer) {
   viewer->branch_commits_cursor_line = 0;
   viewer->fetch_pid = -1;
   viewer->fetch_in_progress = 0;
+  viewer->fetch_pidfd = -1;
+  git_op_queue_init(&viewer->git_ops);
+  git_watch_init(&viewer->watch);
+  viewer->dirty_windows = DIRTY_ALL;
+  viewer->animation_timerfd = -1;
+  viewer->animation_timer_armed = 0;
+  viewer->diff_algorithm = diff_model_algorithm_setting();
+  line_store_init(&viewer->branch_commit_store);
+  preview_cache_init(&viewer->preview_cache);
+  syntax_cache_init(&viewer->syntax_cache);
   memset(viewer->current_branch_for_commits, 0,
          sizeof(viewer->current_branch_for_commits));
 
@@ -173,6 +265,13 @@ int init_ncurses_diff_viewer(NCursesDiffViewer *viewer) {
     init_pair(8, COLOR_GREEN, -1);   // main branch (nice green)
     init_pair(9, COLOR_RED, -1);     // origin/* (red)
     init_pair(10, COLOR_YELLOW, -1); // commit hash and arrows
+
+    // Syntax highlighting in diffs
+    init_pair(11, COLOR_CYAN, -1);    // Keywords
+    init_pair(12, COLOR_BLUE, -1);    // Types and literals
+    init_pair(13, COLOR_YELLOW, -1);  // Strings
+    init_pair(14, COLOR_WHITE, -1);   // Comments (dimmed)
+    init_pair(15, COLOR_MAGENTA, -1); // Numbers and preprocessor lines
   }
 
   getmaxyx(stdscr, viewer->terminal_height, viewer->terminal_width);
@@ -230,95 +329,191 @@ int init_ncurses_diff_viewer(NCursesDiffViewer *viewer) {
   return 1;
 }
 
-int get_ncurses_changed_files(NCursesDiffViewer *viewer) {
-  if (!viewer)
+// Grow the file list (and the fuzzy score table that mirrors it)
+static int ensure_file_capacity(NCursesDiffViewer *viewer, int needed) {
+  if (needed <= viewer->file_capacity)
+    return 1;
+
+  int new_capacity = viewer->file_capacity ? viewer->file_capacity : 64;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  NCursesChangedFile *new_files =
+      realloc(viewer->files, new_capacity * sizeof(NCursesChangedFile));
+  if (!new_files)
     return 0;
+  viewer->files = new_files;
 
-  FILE *fp = popen("git status --porcelain 2>/dev/null", "r");
-  if (!fp)
+  struct NCursesScoredFile *new_scores =
+      realloc(viewer->fuzzy_scored_files,
+              new_capacity * sizeof(struct NCursesScoredFile));
+  if (!new_scores)
     return 0;
+  viewer->fuzzy_scored_files = new_scores;
 
-  viewer->file_count = 0;
-  char line[512];
+  viewer->file_capacity = new_capacity;
+  return 1;
+}
 
-  while (fgets(line, sizeof(line), fp) != NULL &&
-         viewer->file_count < MAX_FILES) {
-    char *newline = strchr(line, '\n');
-    if (newline)
-      *newline = '\0';
+// Fill a file entry from one `git status --porcelain` line
+static void parse_status_line(const char *line, NCursesChangedFile *file) {
+  char staged_status = line[0];
+  char unstaged_status = line[1];
 
-    if (strlen(line) < 3)
-      continue;
+  file->status = (unstaged_status != ' ' ? unstaged_status : staged_status);
+  file->marked_for_commit = 0;
+  file->has_staged_changes =
+      (staged_status != ' ' && staged_status != '?') ? 1 : 0;
 
-    char staged_status = line[0];
-    char unstaged_status = line[1];
+  strncpy(file->filename, line + 3, MAX_FILENAME_LEN - 1);
+  file->filename[MAX_FILENAME_LEN - 1] = '\0';
+}
+
+int get_ncurses_changed_files(NCursesDiffViewer *viewer) {
+  if (!viewer)
+    return 0;
 
-    char *filename = line + 3;
+  // A full status covers whatever the watcher has queued up so far. Take
+  // it before git runs, so changes made while it does are kept for the
+  // next refresh
+  git_watch_read(&viewer->watch);
+  git_watch_clear(&viewer->watch,
+                  GIT_WATCH_WORKTREE | GIT_WATCH_INDEX | GIT_WATCH_RESCAN);
+
+  // -z, as refresh_changed_file uses, so paths come back unquoted and
+  // match the entries it updates
+  const char *argv[] = {"git", "status", "--porcelain", "-z", NULL};
+  GitOutput output;
+  if (!git_command_run(argv, NULL, 0, &output))
+    return 0;
 
-    viewer->files[viewer->file_count].status =
-        (unstaged_status != ' ' ? unstaged_status : staged_status);
-    viewer->files[viewer->file_count].marked_for_commit = 0;
-    viewer->files[viewer->file_count].has_staged_changes =
-        (staged_status != ' ' && staged_status != '?') ? 1 : 0;
+  viewer->file_count = 0;
+  for (size_t offset = 0; offset < output.len;) {
+    const char *line = output.data + offset;
+    size_t line_len = strlen(line);
+    offset += line_len + 1;
+
+    // A rename or copy is followed by the path it came from
+    if ((line[0] == 'R' || line[0] == 'C') && offset < output.len)
+      offset += strlen(output.data + offset) + 1;
+    if (line_len < 3)
+      continue;
 
-    strncpy(viewer->files[viewer->file_count].filename, filename,
-            MAX_FILENAME_LEN - 1);
-    viewer->files[viewer->file_count].filename[MAX_FILENAME_LEN - 1] = '\0';
+    if (!ensure_file_capacity(viewer, viewer->file_count + 1))
+      break;
 
+    parse_status_line(line, &viewer->files[viewer->file_count]);
     viewer->file_count++;
   }
 
-  pclose(fp);
+  git_output_free(&output);
+
+  // git status may have refreshed the index; that write isn't a change
+  git_watch_note_index(&viewer->watch);
   return viewer->file_count;
 }
 
-int create_temp_file_with_changes(const char *filename, char *temp_path) {
-  snprintf(temp_path, 256, "/tmp/shell_diff_current_%d", getpid());
-
-  char cmd[1024];
-  snprintf(cmd, sizeof(cmd), "cp \"%s\" \"%s\" 2>/dev/null", filename,
-           temp_path);
+// Re-read the status of one path after staging, instead of the whole
+// repository. The entry is updated, added or dropped from the list
+int refresh_changed_file(NCursesDiffViewer *viewer, const char *filename) {
+  if (!viewer || !filename)
+    return 0;
 
-  return (system(cmd) == 0);
-}
+  // The path comes from the work tree, so it goes to git as an argument,
+  // matched literally, and the entry comes back NUL-terminated and unquoted
+  const char *argv[] = {"git", "--literal-pathspecs", "status", "--porcelain",
+                        "-z", "--", filename, NULL};
+  GitOutput output;
+  if (!git_command_run(argv, NULL, 0, &output))
+    return 0;
+  git_watch_note_index(&viewer->watch);
+  const char *line = output.data;
+  size_t line_len = strlen(line);
 
-int create_temp_file_git_version(const char *filename, char *temp_path) {
-  snprintf(temp_path, 256, "/tmp/shell_diff_git_%d", getpid());
+  int index = -1;
+  for (int i = 0; i < viewer->file_count; i++) {
+    if (strcmp(viewer->files[i].filename, filename) == 0) {
+      index = i;
+      break;
+    }
+  }
 
-  char cmd[1024];
-  snprintf(cmd, sizeof(cmd), "git show HEAD:\"%s\" > \"%s\" 2>/dev/null",
-           filename, temp_path);
+  if (line_len >= 3) {
+    if (index == -1 && ensure_file_capacity(viewer, viewer->file_count + 1))
+      index = viewer->file_count++;
+    if (index != -1) {
+      int marked = viewer->files[index].marked_for_commit;
+      parse_status_line(line, &viewer->files[index]);
+      viewer->files[index].marked_for_commit = marked;
+    }
+  } else if (index != -1) {
+    // No changes left in the file
+    memmove(&viewer->files[index], &viewer->files[index + 1],
+            (viewer->file_count - index - 1) * sizeof(NCursesChangedFile));
+    viewer->file_count--;
+    if (viewer->selected_file >= viewer->file_count)
+      viewer->selected_file =
+          viewer->file_count > 0 ? viewer->file_count - 1 : 0;
+  }
 
-  return (system(cmd) == 0);
+  git_output_free(&output);
+  return 1;
 }
 
-int is_ncurses_new_file(const char *filename) {
-  char cmd[1024];
-  snprintf(cmd, sizeof(cmd), "git ls-files --error-unmatch \"%s\" 2>/dev/null",
-           filename);
+static int is_hunk_header(const NCursesLineStore *store,
+                          const NCursesFileLine *line) {
+  return line->type == '@' &&
+         strncmp(line_store_text(store, line), "@@", 2) == 0;
+}
 
-  FILE *fp = popen(cmd, "r");
-  if (!fp)
-    return 1; // Assume new if we can't check
+// Give every unstaged line its id and record where each hunk starts and
+// ends, so toggling a line only has to look at its own hunk
+static void index_hunks(NCursesDiffViewer *viewer) {
+  NCursesLineStore *store = &viewer->file_store;
+  int hunk = -1;
 
-  char output[256];
-  int is_tracked = (fgets(output, sizeof(output), fp) != NULL);
-  pclose(fp);
+  viewer->total_hunks = 0;
+  viewer->staged_line_total = 0;
+
+  for (int i = 0; i < store->count; i++) {
+    NCursesFileLine *line = &store->lines[i];
+    if (is_hunk_header(store, line)) {
+      if (hunk + 1 >= viewer->hunk_capacity) {
+        int new_capacity =
+            viewer->hunk_capacity ? viewer->hunk_capacity * 2 : 64;
+        NCursesHunkIndex *grown =
+            realloc(viewer->hunks, new_capacity * sizeof(NCursesHunkIndex));
+        if (!grown)
+          break;
+        viewer->hunks = grown;
+        viewer->hunk_capacity = new_capacity;
+      }
+      hunk++;
+      memset(&viewer->hunks[hunk], 0, sizeof(NCursesHunkIndex));
+      viewer->hunks[hunk].first_line = i;
+      viewer->hunks[hunk].preview_first = -1;
+    }
+    line->line_id = i;
+    line->hunk_id = hunk;
+    line->is_staged = 0;
+    if (hunk >= 0)
+      viewer->hunks[hunk].end_line = i + 1;
+  }
 
-  return !is_tracked; // Return 1 if not tracked (new file)
+  viewer->total_hunks = hunk + 1;
 }
 
-
 int load_file_with_staging_info(NCursesDiffViewer *viewer,
                                 const char *filename) {
   if (!viewer || !filename)
     return 0;
 
-  viewer->file_line_count = 0;
+  line_store_clear(&viewer->file_store);
   viewer->file_scroll_offset = 0;
   viewer->file_cursor_line = 0;
   viewer->total_hunks = 0;
-  viewer->staged_line_count = 0;
+  viewer->staged_line_total = 0;
+  line_store_clear(&viewer->staged_store);
   viewer->staged_cursor_line = 0;
 
   // Store current file path
@@ -327,409 +522,548 @@ int load_file_with_staging_info(NCursesDiffViewer *viewer,
   viewer->current_file_path[sizeof(viewer->current_file_path) - 1] = '\0';
 
   // Check if this is a new file
-  if (is_ncurses_new_file(filename)) {
-    // For new files, show first 50 lines as additions
-    FILE *fp = fopen(filename, "r");
-    if (!fp)
+  viewer->current_file_is_new = diff_model_is_new_file(filename);
+  if (viewer->current_file_is_new) {
+    // For new files, every line shows as an addition
+    if (diff_model_load_new_file(&viewer->file_store, filename) < 0)
       return 0;
-
-    char line[1024];
-    int line_count = 0;
-    int current_hunk = 0;
-
-    // Add fake hunk header for new files
-    NCursesFileLine *hunk_line = &viewer->file_lines[viewer->file_line_count];
-    snprintf(hunk_line->line, sizeof(hunk_line->line), "@@ -0,0 +1,%d @@", 50);
-    hunk_line->type = '@';
-    hunk_line->is_diff_line = 0;
-    hunk_line->hunk_id = current_hunk;
-    hunk_line->is_staged = 0;
-    hunk_line->line_number_old = 0;
-    hunk_line->line_number_new = 1;
-    hunk_line->is_context = 0;
-    viewer->file_line_count++;
-
-    while (fgets(line, sizeof(line), fp) != NULL &&
-           viewer->file_line_count < MAX_FULL_FILE_LINES && line_count < 50) {
-
-      char *newline_pos = strchr(line, '\n');
-      if (newline_pos)
-        *newline_pos = '\0';
-
-      NCursesFileLine *file_line = &viewer->file_lines[viewer->file_line_count];
-      snprintf(file_line->line, sizeof(file_line->line), "+%s", line);
-      file_line->type = '+';
-      file_line->is_diff_line = 1;
-      file_line->hunk_id = current_hunk;
-      file_line->is_staged = 0;
-      file_line->line_number_old = -1;
-      file_line->line_number_new = line_count + 1;
-      file_line->is_context = 0;
-
-      viewer->file_line_count++;
-      line_count++;
-    }
-
-    viewer->total_hunks = current_hunk + 1;
-    fclose(fp);
+    viewer->total_hunks = 1;
 
     // For new files, also build staged view from what's actually staged
+    index_hunks(viewer);
     rebuild_staged_view_from_git(viewer);
-    return viewer->file_line_count;
+    return viewer->file_store.count;
+  }
+
+  // Diff the index blob against the working file in-process; git's own
+  // diff is only needed for binary, symlinked or conflicted paths
+  char object_name[1024];
+  snprintf(object_name, sizeof(object_name), ":%s", filename);
+  int hunks = diff_model_load_worktree(&viewer->file_store, object_name,
+                                       filename, 5, viewer->diff_algorithm);
+  if (hunks < 0) {
+    const char *argv[] = {"git", "--literal-pathspecs", "diff", "-U5", "--",
+                          filename, NULL};
+    hunks = diff_model_load_git(&viewer->file_store, argv);
+    if (hunks < 0)
+      return 0;
   }
+  viewer->total_hunks = hunks;
 
-  // Use git diff to get unstaged changes (staging area vs working directory)
-  char cmd[1024];
-  snprintf(cmd, sizeof(cmd), "git diff -U5 \"%s\" 2>/dev/null", filename);
-
-  FILE *diff_fp = popen(cmd, "r");
-  if (!diff_fp)
-    return 0;
-
-  char diff_line[1024];
-  int current_hunk = -1;
-  int old_line_num = 0, new_line_num = 0;
+  // Build staged view from what's actually in git's staging area
+  index_hunks(viewer);
+  rebuild_staged_view_from_git(viewer);
 
-  while (fgets(diff_line, sizeof(diff_line), diff_fp) != NULL &&
-         viewer->file_line_count < MAX_FULL_FILE_LINES) {
+  return viewer->file_store.count;
+}
 
-    char *newline_pos = strchr(diff_line, '\n');
-    if (newline_pos)
-      *newline_pos = '\0';
 
-    // Skip file headers
-    if (strncmp(diff_line, "diff --git", 10) == 0 ||
-        strncmp(diff_line, "index ", 6) == 0 ||
-        strncmp(diff_line, "--- ", 4) == 0 ||
-        strncmp(diff_line, "+++ ", 4) == 0) {
-      continue;
-    }
+// A line's selection: either the one line given, or every line the user
+// toggled for staging
+static int line_selected(const NCursesFileLine *line, int index,
+                         int selected_line) {
+  if (line->type != '+' && line->type != '-')
+    return 0;
+  return selected_line >= 0 ? index == selected_line : line->is_staged;
+}
 
-    NCursesFileLine *file_line = &viewer->file_lines[viewer->file_line_count];
-    strncpy(file_line->line, diff_line, sizeof(file_line->line) - 1);
-    file_line->line[sizeof(file_line->line) - 1] = '\0';
-    file_line->is_staged = 0;
+// Whether line index is followed by a missing newline marker and then by
+// selected lines before the hunk ends
+static int lacks_newline_before_selection(const NCursesLineStore *store,
+                                          int index, int end,
+                                          int selected_line) {
+  if (index + 1 >= end ||
+      line_store_text(store, &store->lines[index + 1])[0] != '\\')
+    return 0;
+  for (int i = index + 2; i < end; i++) {
+    if (line_selected(&store->lines[i], i, selected_line))
+      return 1;
+  }
+  return 0;
+}
 
-    // Process hunk headers and content
-    if (diff_line[0] == '@' && diff_line[1] == '@') {
-      // Parse hunk header: @@ -old_start,old_count +new_start,new_count @@
-      current_hunk++;
-      sscanf(diff_line, "@@ -%d,%*d +%d,%*d @@", &old_line_num, &new_line_num);
-
-      file_line->type = '@';
-      file_line->is_diff_line = 0;
-      file_line->hunk_id = current_hunk;
-      file_line->line_number_old = old_line_num;
-      file_line->line_number_new = new_line_num;
-      file_line->is_context = 0;
-    } else if (diff_line[0] == '+') {
-      file_line->type = '+';
-      file_line->is_diff_line = 1;
-      file_line->hunk_id = current_hunk;
-      file_line->line_number_old = -1;
-      file_line->line_number_new = new_line_num++;
-      file_line->is_context = 0;
-    } else if (diff_line[0] == '-') {
-      file_line->type = '-';
-      file_line->is_diff_line = 1;
-      file_line->hunk_id = current_hunk;
-      file_line->line_number_old = old_line_num++;
-      file_line->line_number_new = -1;
-      file_line->is_context = 0;
-    } else if (diff_line[0] == ' ') {
-      file_line->type = ' ';
-      file_line->is_diff_line = 0;
-      file_line->hunk_id = current_hunk;
-      file_line->line_number_old = old_line_num++;
-      file_line->line_number_new = new_line_num++;
-      file_line->is_context = 1;
-    } else {
+// Whether a line after index, before the hunk ends, stays in the patch as
+// context (on both sides); keep_as_context is the unselected type that
+// turns into context
+static int context_follows(const NCursesLineStore *store, int index, int end,
+                           int selected_line, char keep_as_context) {
+  for (int i = index + 1; i < end; i++) {
+    const NCursesFileLine *line = &store->lines[i];
+    if (line_store_text(store, line)[0] == '\\' ||
+        line_selected(line, i, selected_line))
       continue;
-    }
-
-    viewer->file_line_count++;
+    if (line->type == keep_as_context || line->is_context)
+      return 1;
   }
+  return 0;
+}
 
-  viewer->total_hunks = current_hunk + 1;
-  pclose(diff_fp);
-
-  // Build staged view from what's actually in git's staging area
-  rebuild_staged_view_from_git(viewer);
-
-  return viewer->file_line_count;
+static NCursesFileLine *append_preview_line(NCursesLineStore *dst,
+                                            const char *text, size_t len,
+                                            int line_id) {
+  NCursesFileLine *line = line_store_append(dst, text, len);
+  if (!line)
+    return NULL;
+
+  char first = len > 0 ? text[0] : ' ';
+  line->type = (first == '+' || first == '-') ? first : ' ';
+  line->is_diff_line = (line->type != ' ');
+  line->is_context = (first == ' ');
+  line->is_staged = 1;
+  line->line_id = line_id;
+  return line;
 }
 
+// Header of a hunk in a partial patch. The side git matches against keeps
+// its position; the other side is shifted by the earlier hunks (delta is
+// lines added minus removed by them). A zero-length side names the line
+// before
+static void format_preview_header(const NCursesHunkIndex *hunk, int delta,
+                                  int reverse, char *buffer, size_t size) {
+  int old_start, new_start;
+  if (reverse) {
+    new_start = hunk->old_start;
+    int first = hunk->new_count ? new_start : new_start + 1;
+    old_start = first - delta - (hunk->old_count ? 0 : 1);
+  } else {
+    old_start = hunk->old_start;
+    int first = hunk->old_count ? old_start : old_start + 1;
+    new_start = first + delta - (hunk->new_count ? 0 : 1);
+  }
+  snprintf(buffer, size, "@@ -%d,%d +%d,%d @@", old_start, hunk->old_count,
+           new_start, hunk->new_count);
+}
 
-// this is a change
-// this is another change
-int stage_hunk_by_line(NCursesDiffViewer *viewer, int line_index) {
-  if (!viewer)
+// Append the part of one hunk of src (lines start..end-1, start being its
+// @@ line) that a partial patch needs. The patch must still match the side
+// git applies it to, so unselected lines are rewritten to that side: when
+// staging (applied to the index, the diff's old side) an unselected deletion
+// stays as context and an unselected addition is left out; when unstaging
+// (applied in reverse, the index is the new side) it's the other way round.
+// The header numbers go to numbers->old_start/old_count/new_count; the start
+// stored is the matched side's. Returns the lines appended, 0 if the hunk
+// has nothing selected
+static int append_hunk_preview(NCursesLineStore *dst,
+                               const NCursesLineStore *src, int start, int end,
+                               int selected_line, int reverse, int delta,
+                               NCursesHunkIndex *numbers) {
+  // Lines that turn into context, and lines that are left out
+  char keep_as_context = reverse ? '+' : '-';
+  char drop = reverse ? '-' : '+';
+
+  // Count both sides of the rewritten hunk
+  int old_count = 0, new_count = 0, selected = 0;
+  for (int i = start + 1; i < end; i++) {
+    const NCursesFileLine *line = &src->lines[i];
+    const char *text = line_store_text(src, line);
+    if (line_selected(line, i, selected_line)) {
+      selected++;
+      if (line->type == '-')
+        old_count++;
+      else
+        new_count++;
+    } else if (line->type == drop || text[0] == '\\') {
+      continue;
+    } else if (line->type == keep_as_context || line->is_context) {
+      old_count++;
+      new_count++;
+    }
+  }
+  if (selected == 0)
     return 0;
 
-  if (viewer->active_pane == 0) {
-    // Unstaged pane - use line_index directly from file_lines
-    if (line_index < 0 || line_index >= viewer->file_line_count)
-      return 0;
-
-    NCursesFileLine *selected_line = &viewer->file_lines[line_index];
-
-    // Don't stage/unstage hunk headers or context lines
-    if (selected_line->type == '@' || selected_line->type == ' ')
-      return 0;
+  int old_start = 0, new_start = 0;
+  sscanf(line_store_text(src, &src->lines[start]), "@@ -%d%*[^+]+%d",
+         &old_start, &new_start);
+  numbers->old_start = reverse ? new_start : old_start;
+  numbers->old_count = old_count;
+  numbers->new_count = new_count;
+
+  int first_count = dst->count;
+  char header[128];
+  format_preview_header(numbers, delta, reverse, header, sizeof(header));
+  NCursesFileLine *header_line =
+      line_store_append(dst, header, strlen(header));
+  if (!header_line)
+    return 0;
+  header_line->type = '@';
+  header_line->is_staged = 1;
+  header_line->line_id = start;
+
+  int previous_emitted = 0;
+  int previous_selected = 0;
+  for (int i = start + 1; i < end; i++) {
+    const NCursesFileLine *line = &src->lines[i];
+    const char *text = line_store_text(src, line);
+    int line_id = line->line_id;
+
+    // "\ No newline at end of file" belongs to the line before it. A
+    // selected line that ended its side is followed there by the unselected
+    // lines turned into context, so it gains a newline and loses the marker
+    if (text[0] == '\\') {
+      if (previous_emitted &&
+          !(previous_selected &&
+            context_follows(src, i, end, selected_line, keep_as_context)))
+        append_preview_line(dst, text, line->text_len, line_id);
+      continue;
+    }
 
-    // Only stage actual diff lines (+ or -)
-    if (selected_line->type != '+' && selected_line->type != '-')
-      return 0;
+    previous_emitted = 1;
+    previous_selected = line_selected(line, i, selected_line);
+    if (previous_selected) {
+      append_preview_line(dst, text, line->text_len, line_id);
+    } else if (line->type == keep_as_context &&
+               lacks_newline_before_selection(src, i, end, selected_line)) {
+      // The line ends its side without a newline but the selection adds
+      // lines after it, so it gains one: a change, not context
+      const NCursesFileLine *marker_line = &src->lines[i + 1];
+      const char *marker = line_store_text(src, marker_line);
+      int body_len = line->text_len - 1;
+
+      char *changed = malloc(body_len + 2);
+      if (!changed)
+        break;
+      memcpy(changed + 1, text + 1, body_len);
+      changed[body_len + 1] = '\0';
+
+      changed[0] = '-';
+      append_preview_line(dst, changed, body_len + 1, line_id);
+      if (!reverse)
+        append_preview_line(dst, marker, marker_line->text_len, line_id);
+      changed[0] = '+';
+      append_preview_line(dst, changed, body_len + 1, line_id);
+      if (reverse)
+        append_preview_line(dst, marker, marker_line->text_len, line_id);
+      free(changed);
+      i++;
+    } else if (line->type == keep_as_context) {
+      NCursesFileLine *context =
+          append_preview_line(dst, text, line->text_len, line_id);
+      if (context) {
+        // Same body, now a context line
+        dst->text[context->text_offset] = ' ';
+        context->type = ' ';
+        context->is_diff_line = 0;
+        context->is_context = 1;
+      }
+    } else if (line->type != drop && line->is_context) {
+      append_preview_line(dst, text, line->text_len, line_id);
+    } else {
+      previous_emitted = 0;
+    }
+  }
 
-    // Toggle the staging state
-    selected_line->is_staged = !selected_line->is_staged;
+  return dst->count - first_count;
+}
 
+static void append_preview_headers(NCursesLineStore *dst, const char *path,
+                                   int new_file) {
+  line_store_appendf(dst, "diff --git a/%s b/%s", path, path);
+  if (new_file) {
+    struct stat st;
+    int executable = stat(path, &st) == 0 && (st.st_mode & S_IXUSR);
+    line_store_appendf(dst, "new file mode %s",
+                       executable ? "100755" : "100644");
+    line_store_appendf(dst, "--- /dev/null");
   } else {
-    // Staged pane - need to find corresponding line in file_lines
-    if (line_index < 0 || line_index >= viewer->staged_line_count)
-      return 0;
-
-    NCursesFileLine *staged_line = &viewer->staged_lines[line_index];
+    line_store_appendf(dst, "--- a/%s", path);
+  }
+  line_store_appendf(dst, "+++ b/%s", path);
 
-    // Skip headers and context lines
-    if (staged_line->type == '@' || staged_line->type == ' ')
-      return 0;
+  // File headers are colored like hunk headers
+  for (int i = 0; i < dst->count; i++) {
+    dst->lines[i].type = '@';
+    dst->lines[i].is_staged = 1;
+    dst->lines[i].line_id = -1;
+  }
+}
 
-    // Only unstage actual diff lines (+ or -)
-    if (staged_line->type != '+' && staged_line->type != '-')
+static int store_to_patch(const NCursesLineStore *store, GitPatch *patch) {
+  for (int i = 0; i < store->count; i++) {
+    const NCursesFileLine *line = &store->lines[i];
+    if (!git_patch_append(patch, line_store_text(store, line),
+                          line->text_len) ||
+        !git_patch_append(patch, "\n", 1))
       return 0;
+  }
+  return 1;
+}
 
-    // Find the corresponding line in file_lines and unstage it
-    for (int i = 0; i < viewer->file_line_count; i++) {
-      NCursesFileLine *orig_line = &viewer->file_lines[i];
+// Build a patch of just the selected lines of a diff store (see
+// append_hunk_preview). Returns the number of hunks it touches
+static int build_partial_patch(const NCursesLineStore *store, const char *path,
+                               int selected_line, int reverse, int new_file,
+                               GitPatch *patch) {
+  NCursesLineStore scratch;
+  line_store_init(&scratch);
+  append_preview_headers(&scratch, path, new_file && !reverse);
+
+  int hunk_count = 0;
+  int delta = 0;
+  for (int start = 0; start < store->count; start++) {
+    if (!is_hunk_header(store, &store->lines[start]))
+      continue;
 
-      // Match by content and type
-      if (orig_line->type == staged_line->type &&
-          strcmp(orig_line->line, staged_line->line) == 0 &&
-          orig_line->is_staged) {
+    int end = start + 1;
+    while (end < store->count && !is_hunk_header(store, &store->lines[end]))
+      end++;
 
-        orig_line->is_staged = 0; // Unstage it
-        break;
-      }
+    NCursesHunkIndex numbers;
+    if (append_hunk_preview(&scratch, store, start, end, selected_line,
+                            reverse, delta, &numbers)) {
+      delta += numbers.new_count - numbers.old_count;
+      hunk_count++;
     }
+    start = end - 1;
   }
 
-  // Rebuild staged view to reflect changes
-  rebuild_staged_view(viewer);
-  return 1;
+  if (hunk_count > 0 && !store_to_patch(&scratch, patch))
+    hunk_count = 0;
+  line_store_free(&scratch);
+  return hunk_count;
 }
 
+// Show the lines picked for staging as the patch that `a` will apply
 void rebuild_staged_view(NCursesDiffViewer *viewer) {
   if (!viewer)
     return;
 
-  viewer->staged_line_count = 0;
+  line_store_clear(&viewer->staged_store);
 
-  // Check if we have any staged changes
-  int has_staged_changes = 0;
-  for (int i = 0; i < viewer->file_line_count; i++) {
-    if (viewer->file_lines[i].is_staged) {
-      has_staged_changes = 1;
-      break;
-    }
+  // With nothing picked, show what the index already has
+  if (viewer->staged_line_total == 0) {
+    rebuild_staged_view_from_git(viewer);
+    return;
   }
 
-  if (!has_staged_changes) {
-    return;
+  append_preview_headers(&viewer->staged_store, viewer->current_file_path,
+                         viewer->current_file_is_new);
+
+  int delta = 0;
+  for (int h = 0; h < viewer->total_hunks; h++) {
+    NCursesHunkIndex *hunk = &viewer->hunks[h];
+    int first = viewer->staged_store.count;
+    int added = hunk->staged_lines > 0
+                    ? append_hunk_preview(&viewer->staged_store,
+                                          &viewer->file_store,
+                                          hunk->first_line, hunk->end_line, -1,
+                                          0, delta, hunk)
+                    : 0;
+    hunk->preview_first = added ? first : -1;
+    hunk->preview_len = added;
+    hunk->preview_delta = delta;
+    if (added)
+      delta += hunk->new_count - hunk->old_count;
   }
+}
 
-  // Add git diff header
-  NCursesFileLine *header = &viewer->staged_lines[viewer->staged_line_count++];
-  snprintf(header->line, sizeof(header->line), "diff --git a/%s b/%s",
-           viewer->current_file_path, viewer->current_file_path);
-  header->type = '@';
-  header->is_diff_line = 0;
-  header->is_staged = 1;
-  header->is_context = 0;
-
-  // Add index line
-  header = &viewer->staged_lines[viewer->staged_line_count++];
-  snprintf(header->line, sizeof(header->line), "index 13bdd0a..9abd450 100644");
-  header->type = '@';
-  header->is_diff_line = 0;
-  header->is_staged = 1;
-  header->is_context = 0;
-
-  // Add file headers
-  header = &viewer->staged_lines[viewer->staged_line_count++];
-  snprintf(header->line, sizeof(header->line), "--- a/%s",
-           viewer->current_file_path);
-  header->type = '@';
-  header->is_diff_line = 0;
-  header->is_staged = 1;
-  header->is_context = 0;
-
-  header = &viewer->staged_lines[viewer->staged_line_count++];
-  snprintf(header->line, sizeof(header->line), "+++ b/%s",
-           viewer->current_file_path);
-  header->type = '@';
-  header->is_diff_line = 0;
-  header->is_staged = 1;
-  header->is_context = 0;
-
-  // Process each hunk that has staged changes
-  for (int hunk = 0; hunk < viewer->total_hunks; hunk++) {
-    // Check if this hunk has staged changes
-    int hunk_has_staged = 0;
-    for (int i = 0; i < viewer->file_line_count; i++) {
-      if (viewer->file_lines[i].hunk_id == hunk &&
-          viewer->file_lines[i].is_staged) {
-        hunk_has_staged = 1;
+// Redo one hunk of the staged preview after a toggle. Only that hunk is
+// rebuilt and spliced in; later hunks just move and, if the hunk's line
+// balance changed, get their headers and running balances renumbered
+static void update_hunk_preview(NCursesDiffViewer *viewer, int hunk_index) {
+  NCursesHunkIndex *hunk = &viewer->hunks[hunk_index];
+  NCursesLineStore *staged = &viewer->staged_store;
+
+  int delta = hunk->preview_delta;
+  int shown = hunk->preview_first >= 0;
+  int old_delta = shown ? hunk->new_count - hunk->old_count : 0;
+
+  int position = staged->count;
+  int remove_count = 0;
+  if (shown) {
+    position = hunk->preview_first;
+    remove_count = hunk->preview_len;
+  } else {
+    for (int h = hunk_index + 1; h < viewer->total_hunks; h++) {
+      if (viewer->hunks[h].preview_first >= 0) {
+        position = viewer->hunks[h].preview_first;
         break;
       }
     }
+  }
 
-    if (!hunk_has_staged)
-      continue;
+  NCursesLineStore scratch;
+  line_store_init(&scratch);
+  int added = hunk->staged_lines > 0
+                  ? append_hunk_preview(&scratch, &viewer->file_store,
+                                        hunk->first_line, hunk->end_line, -1,
+                                        0, delta, hunk)
+                  : 0;
 
-    // Find the hunk boundaries
-    int hunk_start = -1, hunk_end = -1;
-    for (int i = 0; i < viewer->file_line_count; i++) {
-      if (viewer->file_lines[i].hunk_id == hunk) {
-        if (hunk_start == -1)
-          hunk_start = i;
-        hunk_end = i;
-      }
-    }
+  if (!line_store_splice(staged, position, remove_count, &scratch)) {
+    line_store_free(&scratch);
+    rebuild_staged_view(viewer);
+    return;
+  }
+  line_store_free(&scratch);
+
+  hunk->preview_first = added ? position : -1;
+  hunk->preview_len = added;
+  int new_delta = added ? hunk->new_count - hunk->old_count : 0;
 
-    if (hunk_start == -1)
+  int shift = added - remove_count;
+  for (int h = hunk_index + 1; h < viewer->total_hunks; h++) {
+    NCursesHunkIndex *later = &viewer->hunks[h];
+    later->preview_delta += new_delta - old_delta;
+    if (later->preview_first < 0)
       continue;
 
-    // Calculate new hunk header with adjusted line counts
-    int old_start = -1, new_start = -1;
-    int old_count = 0, new_count = 0;
-
-    // Find first line numbers
-    for (int i = hunk_start; i <= hunk_end; i++) {
-      NCursesFileLine *line = &viewer->file_lines[i];
-      if (line->type == '@') {
-        old_start = line->line_number_old;
-        new_start = line->line_number_new;
-      } else if (line->is_staged || line->is_context) {
-        if (line->type != '+')
-          old_count++;
-        if (line->type != '-')
-          new_count++;
-      }
-    }
-
-    // Add hunk header
-    NCursesFileLine *staged_header =
-        &viewer->staged_lines[viewer->staged_line_count++];
-    snprintf(staged_header->line, sizeof(staged_header->line),
-             "@@ -%d,%d +%d,%d @@", old_start, old_count, new_start, new_count);
-    staged_header->type = '@';
-    staged_header->is_diff_line = 0;
-    staged_header->is_staged = 1;
-    staged_header->is_context = 0;
-
-    // Add context lines before staged changes
-    for (int i = hunk_start; i <= hunk_end; i++) {
-      NCursesFileLine *line = &viewer->file_lines[i];
-      if (line->type == '@')
-        continue;
+    later->preview_first += shift;
+    if (new_delta != old_delta) {
+      char header[128];
+      format_preview_header(later, later->preview_delta, 0, header,
+                            sizeof(header));
+      line_store_set_text(staged, later->preview_first, header,
+                          strlen(header));
+    }
+  }
 
-      // Always include context lines and staged diff lines
-      if (line->is_context || line->is_staged) {
-        NCursesFileLine *staged_line =
-            &viewer->staged_lines[viewer->staged_line_count++];
-        *staged_line = *line;
-        staged_line->is_staged = 1;
+  if (viewer->staged_cursor_line >= staged->count)
+    viewer->staged_cursor_line = staged->count > 0 ? staged->count - 1 : 0;
+}
 
-        if (viewer->staged_line_count >= MAX_FULL_FILE_LINES)
-          break;
-      }
-    }
+// Pick or unpick one unstaged line and update the staged preview
+static void toggle_staged_line(NCursesDiffViewer *viewer, int line_index) {
+  NCursesFileLine *line = &viewer->file_store.lines[line_index];
+  if (line->hunk_id < 0 || line->hunk_id >= viewer->total_hunks)
+    return;
 
-    if (viewer->staged_line_count >= MAX_FULL_FILE_LINES)
-      break;
-  }
+  int was_pending = viewer->staged_line_total > 0;
+  int change = line->is_staged ? -1 : 1;
+  line->is_staged = !line->is_staged;
+  viewer->hunks[line->hunk_id].staged_lines += change;
+  viewer->staged_line_total += change;
+
+  // Switching between the index view and the preview redraws the pane
+  if (!was_pending || viewer->staged_line_total == 0)
+    rebuild_staged_view(viewer);
+  else
+    update_hunk_preview(viewer, line->hunk_id);
 }
 
-void rebuild_staged_view_from_git(NCursesDiffViewer *viewer) {
+int stage_hunk_by_line(NCursesDiffViewer *viewer, int line_index) {
   if (!viewer)
-    return;
+    return 0;
 
-  viewer->staged_line_count = 0;
+  if (viewer->active_pane == 0) {
+    // Unstaged pane - use line_index directly from file_lines
+    if (line_index < 0 || line_index >= viewer->file_store.count)
+      return 0;
 
-  // Get staged changes from git (HEAD vs staging area)
-  char cmd[1024];
-  snprintf(cmd, sizeof(cmd), "git diff --cached -U5 \"%s\" 2>/dev/null",
-           viewer->current_file_path);
+    NCursesFileLine *selected_line = &viewer->file_store.lines[line_index];
 
-  FILE *diff_fp = popen(cmd, "r");
-  if (!diff_fp)
-    return;
+    // Only stage actual diff lines (+ or -)
+    if (selected_line->type != '+' && selected_line->type != '-')
+      return 0;
 
-  char diff_line[1024];
-  int has_any_staged = 0;
+    toggle_staged_line(viewer, line_index);
+  } else {
+    // Staged pane - the preview line knows which unstaged line it shows
+    if (line_index < 0 || line_index >= viewer->staged_store.count ||
+        viewer->staged_line_total == 0)
+      return 0;
 
-  // First pass: check if there are any staged changes
-  while (fgets(diff_line, sizeof(diff_line), diff_fp) != NULL) {
-    char *newline_pos = strchr(diff_line, '\n');
-    if (newline_pos)
-      *newline_pos = '\0';
+    NCursesFileLine *staged_line = &viewer->staged_store.lines[line_index];
 
-    // Skip file headers
-    if (strncmp(diff_line, "diff --git", 10) == 0 ||
-        strncmp(diff_line, "index ", 6) == 0 ||
-        strncmp(diff_line, "--- ", 4) == 0 ||
-        strncmp(diff_line, "+++ ", 4) == 0) {
-      continue;
-    }
+    // Only unstage actual diff lines (+ or -)
+    if (staged_line->type != '+' && staged_line->type != '-')
+      return 0;
 
-    if (strlen(diff_line) > 0) {
-      has_any_staged = 1;
-      break;
-    }
+    int source = staged_line->line_id;
+    if (source < 0 || source >= viewer->file_store.count ||
+        !viewer->file_store.lines[source].is_staged)
+      return 0;
+
+    toggle_staged_line(viewer, source);
   }
-  pclose(diff_fp);
 
-  if (!has_any_staged) {
-    return;
+  return 1;
+}
+
+// Staged changes from the HEAD blob versus the index blob. Returns 0 without
+// touching the store when git's diff has to be used (new, deleted, binary or
+// conflicted paths)
+static int load_staged_diff(NCursesDiffViewer *viewer) {
+  char head_name[1024], index_name[1024];
+  snprintf(head_name, sizeof(head_name), "HEAD:%s", viewer->current_file_path);
+  snprintf(index_name, sizeof(index_name), ":%s", viewer->current_file_path);
+
+  GitObjectInfo head_info, index_info;
+  char *head_blob = git_batch_read_object(head_name, &head_info);
+  char *index_blob =
+      head_blob ? git_batch_read_object(index_name, &index_info) : NULL;
+  if (!head_blob || !index_blob || strcmp(head_info.type, "blob") != 0 ||
+      strcmp(index_info.type, "blob") != 0 ||
+      diff_buffer_is_binary(head_blob, head_info.size) ||
+      diff_buffer_is_binary(index_blob, index_info.size)) {
+    free(head_blob);
+    free(index_blob);
+    return 0;
   }
 
-  // Second pass: actually build the staged view
-  diff_fp = popen(cmd, "r");
-  if (!diff_fp)
+  DiffResult diff;
+  int ok = diff_buffers(head_blob, head_info.size, index_blob, index_info.size,
+                        5, viewer->diff_algorithm, &diff);
+  if (ok && diff.hunk_count > 0) {
+    // File headers keep the staged view a valid patch
+    const char *path = viewer->current_file_path;
+    line_store_appendf(&viewer->staged_store, "diff --git a/%s b/%s", path,
+                       path);
+    line_store_appendf(&viewer->staged_store, "index %.7s..%.7s",
+                       head_info.oid, index_info.oid);
+    line_store_appendf(&viewer->staged_store, "--- a/%s", path);
+    line_store_appendf(&viewer->staged_store, "+++ b/%s", path);
+    for (int i = 0; i < viewer->staged_store.count; i++) {
+      viewer->staged_store.lines[i].type = '@';
+      viewer->staged_store.lines[i].is_staged = 1;
+    }
+    ok = viewer->staged_store.count == 4 &&
+         diff_model_append_hunks(&viewer->staged_store, &diff, 1);
+  }
+  diff_result_free(&diff);
+  if (!ok)
+    line_store_clear(&viewer->staged_store);
+
+  free(head_blob);
+  free(index_blob);
+  return ok;
+}
+
+// Staged changes parsed from `git diff --cached` output
+static void load_staged_diff_from_git(NCursesDiffViewer *viewer) {
+  // Get staged changes from git (HEAD vs staging area)
+  const char *argv[] = {"git", "--literal-pathspecs", "diff", "--cached",
+                        "-U5", "--", viewer->current_file_path, NULL};
+  GitOutput output;
+  if (!git_command_run(argv, NULL, 0, &output))
     return;
 
-  while (fgets(diff_line, sizeof(diff_line), diff_fp) != NULL &&
-         viewer->staged_line_count < MAX_FULL_FILE_LINES) {
+  char *diff_line;
+  size_t offset = 0;
+  int diff_line_len;
+  int has_any_staged = 0;
 
-    char *newline_pos = strchr(diff_line, '\n');
-    if (newline_pos)
-      *newline_pos = '\0';
+  while ((diff_line_len = git_output_next_line(&output, &offset,
+                                               &diff_line)) >= 0) {
+    NCursesFileLine *staged_line =
+        line_store_append(&viewer->staged_store, diff_line, diff_line_len);
+    if (!staged_line)
+      break;
+    staged_line->is_staged = 1;
 
-    // Skip file headers for the first few lines, but include them for patch
-    // format
+    // Keep file headers for patch format, but color them like hunk headers
     if (strncmp(diff_line, "diff --git", 10) == 0 ||
         strncmp(diff_line, "index ", 6) == 0 ||
         strncmp(diff_line, "--- ", 4) == 0 ||
         strncmp(diff_line, "+++ ", 4) == 0) {
-
-      NCursesFileLine *staged_line =
-          &viewer->staged_lines[viewer->staged_line_count];
-      strncpy(staged_line->line, diff_line, sizeof(staged_line->line) - 1);
-      staged_line->line[sizeof(staged_line->line) - 1] = '\0';
       staged_line->type = '@';
       staged_line->is_diff_line = 0;
-      staged_line->is_staged = 1;
       staged_line->is_context = 0;
-      viewer->staged_line_count++;
       continue;
     }
 
-    NCursesFileLine *staged_line =
-        &viewer->staged_lines[viewer->staged_line_count];
-    strncpy(staged_line->line, diff_line, sizeof(staged_line->line) - 1);
-    staged_line->line[sizeof(staged_line->line) - 1] = '\0';
-    staged_line->is_staged = 1;
+    if (diff_line_len > 0)
+      has_any_staged = 1;
 
     // Set line type for proper coloring
     if (diff_line[0] == '@' && diff_line[1] == '@') {
@@ -753,107 +1087,110 @@ void rebuild_staged_view_from_git(NCursesDiffViewer *viewer) {
       staged_line->is_diff_line = 0;
       staged_line->is_context = 0;
     }
-
-    viewer->staged_line_count++;
   }
 
-  pclose(diff_fp);
+  git_output_free(&output);
+
+  // Headers alone mean nothing is staged
+  if (!has_any_staged)
+    line_store_clear(&viewer->staged_store);
 }
 
+void rebuild_staged_view_from_git(NCursesDiffViewer *viewer) {
+  if (!viewer)
+    return;
 
-int apply_staged_changes(NCursesDiffViewer *viewer) {
-  if (!viewer || viewer->staged_line_count == 0)
-    return 0;
+  line_store_clear(&viewer->staged_store);
 
-  char *patch_content = malloc(50000);
-  if (!patch_content)
-    return 0;
+  if (!load_staged_diff(viewer))
+    load_staged_diff_from_git(viewer);
+}
 
-  strcpy(patch_content, "");
-  for (int i = 0; i < viewer->staged_line_count; i++) {
-    strcat(patch_content, viewer->staged_lines[i].line);
-    strcat(patch_content, "\n");
-  }
 
-  char patch_filename[256];
-  snprintf(patch_filename, sizeof(patch_filename), "/tmp/lazygit-%d-%ld.patch",
-           getpid(), time(NULL));
+// Refresh the file after its index changed and reload its diff, keeping
+// the cursors where they were when the lines are still there
+static void reload_after_staging(NCursesDiffViewer *viewer) {
+  char path[sizeof(viewer->current_file_path)];
+  strcpy(path, viewer->current_file_path);
+  int file_cursor = viewer->file_cursor_line;
+  int file_scroll = viewer->file_scroll_offset;
+  int staged_cursor = viewer->staged_cursor_line;
 
-  FILE *patch_file = fopen(patch_filename, "w");
-  if (!patch_file) {
-    free(patch_content);
-    return 0;
-  }
+  refresh_changed_file(viewer, path);
+  load_file_with_staging_info(viewer, path);
 
-  fprintf(patch_file, "%s", patch_content);
-  fclose(patch_file);
-  free(patch_content);
+  if (file_cursor < viewer->file_store.count) {
+    viewer->file_cursor_line = file_cursor;
+    if (file_scroll <= file_cursor)
+      viewer->file_scroll_offset = file_scroll;
+  }
+  if (staged_cursor < viewer->staged_store.count)
+    viewer->staged_cursor_line = staged_cursor;
+}
 
-  char cmd[512];
-  snprintf(cmd, sizeof(cmd), "git apply --cached \"%s\" >/dev/null 2>&1",
-           patch_filename);
-  int result = system(cmd);
+// Stage the lines picked in the unstaged pane by piping a patch of just
+// those lines into `git apply --cached`
+int apply_staged_changes(NCursesDiffViewer *viewer) {
+  if (!viewer || viewer->staged_line_total == 0)
+    return 0;
 
-  unlink(patch_filename);
+  // The staged pane already holds the patch
+  GitPatch patch;
+  git_patch_init(&patch);
+  int applied = store_to_patch(&viewer->staged_store, &patch) &&
+                git_apply_patch(&patch, GIT_APPLY_CACHED);
+  git_patch_free(&patch);
 
-  if (result == 0) {
-    // Don't clear staging state - reload from git instead
-    get_ncurses_changed_files(viewer);
-    if (viewer->file_count > 0 && viewer->selected_file < viewer->file_count) {
-      load_file_with_staging_info(
-          viewer, viewer->files[viewer->selected_file].filename);
-    }
-  }
-  return (result == 0);
+  if (applied)
+    reload_after_staging(viewer);
+  return applied;
 }
 
-
+// Unstage one line of the staged pane. Lines only picked for staging are
+// simply unpicked; lines already in the index are taken out by applying a
+// patch of that one line to the index in reverse
 int unstage_line_from_git(NCursesDiffViewer *viewer, int staged_line_index) {
   if (!viewer || staged_line_index < 0 ||
-      staged_line_index >= viewer->staged_line_count)
+      staged_line_index >= viewer->staged_store.count)
     return 0;
 
-  NCursesFileLine *line = &viewer->staged_lines[staged_line_index];
-
-  // Skip headers and context lines
-  if (line->type == '@' || line->type == ' ')
-    return 0;
+  NCursesFileLine *line = &viewer->staged_store.lines[staged_line_index];
 
   // Only unstage actual diff lines (+ or -)
   if (line->type != '+' && line->type != '-')
     return 0;
 
-  // For now, let's just reset the entire file and let user re-stage what they
-  // want This is simpler and more reliable than trying to create reverse
-  // patches
-  char reset_cmd[512];
-  snprintf(reset_cmd, sizeof(reset_cmd),
-           "git reset HEAD \"%s\" >/dev/null 2>&1", viewer->current_file_path);
-  int result = system(reset_cmd);
+  if (viewer->staged_line_total > 0)
+    return stage_hunk_by_line(viewer, staged_line_index);
 
-  if (result == 0) {
-    // Reload after unstaging
-    get_ncurses_changed_files(viewer);
-    if (viewer->file_count > 0 && viewer->selected_file < viewer->file_count) {
-      load_file_with_staging_info(
-          viewer, viewer->files[viewer->selected_file].filename);
-    }
-    return 1;
-  }
+  GitPatch patch;
+  git_patch_init(&patch);
+  int applied =
+      build_partial_patch(&viewer->staged_store, viewer->current_file_path,
+                          staged_line_index, 1, 0, &patch) > 0 &&
+      git_apply_patch(&patch, GIT_APPLY_CACHED | GIT_APPLY_REVERSE);
+  git_patch_free(&patch);
 
-  return 0;
+  if (applied)
+    reload_after_staging(viewer);
+  return applied;
 }
 
-
 int reset_staged_changes(NCursesDiffViewer *viewer) {
   if (!viewer)
     return 0;
 
-  for (int i = 0; i < viewer->file_line_count; i++) {
-    viewer->file_lines[i].is_staged = 0;
+  for (int i = 0; i < viewer->file_store.count; i++) {
+    viewer->file_store.lines[i].is_staged = 0;
+  }
+  for (int h = 0; h < viewer->total_hunks; h++) {
+    viewer->hunks[h].staged_lines = 0;
+    viewer->hunks[h].preview_first = -1;
+    viewer->hunks[h].preview_delta = 0;
   }
+  viewer->staged_line_total = 0;
 
-  viewer->staged_line_count = 0;
+  line_store_clear(&viewer->staged_store);
   rebuild_staged_view(viewer);
 
   return 1;
@@ -885,125 +1222,389 @@ void draw_rounded_box(WINDOW *win) {
   mvwaddch(win, height - 1, width - 1, ACS_LRCORNER);
 }
 
-int get_commit_history(NCursesDiffViewer *viewer) {
-  if (!viewer)
+static int ensure_commit_capacity(NCursesDiffViewer *viewer, int needed) {
+  if (needed <= viewer->commit_capacity)
+    return 1;
+
+  int new_capacity = viewer->commit_capacity ? viewer->commit_capacity : 64;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  NCursesCommit *new_commits =
+      realloc(viewer->commits, new_capacity * sizeof(NCursesCommit));
+  if (!new_commits)
     return 0;
+  viewer->commits = new_commits;
+  viewer->commit_capacity = new_capacity;
+  return 1;
+}
+
+// Fill in a list entry from a full hash, author name and subject
+static void set_commit_entry(NCursesDiffViewer *viewer, NCursesCommit *commit,
+                             const char *oid, const char *author,
+                             size_t author_len, const char *title,
+                             size_t title_len) {
+  snprintf(commit->hash, sizeof(commit->hash), "%.7s", oid);
+
+  // First two letters of the author name
+  commit->author_initials[0] = author_len > 0 ? author[0] : '?';
+  commit->author_initials[1] = author_len > 1 ? author[1] : '?';
+  commit->author_initials[2] = '\0';
+
+  if (title_len >= MAX_COMMIT_TITLE_LEN)
+    title_len = MAX_COMMIT_TITLE_LEN - 1;
+  memcpy(commit->title, title, title_len);
+  commit->title[title_len] = '\0';
+
+  commit->is_pushed =
+      !viewer->upstream_known ||
+      commit_reach_contains(&viewer->pushed_commits, &viewer->commit_graph,
+                            oid);
+}
+
+// Next page from the history walk; each commit's author and subject come
+// from its object through the batch helper
+static int load_commit_page(NCursesDiffViewer *viewer) {
+  int added = 0;
+  char oid[GIT_MAX_OID_HEX_LEN + 1];
+
+  while (added < COMMIT_PAGE_SIZE &&
+         commit_walk_next(&viewer->commit_walk, oid)) {
+    GitObjectInfo info;
+    char *object = git_batch_read_object(oid, &info);
+    GitCommit commit;
+    if (!object || !git_batch_parse_commit(object, info.size, &commit)) {
+      free(object);
+      break;
+    }
+
+    // Author is "Name <email>"; the subject is the message's first line
+    const char *email = memchr(commit.author, '<', commit.author_len);
+    size_t author_len = email ? (size_t)(email - commit.author) : 0;
+    const char *title = commit.message;
+    while (*title == '\n')
+      title++;
 
-  FILE *fp =
-      popen("git log --oneline -20 --format=\"%h|%an|%s\" 2>/dev/null", "r");
+    set_commit_entry(viewer, &viewer->commits[viewer->commit_count], oid,
+                     commit.author, author_len, title, strcspn(title, "\n"));
+    viewer->commit_count++;
+    added++;
+
+    git_batch_free_commit(&commit);
+    free(object);
+  }
+  return added;
+}
+
+// Next page from git log, for when the batch helper is unavailable. Paging
+// continues from the tip the first page started at
+static int load_commit_page_from_log(NCursesDiffViewer *viewer) {
+  char cmd[256];
+  snprintf(cmd, sizeof(cmd),
+           "git log --skip=%d -n %d --format=\"%%H|%%an|%%s\" %s 2>/dev/null",
+           viewer->commit_count, COMMIT_PAGE_SIZE,
+           viewer->commit_log_tip[0] ? viewer->commit_log_tip : "HEAD");
+  FILE *fp = popen(cmd, "r");
   if (!fp)
     return 0;
 
-  viewer->commit_count = 0;
+  int added = 0;
   char line[512];
+  while (added < COMMIT_PAGE_SIZE && fgets(line, sizeof(line), fp) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+
+    // hash|author|title; the title may contain '|' itself
+    char *author = strchr(line, '|');
+    char *title = author ? strchr(author + 1, '|') : NULL;
+    if (!title || (author - line != GIT_OID_HEX_LEN &&
+                   author - line != GIT_MAX_OID_HEX_LEN))
+      continue;
+    *author++ = '\0';
+    *title++ = '\0';
 
-  // Get list of unpushed commits first
-  char unpushed_hashes[MAX_COMMITS][16];
-  int unpushed_count = 0;
-
-  FILE *unpushed_fp =
-      popen("git log origin/HEAD..HEAD --format=\"%h\" 2>/dev/null", "r");
-  if (unpushed_fp) {
-    while (fgets(line, sizeof(line), unpushed_fp) != NULL &&
-           unpushed_count < MAX_COMMITS) {
-      char *newline = strchr(line, '\n');
-      if (newline)
-        *newline = '\0';
-      strncpy(unpushed_hashes[unpushed_count], line,
-              sizeof(unpushed_hashes[unpushed_count]) - 1);
-      unpushed_hashes[unpushed_count]
-                     [sizeof(unpushed_hashes[unpushed_count]) - 1] = '\0';
-      unpushed_count++;
-    }
-    pclose(unpushed_fp);
-  }
-
-  // If origin/HEAD doesn't exist, try origin/main and origin/master
-  if (unpushed_count == 0) {
-    unpushed_fp =
-        popen("git log origin/main..HEAD --format=\"%h\" 2>/dev/null", "r");
-    if (unpushed_fp) {
-      while (fgets(line, sizeof(line), unpushed_fp) != NULL &&
-             unpushed_count < MAX_COMMITS) {
-        char *newline = strchr(line, '\n');
-        if (newline)
-          *newline = '\0';
-        strncpy(unpushed_hashes[unpushed_count], line,
-                sizeof(unpushed_hashes[unpushed_count]) - 1);
-        unpushed_hashes[unpushed_count]
-                       [sizeof(unpushed_hashes[unpushed_count]) - 1] = '\0';
-        unpushed_count++;
-      }
-      pclose(unpushed_fp);
-    }
-  }
-
-  if (unpushed_count == 0) {
-    unpushed_fp =
-        popen("git log origin/master..HEAD --format=\"%h\" 2>/dev/null", "r");
-    if (unpushed_fp) {
-      while (fgets(line, sizeof(line), unpushed_fp) != NULL &&
-             unpushed_count < MAX_COMMITS) {
-        char *newline = strchr(line, '\n');
-        if (newline)
-          *newline = '\0';
-        strncpy(unpushed_hashes[unpushed_count], line,
-                sizeof(unpushed_hashes[unpushed_count]) - 1);
-        unpushed_hashes[unpushed_count]
-                       [sizeof(unpushed_hashes[unpushed_count]) - 1] = '\0';
-        unpushed_count++;
-      }
-      pclose(unpushed_fp);
-    }
-  }
-
-  while (fgets(line, sizeof(line), fp) != NULL &&
-         viewer->commit_count < MAX_COMMITS) {
-    // Remove newline
-    char *newline = strchr(line, '\n');
-    if (newline)
-      *newline = '\0';
-
-    // Parse format: hash|author|title
-    char *hash = strtok(line, "|");
-    char *author = strtok(NULL, "|");
-    char *title = strtok(NULL, "|");
-
-    if (hash && author && title) {
-      // Store commit hash (first 7 chars)
-      strncpy(viewer->commits[viewer->commit_count].hash, hash,
-              sizeof(viewer->commits[viewer->commit_count].hash) - 1);
-      viewer->commits[viewer->commit_count]
-          .hash[sizeof(viewer->commits[viewer->commit_count].hash) - 1] = '\0';
-
-      // Store first two letters of author name
-      viewer->commits[viewer->commit_count].author_initials[0] =
-          author[0] ? author[0] : '?';
-      viewer->commits[viewer->commit_count].author_initials[1] =
-          author[1] ? author[1] : '?';
-      viewer->commits[viewer->commit_count].author_initials[2] = '\0';
-
-      // Store title
-      strncpy(viewer->commits[viewer->commit_count].title, title,
-              MAX_COMMIT_TITLE_LEN - 1);
-      viewer->commits[viewer->commit_count].title[MAX_COMMIT_TITLE_LEN - 1] =
-          '\0';
-
-      // Check if this commit is in the unpushed list
-      viewer->commits[viewer->commit_count].is_pushed = 1; // Default to pushed
-      for (int i = 0; i < unpushed_count; i++) {
-        if (strcmp(viewer->commits[viewer->commit_count].hash,
-                   unpushed_hashes[i]) == 0) {
-          viewer->commits[viewer->commit_count].is_pushed = 0;
-          break;
-        }
-      }
+    if (!viewer->commit_log_tip[0])
+      snprintf(viewer->commit_log_tip, sizeof(viewer->commit_log_tip), "%s",
+               line);
+    set_commit_entry(viewer, &viewer->commits[viewer->commit_count], line,
+                     author, strlen(author), title, strlen(title));
+    viewer->commit_count++;
+    added++;
+  }
+
+  pclose(fp);
+  return added;
+}
+
+// Append the next page of history to the commit list. Returns the number
+// of commits added
+int load_more_commits(NCursesDiffViewer *viewer) {
+  if (!viewer || viewer->commit_log_done ||
+      !ensure_commit_capacity(viewer, viewer->commit_count + COMMIT_PAGE_SIZE))
+    return 0;
+
+  int added = viewer->commit_log_from_git ? load_commit_page_from_log(viewer)
+                                          : load_commit_page(viewer);
+  if (added < COMMIT_PAGE_SIZE)
+    viewer->commit_log_done = 1;
+  return added;
+}
+
+// A name's commit from git rev-parse, for names the batch helper can't be
+// given or when it couldn't say. Returns 0 if the name doesn't resolve
+static int resolve_commit(const char *name, char *oid, size_t size) {
+  char revision[128];
+  snprintf(revision, sizeof(revision), "%s^{commit}", name);
+  const char *argv[] = {"git", "rev-parse", "-q", "--verify", revision, NULL};
+  GitOutput output;
+  if (!git_command_run(argv, NULL, 0, &output))
+    return 0;
+  output.data[strcspn(output.data, "\n")] = '\0';
+  int found = output.status == 0 && git_is_oid_hex(output.data);
+  if (found)
+    snprintf(oid, size, "%s", output.data);
+  git_output_free(&output);
+  return found;
+}
+
+// Work out which commits are on the upstream: the branch's upstream, else
+// origin's default branch. With a commit-graph this is one bitmap walk,
+// redone only when the upstream moves
+static void load_pushed_state(NCursesDiffViewer *viewer, const char *head) {
+  static const char *upstreams[] = {"@{upstream}", "origin/HEAD",
+                                    "origin/main", "origin/master"};
+
+  viewer->upstream_known = 0;
+  for (size_t i = 0; i < sizeof(upstreams) / sizeof(upstreams[0]); i++) {
+    if (!head) {
+      // No batch helper: let rev-list resolve the names
+      commit_reach_free(&viewer->pushed_commits);
+      viewer->upstream_known = commit_reach_compute(
+          &viewer->pushed_commits, NULL, upstreams[i], "HEAD");
+      if (viewer->upstream_known)
+        return;
+      continue;
+    }
 
-      viewer->commit_count++;
+    // @{upstream} makes the batch helper exit when there is none, so git
+    // rev-parse resolves it; the helper only gets plain ref names
+    GitObjectInfo tip;
+    if (i == 0) {
+      if (!resolve_commit(upstreams[i], tip.oid, sizeof(tip.oid)))
+        continue;
+    } else {
+      char name[64];
+      snprintf(name, sizeof(name), "%s^{commit}", upstreams[i]);
+      if (git_batch_object_info(name, &tip) != 1)
+        continue;
     }
+    viewer->upstream_known = commit_reach_compute(
+        &viewer->pushed_commits, &viewer->commit_graph, tip.oid, head);
+    return;
+  }
+}
+
+static int compare_ref_lines(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void free_ref_state(NCursesRefState *state) {
+  free(state->text);
+  free(state->lines);
+  memset(state, 0, sizeof(NCursesRefState));
+}
+
+
+// Every ref, plus HEAD on a line of its own so a detached HEAD moving
+// counts as a change. Returns 0 if git couldn't list them
+static int load_ref_state(NCursesRefState *state, const char *head_oid) {
+  memset(state, 0, sizeof(NCursesRefState));
+  char resolved[GIT_MAX_OID_HEX_LEN + 1];
+  if (!head_oid && resolve_commit("HEAD", resolved, sizeof(resolved)))
+    head_oid = resolved;
+  const char *argv[] = {"git", "for-each-ref",
+                        "--format=%(refname)%09%(objectname)%09"
+                        "%(*objectname)%09%(HEAD)",
+                        NULL};
+  GitOutput output;
+  if (!git_command_run(argv, NULL, 0, &output))
+    return 0;
+  if (output.status != 0) {
+    git_output_free(&output);
+    return 0;
+  }
+
+  size_t head_len = head_oid ? strlen(head_oid) + 6 : 0;
+  char *text = realloc(output.data, output.len + head_len + 1);
+  if (!text) {
+    git_output_free(&output);
+    return 0;
+  }
+  if (head_oid)
+    snprintf(text + output.len, head_len + 1, "HEAD\t%s\n", head_oid);
+
+  int count = 0;
+  for (char *p = text; *p; p++)
+    count += *p == '\n';
+  char **lines = malloc((count + 1) * sizeof(char *));
+  if (!lines) {
+    free(text);
+    return 0;
   }
 
-  pclose(fp);
+  count = 0;
+  for (char *line = text; *line;) {
+    char *end = strchr(line, '\n');
+    if (end)
+      *end = '\0';
+    lines[count++] = line;
+    if (!end)
+      break;
+    line = end + 1;
+  }
+  qsort(lines, count, sizeof(char *), compare_ref_lines);
+
+  state->text = text;
+  state->lines = lines;
+  state->count = count;
+  return 1;
+}
+
+// Previews still worth keeping after the history reloads
+typedef struct {
+  const NCursesDiffViewer *viewer;
+  char (*moved)[GIT_MAX_OID_HEX_LEN + 1]; // Commits whose decorations changed
+  int moved_count;
+} PreviewRetainContext;
+
+// Note the commits a ref line names: the fields after the refname hold its
+// target and, for a tag, the commit the tag points at
+static void add_moved_commits(PreviewRetainContext *retain,
+                              const char *line) {
+  const char *tab = strchr(line, '\t');
+  for (int i = 0; i < 2 && tab; i++) {
+    const char *field = tab + 1;
+    tab = strchr(field, '\t');
+    int len = tab ? (int)(tab - field) : (int)strlen(field);
+    if (len == 0 || len > GIT_MAX_OID_HEX_LEN)
+      continue;
+
+    void *grown = realloc(retain->moved, (retain->moved_count + 1) *
+                                             sizeof(*retain->moved));
+    if (!grown)
+      return;
+    retain->moved = grown;
+    snprintf(retain->moved[retain->moved_count++], sizeof(*retain->moved),
+             "%.*s", len, field);
+  }
+}
+
+static int keep_preview(PreviewKind kind, const char *key, void *context) {
+  const PreviewRetainContext *retain = context;
+
+  // Stash diffs carry no decorations; a branch log decorates every commit
+  // in it, so any ref change may show there
+  if (kind == PREVIEW_STASH)
+    return 1;
+  if (kind == PREVIEW_BRANCH)
+    return retain->moved_count == 0;
+
+  size_t key_len = strlen(key);
+  for (int i = 0; i < retain->moved_count; i++) {
+    if (strncmp(retain->moved[i], key, key_len) == 0)
+      return 0;
+  }
+  const NCursesDiffViewer *viewer = retain->viewer;
+  for (int i = 0; i < viewer->commit_count; i++) {
+    if (strcmp(viewer->commits[i].hash, key) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+// After a reload, drop the previews of commits that left the list and of
+// commits a ref moved onto or away from, since those show decorations. The
+// rest stay cached, so a fetch that changed nothing keeps the cache warm
+static void retain_commit_previews(NCursesDiffViewer *viewer,
+                                   const char *head_oid) {
+  NCursesRefState current;
+  if (!viewer->ref_state.text || !load_ref_state(&current, head_oid)) {
+    preview_cache_clear(&viewer->preview_cache);
+    free_ref_state(&viewer->ref_state);
+    load_ref_state(&viewer->ref_state, head_oid);
+    return;
+  }
+
+  // Lines in only one of the sorted lists are refs that were added,
+  // removed or moved
+  PreviewRetainContext retain = {viewer, NULL, 0};
+  const NCursesRefState *old = &viewer->ref_state;
+  int i = 0, j = 0;
+  while (i < old->count || j < current.count) {
+    int cmp = i >= old->count       ? 1
+              : j >= current.count ? -1
+                                   : strcmp(old->lines[i], current.lines[j]);
+    if (cmp == 0) {
+      i++;
+      j++;
+    } else if (cmp < 0) {
+      add_moved_commits(&retain, old->lines[i++]);
+    } else {
+      add_moved_commits(&retain, current.lines[j++]);
+    }
+  }
+
+  preview_cache_retain(&viewer->preview_cache, keep_preview, &retain);
+  free(retain.moved);
+  free_ref_state(&viewer->ref_state);
+  viewer->ref_state = current;
+}
+
+// (Re)load history from HEAD. As many commits as were loaded before are
+// paged in again, so a refresh doesn't cut the list under the cursor
+int get_commit_history(NCursesDiffViewer *viewer) {
+  if (!viewer)
+    return 0;
+
+  // gc and fetch rewrite the commit-graph; positions in the old one are
+  // meaningless in the new
+  if (!viewer->commit_graph.path[0] ||
+      commit_graph_changed(&viewer->commit_graph)) {
+    commit_graph_close(&viewer->commit_graph);
+    commit_reach_free(&viewer->pushed_commits);
+    commit_graph_open(&viewer->commit_graph);
+  }
+
+  int previous_count = viewer->commit_count;
+  commit_walk_free(&viewer->commit_walk);
+  viewer->commit_count = 0;
+  viewer->commit_log_done = 0;
+  viewer->commit_log_tip[0] = '\0';
+
+  GitObjectInfo head;
+  int head_found = git_batch_object_info("HEAD^{commit}", &head);
+  if (head_found == 0) {
+    // No commits yet
+    viewer->commit_log_done = 1;
+    preview_cache_clear(&viewer->preview_cache);
+    return 0;
+  }
+
+  viewer->commit_log_from_git = head_found == -1;
+  if (viewer->commit_log_from_git) {
+    load_pushed_state(viewer, NULL);
+  } else {
+    snprintf(viewer->commit_log_tip, sizeof(viewer->commit_log_tip), "%s",
+             head.oid);
+    load_pushed_state(viewer, head.oid);
+    commit_walk_start(&viewer->commit_walk, &viewer->commit_graph, head.oid);
+  }
+
+  do {
+    if (load_more_commits(viewer) == 0)
+      break;
+  } while (viewer->commit_count < previous_count);
+
+  retain_commit_previews(viewer, head_found == 1 ? head.oid : NULL);
   return viewer->commit_count;
 }
 
@@ -1494,75 +2095,65 @@ int get_commit_title_input(char *title, int max_len, char *message,
   return strlen(title) > 0 ? 1 : 0;
 }
 
-int commit_marked_files(NCursesDiffViewer *viewer, const char *commit_title,
-                        const char *commit_message) {
-  if (!viewer || !commit_title || strlen(commit_title) == 0)
-    return 0;
+// Commit messages go to `git commit -F -` on stdin, no temp file needed
+static void format_commit_message(const char *title, const char *message,
+                                  char *buffer, size_t buffer_size) {
+  if (message && strlen(message) > 0) {
+    snprintf(buffer, buffer_size, "%s\n\n%s", title, message);
+  } else {
+    snprintf(buffer, buffer_size, "%s", title);
+  }
+}
 
-  // First, add marked files to git
+// Queue one `git add` for every marked file; it reads the paths from stdin,
+// NUL-separated and taken literally so no file name is read as a pattern.
+// Returns 0 if the command couldn't be queued
+static int queue_stage_marked_files(NCursesDiffViewer *viewer) {
+  size_t paths_len = 0;
   for (int i = 0; i < viewer->file_count; i++) {
-    if (viewer->files[i].marked_for_commit) {
-      char cmd[1024];
-      snprintf(cmd, sizeof(cmd), "git add \"%s\" 2>/dev/null >/dev/null",
-               viewer->files[i].filename);
-      system(cmd);
-    }
+    if (viewer->files[i].marked_for_commit)
+      paths_len += strlen(viewer->files[i].filename) + 1;
   }
+  if (paths_len == 0)
+    return 1;
 
-  // Write commit message to temp file
-  char temp_msg_file[256];
-  snprintf(temp_msg_file, sizeof(temp_msg_file), "/tmp/commit_msg_%d",
-           getpid());
-
-  FILE *msg_file = fopen(temp_msg_file, "w");
-  if (!msg_file)
+  char *paths = malloc(paths_len);
+  if (!paths)
     return 0;
 
-  if (commit_message && strlen(commit_message) > 0) {
-    fprintf(msg_file, "%s\n\n%s", commit_title, commit_message);
-  } else {
-    fprintf(msg_file, "%s", commit_title);
-  }
-  fclose(msg_file);
-
-  char commit_cmd[512];
-  snprintf(commit_cmd, sizeof(commit_cmd),
-           "git commit -F \"%s\" 2>/dev/null >/dev/null", temp_msg_file);
-  int result = system(commit_cmd);
-  unlink(temp_msg_file);
-
-  if (result == 0) {
-    // Small delay to ensure git has processed the commit
-    usleep(100000); // 100ms delay
-
-    // Refresh file list and commit history
-    get_ncurses_changed_files(viewer);
-    get_commit_history(viewer);
-    get_ncurses_git_branches(viewer);
-
-    // Reset selection if no files remain
-    if (viewer->file_count == 0) {
-      viewer->selected_file = 0;
-      viewer->file_line_count = 0;
-      viewer->file_scroll_offset = 0;
-    } else if (viewer->selected_file >= viewer->file_count) {
-      viewer->selected_file = viewer->file_count - 1;
+  size_t used = 0;
+  for (int i = 0; i < viewer->file_count; i++) {
+    if (viewer->files[i].marked_for_commit) {
+      size_t len = strlen(viewer->files[i].filename) + 1;
+      memcpy(paths + used, viewer->files[i].filename, len);
+      used += len;
     }
+  }
 
-    // Reload the currently selected file's diff if files still exist
-    if (viewer->file_count > 0 && viewer->selected_file < viewer->file_count) {
-      load_file_with_staging_info(
-          viewer, viewer->files[viewer->selected_file].filename);
-    }
+  int queued = git_op_enqueue(&viewer->git_ops, VIEWER_OP_STAGE_MARKED, 0,
+                              paths, used, "git", "--literal-pathspecs", "add",
+                              "--pathspec-from-file=-", "--pathspec-file-nul",
+                              NULL);
+  free(paths);
+  return queued;
+}
 
-    werase(viewer->branch_list_win);
-    render_branch_list_window(viewer);
-    wrefresh(viewer->branch_list_win);
+// Queue the marked files and the commit; the viewer refreshes when the
+// commit finishes. Returns 1 if the work was queued
+int commit_marked_files(NCursesDiffViewer *viewer, const char *commit_title,
+                        const char *commit_message) {
+  if (!viewer || !commit_title || strlen(commit_title) == 0)
+    return 0;
 
-    return 1;
-  }
+  char full_message[MAX_COMMIT_TITLE_LEN + 2048 + 2];
+  format_commit_message(commit_title, commit_message, full_message,
+                        sizeof(full_message));
 
-  return 0;
+  if (!queue_stage_marked_files(viewer))
+    return 0;
+  return git_op_enqueue(&viewer->git_ops, VIEWER_OP_COMMIT, 0, full_message,
+                        strlen(full_message), "git", "commit", "-F", "-",
+                        NULL);
 }
 
 int reset_commit_soft(NCursesDiffViewer *viewer, int commit_index) {
@@ -1573,27 +2164,8 @@ int reset_commit_soft(NCursesDiffViewer *viewer, int commit_index) {
   if (commit_index != 0)
     return 0;
 
-  // Do soft reset of HEAD~1
-  int result = system("git reset --soft HEAD~1 2>/dev/null >/dev/null");
-
-  if (result == 0) {
-    // Small delay to ensure git has processed the reset
-    usleep(100000); // 100ms delay
-
-    // Refresh everything
-    get_ncurses_changed_files(viewer);
-    get_commit_history(viewer);
-
-    // Reload current file if any files exist
-    if (viewer->file_count > 0 && viewer->selected_file < viewer->file_count) {
-      load_file_with_staging_info(
-          viewer, viewer->files[viewer->selected_file].filename);
-    }
-
-    return 1;
-  }
-
-  return 0;
+  return git_op_enqueue(&viewer->git_ops, VIEWER_OP_RESET_SOFT, 0, NULL, 0,
+                        "git", "reset", "--soft", "HEAD~1", NULL);
 }
 
 int reset_commit_hard(NCursesDiffViewer *viewer, int commit_index) {
@@ -1609,32 +2181,8 @@ int reset_commit_hard(NCursesDiffViewer *viewer, int commit_index) {
     return 0; // User cancelled
   }
 
-  // Do hard reset of HEAD~1
-  int result = system("git reset --hard HEAD~1 2>/dev/null >/dev/null");
-
-  if (result == 0) {
-    // Small delay to ensure git has processed the reset
-    usleep(100000); // 100ms delay
-
-    // Refresh everything
-    get_ncurses_changed_files(viewer);
-    get_commit_history(viewer);
-
-    // Reset file selection since changes are discarded
-    viewer->selected_file = 0;
-    viewer->file_line_count = 0;
-    viewer->file_scroll_offset = 0;
-
-    // Reload current file if any files exist
-    if (viewer->file_count > 0 && viewer->selected_file < viewer->file_count) {
-      load_file_with_staging_info(
-          viewer, viewer->files[viewer->selected_file].filename);
-    }
-
-    return 1;
-  }
-
-  return 0;
+  return git_op_enqueue(&viewer->git_ops, VIEWER_OP_RESET_HARD, 0, NULL, 0,
+                        "git", "reset", "--hard", "HEAD~1", NULL);
 }
 
 int amend_commit(NCursesDiffViewer *viewer) {
@@ -1668,74 +2216,20 @@ int amend_commit(NCursesDiffViewer *viewer) {
   strncpy(new_message, current_message, sizeof(new_message) - 1);
   new_message[sizeof(new_message) - 1] = '\0';
 
-  if (get_commit_title_input(new_title, MAX_COMMIT_TITLE_LEN, new_message,
-                             sizeof(new_message))) {
-    // Add any marked files first
-    for (int i = 0; i < viewer->file_count; i++) {
-      if (viewer->files[i].marked_for_commit) {
-        char cmd[1024];
-        snprintf(cmd, sizeof(cmd), "git add \"%s\" 2>/dev/null >/dev/null",
-                 viewer->files[i].filename);
-        system(cmd);
-      }
-    }
-
-    // Write amended commit message to temp file
-    char temp_msg_file[256];
-    snprintf(temp_msg_file, sizeof(temp_msg_file), "/tmp/amend_msg_%d",
-             getpid());
-
-    FILE *msg_file = fopen(temp_msg_file, "w");
-    if (!msg_file)
-      return 0;
-
-    if (strlen(new_message) > 0) {
-      fprintf(msg_file, "%s\n\n%s", new_title, new_message);
-    } else {
-      fprintf(msg_file, "%s", new_title);
-    }
-    fclose(msg_file);
-
-    char amend_cmd[512];
-    snprintf(amend_cmd, sizeof(amend_cmd),
-             "git commit --amend -F \"%s\" 2>/dev/null >/dev/null",
-             temp_msg_file);
-    int result = system(amend_cmd);
-    unlink(temp_msg_file);
-
-    // this is a change i want
-    // this is a change i dont want
-
-    if (result == 0) {
-      // Small delay to ensure git has processed the amend
-      usleep(100000); // 100ms delay
-
-      // Refresh everything after ammending
-      get_ncurses_changed_files(viewer);
-      get_commit_history(viewer);
-      get_ncurses_git_branches(viewer);
-
-      // Reset selection if no files remain
-      if (viewer->file_count == 0) {
-        viewer->selected_file = 0;
-        viewer->file_line_count = 0;
-        viewer->file_scroll_offset = 0;
-      } else if (viewer->selected_file >= viewer->file_count) {
-        viewer->selected_file = viewer->file_count - 1;
-      }
-
-      // Reload current file if any files exist
-      if (viewer->file_count > 0 &&
-          viewer->selected_file < viewer->file_count) {
-        load_file_with_staging_info(
-            viewer, viewer->files[viewer->selected_file].filename);
-      }
+  if (!get_commit_title_input(new_title, MAX_COMMIT_TITLE_LEN, new_message,
+                              sizeof(new_message)))
+    return 0;
 
-      return 1;
-    }
-  }
+  char full_message[MAX_COMMIT_TITLE_LEN + 2048 + 2];
+  format_commit_message(new_title, new_message, full_message,
+                        sizeof(full_message));
 
-  return 0;
+  // Add any marked files first
+  if (!queue_stage_marked_files(viewer))
+    return 0;
+  return git_op_enqueue(&viewer->git_ops, VIEWER_OP_AMEND, 0, full_message,
+                        strlen(full_message), "git", "commit", "--amend", "-F",
+                        "-", NULL);
 }
 
 // Helper function to check if a character is safe for PAT/username input
@@ -2023,19 +2517,14 @@ int get_github_credentials(char *username, int username_len, char *token,
   return 1;
 }
 
-int execute_git_with_auth(const char *base_cmd, const char *username,
-                          const char *token) {
-  if (!base_cmd || !username || !token)
-    return 1;
+// Turn origin's GitHub URL into one carrying the credentials. Returns 0 for
+// remotes we can't authenticate this way
+int build_authenticated_remote_url(const char *username, const char *token,
+                                   char *auth_url, size_t auth_url_size) {
+  if (!username || !token || !auth_url)
+    return 0;
 
-  FILE *debug_file = fopen("/tmp/git_debug.log", "a");
-  if (debug_file) {
-    fprintf(debug_file, "\n=== Executing git with auth (SAFE VERSION) ===\n");
-    fprintf(debug_file, "Base command: %s\n", base_cmd);
-    fprintf(debug_file, "Username: %s\n", username);
-    fprintf(debug_file, "Token length: %zu\n", strlen(token));
-    fclose(debug_file);
-  }
+  FILE *debug_file;
 
   // Get remote URL to determine auth format
   char remote_url[1024] = "";
@@ -2046,7 +2535,7 @@ int execute_git_with_auth(const char *base_cmd, const char *username,
       fprintf(debug_file, "ERROR: Could not get remote URL\n");
       fclose(debug_file);
     }
-    return 1;
+    return 0;
   }
 
   if (fgets(remote_url, sizeof(remote_url), fp) == NULL) {
@@ -2056,7 +2545,7 @@ int execute_git_with_auth(const char *base_cmd, const char *username,
       fprintf(debug_file, "ERROR: No remote URL found\n");
       fclose(debug_file);
     }
-    return 1;
+    return 0;
   }
   pclose(fp);
 
@@ -2070,14 +2559,10 @@ int execute_git_with_auth(const char *base_cmd, const char *username,
     fclose(debug_file);
   }
 
-  // Create authenticated command using environment variables - SAFE APPROACH
-  char auth_cmd[4096];
-  char auth_url[2048];
-
   if (strstr(remote_url, "https://github.com/")) {
     char *repo_part = remote_url + strlen("https://github.com/");
-    snprintf(auth_url, sizeof(auth_url), "https://%s:%s@github.com/%s",
-             username, token, repo_part);
+    snprintf(auth_url, auth_url_size, "https://%s:%s@github.com/%s", username,
+             token, repo_part);
   } else if (strstr(remote_url, "git@github.com:")) {
     char *repo_part = strchr(remote_url, ':') + 1;
     char repo_clean[512];
@@ -2086,8 +2571,8 @@ int execute_git_with_auth(const char *base_cmd, const char *username,
     if (strstr(repo_clean, ".git")) {
       *(strstr(repo_clean, ".git")) = '\0';
     }
-    snprintf(auth_url, sizeof(auth_url), "https://%s:%s@github.com/%s",
-             username, token, repo_clean);
+    snprintf(auth_url, auth_url_size, "https://%s:%s@github.com/%s", username,
+             token, repo_clean);
   } else {
     debug_file = fopen("/tmp/git_debug.log", "a");
     if (debug_file) {
@@ -2095,9 +2580,33 @@ int execute_git_with_auth(const char *base_cmd, const char *username,
               remote_url);
       fclose(debug_file);
     }
+    return 0;
+  }
+
+  return 1;
+}
+
+int execute_git_with_auth(const char *base_cmd, const char *username,
+                          const char *token) {
+  if (!base_cmd || !username || !token)
     return 1;
+
+  FILE *debug_file = fopen("/tmp/git_debug.log", "a");
+  if (debug_file) {
+    fprintf(debug_file, "\n=== Executing git with auth (SAFE VERSION) ===\n");
+    fprintf(debug_file, "Base command: %s\n", base_cmd);
+    fprintf(debug_file, "Username: %s\n", username);
+    fprintf(debug_file, "Token length: %zu\n", strlen(token));
+    fclose(debug_file);
   }
 
+  // Create authenticated command using environment variables - SAFE APPROACH
+  char auth_cmd[4096];
+  char auth_url[2048];
+  if (!build_authenticated_remote_url(username, token, auth_url,
+                                      sizeof(auth_url)))
+    return 1;
+
   // Create a simple git push command with authenticated URL
   snprintf(auth_cmd, sizeof(auth_cmd), "git push %s", auth_url);
 
@@ -2127,6 +2636,34 @@ int execute_git_with_auth(const char *base_cmd, const char *username,
   return result;
 }
 
+static void start_push_animation(NCursesDiffViewer *viewer) {
+  viewer->sync_status = SYNC_STATUS_PUSHING_VISIBLE;
+  viewer->animation_frame = 0;
+  viewer->text_char_count = 7; // Show full "Pushing" immediately
+
+  viewer->pushing_branch_index = -1;
+  for (int i = 0; i < viewer->branch_count; i++) {
+    if (viewer->branches[i].status == 1) { // Current branch
+      viewer->pushing_branch_index = i;
+      break;
+    }
+  }
+  viewer->branch_push_status = SYNC_STATUS_PUSHING_VISIBLE;
+  viewer->branch_animation_frame = 0;
+  viewer->branch_text_char_count = 7;
+  viewer->dirty_windows |= DIRTY_STATUS_BAR | DIRTY_BRANCH_LIST;
+}
+
+static void stop_push_animation(NCursesDiffViewer *viewer) {
+  viewer->sync_status = SYNC_STATUS_IDLE;
+  viewer->pushing_branch_index = -1;
+  viewer->branch_push_status = SYNC_STATUS_IDLE;
+  viewer->dirty_windows |= DIRTY_STATUS_BAR | DIRTY_BRANCH_LIST;
+}
+
+// Queue a push of the current branch. Dialogs (upstream choice, diverged
+// branch) run first; the push itself happens in the background and its
+// outcome is handled by check_git_operations. Returns 1 if a push was queued
 int push_commit(NCursesDiffViewer *viewer, int commit_index) {
   if (!viewer || commit_index < 0 || commit_index >= viewer->commit_count)
     return 0;
@@ -2135,42 +2672,33 @@ int push_commit(NCursesDiffViewer *viewer, int commit_index) {
   char current_branch[256];
   if (!get_current_branch_name(current_branch, sizeof(current_branch))) {
     show_error_popup("Failed to get current branch name");
-    viewer->sync_status = SYNC_STATUS_IDLE;
     return 0;
   }
 
   if (!branch_has_upstream(current_branch)) {
-    // Show upstream selection dialog
+    // Show upstream selection dialog; the answer is "<remote> <branch>"
     char upstream_selection[512];
-    if (show_upstream_selection_dialog(current_branch, upstream_selection,
-                                       sizeof(upstream_selection))) {
-      // User selected an upstream, set it up
-      char cmd[1024];
-      snprintf(cmd, sizeof(cmd), "git push --set-upstream %s >/dev/null 2>&1",
-               upstream_selection);
-
-      int result = system(cmd);
-      if (result == 0) {
-        // Upstream set successfully, show success and refresh
-        viewer->sync_status = SYNC_STATUS_PUSHED_APPEARING;
-        viewer->animation_frame = 0;
-        viewer->text_char_count = 0;
-        get_commit_history(viewer);
-
-        // Only refresh the commit pane
-        werase(viewer->commit_list_win);
-        render_commit_list_window(viewer);
-        wrefresh(viewer->commit_list_win);
-
-        return 1;
-      } else {
-        show_error_popup(
-            "Failed to set upstream and push. Check your connection.");
-      }
-    }
+    if (!show_upstream_selection_dialog(current_branch, upstream_selection,
+                                        sizeof(upstream_selection)))
+      return 0;
 
-    viewer->sync_status = SYNC_STATUS_IDLE;
-    return 0;
+    char *upstream_branch = strchr(upstream_selection, ' ');
+    if (upstream_branch)
+      *upstream_branch++ = '\0';
+
+    int queued =
+        upstream_branch
+            ? git_op_enqueue(&viewer->git_ops, VIEWER_OP_PUSH_UPSTREAM,
+                             GIT_OP_NO_PROMPT, NULL, 0, "git", "push",
+                             "--progress", "--set-upstream",
+                             upstream_selection, upstream_branch, NULL)
+            : git_op_enqueue(&viewer->git_ops, VIEWER_OP_PUSH_UPSTREAM,
+                             GIT_OP_NO_PROMPT, NULL, 0, "git", "push",
+                             "--progress", "--set-upstream",
+                             upstream_selection, NULL);
+    if (queued)
+      start_push_animation(viewer);
+    return queued;
   }
 
   // Check for branch divergence first
@@ -2181,210 +2709,375 @@ int push_commit(NCursesDiffViewer *viewer, int commit_index) {
   // If diverged, show confirmation dialog
   if (is_diverged) {
     if (!show_diverged_branch_dialog(commits_ahead, commits_behind)) {
-      // User cancelled
-      viewer->sync_status = SYNC_STATUS_IDLE;
-      return 0;
+      return 0; // User cancelled
     }
   }
 
-  // Animation already started by key handler for immediate feedback
+  // Try push without credentials first - force git to fail without prompting
+  int queued =
+      is_diverged
+          ? git_op_enqueue(&viewer->git_ops, VIEWER_OP_PUSH, GIT_OP_NO_PROMPT,
+                           NULL, 0, "git", "push", "--progress",
+                           "--force-with-lease", "origin", NULL)
+          : git_op_enqueue(&viewer->git_ops, VIEWER_OP_PUSH, GIT_OP_NO_PROMPT,
+                           NULL, 0, "git", "push", "--progress", "origin",
+                           NULL);
+  if (queued)
+    start_push_animation(viewer);
+  return queued;
+}
 
-  for (int i = 0; i < viewer->branch_count; i++) {
-    if (viewer->branches[i].status == 1) { // Current branch
-      viewer->pushing_branch_index = i;
-      break;
-    }
+// The plain push was rejected: ask for a GitHub username and token and
+// queue the push again with them. Returns 1 if the retry was queued
+static int retry_push_with_credentials(NCursesDiffViewer *viewer) {
+  FILE *debug_file = fopen("/tmp/git_debug.log", "a");
+  if (debug_file) {
+    fprintf(debug_file, "\n=== PUSH FAILED - Starting credential flow ===\n");
+    fclose(debug_file);
   }
 
-  // Set branch-specific push status
-  viewer->branch_push_status = SYNC_STATUS_PUSHING_VISIBLE;
-  viewer->branch_animation_frame = 0;
-  viewer->branch_text_char_count = 7; // Show full "Pushing" immediately
+  char username[256] = "";
+  char token[512] = ""; // Larger buffer for long PATs
+  char auth_url[2048] = "";
+  int have_url = 0;
 
-  // Force immediate branch window refresh to show "Pushing" before the blocking
-  // git operation
+  // Save current terminal state and fully clear screen
+  endwin();
+  clear();
+  refresh();
 
-  werase(viewer->branch_list_win);
-  render_file_list_window(viewer);
-  render_file_content_window(viewer);
-  render_commit_list_window(viewer);
-  render_branch_list_window(viewer);
-  render_stash_list_window(viewer);
-  render_status_bar(viewer);
-
-  // Create a simple animated push with spinner updates
-  pid_t push_pid;
-  int result = 0;
+  // Reinitialize ncurses for clean credential dialog
+  initscr();
+  noecho();
+  cbreak();
+  keypad(stdscr, TRUE);
+  start_color();
 
-  // Try push first without authentication
-  char push_cmd[256];
-  if (is_diverged) {
-    strcpy(push_cmd, "git push --force-with-lease origin");
-  } else {
-    strcpy(push_cmd, "git push origin");
+  // Initialize color pairs for the dialog
+  init_pair(1, COLOR_WHITE, COLOR_BLACK);
+  init_pair(2, COLOR_GREEN, COLOR_BLACK);
+  init_pair(3, COLOR_YELLOW, COLOR_BLACK);
+  init_pair(4, COLOR_CYAN, COLOR_BLACK);
+  init_pair(5, COLOR_RED, COLOR_BLACK);
+  init_pair(6, COLOR_MAGENTA, COLOR_BLACK);
+
+  clear();
+  refresh();
+
+  if (get_github_credentials(username, sizeof(username), token,
+                             sizeof(token))) {
+    have_url = build_authenticated_remote_url(username, token, auth_url,
+                                              sizeof(auth_url));
   }
 
-  // Try push without credentials first - force git to fail without prompting
-  // Use multiple methods to ensure git doesn't prompt for credentials
-  result =
-      system(is_diverged ? "GIT_ASKPASS=/bin/false GIT_TERMINAL_PROMPT=0 "
-                           "SSH_ASKPASS=/bin/false git push --force-with-lease "
-                           "origin </dev/null >/dev/null 2>/dev/null"
-                         : "GIT_ASKPASS=/bin/false GIT_TERMINAL_PROMPT=0 "
-                           "SSH_ASKPASS=/bin/false git push origin </dev/null "
-                           ">/dev/null 2>/dev/null");
-
-  // If push failed, immediately try with authentication
-  if (result != 0) {
-    FILE *debug_file = fopen("/tmp/git_debug.log", "a");
-    if (debug_file) {
-      fprintf(debug_file, "\n=== PUSH FAILED - Starting credential flow ===\n");
-      fprintf(debug_file, "Initial push result: %d\n", result);
-      fclose(debug_file);
-    }
+  // Clear credentials from memory for security
+  memset(username, 0, sizeof(username));
+  memset(token, 0, sizeof(token));
 
-    char username[256] = "";
-    char token[512] = ""; // Larger buffer for long PATs
+  // Force complete screen refresh after credential dialog
+  clear();
+  refresh();
+  viewer->dirty_windows = DIRTY_ALL;
+
+  int queued = have_url &&
+               git_op_enqueue(&viewer->git_ops, VIEWER_OP_PUSH_AUTH,
+                              GIT_OP_NO_PROMPT, NULL, 0, "git", "push",
+                              "--progress", auth_url, NULL);
+  memset(auth_url, 0, sizeof(auth_url));
+  return queued;
+}
 
-    // Save current terminal state and fully clear screen
-    endwin();
-    clear();
-    refresh();
+// Queue a pull of the current branch. Returns 1 if it was queued
+int pull_commits(NCursesDiffViewer *viewer) {
+  if (!viewer)
+    return 0;
 
-    // Reinitialize ncurses for clean credential dialog
-    initscr();
-    noecho();
-    cbreak();
-    keypad(stdscr, TRUE);
-    start_color();
+  if (!git_op_enqueue(&viewer->git_ops, VIEWER_OP_PULL, GIT_OP_NO_PROMPT,
+                      NULL, 0, "git", "pull", "--progress", "origin", NULL))
+    return 0;
 
-    // Initialize color pairs for the dialog
-    init_pair(1, COLOR_WHITE, COLOR_BLACK);
-    init_pair(2, COLOR_GREEN, COLOR_BLACK);
-    init_pair(3, COLOR_YELLOW, COLOR_BLACK);
-    init_pair(4, COLOR_CYAN, COLOR_BLACK);
-    init_pair(5, COLOR_RED, COLOR_BLACK);
-    init_pair(6, COLOR_MAGENTA, COLOR_BLACK);
+  // Start pulling animation immediately
+  viewer->sync_status = SYNC_STATUS_PULLING_APPEARING;
+  viewer->animation_frame = 0;
+  viewer->text_char_count = 0;
+  viewer->dirty_windows |= DIRTY_STATUS_BAR;
+  return 1;
+}
 
-    clear();
-    refresh();
+// Reload whatever the preview pane shows for the current mode
+static void reload_current_preview(NCursesDiffViewer *viewer) {
+  if (viewer->file_count == 0) {
+    viewer->selected_file = 0;
+    viewer->file_scroll_offset = 0;
+  } else if (viewer->selected_file >= viewer->file_count) {
+    viewer->selected_file = viewer->file_count - 1;
+  }
+  if (viewer->selected_commit >= viewer->commit_count)
+    viewer->selected_commit =
+        viewer->commit_count > 0 ? viewer->commit_count - 1 : 0;
 
-    debug_file = fopen("/tmp/git_debug.log", "a");
-    if (debug_file) {
-      fprintf(debug_file, "Ncurses reinitialized, calling credential dialog\n");
-      fclose(debug_file);
+  switch (viewer->current_mode) {
+  case NCURSES_MODE_FILE_LIST:
+  case NCURSES_MODE_FILE_VIEW:
+    if (viewer->file_count > 0) {
+      load_file_with_staging_info(
+          viewer, viewer->files[viewer->selected_file].filename);
+    } else {
+      line_store_clear(&viewer->file_store);
+    }
+    break;
+  case NCURSES_MODE_COMMIT_LIST:
+    if (viewer->commit_count > 0)
+      load_commit_for_viewing(viewer,
+                              viewer->commits[viewer->selected_commit].hash);
+    break;
+  case NCURSES_MODE_BRANCH_LIST:
+    if (viewer->branch_count > 0) {
+      load_branch_commits(viewer,
+                          viewer->branches[viewer->selected_branch].name);
+      parse_branch_commits_to_lines(viewer);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// Refresh what a finished operation can have changed. Commits and branch
+// counts always move; the file list only when the work tree or index did
+static void refresh_after_git_operation(NCursesDiffViewer *viewer,
+                                        int worktree_changed) {
+  if (worktree_changed)
+    get_ncurses_changed_files(viewer);
+  get_commit_history(viewer);
+  get_ncurses_git_branches(viewer);
+  reload_current_preview(viewer);
+  viewer->dirty_windows = DIRTY_ALL;
+
+  // The operation's own ref updates are already reflected
+  git_watch_read(&viewer->watch);
+  git_watch_clear(&viewer->watch, GIT_WATCH_REFS);
+}
+
+static void show_git_operation_error(const char *what,
+                                     const GitOpResult *result) {
+  char error[512];
+  if (result->message[0]) {
+    snprintf(error, sizeof(error), "%s: %s", what, result->message);
+  } else {
+    snprintf(error, sizeof(error), "%s", what);
+  }
+  show_error_popup(error);
+}
+
+static void finish_git_operation(NCursesDiffViewer *viewer,
+                                 const GitOpResult *result) {
+  // Whatever was queued behind a failed step (the commit after its git
+  // add, say) no longer makes sense
+  if (!result->success)
+    git_op_cancel(&viewer->git_ops);
+
+  switch (result->kind) {
+  case VIEWER_OP_STAGE_MARKED:
+    if (!result->success) {
+      if (!result->cancelled)
+        show_git_operation_error("Failed to stage the marked files", result);
+      refresh_after_git_operation(viewer, 1);
     }
+    break;
 
-    if (get_github_credentials(username, sizeof(username), token,
-                               sizeof(token))) {
-      debug_file = fopen("/tmp/git_debug.log", "a");
-      if (debug_file) {
-        fprintf(debug_file, "Credentials obtained successfully, attempting "
-                            "authenticated push\n");
-        fclose(debug_file);
+  case VIEWER_OP_COMMIT:
+  case VIEWER_OP_AMEND:
+  case VIEWER_OP_RESET_SOFT:
+  case VIEWER_OP_RESET_HARD:
+    if (result->success) {
+      if (result->kind == VIEWER_OP_RESET_HARD) {
+        // Changes are discarded, start over at the top of the file list
+        viewer->selected_file = 0;
+        viewer->file_scroll_offset = 0;
       }
+      refresh_after_git_operation(viewer, 1);
+    } else if (!result->cancelled) {
+      show_git_operation_error(result->kind == VIEWER_OP_AMEND ? "Amend failed"
+                               : result->kind == VIEWER_OP_COMMIT
+                                   ? "Commit failed"
+                                   : "Reset failed",
+                               result);
+      viewer->dirty_windows = DIRTY_ALL;
+    }
+    break;
 
-      // Try authenticated push
-      result = execute_git_with_auth(push_cmd, username, token);
-
-      // Clear credentials from memory for security
-      memset(username, 0, sizeof(username));
-      memset(token, 0, sizeof(token));
+  case VIEWER_OP_PUSH:
+  case VIEWER_OP_PUSH_AUTH:
+  case VIEWER_OP_PUSH_UPSTREAM:
+    if (result->success) {
+      viewer->sync_status = SYNC_STATUS_PUSHED_APPEARING;
+      viewer->animation_frame = 0;
+      viewer->text_char_count = 0;
+      viewer->branch_push_status = SYNC_STATUS_PUSHED_APPEARING;
+      viewer->branch_animation_frame = 0;
+      viewer->branch_text_char_count = 0;
+      refresh_after_git_operation(viewer, 0);
+    } else if (result->cancelled) {
+      stop_push_animation(viewer);
+    } else if (result->kind == VIEWER_OP_PUSH &&
+               retry_push_with_credentials(viewer)) {
+      // Keep "Pushing" up while the authenticated push runs
     } else {
-      debug_file = fopen("/tmp/git_debug.log", "a");
-      if (debug_file) {
-        fprintf(debug_file, "Credential dialog cancelled by user\n");
-        fclose(debug_file);
+      stop_push_animation(viewer);
+      if (result->kind == VIEWER_OP_PUSH_UPSTREAM) {
+        show_error_popup(
+            "Failed to set upstream and push. Check your connection.");
+      } else {
+        show_error_popup(
+            "Push failed. Check your network, credentials, or get a "
+            "Personal Access Token from github.com/settings/tokens");
       }
-      result = 1; // User cancelled
+      viewer->dirty_windows = DIRTY_ALL;
     }
+    break;
 
-    // Force complete screen refresh after credential dialog
-    clear();
-    refresh();
+  case VIEWER_OP_PULL:
+    if (result->success) {
+      if (viewer->pulling_branch_index >= 0) {
+        viewer->branch_pull_status = SYNC_STATUS_PULLED_APPEARING;
+        viewer->branch_animation_frame = 0;
+        viewer->branch_text_char_count = 0;
+      }
+      viewer->sync_status = SYNC_STATUS_PULLED_APPEARING;
+      viewer->animation_frame = 0;
+      viewer->text_char_count = 0;
+      refresh_after_git_operation(viewer, 1);
+    } else {
+      viewer->sync_status = SYNC_STATUS_IDLE;
+      viewer->pulling_branch_index = -1;
+      viewer->branch_pull_status = SYNC_STATUS_IDLE;
+      if (!result->cancelled)
+        show_git_operation_error("Pull failed", result);
+      viewer->dirty_windows = DIRTY_ALL;
+    }
+    break;
   }
+}
 
-  // Update UI after push attempt
-  get_ncurses_changed_files(viewer);
-  get_commit_history(viewer);
-  get_ncurses_git_branches(viewer);
-
-  if (result == 0) {
-    // Immediately transition to "Pushed!" animation
-    viewer->sync_status = SYNC_STATUS_PUSHED_APPEARING;
-    viewer->animation_frame = 0;
-    viewer->text_char_count = 0;
-
-    // Set branch-specific pushed status
-    viewer->branch_push_status = SYNC_STATUS_PUSHED_APPEARING;
-    viewer->branch_animation_frame = 0;
-    viewer->branch_text_char_count = 0;
-
-    // Refresh commit history to get proper push status
-    get_commit_history(viewer);
-    get_ncurses_git_branches(viewer); // Add this line to refresh branch status
-
-    // Refresh both commit and branch panes
-    werase(viewer->commit_list_win);
-    render_commit_list_window(viewer);
-    wrefresh(viewer->commit_list_win);
+// Drive the operation queue from the main loop: pick up progress, handle a
+// finished operation and start the next. Operations wait for a running
+// fetch, since both would take the same ref locks
+void check_git_operations(NCursesDiffViewer *viewer) {
+  if (!viewer)
+    return;
 
-    werase(viewer->branch_list_win);
-    render_branch_list_window(viewer);
-    wrefresh(viewer->branch_list_win);
+  GitOpQueue *ops = &viewer->git_ops;
+  git_op_write_input(ops);
+  if (git_op_read_output(ops))
+    viewer->dirty_windows |= DIRTY_STATUS_BAR;
 
-    return 1;
-  } else {
-    // Push failed, show error
-    show_error_popup("Push failed. Check your network, credentials, or get a "
-                     "Personal Access Token from github.com/settings/tokens");
-    viewer->sync_status = SYNC_STATUS_IDLE;
-    viewer->pushing_branch_index = -1;
-    viewer->branch_push_status = SYNC_STATUS_IDLE;
+  GitOpResult result;
+  for (;;) {
+    if (git_op_reap(ops, &result))
+      finish_git_operation(viewer, &result);
+    if (ops->running || viewer->fetch_in_progress || !git_op_start_next(ops))
+      break;
+    // A command that couldn't be started is reaped straight away
+    if (ops->pid > 0)
+      break;
   }
-
-  return 0;
 }
 
-int pull_commits(NCursesDiffViewer *viewer) {
-  if (!viewer)
-    return 0;
+// The untracked directory entry ("dir/") a changed path falls under, if
+// the file list has one, since git status reports new directories whole
+static const char *changed_file_entry_for(NCursesDiffViewer *viewer,
+                                          const char *path) {
+  for (int i = 0; i < viewer->file_count; i++) {
+    const char *entry = viewer->files[i].filename;
+    size_t len = strlen(entry);
+    if (len > 0 && entry[len - 1] == '/' && strncmp(path, entry, len) == 0)
+      return entry;
+  }
+  return path;
+}
 
-  // Start pulling animation immediately
-  viewer->sync_status = SYNC_STATUS_PULLING_APPEARING;
-  viewer->animation_frame = 0;
-  viewer->text_char_count = 0;
+// Catch up on what the watcher saw once it has settled: re-read the status
+// of just the changed paths, or everything after an index rewrite or an
+// overflow, and reload refs and stashes only when they moved. Waits while a
+// fetch or queued operation runs, since those refresh on completion
+void apply_watched_changes(NCursesDiffViewer *viewer) {
+  if (!viewer || git_watch_ms_until_ready(&viewer->watch) != 0 ||
+      viewer->fetch_in_progress || git_op_busy(&viewer->git_ops))
+    return;
 
-  // Render immediately to show the animation start
-  render_status_bar(viewer);
+  GitWatcher *watch = &viewer->watch;
+  int changes = watch->changes;
+  int file_mode = viewer->current_mode == NCURSES_MODE_FILE_LIST ||
+                  viewer->current_mode == NCURSES_MODE_FILE_VIEW;
 
-  // Do the actual pull work
-  int result = system("git pull origin 2>/dev/null >/dev/null");
+  char selected[MAX_FILENAME_LEN] = "";
+  if (viewer->file_count > 0)
+    snprintf(selected, sizeof(selected), "%s",
+             viewer->files[viewer->selected_file].filename);
+  int reload_file = 0;
 
-  if (result == 0) {
-    // Refresh everything after pull
+  if (changes & (GIT_WATCH_RESCAN | GIT_WATCH_INDEX)) {
     get_ncurses_changed_files(viewer);
-    get_commit_history(viewer);
-
-    // Reset selection if no files remain
-    if (viewer->file_count == 0) {
-      viewer->selected_file = 0;
-      viewer->file_line_count = 0;
-      viewer->file_scroll_offset = 0;
-    } else if (viewer->selected_file >= viewer->file_count) {
-      viewer->selected_file = viewer->file_count - 1;
+    reload_file = 1;
+  } else if (changes & GIT_WATCH_WORKTREE) {
+    for (int i = 0; i < watch->path_count; i++) {
+      char target[MAX_FILENAME_LEN];
+      snprintf(target, sizeof(target), "%s",
+               changed_file_entry_for(viewer, watch->paths[i]));
+      refresh_changed_file(viewer, target);
+      if (strcmp(target, selected) == 0)
+        reload_file = 1;
     }
+  }
 
-    // Reload current file if any
-    if (viewer->file_count > 0 && viewer->selected_file < viewer->file_count) {
-      load_file_with_staging_info(
-          viewer, viewer->files[viewer->selected_file].filename);
+  // Entries can have been added or dropped around the selection
+  if (changes & (GIT_WATCH_RESCAN | GIT_WATCH_INDEX | GIT_WATCH_WORKTREE)) {
+    int found = 0;
+    for (int i = 0; i < viewer->file_count; i++) {
+      if (strcmp(viewer->files[i].filename, selected) == 0) {
+        viewer->selected_file = i;
+        found = 1;
+        break;
+      }
+    }
+    if (!found) {
+      if (viewer->selected_file >= viewer->file_count)
+        viewer->selected_file =
+            viewer->file_count > 0 ? viewer->file_count - 1 : 0;
+      reload_file = 1;
     }
+  }
 
-    return 1;
+  if (changes & GIT_WATCH_REFS) {
+    get_commit_history(viewer);
+    get_ncurses_git_branches(viewer);
   }
+  if (changes & GIT_WATCH_STASH)
+    get_ncurses_git_stashes(viewer);
 
-  return 0;
+  if (file_mode) {
+    // Lines picked for staging would be lost by a reload
+    if (reload_file && viewer->staged_line_total == 0) {
+      int cursor = viewer->file_cursor_line;
+      int scroll = viewer->file_scroll_offset;
+      if (viewer->file_count > 0) {
+        load_file_with_staging_info(
+            viewer, viewer->files[viewer->selected_file].filename);
+      } else {
+        line_store_clear(&viewer->file_store);
+      }
+      if (cursor < viewer->file_store.count)
+        viewer->file_cursor_line = cursor;
+      if (scroll < viewer->file_store.count)
+        viewer->file_scroll_offset = scroll;
+    }
+  } else if (changes & (GIT_WATCH_REFS | GIT_WATCH_STASH)) {
+    reload_current_preview(viewer);
+  }
+
+  git_watch_clear(watch, changes);
+  viewer->dirty_windows = DIRTY_ALL;
 }
 
 void render_file_list_window(NCursesDiffViewer *viewer) {
@@ -2640,6 +3333,162 @@ void render_commit_list_window(NCursesDiffViewer *viewer) {
   wrefresh(viewer->commit_list_win);
 }
 
+// Lines walked back from the first visible line to recover comment and
+// string state; anything before that is taken as plain code
+#define SYNTAX_STATE_LOOKBACK 256
+
+// Highlighting as it stands at some line of a diff
+typedef struct {
+  const SyntaxLanguage *language;
+  int old_state; // Carried by '-' and context lines
+  int new_state; // Carried by '+' and context lines
+} DiffSyntax;
+
+static int is_diff_file_header(const char *text) {
+  return (strncmp(text, "--- ", 4) == 0 || strncmp(text, "+++ ", 4) == 0) &&
+         (strncmp(text + 4, "a/", 2) == 0 || strncmp(text + 4, "b/", 2) == 0 ||
+          strcmp(text + 4, "/dev/null") == 0);
+}
+
+// Language of the file a "diff --git a/x b/x" line starts
+static const SyntaxLanguage *diff_header_language(const char *text) {
+  const char *path = strstr(text, " b/");
+  return path ? syntax_language_for_path(path + 3) : NULL;
+}
+
+// Feed one line through the highlighter, in order. Returns 1 with the
+// spans of the code after the diff marker if the line is highlighted
+static int diff_syntax_line(SyntaxCache *cache, DiffSyntax *syntax,
+                            const NCursesFileLine *line, const char *text,
+                            const SyntaxSpan **spans, int *span_count) {
+  *spans = NULL;
+  *span_count = 0;
+
+  if (strncmp(text, "diff --git ", 11) == 0) {
+    syntax->language = diff_header_language(text);
+    syntax->old_state = syntax->new_state = SYNTAX_STATE_NORMAL;
+    return 0;
+  }
+  if (line->type == '@') {
+    syntax->old_state = syntax->new_state = SYNTAX_STATE_NORMAL;
+    return 0;
+  }
+  if (!syntax->language ||
+      (text[0] != '+' && text[0] != '-' && text[0] != ' ') ||
+      is_diff_file_header(text))
+    return 0;
+
+  int *state = text[0] == '-' ? &syntax->old_state : &syntax->new_state;
+  *state = syntax_highlight(cache, syntax->language, text + 1, *state, spans,
+                            span_count);
+  if (text[0] == ' ')
+    syntax->old_state = syntax->new_state;
+  return 1;
+}
+
+// Set up highlighting for drawing store from line first: the language of
+// the file being shown (the nearest "diff --git" line in multi-file diffs)
+// and the state the hunk has built up so far, replayed from the cache
+static void diff_syntax_begin(SyntaxCache *cache, DiffSyntax *syntax,
+                              const NCursesLineStore *store, int first,
+                              const SyntaxLanguage *language) {
+  syntax->language = language;
+  syntax->old_state = syntax->new_state = SYNTAX_STATE_NORMAL;
+
+  for (int i = first - 1; i >= 0; i--) {
+    const char *text = line_store_text(store, &store->lines[i]);
+    if (strncmp(text, "diff --git ", 11) == 0) {
+      syntax->language = diff_header_language(text);
+      break;
+    }
+  }
+  if (!syntax->language)
+    return;
+
+  int start = first > SYNTAX_STATE_LOOKBACK ? first - SYNTAX_STATE_LOOKBACK : 0;
+  for (int i = first - 1; i >= start; i--) {
+    const char *text = line_store_text(store, &store->lines[i]);
+    if (store->lines[i].type == '@' || strncmp(text, "diff --git ", 11) == 0) {
+      start = i + 1;
+      break;
+    }
+  }
+
+  const SyntaxSpan *spans;
+  int span_count;
+  for (int i = start; i < first; i++) {
+    diff_syntax_line(cache, syntax, &store->lines[i],
+                     line_store_text(store, &store->lines[i]), &spans,
+                     &span_count);
+  }
+}
+
+static attr_t syntax_attr(SyntaxKind kind) {
+  switch (kind) {
+  case SYNTAX_KEYWORD:
+    return COLOR_PAIR(11) | A_BOLD;
+  case SYNTAX_TYPE:
+    return COLOR_PAIR(12);
+  case SYNTAX_STRING:
+    return COLOR_PAIR(13);
+  case SYNTAX_COMMENT:
+    return COLOR_PAIR(14) | A_DIM;
+  default:
+    return COLOR_PAIR(15);
+  }
+}
+
+// render_wrapped_line with token colors. Spans index the code after the
+// diff marker; the marker and untokenized text keep the diff color
+static int render_highlighted_line(WINDOW *win, const char *line,
+                                   const SyntaxSpan *spans, int span_count,
+                                   int start_y, int start_x, int width,
+                                   int max_rows, int color_pair, int reverse) {
+  int segment_width = width - start_x;
+  if (segment_width < 1)
+    segment_width = 1;
+  int line_len = strlen(line);
+  attr_t reverse_attr = reverse ? A_REVERSE : A_NORMAL;
+  attr_t base_attr =
+      (color_pair > 0 ? COLOR_PAIR(color_pair) : A_NORMAL) | reverse_attr;
+
+  int span = 0;
+  int rows_used = 0;
+  for (int pos = 0; (pos < line_len || pos == 0) && rows_used < max_rows;
+       pos += segment_width) {
+    int end = pos + segment_width < line_len ? pos + segment_width : line_len;
+    wmove(win, start_y + rows_used, start_x);
+
+    for (int p = pos; p < end;) {
+      while (span < span_count &&
+             1 + spans[span].start + spans[span].len <= p)
+        span++;
+
+      int run_end = end;
+      attr_t attr = base_attr;
+      if (span < span_count) {
+        int span_start = 1 + spans[span].start;
+        int span_end = span_start + spans[span].len;
+        if (p >= span_start) {
+          run_end = span_end < end ? span_end : end;
+          attr = syntax_attr(spans[span].kind) | reverse_attr;
+        } else if (span_start < end) {
+          run_end = span_start;
+        }
+      }
+
+      wattrset(win, attr);
+      waddnstr(win, line + p, run_end - p);
+      p = run_end;
+    }
+    wattrset(win, A_NORMAL);
+
+    rows_used++;
+  }
+
+  return rows_used;
+}
+
 void render_file_content_window(NCursesDiffViewer *viewer) {
   if (!viewer || !viewer->file_content_win)
     return;
@@ -2651,6 +3500,17 @@ void render_file_content_window(NCursesDiffViewer *viewer) {
   werase(viewer->file_content_win);
   draw_rounded_box(viewer->file_content_win);
 
+  // A single file's diff is highlighted by its name; commit and stash
+  // diffs by their "diff --git" lines
+  const SyntaxLanguage *file_language =
+      (viewer->current_mode == NCURSES_MODE_FILE_LIST ||
+       viewer->current_mode == NCURSES_MODE_FILE_VIEW)
+          ? syntax_language_for_path(viewer->current_file_path)
+          : NULL;
+  DiffSyntax syntax;
+  const SyntaxSpan *spans;
+  int span_count;
+
   if (!viewer->split_view_mode) {
     // Show preview content in list modes and view modes
     if (viewer->current_mode == NCURSES_MODE_FILE_LIST ||
@@ -2692,20 +3552,23 @@ void render_file_content_window(NCursesDiffViewer *viewer) {
       mvwprintw(viewer->file_content_win, 0, 2, "%s", title);
 
       // Render preview content using the loaded file_lines
-      if (viewer->file_line_count > 0) {
+      if (viewer->file_store.count > 0) {
         int max_lines_visible = height - 2;
         int display_count = 0;
+        diff_syntax_begin(&viewer->syntax_cache, &syntax, &viewer->file_store,
+                          viewer->file_scroll_offset, file_language);
 
         for (int i = viewer->file_scroll_offset;
-             i < viewer->file_line_count && display_count < max_lines_visible;
+             i < viewer->file_store.count && display_count < max_lines_visible;
              i++) {
 
-          NCursesFileLine *line = &viewer->file_lines[i];
+          NCursesFileLine *line = &viewer->file_store.lines[i];
+          const char *text = line_store_text(&viewer->file_store, line);
           int is_cursor_line = (i == viewer->file_cursor_line);
 
           // Calculate how many display lines this logical line will need
           int line_height =
-              calculate_wrapped_line_height(line->line, width - 4);
+              calculate_wrapped_line_height(text, width - 4);
 
           // Skip if this line would exceed remaining space
           if (display_count + line_height > max_lines_visible) {
@@ -2725,9 +3588,15 @@ void render_file_content_window(NCursesDiffViewer *viewer) {
           }
 
           // Render the line with wrapping
-          int rows_used = render_wrapped_line(
-              viewer->file_content_win, line->line, y, 1, width - 2,
-              line_height, color_pair, is_cursor_line);
+          int rows_used =
+              diff_syntax_line(&viewer->syntax_cache, &syntax, line, text,
+                               &spans, &span_count)
+                  ? render_highlighted_line(
+                        viewer->file_content_win, text, spans, span_count, y,
+                        1, width - 2, line_height, color_pair, is_cursor_line)
+                  : render_wrapped_line(viewer->file_content_win, text, y, 1,
+                                        width - 2, line_height, color_pair,
+                                        is_cursor_line);
           display_count += rows_used;
         }
       } else {
@@ -2762,17 +3631,20 @@ void render_file_content_window(NCursesDiffViewer *viewer) {
 
   // Show unstaged lines with wrapping
   int unstaged_display_count = 0;
+  diff_syntax_begin(&viewer->syntax_cache, &syntax, &viewer->file_store,
+                    viewer->file_scroll_offset, file_language);
   for (int i = viewer->file_scroll_offset;
-       i < viewer->file_line_count &&
+       i < viewer->file_store.count &&
        unstaged_display_count < unstaged_height - 1;
        i++) {
 
-    NCursesFileLine *line = &viewer->file_lines[i];
+    NCursesFileLine *line = &viewer->file_store.lines[i];
+    const char *text = line_store_text(&viewer->file_store, line);
     int is_cursor_line =
         (i == viewer->file_cursor_line && viewer->active_pane == 0);
 
     // Calculate how many display lines this logical line will need
-    int line_height = calculate_wrapped_line_height(line->line, width - 4);
+    int line_height = calculate_wrapped_line_height(text, width - 4);
 
     // Skip if this line would exceed remaining space
     if (unstaged_display_count + line_height > unstaged_height - 1) {
@@ -2781,6 +3653,8 @@ void render_file_content_window(NCursesDiffViewer *viewer) {
 
     int y = unstaged_display_count + 1;
     int color_pair = 0;
+    int highlighted = diff_syntax_line(&viewer->syntax_cache, &syntax, line,
+                                       text, &spans, &span_count);
 
     // Determine color based on line type
     if (line->type == '@') {
@@ -2808,15 +3682,18 @@ void render_file_content_window(NCursesDiffViewer *viewer) {
 
       // Then render the line content starting from column 2, skipping first
       // char
-      char line_without_prefix[1024];
-      strcpy(line_without_prefix, line->line + 1);
       int rows_used = render_wrapped_line(
-          viewer->file_content_win, line_without_prefix, y, 2, width - 2,
+          viewer->file_content_win, text + 1, y, 2, width - 2,
+          line_height, color_pair, is_cursor_line);
+      unstaged_display_count += rows_used;
+    } else if (highlighted) {
+      int rows_used = render_highlighted_line(
+          viewer->file_content_win, text, spans, span_count, y, 1, width - 2,
           line_height, color_pair, is_cursor_line);
       unstaged_display_count += rows_used;
     } else {
       // Regular line rendering
-      int rows_used = render_wrapped_line(viewer->file_content_win, line->line,
+      int rows_used = render_wrapped_line(viewer->file_content_win, text,
                                           y, 1, width - 2, line_height,
                                           color_pair, is_cursor_line);
       unstaged_display_count += rows_used;
@@ -2834,17 +3711,20 @@ void render_file_content_window(NCursesDiffViewer *viewer) {
 
   // Show staged lines with proper git patch format and wrapping
   int staged_display_count = 0;
+  diff_syntax_begin(&viewer->syntax_cache, &syntax, &viewer->staged_store,
+                    viewer->staged_scroll_offset, file_language);
   for (int i = viewer->staged_scroll_offset;
-       i < viewer->staged_line_count &&
+       i < viewer->staged_store.count &&
        staged_display_count < staged_height - 1;
        i++) {
 
-    NCursesFileLine *line = &viewer->staged_lines[i];
+    NCursesFileLine *line = &viewer->staged_store.lines[i];
+    const char *text = line_store_text(&viewer->staged_store, line);
     int is_cursor_line =
         (i == viewer->staged_cursor_line && viewer->active_pane == 1);
 
     // Calculate how many display lines this logical line will need
-    int line_height = calculate_wrapped_line_height(line->line, width - 4);
+    int line_height = calculate_wrapped_line_height(text, width - 4);
 
     // Skip if this line would exceed remaining space
     if (staged_display_count + line_height > staged_height - 1) {
@@ -2865,8 +3745,14 @@ void render_file_content_window(NCursesDiffViewer *viewer) {
 
     // Render the line with wrapping
     int rows_used =
-        render_wrapped_line(viewer->file_content_win, line->line, y, 1,
-                            width - 2, line_height, color_pair, is_cursor_line);
+        diff_syntax_line(&viewer->syntax_cache, &syntax, line, text, &spans,
+                         &span_count)
+            ? render_highlighted_line(viewer->file_content_win, text, spans,
+                                      span_count, y, 1, width - 2, line_height,
+                                      color_pair, is_cursor_line)
+            : render_wrapped_line(viewer->file_content_win, text, y, 1,
+                                  width - 2, line_height, color_pair,
+                                  is_cursor_line);
     staged_display_count += rows_used;
   }
 
@@ -2902,10 +3788,21 @@ void render_status_bar(NCursesDiffViewer *viewer) {
     strcpy(keybindings, "Scroll: j/k | Page: Ctrl+U/D | Back: Esc");
   }
 
+  if (git_op_busy(&viewer->git_ops))
+    strcat(keybindings, " | Cancel: x");
+
   mvwprintw(viewer->status_bar_win, 0, 1, "%s", keybindings);
 
+  // What the running push/pull reports, e.g. " Writing objects 45%"
+  char progress_text[80] = "";
+  if (viewer->git_ops.running && viewer->git_ops.progress >= 0) {
+    snprintf(progress_text, sizeof(progress_text), " %s%s%d%%",
+             viewer->git_ops.phase, viewer->git_ops.phase[0] ? " " : "",
+             viewer->git_ops.progress);
+  }
+
   // Right side: Sync status
-  char sync_text[64] = "";
+  char sync_text[128] = "";
   char *spinner_chars[] = {"|", "/", "-", "\\"};
   int spinner_idx = (viewer->spinner_frame / 2) %
                     4; // Change every frame (~20ms per character)
@@ -2953,8 +3850,8 @@ void render_status_bar(NCursesDiffViewer *viewer) {
       partial_text[chars_to_show] = '\0';
 
       if (viewer->sync_status == SYNC_STATUS_PUSHING_VISIBLE) {
-        snprintf(sync_text, sizeof(sync_text), "%s %s", partial_text,
-                 spinner_chars[spinner_idx]);
+        snprintf(sync_text, sizeof(sync_text), "%s%s %s", partial_text,
+                 progress_text, spinner_chars[spinner_idx]);
       } else {
         strcpy(sync_text, partial_text);
       }
@@ -2977,8 +3874,8 @@ void render_status_bar(NCursesDiffViewer *viewer) {
       partial_text[chars_to_show] = '\0';
 
       if (viewer->sync_status == SYNC_STATUS_PULLING_VISIBLE) {
-        snprintf(sync_text, sizeof(sync_text), "%s %s", partial_text,
-                 spinner_chars[spinner_idx]);
+        snprintf(sync_text, sizeof(sync_text), "%s%s %s", partial_text,
+                 progress_text, spinner_chars[spinner_idx]);
       } else {
         strcpy(sync_text, partial_text);
       }
@@ -3058,8 +3955,8 @@ void update_sync_status(NCursesDiffViewer *viewer) {
 
   time_t current_time = time(NULL);
 
-  // Check if it's time to sync (every 30 seconds)
-  if (current_time - viewer->last_sync_time >= 30 &&
+  // Check if it's time to sync (every SYNC_FETCH_INTERVAL seconds)
+  if (current_time - viewer->last_sync_time >= SYNC_FETCH_INTERVAL &&
       !viewer->critical_operation_in_progress && !viewer->fetch_in_progress) {
     viewer->last_sync_time = current_time;
 
@@ -3070,6 +3967,21 @@ void update_sync_status(NCursesDiffViewer *viewer) {
 
   // Always check if background fetch is complete
   check_background_fetch(viewer);
+}
+
+int sync_animation_active(NCursesDiffViewer *viewer) {
+  if (!viewer)
+    return 0;
+
+  return viewer->sync_status != SYNC_STATUS_IDLE ||
+         viewer->branch_push_status != SYNC_STATUS_IDLE ||
+         viewer->branch_pull_status != SYNC_STATUS_IDLE;
+}
+
+// Advance every running animation by one SYNC_ANIMATION_TICK_MS frame
+void advance_sync_animation(NCursesDiffViewer *viewer) {
+  if (!viewer)
+    return;
 
   // Handle all animation states
   if (viewer->sync_status != SYNC_STATUS_IDLE) {
@@ -3118,9 +4030,8 @@ void update_sync_status(NCursesDiffViewer *viewer) {
           viewer->animation_frame = 0;
         }
       } else if (viewer->sync_status == SYNC_STATUS_PUSHING_VISIBLE) {
-        // Visible with spinner - keep spinning until push_commit changes status
-        // Don't auto-transition, let push_commit function handle the transition
-        // This allows the spinner to keep going during the blocking git push
+        // Visible with spinner - keep spinning until the queued push
+        // finishes and check_git_operations moves on to "Pushed!"
       } else if (viewer->sync_status == SYNC_STATUS_PUSHING_DISAPPEARING) {
         // Disappearing: remove one character every frame (0.05s)
         int chars_to_remove = viewer->animation_frame;
@@ -3145,12 +4056,8 @@ void update_sync_status(NCursesDiffViewer *viewer) {
           viewer->animation_frame = 0;
         }
       } else if (viewer->sync_status == SYNC_STATUS_PULLING_VISIBLE) {
-        // Visible with spinner for 1.2 seconds (24 frames) - faster
-        if (viewer->animation_frame >= 24) {
-          viewer->sync_status = SYNC_STATUS_PULLING_DISAPPEARING;
-          viewer->animation_frame = 0;
-          viewer->text_char_count = 7;
-        }
+        // Visible with spinner until the queued pull finishes and
+        // check_git_operations moves on to "Pulled!"
       } else if (viewer->sync_status == SYNC_STATUS_PULLING_DISAPPEARING) {
         // Disappearing: remove one character every 2 frames (0.1s)
         int chars_to_remove = viewer->animation_frame / 2;
@@ -3325,44 +4232,12 @@ int commit_staged_changes_only(NCursesDiffViewer *viewer,
   if (!viewer || !commit_title || strlen(commit_title) == 0)
     return 0;
 
-  char temp_msg_file[256];
-  snprintf(temp_msg_file, sizeof(temp_msg_file), "/tmp/commit_msg_%d",
-           getpid());
-
-  FILE *msg_file = fopen(temp_msg_file, "w");
-  if (!msg_file)
-    return 0;
-
-  if (commit_message && strlen(commit_message) > 0) {
-    fprintf(msg_file, "%s\n\n%s", commit_title, commit_message);
-  } else {
-    fprintf(msg_file, "%s", commit_title);
-  }
-  fclose(msg_file);
-
-  char commit_cmd[512];
-  snprintf(commit_cmd, sizeof(commit_cmd),
-           "git commit -F \"%s\" 2>/dev/null >/dev/null", temp_msg_file);
-  int result = system(commit_cmd);
-  unlink(temp_msg_file);
-
-  if (result == 0) {
-    usleep(100000);
-
-    get_ncurses_changed_files(viewer);
-    get_commit_history(viewer);
-    get_ncurses_git_branches(viewer);
-
-    if (viewer->file_count == 0) {
-      viewer->selected_file = 0;
-      viewer->file_line_count = 0;
-      viewer->file_scroll_offset = 0;
-    } else if (viewer->selected_file >= viewer->file_count) {
-      viewer->selected_file = viewer->file_count - 1;
-    }
-    return 1;
-  }
-  return 0;
+  char full_message[MAX_COMMIT_TITLE_LEN + 2048 + 2];
+  format_commit_message(commit_title, commit_message, full_message,
+                        sizeof(full_message));
+  return git_op_enqueue(&viewer->git_ops, VIEWER_OP_COMMIT, 0, full_message,
+                        strlen(full_message), "git", "commit", "-F", "-",
+                        NULL);
 }
 
 int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
@@ -3386,6 +4261,12 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
     return 0; // Exit
   }
 
+  // Cancel a running commit/push/pull and everything queued behind it
+  if ((key == 'x' || key == 'X') && git_op_busy(&viewer->git_ops)) {
+    git_op_cancel(&viewer->git_ops);
+    return 1;
+  }
+
   // Global number key navigation
   switch (key) {
   case '1':
@@ -3552,12 +4433,12 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
         }
       } else {
         // Existing scroll logic for non-split view
-        if (viewer->file_line_count > max_lines_visible) {
+        if (viewer->file_store.count > max_lines_visible) {
           viewer->file_scroll_offset += max_lines_visible;
           if (viewer->file_scroll_offset >
-              viewer->file_line_count - max_lines_visible) {
+              viewer->file_store.count - max_lines_visible) {
             viewer->file_scroll_offset =
-                viewer->file_line_count - max_lines_visible;
+                viewer->file_store.count - max_lines_visible;
           }
         }
       }
@@ -3639,13 +4520,13 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
       // move_cursor_smart does)
       int final_cursor = target_cursor;
       int attempts = 0;
-      const int max_attempts = viewer->file_line_count;
+      const int max_attempts = viewer->file_store.count;
 
       // Look for non-empty line near target position
       while (attempts < max_attempts &&
-             final_cursor < viewer->file_line_count) {
-        NCursesFileLine *line = &viewer->file_lines[final_cursor];
-        char *trimmed = line->line;
+             final_cursor < viewer->file_store.count) {
+        NCursesFileLine *line = &viewer->file_store.lines[final_cursor];
+        const char *trimmed = line_store_text(&viewer->file_store, line);
 
         // Skip leading whitespace
         while (*trimmed == ' ' || *trimmed == '\t') {
@@ -3666,8 +4547,8 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
           final_cursor = target_cursor;
           // Try going up from target
           while (final_cursor > 0 && attempts < max_attempts) {
-            line = &viewer->file_lines[final_cursor];
-            trimmed = line->line;
+            line = &viewer->file_store.lines[final_cursor];
+            trimmed = line_store_text(&viewer->file_store, line);
             while (*trimmed == ' ' || *trimmed == '\t') {
               trimmed++;
             }
@@ -3684,8 +4565,8 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
       // Ensure final cursor is in bounds
       if (final_cursor < 0)
         final_cursor = 0;
-      if (final_cursor >= viewer->file_line_count)
-        final_cursor = viewer->file_line_count - 1;
+      if (final_cursor >= viewer->file_store.count)
+        final_cursor = viewer->file_store.count - 1;
 
       viewer->file_cursor_line = final_cursor;
 
@@ -3703,20 +4584,20 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
     {
       // Move cursor down half page with smart positioning
       int target_cursor = viewer->file_cursor_line + max_lines_visible / 2;
-      if (target_cursor >= viewer->file_line_count) {
-        target_cursor = viewer->file_line_count - 1;
+      if (target_cursor >= viewer->file_store.count) {
+        target_cursor = viewer->file_store.count - 1;
       }
 
       // Find the actual cursor position (skip empty lines like
       // move_cursor_smart does)
       int final_cursor = target_cursor;
       int attempts = 0;
-      const int max_attempts = viewer->file_line_count;
+      const int max_attempts = viewer->file_store.count;
 
       // Look for non-empty line near target position
       while (attempts < max_attempts && final_cursor >= 0) {
-        NCursesFileLine *line = &viewer->file_lines[final_cursor];
-        char *trimmed = line->line;
+        NCursesFileLine *line = &viewer->file_store.lines[final_cursor];
+        const char *trimmed = line_store_text(&viewer->file_store, line);
 
         // Skip leading whitespace
         while (*trimmed == ' ' || *trimmed == '\t') {
@@ -3736,10 +4617,10 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
         if (final_cursor < target_cursor - 5) {
           final_cursor = target_cursor;
           // Try going down from target
-          while (final_cursor < viewer->file_line_count - 1 &&
+          while (final_cursor < viewer->file_store.count - 1 &&
                  attempts < max_attempts) {
-            line = &viewer->file_lines[final_cursor];
-            trimmed = line->line;
+            line = &viewer->file_store.lines[final_cursor];
+            trimmed = line_store_text(&viewer->file_store, line);
             while (*trimmed == ' ' || *trimmed == '\t') {
               trimmed++;
             }
@@ -3756,8 +4637,8 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
       // Ensure final cursor is in bounds
       if (final_cursor < 0)
         final_cursor = 0;
-      if (final_cursor >= viewer->file_line_count)
-        final_cursor = viewer->file_line_count - 1;
+      if (final_cursor >= viewer->file_store.count)
+        final_cursor = viewer->file_store.count - 1;
 
       viewer->file_cursor_line = final_cursor;
 
@@ -3767,9 +4648,9 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
         viewer->file_scroll_offset =
             viewer->file_cursor_line - max_lines_visible + 5;
         if (viewer->file_scroll_offset >
-            viewer->file_line_count - max_lines_visible) {
+            viewer->file_store.count - max_lines_visible) {
           viewer->file_scroll_offset =
-              viewer->file_line_count - max_lines_visible;
+              viewer->file_store.count - max_lines_visible;
         }
         if (viewer->file_scroll_offset < 0) {
           viewer->file_scroll_offset = 0;
@@ -3780,12 +4661,12 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
 
     case KEY_NPAGE: // Page Down
       // Scroll content down by page
-      if (viewer->file_line_count > max_lines_visible) {
+      if (viewer->file_store.count > max_lines_visible) {
         viewer->file_scroll_offset += max_lines_visible;
         if (viewer->file_scroll_offset >
-            viewer->file_line_count - max_lines_visible) {
+            viewer->file_store.count - max_lines_visible) {
           viewer->file_scroll_offset =
-              viewer->file_line_count - max_lines_visible;
+              viewer->file_store.count - max_lines_visible;
         }
       }
       break;
@@ -3825,6 +4706,9 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
 
     case KEY_DOWN:
     case 'j':
+      // Page in more history before the selection reaches the end
+      if (viewer->selected_commit + COMMIT_PAGE_MARGIN >= viewer->commit_count)
+        load_more_commits(viewer);
       if (viewer->selected_commit < viewer->commit_count - 1) {
         viewer->selected_commit++;
         int max_commits_visible = viewer->commit_panel_height - 2;
@@ -3862,25 +4746,19 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
       if (viewer->commit_count > 0 &&
           viewer->selected_commit < viewer->commit_count) {
         viewer->critical_operation_in_progress =
-            1; // Block fetching during push
-        // Show immediate feedback
-        viewer->sync_status = SYNC_STATUS_PUSHING_VISIBLE;
-        viewer->animation_frame = 0;
-        viewer->text_char_count = 7; // Show full "Pushing" immediately
-        // Force a quick render to show "Pushing!" immediately
-        render_status_bar(viewer);
-        wrefresh(viewer->status_bar_win);
-        // Now do the actual push
+            1; // Block fetching while the push dialogs are up
         push_commit(viewer, viewer->selected_commit);
-        viewer->critical_operation_in_progress = 0; // Re-enable fetching
+        viewer->critical_operation_in_progress = 0;
       }
       break;
 
+    case 'p': // Pull
+      pull_commits(viewer);
+      break;
+
     case 'r':
       if (viewer->commit_count > 0 && viewer->selected_commit == 0) {
-        viewer->critical_operation_in_progress = 1;
         reset_commit_soft(viewer, viewer->selected_commit);
-        viewer->critical_operation_in_progress = 0;
       }
       break;
 
@@ -4001,7 +4879,7 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
           // Reset file selection if no files remain
           if (viewer->file_count == 0) {
             viewer->selected_file = 0;
-            viewer->file_line_count = 0;
+            line_store_clear(&viewer->file_store);
             viewer->file_scroll_offset = 0;
           } else if (viewer->selected_file >= viewer->file_count) {
             viewer->selected_file = viewer->file_count - 1;
@@ -4038,7 +4916,7 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
           // Reset file selection if no files remain
           if (viewer->file_count == 0) {
             viewer->selected_file = 0;
-            viewer->file_line_count = 0;
+            line_store_clear(&viewer->file_store);
             viewer->file_scroll_offset = 0;
           } else if (viewer->selected_file >= viewer->file_count) {
             viewer->selected_file = viewer->file_count - 1;
@@ -4145,7 +5023,7 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
           // Reset file selection if no files remain
           if (viewer->file_count == 0) {
             viewer->selected_file = 0;
-            viewer->file_line_count = 0;
+            line_store_clear(&viewer->file_store);
             viewer->file_scroll_offset = 0;
           } else if (viewer->selected_file >= viewer->file_count) {
             viewer->selected_file = viewer->file_count - 1;
@@ -4199,7 +5077,7 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
           // Reset file selection if no files remain
           if (viewer->file_count == 0) {
             viewer->selected_file = 0;
-            viewer->file_line_count = 0;
+            line_store_clear(&viewer->file_store);
             viewer->file_scroll_offset = 0;
           } else if (viewer->selected_file >= viewer->file_count) {
             viewer->selected_file = viewer->file_count - 1;
@@ -4302,102 +5180,24 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
     case 'p':
       if (viewer->branch_count > 0 &&
           viewer->selected_branch < viewer->branch_count) {
-        viewer->critical_operation_in_progress = 1;
-        const char *branch_name =
-            viewer->branches[viewer->selected_branch].name;
-
         if (viewer->branches[viewer->selected_branch].commits_behind > 0) {
-          // Start pulling animation immediately
-          viewer->sync_status = SYNC_STATUS_PULLING_APPEARING;
-          viewer->animation_frame = 0;
-          viewer->text_char_count = 0;
-
-          // Set branch-specific pull status
-          viewer->pulling_branch_index = viewer->selected_branch;
-          viewer->branch_pull_status = SYNC_STATUS_PULLING_VISIBLE;
-          viewer->branch_animation_frame = 0;
-          viewer->branch_text_char_count = 7; // Show full "Pulling" immediately
-
-          // Force immediate branch window refresh to show "Pulling" before the
-          // blocking git operation
-          werase(viewer->branch_list_win);
-          render_branch_list_window(viewer);
-          wrefresh(viewer->branch_list_win);
-
-          // Create a simple animated pull with spinner updates
-          pid_t pull_pid = fork();
-          int result = 0;
-
-          if (pull_pid == 0) {
-            // Child process: do the actual pull
-            exit(system("git pull 2>/dev/null >/dev/null"));
-          }
-
-          // Parent process: animate the spinner while pull is happening
-          if (pull_pid > 0) {
-            int status;
-            int spinner_counter = 0;
-
-            while (waitpid(pull_pid, &status, WNOHANG) == 0) {
-              // Update spinner animation
-              viewer->branch_animation_frame = spinner_counter;
-              spinner_counter =
-                  (spinner_counter + 1) % 40; // Cycle every 40 iterations
-
-              // Refresh the branch window to show spinning animation
-              werase(viewer->branch_list_win);
-              render_branch_list_window(viewer);
-              wrefresh(viewer->branch_list_win);
-
-              // Small delay for animation timing
-              usleep(100000); // 100ms delay
-            }
-
-            // Get the exit status of the pull command
-            if (WIFEXITED(status)) {
-              result = WEXITSTATUS(status);
-            } else {
-              result = 1; // Error
-            }
-          } else {
-            result = 1; // Fork failed
-          }
-
-          if (result == 0) {
-            // Reset branch animation completely
-            viewer->branch_pull_status = SYNC_STATUS_PULLED_APPEARING;
-            viewer->branch_animation_frame = 0;
-            viewer->branch_text_char_count = 0;
-
-            get_ncurses_changed_files(viewer);
-            get_commit_history(viewer);
-            get_ncurses_git_branches(viewer);
-            if (viewer->file_count == 0) {
-              viewer->selected_file = 0;
-              viewer->file_line_count = 0;
-              viewer->file_scroll_offset = 0;
-            } else if (viewer->selected_file >= viewer->file_count) {
-              viewer->selected_file = viewer->file_count - 1;
-            }
-            if (viewer->file_count > 0 &&
-                viewer->selected_file < viewer->file_count) {
-              load_file_with_staging_info(
-                  viewer, viewer->files[viewer->selected_file].filename);
-            }
-            viewer->sync_status = SYNC_STATUS_PULLED_APPEARING;
+          if (git_op_enqueue(&viewer->git_ops, VIEWER_OP_PULL,
+                             GIT_OP_NO_PROMPT, NULL, 0, "git", "pull",
+                             "--progress", NULL)) {
+            // Start pulling animation immediately
+            viewer->sync_status = SYNC_STATUS_PULLING_APPEARING;
             viewer->animation_frame = 0;
             viewer->text_char_count = 0;
-          } else {
-            show_error_popup("Pull failed. Check your network connection.");
-            viewer->sync_status = SYNC_STATUS_IDLE;
-            viewer->pulling_branch_index = -1;
-            viewer->branch_pull_status = SYNC_STATUS_IDLE;
-          }
 
+            // Set branch-specific pull status
+            viewer->pulling_branch_index = viewer->selected_branch;
+            viewer->branch_pull_status = SYNC_STATUS_PULLING_VISIBLE;
+            viewer->branch_animation_frame = 0;
+            viewer->branch_text_char_count = 7; // Show full "Pulling"
+          }
         } else {
           show_error_popup("No commits to pull from remote");
         }
-        viewer->critical_operation_in_progress = 0;
       }
       break;
 
@@ -4444,8 +5244,8 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
     case 4: // Ctrl+D
       // Move cursor down half page
       viewer->file_cursor_line += max_lines_visible / 2;
-      if (viewer->file_cursor_line >= viewer->file_line_count) {
-        viewer->file_cursor_line = viewer->file_line_count - 1;
+      if (viewer->file_cursor_line >= viewer->file_store.count) {
+        viewer->file_cursor_line = viewer->file_store.count - 1;
       }
       // Adjust scroll to keep cursor visible with padding
       if (viewer->file_cursor_line >=
@@ -4453,9 +5253,9 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
         viewer->file_scroll_offset =
             viewer->file_cursor_line - max_lines_visible + 4;
         if (viewer->file_scroll_offset >
-            viewer->file_line_count - max_lines_visible) {
+            viewer->file_store.count - max_lines_visible) {
           viewer->file_scroll_offset =
-              viewer->file_line_count - max_lines_visible;
+              viewer->file_store.count - max_lines_visible;
         }
         if (viewer->file_scroll_offset < 0) {
           viewer->file_scroll_offset = 0;
@@ -4466,12 +5266,12 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
     case KEY_NPAGE: // Page Down
     case ' ':
       // Scroll content down by page
-      if (viewer->file_line_count > max_lines_visible) {
+      if (viewer->file_store.count > max_lines_visible) {
         viewer->file_scroll_offset += max_lines_visible;
         if (viewer->file_scroll_offset >
-            viewer->file_line_count - max_lines_visible) {
+            viewer->file_store.count - max_lines_visible) {
           viewer->file_scroll_offset =
-              viewer->file_line_count - max_lines_visible;
+              viewer->file_store.count - max_lines_visible;
         }
       }
       break;
@@ -4523,8 +5323,8 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
     case 4: // Ctrl+D
       // Move cursor down half page
       viewer->file_cursor_line += max_lines_visible / 2;
-      if (viewer->file_cursor_line >= viewer->file_line_count) {
-        viewer->file_cursor_line = viewer->file_line_count - 1;
+      if (viewer->file_cursor_line >= viewer->file_store.count) {
+        viewer->file_cursor_line = viewer->file_store.count - 1;
       }
       // Adjust scroll to keep cursor visible with padding
       if (viewer->file_cursor_line >=
@@ -4532,9 +5332,9 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
         viewer->file_scroll_offset =
             viewer->file_cursor_line - max_lines_visible + 4;
         if (viewer->file_scroll_offset >
-            viewer->file_line_count - max_lines_visible) {
+            viewer->file_store.count - max_lines_visible) {
           viewer->file_scroll_offset =
-              viewer->file_line_count - max_lines_visible;
+              viewer->file_store.count - max_lines_visible;
         }
         if (viewer->file_scroll_offset < 0) {
           viewer->file_scroll_offset = 0;
@@ -4545,12 +5345,12 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
     case KEY_NPAGE: // Page Down
     case ' ':
       // Scroll content down by page
-      if (viewer->file_line_count > max_lines_visible) {
+      if (viewer->file_store.count > max_lines_visible) {
         viewer->file_scroll_offset += max_lines_visible;
         if (viewer->file_scroll_offset >
-            viewer->file_line_count - max_lines_visible) {
+            viewer->file_store.count - max_lines_visible) {
           viewer->file_scroll_offset =
-              viewer->file_line_count - max_lines_visible;
+              viewer->file_store.count - max_lines_visible;
         }
       }
       break;
@@ -4602,8 +5402,8 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
     case 4: // Ctrl+D
       // Move cursor down half page
       viewer->file_cursor_line += max_lines_visible / 2;
-      if (viewer->file_cursor_line >= viewer->file_line_count) {
-        viewer->file_cursor_line = viewer->file_line_count - 1;
+      if (viewer->file_cursor_line >= viewer->file_store.count) {
+        viewer->file_cursor_line = viewer->file_store.count - 1;
       }
       // Adjust scroll to keep cursor visible with padding
       if (viewer->file_cursor_line >=
@@ -4611,9 +5411,9 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
         viewer->file_scroll_offset =
             viewer->file_cursor_line - max_lines_visible + 4;
         if (viewer->file_scroll_offset >
-            viewer->file_line_count - max_lines_visible) {
+            viewer->file_store.count - max_lines_visible) {
           viewer->file_scroll_offset =
-              viewer->file_line_count - max_lines_visible;
+              viewer->file_store.count - max_lines_visible;
         }
         if (viewer->file_scroll_offset < 0) {
           viewer->file_scroll_offset = 0;
@@ -4624,27 +5424,170 @@ int handle_ncurses_diff_input(NCursesDiffViewer *viewer, int key) {
     case KEY_NPAGE: // Page Down
     case ' ':
       // Scroll content down by page
-      if (viewer->file_line_count > max_lines_visible) {
+      if (viewer->file_store.count > max_lines_visible) {
         viewer->file_scroll_offset += max_lines_visible;
         if (viewer->file_scroll_offset >
-            viewer->file_line_count - max_lines_visible) {
+            viewer->file_store.count - max_lines_visible) {
           viewer->file_scroll_offset =
-              viewer->file_line_count - max_lines_visible;
+              viewer->file_store.count - max_lines_visible;
         }
       }
       break;
 
-    case KEY_PPAGE: // Page Up
-      // Scroll content up by page
-      viewer->file_scroll_offset -= max_lines_visible;
-      if (viewer->file_scroll_offset < 0) {
-        viewer->file_scroll_offset = 0;
-      }
-      break;
-    }
+    case KEY_PPAGE: // Page Up
+      // Scroll content up by page
+      viewer->file_scroll_offset -= max_lines_visible;
+      if (viewer->file_scroll_offset < 0) {
+        viewer->file_scroll_offset = 0;
+      }
+      break;
+    }
+  }
+
+  return 1; // Continue
+}
+
+static void render_title_bar(NCursesDiffViewer *viewer) {
+  // Clear just the title line
+  move(0, 0);
+  clrtoeol();
+
+  attron(COLOR_PAIR(3));
+  if (viewer->current_mode == NCURSES_MODE_FILE_LIST) {
+    mvprintw(0, 0,
+             "Git Diff Viewer: 1=files 2=view 3=branches 4=commits 5=stashes | "
+             "j/k=nav "
+             "Space=mark "
+             "A=all S=stash C=commit P=push | q=quit");
+  } else if (viewer->current_mode == NCURSES_MODE_FILE_VIEW) {
+    mvprintw(0, 0,
+             "Git Diff Viewer: 1=files 2=view 3=branches 4=commits 5=stashes | "
+             "j/k=scroll "
+             "Ctrl+U/D=30lines | q=quit");
+  } else {
+    mvprintw(0, 0,
+             "Git Diff Viewer: 1=files 2=view 3=branches 4=commits 5=stashes | "
+             "j/k=nav P=push "
+             "r/R=reset a=amend | q=quit");
+  }
+  attroff(COLOR_PAIR(3));
+  refresh();
+}
+
+void mark_viewer_dirty(NCursesDiffViewer *viewer, int windows) {
+  if (viewer)
+    viewer->dirty_windows |= windows;
+}
+
+void render_dirty_windows(NCursesDiffViewer *viewer) {
+  if (!viewer)
+    return;
+
+  int dirty = viewer->dirty_windows;
+  viewer->dirty_windows = 0;
+
+  // Skip main window rendering if fuzzy or grep search is active to prevent
+  // flickering
+  if (!viewer->fuzzy_search_active && !viewer->grep_search_active) {
+    if (dirty & DIRTY_TITLE)
+      render_title_bar(viewer);
+    if (dirty & DIRTY_FILE_LIST)
+      render_file_list_window(viewer);
+    if (dirty & DIRTY_FILE_CONTENT)
+      render_file_content_window(viewer);
+    if (dirty & DIRTY_COMMIT_LIST)
+      render_commit_list_window(viewer);
+    if (dirty & DIRTY_BRANCH_LIST)
+      render_branch_list_window(viewer);
+    if (dirty & DIRTY_STASH_LIST)
+      render_stash_list_window(viewer);
+    if (dirty & DIRTY_STATUS_BAR)
+      render_status_bar(viewer);
+  } else {
+    // Keep the main panes pending until the overlay closes
+    viewer->dirty_windows = dirty;
+  }
+
+  // Search overlays track their own redraw state
+  render_fuzzy_search(viewer);
+  render_grep_search(viewer);
+
+  // Keep cursor hidden
+  curs_set(0);
+}
+
+// Milliseconds until the next periodic background fetch is due
+static int ms_until_next_fetch(NCursesDiffViewer *viewer) {
+  time_t elapsed = time(NULL) - viewer->last_sync_time;
+  if (elapsed >= SYNC_FETCH_INTERVAL)
+    return 0;
+  return (int)(SYNC_FETCH_INTERVAL - elapsed) * 1000;
+}
+
+// What a key press can change beyond the focused pane
+typedef struct {
+  NCursesViewMode mode;
+  int split_view_mode;
+  int active_pane;
+  int search_active; // Fuzzy or grep overlay open
+  int file_count;
+  int commit_count;
+  int branch_count;
+  int stash_count;
+} ViewerKeyState;
+
+static void save_key_state(const NCursesDiffViewer *viewer,
+                           ViewerKeyState *state) {
+  state->mode = viewer->current_mode;
+  state->split_view_mode = viewer->split_view_mode;
+  state->active_pane = viewer->active_pane;
+  state->search_active =
+      viewer->fuzzy_search_active || viewer->grep_search_active;
+  state->file_count = viewer->file_count;
+  state->commit_count = viewer->commit_count;
+  state->branch_count = viewer->branch_count;
+  state->stash_count = viewer->stash_count;
+}
+
+// Windows a key press changed. Keys typed into a search overlay change
+// only the overlay, which tracks its own redraws; moving or scrolling
+// within a pane changes that pane and the preview beside it. Anything
+// else, like a git command, a prompt or a mode switch, may touch them all
+static int windows_changed_by_key(const NCursesDiffViewer *viewer, int key,
+                                  const ViewerKeyState *before) {
+  ViewerKeyState after;
+  save_key_state(viewer, &after);
+  if (memcmp(before, &after, sizeof(after)) != 0)
+    return DIRTY_ALL;
+  if (after.search_active)
+    return 0;
+
+  switch (key) {
+  case KEY_UP:
+  case KEY_DOWN:
+  case KEY_PPAGE:
+  case KEY_NPAGE:
+  case 'j':
+  case 'k':
+  case 4:  // Ctrl+D
+  case 21: // Ctrl+U
+    break;
+  default:
+    return DIRTY_ALL;
   }
 
-  return 1; // Continue
+  switch (after.mode) {
+  case NCURSES_MODE_FILE_LIST:
+    return DIRTY_FILE_LIST | DIRTY_FILE_CONTENT;
+  case NCURSES_MODE_COMMIT_LIST:
+    return DIRTY_COMMIT_LIST | DIRTY_FILE_CONTENT;
+  case NCURSES_MODE_BRANCH_LIST:
+    return DIRTY_BRANCH_LIST | DIRTY_FILE_CONTENT;
+  case NCURSES_MODE_STASH_LIST:
+    return DIRTY_STASH_LIST | DIRTY_FILE_CONTENT;
+  default: // The view modes scroll the content pane
+    return DIRTY_FILE_CONTENT;
+  }
 }
 
 int run_ncurses_diff_viewer(void) {
@@ -4654,7 +5597,22 @@ int run_ncurses_diff_viewer(void) {
     printf("Failed to initialize ncurses diff viewer\n");
     return 1;
   }
-  signal(SIGWINCH, handle_sigwinch);
+
+  // Wake sources: SIGWINCH and SIGCHLD write into a self-pipe so poll() can
+  // sleep until something actually happens
+  open_wake_pipe();
+  struct sigaction sa, old_winch, old_chld;
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sa.sa_handler = handle_sigwinch;
+  sigaction(SIGWINCH, &sa, &old_winch);
+  sa.sa_handler = handle_sigchld;
+  sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigaction(SIGCHLD, &sa, &old_chld);
+
+  viewer.animation_timerfd =
+      timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
 
   // Get changed files (can be 0, that's okay)
   get_ncurses_changed_files(&viewer);
@@ -4668,43 +5626,19 @@ int run_ncurses_diff_viewer(void) {
   // Load commit history
   get_commit_history(&viewer);
 
-  // Initial preview will be handled by update_preview_for_current_selection
-
-  // Initial display
-  attron(COLOR_PAIR(3));
-  if (viewer.current_mode == NCURSES_MODE_FILE_LIST) {
-    mvprintw(0, 0,
-             "Git Diff Viewer: 1=files 2=view 3=branches 4=commits 5=stashes | "
-             "j/k=nav "
-             "Space=mark "
-             "A=all S=stash C=commit P=push | q=quit");
-  } else if (viewer.current_mode == NCURSES_MODE_FILE_VIEW) {
-    mvprintw(0, 0,
-             "Git Diff Viewer: 1=files 2=view 3=branches 4=commits 5=stashes | "
-             "j/k=scroll "
-             "Ctrl+U/D=30lines | q=quit");
-  } else {
-    mvprintw(0, 0,
-             "Git Diff Viewer: 1=files 2=view 3=branches 4=commits 5=stashes | "
-             "j/k=nav P=push "
-             "r/R=reset a=amend | q=quit");
-  }
-
-  attroff(COLOR_PAIR(3));
-  refresh();
+  // Watch for outside changes from here on; without inotify the file list
+  // is rescanned after each background fetch instead
+  git_watch_start(&viewer.watch);
+  git_watch_note_index(&viewer.watch);
 
-  render_file_list_window(&viewer);
-  render_file_content_window(&viewer);
-  render_commit_list_window(&viewer);
-  render_branch_list_window(&viewer);
-  render_stash_list_window(&viewer);
-  render_status_bar(&viewer);
-  render_fuzzy_search(&viewer);
-  render_grep_search(&viewer);
+  // Initial preview will be handled by update_preview_for_current_selection
 
-  // Main display loop
+  // Main event loop: sleep in poll() on stdin, the wake pipe, the fetch
+  // child's pidfd, the running git operation's pipes and pidfd, the
+  // inotify watcher and the animation timer; redraw only dirty windows
   int running = 1;
   NCursesViewMode last_mode = viewer.current_mode;
+  viewer.dirty_windows = DIRTY_ALL;
 
   while (running) {
 
@@ -4712,179 +5646,378 @@ int run_ncurses_diff_viewer(void) {
       handle_terminal_resize(&viewer);
     }
 
+    // Update preview based on current selection
+    update_preview_for_current_selection(&viewer);
+
     // Only update title if mode changed
     if (viewer.current_mode != last_mode) {
-      // Clear just the title line
-      move(0, 0);
-      clrtoeol();
-
-      attron(COLOR_PAIR(3));
-      if (viewer.current_mode == NCURSES_MODE_FILE_LIST) {
-        mvprintw(0, 0,
-                 "Git Diff Viewer: 1=files 2=view 3=branches 4=commits "
-                 "5=stashes | j/k=nav "
-                 "Space=mark A=all S=stash C=commit P=push | q=quit");
-      } else if (viewer.current_mode == NCURSES_MODE_FILE_VIEW) {
-        mvprintw(0, 0,
-                 "Git Diff Viewer: 1=files 2=view 3=branches 4=commits "
-                 "5=stashes | j/k=scroll "
-                 "Ctrl+U/D=30lines | q=quit");
-      } else {
-        mvprintw(
-            0, 0,
-            "Git Diff Viewer: 1=files 2=view 3=branches 4=commits 5=stashes | "
-            "j/k=nav P=push "
-            "r/R=reset a=amend | q=quit");
-      }
-      attroff(COLOR_PAIR(3));
-      refresh();
+      viewer.dirty_windows |= DIRTY_TITLE;
       last_mode = viewer.current_mode;
     }
-    // Update sync status and check for new files
-    update_sync_status(&viewer);
 
-    // Update preview based on current selection
-    update_preview_for_current_selection(&viewer);
+    render_dirty_windows(&viewer);
+
+    // Tick the animation timer only while something is animating
+    set_animation_timer(&viewer, sync_animation_active(&viewer));
+
+    struct pollfd fds[8];
+    int nfds = 0;
+    int stdin_idx, wake_idx = -1, timer_idx = -1;
+
+    fds[nfds].fd = STDIN_FILENO;
+    fds[nfds].events = POLLIN;
+    stdin_idx = nfds++;
+    if (wake_pipe[0] >= 0) {
+      fds[nfds].fd = wake_pipe[0];
+      fds[nfds].events = POLLIN;
+      wake_idx = nfds++;
+    }
+    if (viewer.fetch_pidfd >= 0) {
+      fds[nfds].fd = viewer.fetch_pidfd;
+      fds[nfds].events = POLLIN;
+      nfds++;
+    }
+    if (viewer.git_ops.input_fd >= 0) {
+      fds[nfds].fd = viewer.git_ops.input_fd;
+      fds[nfds].events = POLLOUT;
+      nfds++;
+    }
+    if (viewer.git_ops.output_fd >= 0) {
+      fds[nfds].fd = viewer.git_ops.output_fd;
+      fds[nfds].events = POLLIN;
+      nfds++;
+    }
+    if (viewer.git_ops.pidfd >= 0) {
+      fds[nfds].fd = viewer.git_ops.pidfd;
+      fds[nfds].events = POLLIN;
+      nfds++;
+    }
+    if (viewer.watch.fd >= 0) {
+      fds[nfds].fd = viewer.watch.fd;
+      fds[nfds].events = POLLIN;
+      nfds++;
+    }
+    if (viewer.animation_timer_armed) {
+      fds[nfds].fd = viewer.animation_timerfd;
+      fds[nfds].events = POLLIN;
+      timer_idx = nfds++;
+    }
+
+    // Without a timerfd, fall back to polling at the animation tick rate
+    int timeout = ms_until_next_fetch(&viewer);
+    if (sync_animation_active(&viewer) && viewer.animation_timerfd < 0 &&
+        timeout > SYNC_ANIMATION_TICK_MS)
+      timeout = SYNC_ANIMATION_TICK_MS;
+
+    // Wake once watched changes settle, unless a fetch or operation is
+    // running and will refresh anyway
+    if (!viewer.fetch_in_progress && !git_op_busy(&viewer.git_ops)) {
+      int watch_timeout = git_watch_ms_until_ready(&viewer.watch);
+      if (watch_timeout >= 0 && watch_timeout < timeout)
+        timeout = watch_timeout;
+    }
 
-    // Skip main window rendering if fuzzy or grep search is active to prevent
-    // flickering
-    if (!viewer.fuzzy_search_active && !viewer.grep_search_active) {
-      render_file_list_window(&viewer);
-      render_file_content_window(&viewer);
-      render_commit_list_window(&viewer);
-      render_branch_list_window(&viewer);
-      render_stash_list_window(&viewer);
-      render_status_bar(&viewer);
+    int ready = poll(fds, nfds, timeout);
+    if (ready < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
     }
 
-    // Always render search overlays (they handle their own visibility)
-    render_fuzzy_search(&viewer);
-    render_grep_search(&viewer);
+    if (wake_idx >= 0 && (fds[wake_idx].revents & POLLIN)) {
+      // Resize is picked up via terminal_resized, SIGCHLD via the fetch check
+      drain_fd(wake_pipe[0]);
+    }
 
-    // Keep cursor hidden
-    curs_set(0);
+    if (timer_idx >= 0 && (fds[timer_idx].revents & POLLIN)) {
+      uint64_t expirations = 0;
+      if (read(viewer.animation_timerfd, &expirations, sizeof(expirations)) ==
+          sizeof(expirations)) {
+        // Catch up on missed ticks, but never replay more than a second
+        if (expirations > 1000 / SYNC_ANIMATION_TICK_MS)
+          expirations = 1000 / SYNC_ANIMATION_TICK_MS;
+        for (uint64_t i = 0; i < expirations; i++)
+          advance_sync_animation(&viewer);
+        viewer.dirty_windows |= DIRTY_STATUS_BAR | DIRTY_BRANCH_LIST;
+      }
+    } else if (timer_idx < 0 && sync_animation_active(&viewer) &&
+               viewer.animation_timerfd < 0) {
+      advance_sync_animation(&viewer);
+      viewer.dirty_windows |= DIRTY_STATUS_BAR | DIRTY_BRANCH_LIST;
+    }
 
-    int c = getch();
-    if (c != ERR) { // Only process if a key was actually pressed
-      running = handle_ncurses_diff_input(&viewer, c);
+    if (fds[stdin_idx].revents & (POLLIN | POLLHUP | POLLERR)) {
+      // Drain everything ncurses has buffered before redrawing
+      int c;
+      while (running && (c = getch()) != ERR) {
+        ViewerKeyState before;
+        save_key_state(&viewer, &before);
+        running = handle_ncurses_diff_input(&viewer, c);
+        viewer.dirty_windows |= windows_changed_by_key(&viewer, c, &before);
+      }
+      if (fds[stdin_idx].revents & (POLLHUP | POLLERR))
+        running = 0;
     }
 
-    // Small delay to prevent excessive CPU usage and allow animations
-    usleep(20000); // 20ms delay
+    // Start a due fetch and reap a finished one (pidfd or SIGCHLD woke us)
+    SyncStatus previous_status = viewer.sync_status;
+    update_sync_status(&viewer);
+    if (viewer.sync_status != previous_status)
+      viewer.dirty_windows |= DIRTY_STATUS_BAR;
+
+    // Progress, completion and the next queued commit/push/pull
+    check_git_operations(&viewer);
+
+    // Files edited, refs moved or stashes changed outside the viewer
+    git_watch_read(&viewer.watch);
+    apply_watched_changes(&viewer);
   }
 
   cleanup_ncurses_diff_viewer(&viewer);
+
+  sigaction(SIGWINCH, &old_winch, NULL);
+  sigaction(SIGCHLD, &old_chld, NULL);
+  close_wake_pipe();
   return 0;
 }
 
 
 
-int get_ncurses_git_branches(NCursesDiffViewer *viewer) {
-  if (!viewer)
-    return 0;
+// A ref and the commit it points at, from for-each-ref
+typedef struct {
+  char refname[MAX_BRANCHNAME_LEN + 32];
+  char oid[GIT_MAX_OID_HEX_LEN + 1];
+} RefTip;
 
-  viewer->branch_count = 0;
+static int compare_ref_tips(const void *a, const void *b) {
+  return strcmp(((const RefTip *)a)->refname, ((const RefTip *)b)->refname);
+}
 
-  // Note: We now do fetching in the background to avoid UI freezes
+// Parse "ahead 3, behind 2" as printed by %(upstream:track,nobracket)
+static void parse_upstream_track(const char *track, int *ahead, int *behind) {
+  const char *field;
+  *ahead = *behind = 0;
+  if ((field = strstr(track, "ahead ")))
+    *ahead = atoi(field + 6);
+  if ((field = strstr(track, "behind ")))
+    *behind = atoi(field + 7);
+}
 
-  // Use git branch (without -a) to only show local branches
-  FILE *fp = popen("git branch 2>/dev/null", "r");
-  if (!fp) {
-    return 0;
+// Split a tab-separated line in place; missing fields are empty strings
+static int split_tab_fields(char *line, char **fields, int max_fields) {
+  int count = 0;
+  while (count < max_fields) {
+    fields[count++] = line;
+    char *tab = strchr(line, '\t');
+    if (!tab)
+      break;
+    *tab = '\0';
+    line = tab + 1;
   }
+  for (int i = count; i < max_fields; i++)
+    fields[i] = "";
+  return count;
+}
 
-  char line[512];
-  while (fgets(line, sizeof(line), fp) && viewer->branch_count < MAX_BRANCHES) {
-    // Remove newline
-    line[strcspn(line, "\n")] = 0;
-
-    // Skip empty lines
-    if (strlen(line) == 0)
-      continue;
+// List local branches with their ahead/behind counts. One for-each-ref
+// gives every branch tip, its upstream and the remote tips; counts from the
+// previous load are kept while the branch, its upstream and the upstream's
+// tip are unchanged, so only branches a fetch or commit moved are counted
+// again. Branches without an upstream are compared with origin/<name>
+int get_ncurses_git_branches(NCursesDiffViewer *viewer) {
+  if (!viewer)
+    return 0;
 
-    // Check if this is the current branch (starts with *)
-    int is_current = 0;
-    char *branch_name = line;
+  // Without earlier counts, have git count ahead/behind in the same pass
+  int first_load = viewer->branch_count == 0;
+  FILE *fp = popen(first_load
+                       ? "git for-each-ref --format='%(refname)%09%(objectname)"
+                         "%09%(HEAD)%09%(upstream)%09%(upstream:track,"
+                         "nobracket)' refs/heads refs/remotes 2>/dev/null"
+                       : "git for-each-ref --format='%(refname)%09%(objectname)"
+                         "%09%(HEAD)%09%(upstream)' refs/heads refs/remotes "
+                         "2>/dev/null",
+                   "r");
+  if (!fp)
+    return 0;
 
-    // Skip leading spaces
-    while (*branch_name == ' ')
-      branch_name++;
+  NCursesBranches *branches = NULL;
+  int branch_count = 0, branch_capacity = 0;
+  RefTip *refs = NULL;
+  int ref_count = 0, ref_capacity = 0;
+  char **tracks = NULL; // Track text per branch, first load only
+
+  char *line = NULL;
+  size_t line_size = 0;
+  while (line_store_read_line(fp, &line, &line_size) >= 0) {
+    char *fields[5];
+    split_tab_fields(line, fields, 5);
+    if (!git_is_oid_hex(fields[1]))
+      continue;
 
-    if (*branch_name == '*') {
-      is_current = 1;
-      branch_name++; // Skip the *
-      while (*branch_name == ' ')
-        branch_name++; // Skip spaces after *
+    if (ref_count == ref_capacity) {
+      int new_capacity = ref_capacity ? ref_capacity * 2 : 64;
+      RefTip *grown = realloc(refs, new_capacity * sizeof(RefTip));
+      if (!grown)
+        break;
+      refs = grown;
+      ref_capacity = new_capacity;
     }
+    snprintf(refs[ref_count].refname, sizeof(refs[ref_count].refname), "%s",
+             fields[0]);
+    strcpy(refs[ref_count].oid, fields[1]);
+    ref_count++;
 
-    // Skip any lines that contain "->" (symbolic references like origin/HEAD ->
-    // origin/main)
-    if (strstr(branch_name, "->") != NULL) {
+    if (strncmp(fields[0], "refs/heads/", 11) != 0)
       continue;
-    }
 
-    // Skip remote branches (shouldn't appear with git branch, but just in case)
-    if (strncmp(branch_name, "remotes/", 8) == 0) {
-      continue;
+    if (branch_count == branch_capacity) {
+      int new_capacity = branch_capacity ? branch_capacity * 2 : 16;
+      NCursesBranches *grown =
+          realloc(branches, new_capacity * sizeof(NCursesBranches));
+      char **grown_tracks =
+          first_load ? realloc(tracks, new_capacity * sizeof(char *)) : NULL;
+      if (grown)
+        branches = grown;
+      if (grown_tracks)
+        tracks = grown_tracks;
+      if (!grown || (first_load && !grown_tracks))
+        break;
+      branch_capacity = new_capacity;
     }
 
-    // Copy branch name
-    strncpy(viewer->branches[viewer->branch_count].name, branch_name,
-            MAX_BRANCHNAME_LEN - 1);
-    viewer->branches[viewer->branch_count].name[MAX_BRANCHNAME_LEN - 1] = '\0';
-    viewer->branches[viewer->branch_count].status = is_current;
-
-    // Initialize ahead/behind counts
-    viewer->branches[viewer->branch_count].commits_ahead = 0;
-    viewer->branches[viewer->branch_count].commits_behind = 0;
+    NCursesBranches *branch = &branches[branch_count];
+    memset(branch, 0, sizeof(NCursesBranches));
+    snprintf(branch->name, sizeof(branch->name), "%s", fields[0] + 11);
+    strcpy(branch->tip, fields[1]);
+    branch->status = (fields[2][0] == '*');
+    if (fields[3][0]) {
+      snprintf(branch->compare_ref, sizeof(branch->compare_ref), "%s",
+               fields[3]);
+    } else {
+      snprintf(branch->compare_ref, sizeof(branch->compare_ref),
+               "refs/remotes/origin/%s", branch->name);
+    }
+    if (first_load)
+      tracks[branch_count] = fields[3][0] ? strdup(fields[4]) : NULL;
+    branch_count++;
+  }
+  free(line);
+  pclose(fp);
 
-    // Get ahead/behind status using the exact method lazygit uses
-    // First check if remote branch exists
-    char remote_exists_cmd[512];
-    snprintf(remote_exists_cmd, sizeof(remote_exists_cmd),
-             "git show-ref --verify --quiet refs/remotes/origin/%s",
-             branch_name);
+  // for-each-ref sorts by refname, but don't rely on the locale
+  qsort(refs, ref_count, sizeof(RefTip), compare_ref_tips);
 
-    if (system(remote_exists_cmd) == 0) {
-      // Remote branch exists, now get ahead/behind counts
+  int need_track = 0;
+  int previous = 0;
+  for (int i = 0; i < branch_count; i++) {
+    NCursesBranches *branch = &branches[i];
 
-      // Get commits behind (how many commits remote has that we don't)
-      char behind_cmd[512];
-      snprintf(behind_cmd, sizeof(behind_cmd),
-               "git rev-list --count %s..origin/%s 2>/dev/null", branch_name,
-               branch_name);
+    RefTip probe;
+    snprintf(probe.refname, sizeof(probe.refname), "%s", branch->compare_ref);
+    RefTip *compare =
+        bsearch(&probe, refs, ref_count, sizeof(RefTip), compare_ref_tips);
+    if (compare) {
+      strcpy(branch->compare_tip, compare->oid);
+    } else {
+      // Nothing to compare with
+      branch->compare_ref[0] = '\0';
+      continue;
+    }
 
-      FILE *behind_fp = popen(behind_cmd, "r");
-      if (behind_fp) {
-        char behind_count[32];
-        if (fgets(behind_count, sizeof(behind_count), behind_fp) != NULL) {
-          viewer->branches[viewer->branch_count].commits_behind =
-              atoi(behind_count);
-        }
-        pclose(behind_fp);
+    if (first_load) {
+      if (tracks[i]) {
+        parse_upstream_track(tracks[i], &branch->commits_ahead,
+                             &branch->commits_behind);
+        continue;
       }
+    } else {
+      // Both lists are in refname order
+      while (previous < viewer->branch_count &&
+             strcmp(viewer->branches[previous].name, branch->name) < 0)
+        previous++;
+      NCursesBranches *old = previous < viewer->branch_count
+                                 ? &viewer->branches[previous]
+                                 : NULL;
+      if (old && strcmp(old->name, branch->name) == 0 &&
+          strcmp(old->tip, branch->tip) == 0 &&
+          strcmp(old->compare_ref, branch->compare_ref) == 0 &&
+          strcmp(old->compare_tip, branch->compare_tip) == 0) {
+        branch->commits_ahead = old->commits_ahead;
+        branch->commits_behind = old->commits_behind;
+        continue;
+      }
+    }
 
-      // Get commits ahead (how many commits we have that remote doesn't)
-      char ahead_cmd[512];
-      snprintf(ahead_cmd, sizeof(ahead_cmd),
-               "git rev-list --count origin/%s..%s 2>/dev/null", branch_name,
-               branch_name);
-
-      FILE *ahead_fp = popen(ahead_cmd, "r");
-      if (ahead_fp) {
-        char ahead_count[32];
-        if (fgets(ahead_count, sizeof(ahead_count), ahead_fp) != NULL) {
-          viewer->branches[viewer->branch_count].commits_ahead =
-              atoi(ahead_count);
+    // Counted below. On the first load git already counted every branch
+    // with an upstream
+    branch->commits_ahead = -1;
+    if (!first_load)
+      need_track = 1;
+  }
+
+  if (tracks) {
+    for (int i = 0; i < branch_count; i++)
+      free(tracks[i]);
+    free(tracks);
+  }
+  free(refs);
+
+  // Branches with an upstream: git counts them all in one process
+  if (need_track) {
+    fp = popen("git for-each-ref --format='%(refname)%09%(upstream:track,"
+               "nobracket)' refs/heads 2>/dev/null",
+               "r");
+    if (fp) {
+      int index = 0;
+      line = NULL;
+      line_size = 0;
+      while (line_store_read_line(fp, &line, &line_size) >= 0) {
+        char *fields[2];
+        split_tab_fields(line, fields, 2);
+        if (strncmp(fields[0], "refs/heads/", 11) != 0)
+          continue;
+        while (index < branch_count &&
+               strcmp(branches[index].name, fields[0] + 11) < 0)
+          index++;
+        if (index < branch_count &&
+            strcmp(branches[index].name, fields[0] + 11) == 0 &&
+            branches[index].commits_ahead == -1 && fields[1][0]) {
+          parse_upstream_track(fields[1], &branches[index].commits_ahead,
+                               &branches[index].commits_behind);
         }
-        pclose(ahead_fp);
       }
+      free(line);
+      pclose(fp);
     }
-
-    viewer->branch_count++;
   }
 
-  pclose(fp);
+  // Branches only matched to origin/<name> by name
+  for (int i = 0; i < branch_count; i++) {
+    NCursesBranches *branch = &branches[i];
+    if (branch->commits_ahead != -1)
+      continue;
+
+    branch->commits_ahead = branch->commits_behind = 0;
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd),
+             "git rev-list --left-right --count \"%s...%s\" 2>/dev/null",
+             branch->tip, branch->compare_tip);
+    FILE *count_fp = popen(cmd, "r");
+    if (count_fp) {
+      if (fscanf(count_fp, "%d %d", &branch->commits_ahead,
+                 &branch->commits_behind) != 2)
+        branch->commits_ahead = branch->commits_behind = 0;
+      pclose(count_fp);
+    }
+  }
+
+  free(viewer->branches);
+  viewer->branches = branches;
+  viewer->branch_count = branch_count;
+  viewer->branch_capacity = branch_capacity;
+  if (viewer->selected_branch >= branch_count)
+    viewer->selected_branch = branch_count > 0 ? branch_count - 1 : 0;
   return 1;
 }
 
@@ -5452,14 +6585,29 @@ int get_ncurses_git_stashes(NCursesDiffViewer *viewer) {
   if (!viewer)
     return 0;
 
-  char stash_lines[MAX_STASHES][512];
-  viewer->stash_count = get_git_stashes(stash_lines, MAX_STASHES);
+  char(*stash_lines)[512] = NULL;
+  int line_capacity = 0;
+  int count = get_git_stashes(&stash_lines, &line_capacity);
+
+  if (count > viewer->stash_capacity) {
+    NCursesStash *grown =
+        realloc(viewer->stashes, count * sizeof(NCursesStash));
+    if (!grown) {
+      free(stash_lines);
+      viewer->stash_count = 0;
+      return 0;
+    }
+    viewer->stashes = grown;
+    viewer->stash_capacity = count;
+  }
 
+  viewer->stash_count = count;
   for (int i = 0; i < viewer->stash_count; i++) {
     strncpy(viewer->stashes[i].stash_info, stash_lines[i], 511);
     viewer->stashes[i].stash_info[511] = '\0';
   }
 
+  free(stash_lines);
   return viewer->stash_count;
 }
 
@@ -5634,7 +6782,7 @@ int create_ncurses_git_stash(NCursesDiffViewer *viewer) {
 
     // Reset file selection since changes are stashed
     viewer->selected_file = 0;
-    viewer->file_line_count = 0;
+    line_store_clear(&viewer->file_store);
     viewer->file_scroll_offset = 0;
 
     // Reload current file if any files still exist
@@ -5814,11 +6962,27 @@ void render_branch_list_window(NCursesDiffViewer *viewer) {
     }
   }
 
+  // Keep the selected branch in view
+  if (viewer->selected_branch < viewer->branch_scroll_offset)
+    viewer->branch_scroll_offset = viewer->selected_branch;
+  if (viewer->selected_branch >=
+      viewer->branch_scroll_offset + max_branches_visible)
+    viewer->branch_scroll_offset =
+        viewer->selected_branch - max_branches_visible + 1;
+  if (viewer->branch_scroll_offset >
+      viewer->branch_count - max_branches_visible)
+    viewer->branch_scroll_offset = viewer->branch_count - max_branches_visible;
+  if (viewer->branch_scroll_offset < 0)
+    viewer->branch_scroll_offset = 0;
+
   if (viewer->branch_count == 0) {
     mvwprintw(viewer->branch_list_win, 1, 2, "No branches available");
   } else {
-    for (int i = 0; i < max_branches_visible && i < viewer->branch_count; i++) {
-      int y = i + 1;
+    for (int i = viewer->branch_scroll_offset;
+         i < viewer->branch_scroll_offset + max_branches_visible &&
+         i < viewer->branch_count;
+         i++) {
+      int y = i - viewer->branch_scroll_offset + 1;
 
       int is_selected_branch =
           (i == viewer->selected_branch &&
@@ -6021,77 +7185,78 @@ int parse_content_lines(NCursesDiffViewer *viewer, const char *content) {
     return 0;
   }
 
-  viewer->file_line_count = 0;
   viewer->file_scroll_offset = 0;
   viewer->file_cursor_line = 0;
+  return preview_parse_content(&viewer->file_store, content);
+}
 
-  // Parse line by line, preserving empty lines
-  const char *line_start = content;
-  const char *line_end;
-
-  while (*line_start && viewer->file_line_count < MAX_FULL_FILE_LINES) {
-    NCursesFileLine *file_line = &viewer->file_lines[viewer->file_line_count];
-
-    // Find end of current line
-    line_end = strchr(line_start, '\n');
-    if (!line_end) {
-      line_end = line_start + strlen(line_start);
-    }
-
-    // Calculate line length
-    size_t line_len = line_end - line_start;
-
-    // Copy line content (truncate if too long)
-    size_t copy_len = (line_len < sizeof(file_line->line) - 1)
-                          ? line_len
-                          : sizeof(file_line->line) - 1;
-    strncpy(file_line->line, line_start, copy_len);
-    file_line->line[copy_len] = '\0';
-
-    // Determine line type for syntax highlighting
-    if (line_len == 0) {
-      file_line->type = ' '; // Empty line
-    } else if (strncmp(file_line->line, "diff --git", 10) == 0 ||
-               strncmp(file_line->line, "index ", 6) == 0 ||
-               strncmp(file_line->line, "--- ", 4) == 0 ||
-               strncmp(file_line->line, "+++ ", 4) == 0) {
-      file_line->type = '@'; // Use @ for headers
-    } else if (line_len > 1 && file_line->line[0] == '@' &&
-               file_line->line[1] == '@') {
-      file_line->type = '@'; // Hunk headers
-    } else if (line_len > 0 && file_line->line[0] == '+') {
-      file_line->type = '+'; // Added lines
-    } else if (line_len > 0 && file_line->line[0] == '-') {
-      file_line->type = '-'; // Removed lines
-    } else if (strstr(file_line->line, " | ") &&
-               (strstr(file_line->line, "+") || strstr(file_line->line, "-") ||
-                strstr(file_line->line, "Bin"))) {
-      file_line->type = 's'; // File statistics lines (special type)
-    } else if (strstr(file_line->line, " files changed") ||
-               strstr(file_line->line, " insertions") ||
-               strstr(file_line->line, " deletions")) {
-      file_line->type = 's'; // Summary statistics lines
-    } else if (strncmp(file_line->line, "commit ", 7) == 0) {
-      file_line->type = 'h'; // Commit header
-    } else if (strncmp(file_line->line, "Author: ", 8) == 0 ||
-               strncmp(file_line->line, "Date: ", 6) == 0) {
-      file_line->type = 'i'; // Commit info lines
-    } else {
-      file_line->type = ' '; // Normal/context lines
-    }
+// Fill store with a preview, from the cache when the object was seen (or
+// prefetched) before. The resolved key is copied to key_out if given
+static int load_preview(NCursesDiffViewer *viewer, PreviewKind kind,
+                        const char *object, NCursesLineStore *store,
+                        int *item_count, char *key_out) {
+  char key[PREVIEW_KEY_LEN];
+  int have_key = preview_resolve_key(kind, object, key, sizeof(key));
+
+  if (key_out)
+    snprintf(key_out, PREVIEW_KEY_LEN, "%s", have_key ? key : "");
 
-    file_line->is_diff_line = (file_line->type != ' ') ? 1 : 0;
+  if (have_key && preview_cache_lookup(&viewer->preview_cache, kind, key,
+                                       store, item_count))
+    return 1;
 
-    viewer->file_line_count++;
+  if (!preview_load(kind, object, have_key ? key : NULL, store, item_count))
+    return 0;
 
-    // Move to next line
-    if (*line_end == '\n') {
-      line_start = line_end + 1;
-    } else {
-      break; // End of content
+  if (have_key)
+    preview_cache_insert(&viewer->preview_cache, kind, key, store,
+                         item_count ? *item_count : 0);
+  return 1;
+}
+
+// Queue the previews around the selection so j/k lands on a warm cache
+static void prefetch_neighbor_previews(NCursesDiffViewer *viewer,
+                                       PreviewKind kind) {
+  int selected, count;
+  switch (kind) {
+  case PREVIEW_COMMIT:
+    selected = viewer->selected_commit;
+    count = viewer->commit_count;
+    break;
+  case PREVIEW_BRANCH:
+    selected = viewer->selected_branch;
+    count = viewer->branch_count;
+    break;
+  default:
+    selected = viewer->selected_stash;
+    count = viewer->stash_count;
+    break;
+  }
+
+  PreviewJob jobs[PREVIEW_MAX_JOBS];
+  int job_count = 0;
+  for (int distance = 1; distance <= PREVIEW_PREFETCH_RADIUS; distance++) {
+    int candidates[2] = {selected + distance, selected - distance};
+    for (int i = 0; i < 2; i++) {
+      int index = candidates[i];
+      if (index < 0 || index >= count)
+        continue;
+
+      PreviewJob *job = &jobs[job_count++];
+      job->kind = kind;
+      if (kind == PREVIEW_COMMIT) {
+        snprintf(job->object, sizeof(job->object), "%s",
+                 viewer->commits[index].hash);
+      } else if (kind == PREVIEW_BRANCH) {
+        snprintf(job->object, sizeof(job->object), "%s",
+                 viewer->branches[index].name);
+      } else {
+        snprintf(job->object, sizeof(job->object), "stash@{%d}", index);
+      }
     }
   }
-  return viewer->file_line_count;
+
+  preview_cache_prefetch(&viewer->preview_cache, jobs, job_count);
 }
 
 int load_commit_for_viewing(NCursesDiffViewer *viewer,
@@ -6100,19 +7265,12 @@ int load_commit_for_viewing(NCursesDiffViewer *viewer,
     return 0;
   }
 
-  char *commit_content = malloc(50000); // Large buffer for commit details
-  if (!commit_content) {
-    return 0;
-  }
-
-  if (get_commit_details(commit_hash, commit_content, 50000)) {
-    int result = parse_content_lines(viewer, commit_content);
-    free(commit_content);
-    return result;
-  }
-
-  free(commit_content);
-  return 0;
+  viewer->file_scroll_offset = 0;
+  viewer->file_cursor_line = 0;
+  int loaded = load_preview(viewer, PREVIEW_COMMIT, commit_hash,
+                            &viewer->file_store, NULL, NULL);
+  prefetch_neighbor_previews(viewer, PREVIEW_COMMIT);
+  return loaded ? viewer->file_store.count : 0;
 }
 
 int load_stash_for_viewing(NCursesDiffViewer *viewer, int stash_index) {
@@ -6120,19 +7278,15 @@ int load_stash_for_viewing(NCursesDiffViewer *viewer, int stash_index) {
     return 0;
   }
 
-  char *stash_content = malloc(50000); // Large buffer for stash details
-  if (!stash_content) {
-    return 0;
-  }
-
-  if (get_stash_diff(stash_index, stash_content, 50000)) {
-    int result = parse_content_lines(viewer, stash_content);
-    free(stash_content);
-    return result;
-  }
+  char stash_ref[32];
+  snprintf(stash_ref, sizeof(stash_ref), "stash@{%d}", stash_index);
 
-  free(stash_content);
-  return 0;
+  viewer->file_scroll_offset = 0;
+  viewer->file_cursor_line = 0;
+  int loaded = load_preview(viewer, PREVIEW_STASH, stash_ref,
+                            &viewer->file_store, NULL, NULL);
+  prefetch_neighbor_previews(viewer, PREVIEW_STASH);
+  return loaded ? viewer->file_store.count : 0;
 }
 
 int load_branch_commits(NCursesDiffViewer *viewer, const char *branch_name) {
@@ -6140,13 +7294,22 @@ int load_branch_commits(NCursesDiffViewer *viewer, const char *branch_name) {
     return 0;
   }
 
-  // Only load if it's a different branch than currently loaded
-  if (strcmp(viewer->current_branch_for_commits, branch_name) == 0) {
+  // Reuse the loaded log only while the branch still points at the same
+  // commit; a fetch or commit that moves it reloads
+  char key[PREVIEW_KEY_LEN];
+  if (strcmp(viewer->current_branch_for_commits, branch_name) == 0 &&
+      preview_resolve_key(PREVIEW_BRANCH, branch_name, key, sizeof(key)) &&
+      strcmp(viewer->branch_commits_key, key) == 0) {
     return viewer->branch_commit_count; // Already loaded
   }
 
-  viewer->branch_commit_count =
-      get_branch_commits(branch_name, viewer->branch_commits, MAX_COMMITS);
+  viewer->branch_commit_count = 0;
+  if (!load_preview(viewer, PREVIEW_BRANCH, branch_name,
+                    &viewer->branch_commit_store, &viewer->branch_commit_count,
+                    viewer->branch_commits_key)) {
+    line_store_clear(&viewer->branch_commit_store);
+    viewer->branch_commit_count = 0;
+  }
 
   strncpy(viewer->current_branch_for_commits, branch_name,
           sizeof(viewer->current_branch_for_commits) - 1);
@@ -6154,6 +7317,7 @@ int load_branch_commits(NCursesDiffViewer *viewer, const char *branch_name) {
       ->current_branch_for_commits[sizeof(viewer->current_branch_for_commits) -
                                    1] = '\0';
 
+  prefetch_neighbor_previews(viewer, PREVIEW_BRANCH);
   return viewer->branch_commit_count;
 }
 
@@ -6162,73 +7326,18 @@ int parse_branch_commits_to_lines(NCursesDiffViewer *viewer) {
     return 0;
   }
 
-  viewer->file_line_count = 0;
   viewer->file_scroll_offset = 0;
   viewer->file_cursor_line = 0;
+  if (!line_store_copy(&viewer->file_store, &viewer->branch_commit_store))
+    line_store_clear(&viewer->file_store);
 
-  // Parse each commit into file_lines for navigation
-  for (int commit_idx = 0; commit_idx < viewer->branch_commit_count &&
-                           viewer->file_line_count < MAX_FULL_FILE_LINES;
-       commit_idx++) {
-
-    char *commit_text = viewer->branch_commits[commit_idx];
-    char *line_start = commit_text;
-    char *line_end;
-
-    // Parse each line of the commit
-    while ((line_end = strchr(line_start, '\n')) != NULL &&
-           viewer->file_line_count < MAX_FULL_FILE_LINES) {
-      *line_end = '\0'; // Temporarily null-terminate
-
-      NCursesFileLine *file_line = &viewer->file_lines[viewer->file_line_count];
-      strncpy(file_line->line, line_start, sizeof(file_line->line) - 1);
-      file_line->line[sizeof(file_line->line) - 1] = '\0';
-
-      // Set line type for appropriate coloring
-      if (strncmp(line_start, "commit ", 7) == 0) {
-        file_line->type = 'h'; // Commit header
-      } else if (strncmp(line_start, "Author:", 7) == 0 ||
-                 strncmp(line_start, "Date:", 5) == 0) {
-        file_line->type = 'i'; // Info line
-      } else {
-        file_line->type = ' '; // Regular line
-      }
-
-      file_line->is_diff_line = 0;
-      viewer->file_line_count++;
-
-      *line_end = '\n'; // Restore newline
-      line_start = line_end + 1;
-    }
-
-    // Handle last line if no newline at end
-    if (strlen(line_start) > 0 &&
-        viewer->file_line_count < MAX_FULL_FILE_LINES) {
-      NCursesFileLine *file_line = &viewer->file_lines[viewer->file_line_count];
-      strncpy(file_line->line, line_start, sizeof(file_line->line) - 1);
-      file_line->line[sizeof(file_line->line) - 1] = '\0';
-      file_line->type = ' ';
-      file_line->is_diff_line = 0;
-      viewer->file_line_count++;
-    }
-
-    // Add spacing between commits
-    if (viewer->file_line_count < MAX_FULL_FILE_LINES) {
-      NCursesFileLine *empty_line =
-          &viewer->file_lines[viewer->file_line_count];
-      strcpy(empty_line->line, "");
-      empty_line->type = ' ';
-      empty_line->is_diff_line = 0;
-      viewer->file_line_count++;
-    }
-  }
-
-  return viewer->file_line_count;
+  return viewer->file_store.count;
 }
 
 void start_background_fetch(NCursesDiffViewer *viewer) {
   if (!viewer || viewer->fetch_in_progress ||
-      viewer->critical_operation_in_progress) {
+      viewer->critical_operation_in_progress ||
+      git_op_busy(&viewer->git_ops)) {
     return;
   }
 
@@ -6239,6 +7348,7 @@ void start_background_fetch(NCursesDiffViewer *viewer) {
     exit(0);
   } else if (viewer->fetch_pid > 0) {
     // Parent process: mark fetch as in progress
+    viewer->fetch_pidfd = git_op_open_pidfd(viewer->fetch_pid);
     viewer->fetch_in_progress = 1;
     viewer->sync_status = SYNC_STATUS_SYNCING_APPEARING;
     viewer->animation_frame = 0;
@@ -6246,6 +7356,62 @@ void start_background_fetch(NCursesDiffViewer *viewer) {
   }
 }
 
+// Reload everything a fetch may have moved, keeping the cursor in place.
+// Only used when the repository isn't being watched
+static void refresh_after_fetch(NCursesDiffViewer *viewer) {
+  // Preserve current positions during refresh
+  int preserved_file_scroll = viewer->file_scroll_offset;
+  int preserved_file_cursor = viewer->file_cursor_line;
+  int preserved_selected_file = viewer->selected_file;
+
+  // Update only the necessary data without blocking UI
+  get_ncurses_changed_files(viewer);
+  get_commit_history(viewer);
+  get_ncurses_git_branches(viewer);
+
+  // Restore file selection if still valid
+  if (preserved_selected_file < viewer->file_count) {
+    viewer->selected_file = preserved_selected_file;
+
+    // Reload current file if in file mode and restore position
+    if ((viewer->current_mode == NCURSES_MODE_FILE_LIST ||
+         viewer->current_mode == NCURSES_MODE_FILE_VIEW) &&
+        viewer->file_count > 0) {
+      load_file_with_staging_info(
+          viewer, viewer->files[viewer->selected_file].filename);
+
+      // Restore scroll position if still valid
+      if (preserved_file_cursor < viewer->file_store.count) {
+        viewer->file_cursor_line = preserved_file_cursor;
+      }
+      if (preserved_file_scroll < viewer->file_store.count) {
+        viewer->file_scroll_offset = preserved_file_scroll;
+      }
+    }
+  }
+
+  // If we're in branch mode and have commits loaded, refresh them
+  if (viewer->current_mode == NCURSES_MODE_BRANCH_LIST ||
+      viewer->current_mode == NCURSES_MODE_BRANCH_VIEW) {
+    if (viewer->branch_count > 0 &&
+        strlen(viewer->current_branch_for_commits) > 0) {
+      load_branch_commits(viewer, viewer->current_branch_for_commits);
+      if (viewer->current_mode == NCURSES_MODE_BRANCH_VIEW) {
+        // Preserve cursor position in branch view too
+        int prev_cursor = viewer->file_cursor_line;
+        int prev_scroll = viewer->file_scroll_offset;
+        parse_branch_commits_to_lines(viewer);
+        if (prev_cursor < viewer->file_store.count) {
+          viewer->file_cursor_line = prev_cursor;
+        }
+        if (prev_scroll < viewer->file_store.count) {
+          viewer->file_scroll_offset = prev_scroll;
+        }
+      }
+    }
+  }
+}
+
 void check_background_fetch(NCursesDiffViewer *viewer) {
   if (!viewer || !viewer->fetch_in_progress) {
     return;
@@ -6258,58 +7424,13 @@ void check_background_fetch(NCursesDiffViewer *viewer) {
     // Fetch completed
     viewer->fetch_in_progress = 0;
     viewer->fetch_pid = -1;
+    close_fetch_pidfd(viewer);
+    viewer->dirty_windows = DIRTY_ALL;
 
-    // Preserve current positions during refresh
-    int preserved_file_scroll = viewer->file_scroll_offset;
-    int preserved_file_cursor = viewer->file_cursor_line;
-    int preserved_selected_file = viewer->selected_file;
-
-    // Update only the necessary data without blocking UI
-    get_ncurses_changed_files(viewer);
-    get_commit_history(viewer);
-    get_ncurses_git_branches(viewer);
-
-    // Restore file selection if still valid
-    if (preserved_selected_file < viewer->file_count) {
-      viewer->selected_file = preserved_selected_file;
-
-      // Reload current file if in file mode and restore position
-      if ((viewer->current_mode == NCURSES_MODE_FILE_LIST ||
-           viewer->current_mode == NCURSES_MODE_FILE_VIEW) &&
-          viewer->file_count > 0) {
-        load_file_with_staging_info(
-            viewer, viewer->files[viewer->selected_file].filename);
-
-        // Restore scroll position if still valid
-        if (preserved_file_cursor < viewer->file_line_count) {
-          viewer->file_cursor_line = preserved_file_cursor;
-        }
-        if (preserved_file_scroll < viewer->file_line_count) {
-          viewer->file_scroll_offset = preserved_file_scroll;
-        }
-      }
-    }
-
-    // If we're in branch mode and have commits loaded, refresh them
-    if (viewer->current_mode == NCURSES_MODE_BRANCH_LIST ||
-        viewer->current_mode == NCURSES_MODE_BRANCH_VIEW) {
-      if (viewer->branch_count > 0 &&
-          strlen(viewer->current_branch_for_commits) > 0) {
-        load_branch_commits(viewer, viewer->current_branch_for_commits);
-        if (viewer->current_mode == NCURSES_MODE_BRANCH_VIEW) {
-          // Preserve cursor position in branch view too
-          int prev_cursor = viewer->file_cursor_line;
-          int prev_scroll = viewer->file_scroll_offset;
-          parse_branch_commits_to_lines(viewer);
-          if (prev_cursor < viewer->file_line_count) {
-            viewer->file_cursor_line = prev_cursor;
-          }
-          if (prev_scroll < viewer->file_line_count) {
-            viewer->file_scroll_offset = prev_scroll;
-          }
-        }
-      }
-    }
+    // With the watcher running, moved remote-tracking refs come in as ref
+    // changes and a fetch leaves the work tree alone: nothing to rescan
+    if (!git_watch_active(&viewer->watch))
+      refresh_after_fetch(viewer);
 
     // Show completion status briefly
     viewer->sync_status = SYNC_STATUS_SYNCED_APPEARING;
@@ -6319,7 +7440,9 @@ void check_background_fetch(NCursesDiffViewer *viewer) {
     // Error occurred
     viewer->fetch_in_progress = 0;
     viewer->fetch_pid = -1;
+    close_fetch_pidfd(viewer);
     viewer->sync_status = SYNC_STATUS_IDLE;
+    viewer->dirty_windows |= DIRTY_STATUS_BAR;
   }
 }
 
@@ -6385,6 +7508,7 @@ void update_preview_for_current_selection(NCursesDiffViewer *viewer) {
 
   if (needs_update) {
     last_mode = viewer->current_mode;
+    viewer->dirty_windows |= DIRTY_FILE_CONTENT;
   }
 }
 
@@ -6392,7 +7516,7 @@ int load_file_preview(NCursesDiffViewer *viewer, const char *filename) {
   if (!viewer || !filename)
     return 0;
 
-  viewer->file_line_count = 0;
+  line_store_clear(&viewer->file_store);
   viewer->file_scroll_offset = 0;
   viewer->file_cursor_line = 0;
 
@@ -6401,39 +7525,35 @@ int load_file_preview(NCursesDiffViewer *viewer, const char *filename) {
     return 0;
   }
 
-  char line[1024];
+  char *line = NULL;
+  size_t line_size = 0;
+  int line_len;
   int line_count = 0;
 
   // Load first 50 lines of the file for preview
-  while (fgets(line, sizeof(line), fp) && line_count < 50 &&
-         line_count < MAX_FULL_FILE_LINES) {
-    // Remove trailing newline
-    int len = strlen(line);
-    if (len > 0 && line[len - 1] == '\n') {
-      line[len - 1] = '\0';
-    }
-
+  while (line_count < 50 &&
+         (line_len = line_store_read_line(fp, &line, &line_size)) >= 0) {
     // Store the line as a context line (no diff markings)
-    strncpy(viewer->file_lines[line_count].line, line,
-            sizeof(viewer->file_lines[line_count].line) - 1);
-    viewer->file_lines[line_count]
-        .line[sizeof(viewer->file_lines[line_count].line) - 1] = '\0';
-    viewer->file_lines[line_count].type = ' '; // Context line
-    viewer->file_lines[line_count].is_diff_line = 0;
-    viewer->file_lines[line_count].is_staged = 0;
-    viewer->file_lines[line_count].hunk_id = 0;
-    viewer->file_lines[line_count].line_number_old = line_count + 1;
-    viewer->file_lines[line_count].line_number_new = line_count + 1;
-    viewer->file_lines[line_count].is_context = 1;
+    NCursesFileLine *file_line =
+        line_store_append(&viewer->file_store, line, line_len);
+    if (!file_line)
+      break;
+    file_line->type = ' '; // Context line
+    file_line->is_diff_line = 0;
+    file_line->is_staged = 0;
+    file_line->hunk_id = 0;
+    file_line->line_number_old = line_count + 1;
+    file_line->line_number_new = line_count + 1;
+    file_line->is_context = 1;
 
     line_count++;
   }
 
+  free(line);
   fclose(fp);
-  viewer->file_line_count = line_count;
 
   // Reset staged content since this is just a preview
-  viewer->staged_line_count = 0;
+  line_store_clear(&viewer->staged_store);
   viewer->staged_cursor_line = 0;
   viewer->staged_scroll_offset = 0;
 
@@ -6473,12 +7593,16 @@ int wrap_line_to_width(const char *input_line, char wrapped_lines[][1024],
 
 int render_wrapped_line(WINDOW *win, const char *line, int start_y, int start_x,
                         int width, int max_rows, int color_pair, int reverse) {
-  char wrapped_lines[10]
-                    [1024]; // Support up to 10 wrapped lines per original line
-  int wrap_count = wrap_line_to_width(line, wrapped_lines, 10, width - start_x);
+  // Print segments straight from the source text so lines of any length wrap
+  // without intermediate copies
+  int segment_width = width - start_x;
+  if (segment_width < 1)
+    segment_width = 1;
+  int line_len = strlen(line);
 
   int rows_used = 0;
-  for (int i = 0; i < wrap_count && rows_used < max_rows; i++) {
+  for (int pos = 0; (pos < line_len || pos == 0) && rows_used < max_rows;
+       pos += segment_width) {
     if (reverse) {
       wattron(win, A_REVERSE);
     }
@@ -6486,7 +7610,7 @@ int render_wrapped_line(WINDOW *win, const char *line, int start_y, int start_x,
       wattron(win, COLOR_PAIR(color_pair));
     }
 
-    mvwprintw(win, start_y + rows_used, start_x, "%s", wrapped_lines[i]);
+    mvwaddnstr(win, start_y + rows_used, start_x, line + pos, segment_width);
 
     if (color_pair > 0) {
       wattroff(win, COLOR_PAIR(color_pair));
@@ -6510,14 +7634,14 @@ int calculate_wrapped_line_height(const char *line, int width) {
 }
 
 void move_cursor_smart(NCursesDiffViewer *viewer, int direction) {
-  if (!viewer || viewer->file_line_count == 0) {
+  if (!viewer || viewer->file_store.count == 0) {
     return;
   }
 
   int original_cursor = viewer->file_cursor_line;
   int new_cursor = viewer->file_cursor_line;
   int attempts = 0;
-  const int max_attempts = viewer->file_line_count; // Prevent infinite loops
+  const int max_attempts = viewer->file_store.count; // Prevent infinite loops
 
   do {
     new_cursor += direction;
@@ -6528,14 +7652,14 @@ void move_cursor_smart(NCursesDiffViewer *viewer, int direction) {
       new_cursor = 0;
       break;
     }
-    if (new_cursor >= viewer->file_line_count) {
-      new_cursor = viewer->file_line_count - 1;
+    if (new_cursor >= viewer->file_store.count) {
+      new_cursor = viewer->file_store.count - 1;
       break;
     }
 
     // Check if current line is empty or just whitespace
-    NCursesFileLine *line = &viewer->file_lines[new_cursor];
-    char *trimmed = line->line;
+    NCursesFileLine *line = &viewer->file_store.lines[new_cursor];
+    const char *trimmed = line_store_text(&viewer->file_store, line);
 
     // Skip leading whitespace
     while (*trimmed == ' ' || *trimmed == '\t') {
@@ -6578,7 +7702,7 @@ void move_cursor_smart(NCursesDiffViewer *viewer, int direction) {
       int scroll_adjustment = cursor_display_pos - (max_lines_visible - 4);
       viewer->file_scroll_offset += scroll_adjustment;
 
-      int max_scroll = viewer->file_line_count - max_lines_visible;
+      int max_scroll = viewer->file_store.count - max_lines_visible;
       if (max_scroll < 0)
         max_scroll = 0;
       if (viewer->file_scroll_offset > max_scroll) {
@@ -6589,14 +7713,14 @@ void move_cursor_smart(NCursesDiffViewer *viewer, int direction) {
 }
 
 void move_cursor_smart_unstaged(NCursesDiffViewer *viewer, int direction) {
-  if (!viewer || viewer->file_line_count == 0) {
+  if (!viewer || viewer->file_store.count == 0) {
     return;
   }
 
   int original_cursor = viewer->file_cursor_line;
   int new_cursor = viewer->file_cursor_line;
   int attempts = 0;
-  const int max_attempts = viewer->file_line_count;
+  const int max_attempts = viewer->file_store.count;
 
   do {
     new_cursor += direction;
@@ -6606,13 +7730,13 @@ void move_cursor_smart_unstaged(NCursesDiffViewer *viewer, int direction) {
       new_cursor = 0;
       break;
     }
-    if (new_cursor >= viewer->file_line_count) {
-      new_cursor = viewer->file_line_count - 1;
+    if (new_cursor >= viewer->file_store.count) {
+      new_cursor = viewer->file_store.count - 1;
       break;
     }
 
-    NCursesFileLine *line = &viewer->file_lines[new_cursor];
-    char *trimmed = line->line;
+    NCursesFileLine *line = &viewer->file_store.lines[new_cursor];
+    const char *trimmed = line_store_text(&viewer->file_store, line);
 
     while (*trimmed == ' ' || *trimmed == '\t') {
       trimmed++;
@@ -6637,9 +7761,9 @@ void move_cursor_smart_unstaged(NCursesDiffViewer *viewer, int direction) {
 
   // Count display rows from scroll offset to cursor
   for (int i = viewer->file_scroll_offset;
-       i <= viewer->file_cursor_line && i < viewer->file_line_count; i++) {
+       i <= viewer->file_cursor_line && i < viewer->file_store.count; i++) {
     int line_height =
-        calculate_wrapped_line_height(viewer->file_lines[i].line, width - 4);
+        calculate_wrapped_line_height(file_line_text(viewer, i), width - 4);
     if (i < viewer->file_cursor_line) {
       cursor_display_rows += line_height;
     }
@@ -6655,12 +7779,12 @@ void move_cursor_smart_unstaged(NCursesDiffViewer *viewer, int direction) {
       int target_rows = 2;
       int new_scroll_offset = viewer->file_cursor_line;
       int accumulated_rows = calculate_wrapped_line_height(
-          viewer->file_lines[viewer->file_cursor_line].line, width - 4);
+          file_line_text(viewer, viewer->file_cursor_line), width - 4);
 
       while (new_scroll_offset > 0 && accumulated_rows < target_rows) {
         new_scroll_offset--;
         accumulated_rows += calculate_wrapped_line_height(
-            viewer->file_lines[new_scroll_offset].line, width - 4);
+            file_line_text(viewer, new_scroll_offset), width - 4);
       }
 
       viewer->file_scroll_offset = new_scroll_offset;
@@ -6675,20 +7799,20 @@ void move_cursor_smart_unstaged(NCursesDiffViewer *viewer, int direction) {
       int target_remaining_rows = unstaged_height - 3;
       int new_scroll_offset = viewer->file_cursor_line;
       int accumulated_rows = calculate_wrapped_line_height(
-          viewer->file_lines[viewer->file_cursor_line].line, width - 4);
+          file_line_text(viewer, viewer->file_cursor_line), width - 4);
 
       while (new_scroll_offset > viewer->file_scroll_offset &&
              accumulated_rows > target_remaining_rows) {
         new_scroll_offset--;
         accumulated_rows -= calculate_wrapped_line_height(
-            viewer->file_lines[new_scroll_offset].line, width - 4);
+            file_line_text(viewer, new_scroll_offset), width - 4);
       }
 
       if (new_scroll_offset > viewer->file_scroll_offset) {
         viewer->file_scroll_offset = new_scroll_offset;
       }
 
-      int max_scroll = viewer->file_line_count - 1;
+      int max_scroll = viewer->file_store.count - 1;
       if (viewer->file_scroll_offset > max_scroll) {
         viewer->file_scroll_offset = max_scroll;
       }
@@ -6697,7 +7821,7 @@ void move_cursor_smart_unstaged(NCursesDiffViewer *viewer, int direction) {
 }
 
 void move_cursor_smart_staged(NCursesDiffViewer *viewer, int direction) {
-  if (!viewer || viewer->staged_line_count == 0) {
+  if (!viewer || viewer->staged_store.count == 0) {
     return;
   }
 
@@ -6715,10 +7839,10 @@ void move_cursor_smart_staged(NCursesDiffViewer *viewer, int direction) {
 
       // Count display rows from scroll offset to cursor
       for (int i = viewer->staged_scroll_offset;
-           i < viewer->staged_cursor_line && i < viewer->staged_line_count;
+           i < viewer->staged_cursor_line && i < viewer->staged_store.count;
            i++) {
         cursor_display_rows += calculate_wrapped_line_height(
-            viewer->staged_lines[i].line, width - 4);
+            staged_line_text(viewer, i), width - 4);
       }
 
       if (cursor_display_rows < 1) {
@@ -6726,12 +7850,12 @@ void move_cursor_smart_staged(NCursesDiffViewer *viewer, int direction) {
         int target_rows = 1;
         int new_scroll_offset = viewer->staged_cursor_line;
         int accumulated_rows = calculate_wrapped_line_height(
-            viewer->staged_lines[viewer->staged_cursor_line].line, width - 4);
+            staged_line_text(viewer, viewer->staged_cursor_line), width - 4);
 
         while (new_scroll_offset > 0 && accumulated_rows < target_rows) {
           new_scroll_offset--;
           accumulated_rows += calculate_wrapped_line_height(
-              viewer->staged_lines[new_scroll_offset].line, width - 4);
+              staged_line_text(viewer, new_scroll_offset), width - 4);
         }
 
         viewer->staged_scroll_offset = new_scroll_offset;
@@ -6741,7 +7865,7 @@ void move_cursor_smart_staged(NCursesDiffViewer *viewer, int direction) {
       }
     }
   } else {
-    if (viewer->staged_cursor_line < viewer->staged_line_count - 1) {
+    if (viewer->staged_cursor_line < viewer->staged_store.count - 1) {
       viewer->staged_cursor_line++;
 
       // Calculate display positions accounting for wrapped lines
@@ -6749,10 +7873,10 @@ void move_cursor_smart_staged(NCursesDiffViewer *viewer, int direction) {
 
       // Count display rows from scroll offset to cursor
       for (int i = viewer->staged_scroll_offset;
-           i < viewer->staged_cursor_line && i < viewer->staged_line_count;
+           i < viewer->staged_cursor_line && i < viewer->staged_store.count;
            i++) {
         cursor_display_rows += calculate_wrapped_line_height(
-            viewer->staged_lines[i].line, width - 4);
+            staged_line_text(viewer, i), width - 4);
       }
 
       if (cursor_display_rows >= staged_height - 1) {
@@ -6760,20 +7884,20 @@ void move_cursor_smart_staged(NCursesDiffViewer *viewer, int direction) {
         int target_remaining_rows = staged_height - 2;
         int new_scroll_offset = viewer->staged_cursor_line;
         int accumulated_rows = calculate_wrapped_line_height(
-            viewer->staged_lines[viewer->staged_cursor_line].line, width - 4);
+            staged_line_text(viewer, viewer->staged_cursor_line), width - 4);
 
         while (new_scroll_offset > viewer->staged_scroll_offset &&
                accumulated_rows > target_remaining_rows) {
           new_scroll_offset--;
           accumulated_rows -= calculate_wrapped_line_height(
-              viewer->staged_lines[new_scroll_offset].line, width - 4);
+              staged_line_text(viewer, new_scroll_offset), width - 4);
         }
 
         if (new_scroll_offset > viewer->staged_scroll_offset) {
           viewer->staged_scroll_offset = new_scroll_offset;
         }
 
-        int max_scroll = viewer->staged_line_count - 1;
+        int max_scroll = viewer->staged_store.count - 1;
         if (viewer->staged_scroll_offset > max_scroll) {
           viewer->staged_scroll_offset = max_scroll;
         }
@@ -6789,6 +7913,22 @@ void cleanup_ncurses_diff_viewer(NCursesDiffViewer *viewer) {
       kill(viewer->fetch_pid, SIGTERM);
       waitpid(viewer->fetch_pid, NULL, 0);
     }
+    close_fetch_pidfd(viewer);
+
+    // Quitting stops a running commit/push/pull and drops queued ones
+    git_op_queue_destroy(&viewer->git_ops);
+    git_watch_stop(&viewer->watch);
+
+    // The prefetch thread uses the lookup helper, so it goes first
+    preview_cache_destroy(&viewer->preview_cache);
+
+    // Shut down the object lookup helper
+    git_batch_stop();
+
+    if (viewer->animation_timerfd >= 0) {
+      close(viewer->animation_timerfd);
+      viewer->animation_timerfd = -1;
+    }
 
     if (viewer->file_list_win) {
       delwin(viewer->file_list_win);
@@ -6814,6 +7954,35 @@ void cleanup_ncurses_diff_viewer(NCursesDiffViewer *viewer) {
 
     // Clean up grep search windows
     cleanup_grep_search(viewer);
+
+    // Release growable storage
+    line_store_free(&viewer->file_store);
+    line_store_free(&viewer->staged_store);
+    free(viewer->files);
+    line_store_free(&viewer->branch_commit_store);
+    free(viewer->hunks);
+    free(viewer->branches);
+    free(viewer->stashes);
+    free(viewer->grep_scored_items);
+    free(viewer->commits);
+    syntax_cache_free(&viewer->syntax_cache);
+    free(viewer->fuzzy_scored_files);
+    commit_walk_free(&viewer->commit_walk);
+    commit_reach_free(&viewer->pushed_commits);
+    commit_graph_close(&viewer->commit_graph);
+    free_ref_state(&viewer->ref_state);
+    viewer->files = NULL;
+    viewer->commits = NULL;
+    viewer->commit_count = viewer->commit_capacity = 0;
+    viewer->hunks = NULL;
+    viewer->branches = NULL;
+    viewer->branch_count = viewer->branch_capacity = 0;
+    viewer->stashes = NULL;
+    viewer->stash_count = viewer->stash_capacity = 0;
+    viewer->grep_scored_items = NULL;
+    viewer->grep_scored_capacity = 0;
+    viewer->fuzzy_scored_files = NULL;
+    viewer->file_count = viewer->file_capacity = 0;
   }
   endwin();
 }
@@ -6955,9 +8124,7 @@ void update_fuzzy_filter(NCursesDiffViewer *viewer) {
   viewer->fuzzy_scroll_offset = 0;
 
   // Calculate scores for all files and collect matches
-  for (int i = 0;
-       i < viewer->file_count && viewer->fuzzy_filtered_count < MAX_FILES;
-       i++) {
+  for (int i = 0; i < viewer->file_count; i++) {
     int score = calculate_fuzzy_score(viewer->fuzzy_search_query,
                                       viewer->files[i].filename);
     if (score > 0) {
@@ -7391,17 +8558,30 @@ int calculate_grep_score(const char *pattern, const char *text) {
 }
 
 int compare_grep_scored_items(const void *a, const void *b) {
-  const struct {
-    int item_index;
-    int score;
-  } *item_a = a;
-  const struct {
-    int item_index;
-    int score;
-  } *item_b = b;
+  const NCursesGrepItem *item_a = a;
+  const NCursesGrepItem *item_b = b;
   return item_b->score - item_a->score; // Descending order
 }
 
+// Room for every item of the list being searched to match
+static int ensure_grep_capacity(NCursesDiffViewer *viewer, int needed) {
+  if (needed <= viewer->grep_scored_capacity)
+    return 1;
+
+  int new_capacity =
+      viewer->grep_scored_capacity ? viewer->grep_scored_capacity : 64;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  NCursesGrepItem *grown = realloc(viewer->grep_scored_items,
+                                   new_capacity * sizeof(NCursesGrepItem));
+  if (!grown)
+    return 0;
+  viewer->grep_scored_items = grown;
+  viewer->grep_scored_capacity = new_capacity;
+  return 1;
+}
+
 void update_grep_filter(NCursesDiffViewer *viewer) {
   if (!viewer)
     return;
@@ -7410,13 +8590,21 @@ void update_grep_filter(NCursesDiffViewer *viewer) {
   viewer->grep_selected_index = 0;
   viewer->grep_scroll_offset = 0;
 
+  int searched = viewer->grep_search_mode == NCURSES_MODE_COMMIT_LIST
+                     ? viewer->commit_count
+                 : viewer->grep_search_mode == NCURSES_MODE_STASH_LIST
+                     ? viewer->stash_count
+                 : viewer->grep_search_mode == NCURSES_MODE_BRANCH_LIST
+                     ? viewer->branch_count
+                     : 0;
+  if (!ensure_grep_capacity(viewer, searched))
+    return;
+
   // Search different data based on current mode
   switch (viewer->grep_search_mode) {
   case NCURSES_MODE_COMMIT_LIST:
     // Search commit titles and author initials
-    for (int i = 0;
-         i < viewer->commit_count && viewer->grep_filtered_count < MAX_COMMITS;
-         i++) {
+    for (int i = 0; i < viewer->commit_count; i++) {
       // Try matching against title first
       int title_score = calculate_grep_score(viewer->grep_search_query,
                                              viewer->commits[i].title);
@@ -7438,9 +8626,7 @@ void update_grep_filter(NCursesDiffViewer *viewer) {
 
   case NCURSES_MODE_STASH_LIST:
     // Search stash info and branch names
-    for (int i = 0;
-         i < viewer->stash_count && viewer->grep_filtered_count < MAX_COMMITS;
-         i++) {
+    for (int i = 0; i < viewer->stash_count; i++) {
       // Try matching against full stash info first
       int stash_score = calculate_grep_score(viewer->grep_search_query,
                                              viewer->stashes[i].stash_info);
@@ -7469,9 +8655,7 @@ void update_grep_filter(NCursesDiffViewer *viewer) {
 
   case NCURSES_MODE_BRANCH_LIST:
     // Search branch names
-    for (int i = 0;
-         i < viewer->branch_count && viewer->grep_filtered_count < MAX_COMMITS;
-         i++) {
+    for (int i = 0; i < viewer->branch_count; i++) {
       int score = calculate_grep_score(viewer->grep_search_query,
                                        viewer->branches[i].name);
       if (score > 0) {
@@ -0,0 +1,266 @@
+#include "ncurses_line_store.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void line_store_init(NCursesLineStore *store) {
+  if (!store)
+    return;
+  memset(store, 0, sizeof(NCursesLineStore));
+}
+
+// Drop all lines but keep the allocations for the next load
+void line_store_clear(NCursesLineStore *store) {
+  if (!store)
+    return;
+  store->count = 0;
+  store->text_len = 0;
+  store->text_garbage = 0;
+}
+
+// Drop every line from count on, e.g. to undo a load that failed halfway
+void line_store_truncate(NCursesLineStore *store, int count) {
+  if (!store || count < 0 || count >= store->count)
+    return;
+  for (int i = count; i < store->count; i++)
+    store->text_garbage += store->lines[i].text_len + 1;
+  store->count = count;
+}
+
+void line_store_free(NCursesLineStore *store) {
+  if (!store)
+    return;
+  free(store->lines);
+  free(store->text);
+  line_store_init(store);
+}
+
+static int reserve_lines(NCursesLineStore *store, int needed) {
+  if (needed <= store->capacity)
+    return 1;
+
+  int new_capacity = store->capacity ? store->capacity : 256;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  NCursesFileLine *new_lines =
+      realloc(store->lines, new_capacity * sizeof(NCursesFileLine));
+  if (!new_lines)
+    return 0;
+
+  store->lines = new_lines;
+  store->capacity = new_capacity;
+  return 1;
+}
+
+static int reserve_text(NCursesLineStore *store, size_t needed) {
+  if (needed <= store->text_cap)
+    return 1;
+
+  size_t new_cap = store->text_cap ? store->text_cap : 16384;
+  while (new_cap < needed)
+    new_cap *= 2;
+
+  char *new_text = realloc(store->text, new_cap);
+  if (!new_text)
+    return 0;
+
+  store->text = new_text;
+  store->text_cap = new_cap;
+  return 1;
+}
+
+// Append a line; metadata is zeroed and the returned pointer stays valid
+// until the next append
+NCursesFileLine *line_store_append(NCursesLineStore *store, const char *text,
+                                   size_t len) {
+  if (!store || !text)
+    return NULL;
+
+  // Text may come from this store's own arena, which can move on growth
+  int self_copy = store->text && text >= store->text &&
+                  text < store->text + store->text_cap;
+  size_t self_offset = self_copy ? (size_t)(text - store->text) : 0;
+
+  if (!reserve_lines(store, store->count + 1) ||
+      !reserve_text(store, store->text_len + len + 1))
+    return NULL;
+  if (self_copy)
+    text = store->text + self_offset;
+
+  NCursesFileLine *line = &store->lines[store->count++];
+  memset(line, 0, sizeof(NCursesFileLine));
+  line->text_offset = store->text_len;
+  line->text_len = (int)len;
+
+  memcpy(store->text + store->text_len, text, len);
+  store->text[store->text_len + len] = '\0';
+  store->text_len += len + 1;
+
+  return line;
+}
+
+NCursesFileLine *line_store_appendf(NCursesLineStore *store, const char *fmt,
+                                    ...) {
+  if (!store || !fmt)
+    return NULL;
+
+  char small[256];
+  va_list args;
+  va_start(args, fmt);
+  int needed = vsnprintf(small, sizeof(small), fmt, args);
+  va_end(args);
+
+  if (needed < 0)
+    return NULL;
+  if ((size_t)needed < sizeof(small))
+    return line_store_append(store, small, needed);
+
+  char *large = malloc(needed + 1);
+  if (!large)
+    return NULL;
+  va_start(args, fmt);
+  vsnprintf(large, needed + 1, fmt, args);
+  va_end(args);
+
+  NCursesFileLine *line = line_store_append(store, large, needed);
+  free(large);
+  return line;
+}
+
+// Copy a line (text and metadata) from another store
+NCursesFileLine *line_store_append_copy(NCursesLineStore *store,
+                                        const NCursesLineStore *src,
+                                        const NCursesFileLine *line) {
+  if (!store || !src || !line)
+    return NULL;
+
+  NCursesFileLine saved = *line;
+  NCursesFileLine *copy = line_store_append(
+      store, src->text + saved.text_offset, saved.text_len);
+  if (!copy)
+    return NULL;
+
+  size_t offset = copy->text_offset;
+  *copy = saved;
+  copy->text_offset = offset;
+  return copy;
+}
+
+// Point an existing line at new text. The old body stays in the arena until
+// the next clear, which is fine for the occasional header rewrite
+int line_store_set_text(NCursesLineStore *store, int index, const char *text,
+                        size_t len) {
+  if (!store || !text || index < 0 || index >= store->count)
+    return 0;
+
+  NCursesFileLine *scratch = line_store_append(store, text, len);
+  if (!scratch)
+    return 0;
+
+  store->text_garbage += store->lines[index].text_len + 1;
+  store->lines[index].text_offset = scratch->text_offset;
+  store->lines[index].text_len = scratch->text_len;
+  store->count--;
+  return 1;
+}
+
+// Replace the contents of dst with a copy of src
+int line_store_copy(NCursesLineStore *dst, const NCursesLineStore *src) {
+  if (!dst || !src)
+    return 0;
+
+  line_store_clear(dst);
+  if (!reserve_lines(dst, src->count) || !reserve_text(dst, src->text_len))
+    return 0;
+
+  if (src->count > 0)
+    memcpy(dst->lines, src->lines, src->count * sizeof(NCursesFileLine));
+  if (src->text_len > 0)
+    memcpy(dst->text, src->text, src->text_len);
+  dst->count = src->count;
+  dst->text_len = src->text_len;
+  dst->text_garbage = src->text_garbage;
+  return 1;
+}
+
+// Rewrite the arena with only the text lines still point at
+static int compact_text(NCursesLineStore *store) {
+  size_t live = store->text_len - store->text_garbage;
+  char *text = malloc(live > 0 ? live : 1);
+  if (!text)
+    return 0;
+
+  size_t used = 0;
+  for (int i = 0; i < store->count; i++) {
+    NCursesFileLine *line = &store->lines[i];
+    memcpy(text + used, store->text + line->text_offset, line->text_len + 1);
+    line->text_offset = used;
+    used += line->text_len + 1;
+  }
+
+  free(store->text);
+  store->text = text;
+  store->text_cap = live > 0 ? live : 1;
+  store->text_len = used;
+  store->text_garbage = 0;
+  return 1;
+}
+
+// Replace remove_count lines at index with copies of every line in src,
+// e.g. to redraw one hunk of a view without rebuilding the rest
+int line_store_splice(NCursesLineStore *store, int index, int remove_count,
+                      const NCursesLineStore *src) {
+  if (!store || !src || index < 0 || remove_count < 0 ||
+      index + remove_count > store->count)
+    return 0;
+
+  size_t added_text = 0;
+  for (int i = 0; i < src->count; i++)
+    added_text += src->lines[i].text_len + 1;
+  if (!reserve_lines(store, store->count - remove_count + src->count) ||
+      !reserve_text(store, store->text_len + added_text))
+    return 0;
+
+  for (int i = index; i < index + remove_count; i++)
+    store->text_garbage += store->lines[i].text_len + 1;
+
+  memmove(&store->lines[index + src->count],
+          &store->lines[index + remove_count],
+          (store->count - index - remove_count) * sizeof(NCursesFileLine));
+
+  for (int i = 0; i < src->count; i++) {
+    NCursesFileLine *line = &store->lines[index + i];
+    *line = src->lines[i];
+    line->text_offset = store->text_len;
+    memcpy(store->text + store->text_len, src->text + src->lines[i].text_offset,
+           line->text_len + 1);
+    store->text_len += line->text_len + 1;
+  }
+  store->count += src->count - remove_count;
+
+  // Splicing leaves the replaced text behind; reclaim it once it dominates
+  if (store->text_garbage > 65536 && store->text_garbage > store->text_len / 2)
+    compact_text(store);
+  return 1;
+}
+
+const char *line_store_text(const NCursesLineStore *store,
+                            const NCursesFileLine *line) {
+  if (!store || !line || !store->text)
+    return "";
+  return store->text + line->text_offset;
+}
+
+// Read one line of any length into a growable buffer and strip the newline.
+// Returns the line length, or -1 at end of input
+int line_store_read_line(FILE *fp, char **buffer, size_t *buffer_size) {
+  ssize_t len = getline(buffer, buffer_size, fp);
+  if (len < 0)
+    return -1;
+
+  if (len > 0 && (*buffer)[len - 1] == '\n')
+    (*buffer)[--len] = '\0';
+  return (int)len;
+}
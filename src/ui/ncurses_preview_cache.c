@@ -0,0 +1,391 @@
+#include "ncurses_preview_cache.h"
+#include "git_batch.h"
+#include "git_integration.h"
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+// Commits shown in a branch preview
+#define PREVIEW_BRANCH_LOG_LENGTH 50
+
+static char classify_content_line(const char *line, size_t line_len) {
+  if (line_len == 0) {
+    return ' '; // Empty line
+  } else if (strncmp(line, "diff --git", 10) == 0 ||
+             strncmp(line, "index ", 6) == 0 || strncmp(line, "--- ", 4) == 0 ||
+             strncmp(line, "+++ ", 4) == 0) {
+    return '@'; // Use @ for headers
+  } else if (line_len > 1 && line[0] == '@' && line[1] == '@') {
+    return '@'; // Hunk headers
+  } else if (line[0] == '+') {
+    return '+'; // Added lines
+  } else if (line[0] == '-') {
+    return '-'; // Removed lines
+  } else if (strstr(line, " | ") &&
+             (strstr(line, "+") || strstr(line, "-") || strstr(line, "Bin"))) {
+    return 's'; // File statistics lines (special type)
+  } else if (strstr(line, " files changed") || strstr(line, " insertions") ||
+             strstr(line, " deletions")) {
+    return 's'; // Summary statistics lines
+  } else if (strncmp(line, "commit ", 7) == 0) {
+    return 'h'; // Commit header
+  } else if (strncmp(line, "Author: ", 8) == 0 ||
+             strncmp(line, "Date: ", 6) == 0) {
+    return 'i'; // Commit info lines
+  }
+  return ' '; // Normal/context lines
+}
+
+// Split commit or stash output into typed lines, preserving empty lines
+int preview_parse_content(NCursesLineStore *store, const char *content) {
+  if (!store || !content) {
+    return 0;
+  }
+
+  line_store_clear(store);
+
+  const char *line_start = content;
+  while (*line_start) {
+    const char *line_end = strchr(line_start, '\n');
+    if (!line_end) {
+      line_end = line_start + strlen(line_start);
+    }
+
+    size_t line_len = line_end - line_start;
+    NCursesFileLine *file_line = line_store_append(store, line_start, line_len);
+    if (!file_line)
+      break;
+
+    file_line->type =
+        classify_content_line(line_store_text(store, file_line), line_len);
+    file_line->is_diff_line = (file_line->type != ' ') ? 1 : 0;
+
+    if (*line_end != '\n')
+      break;
+    line_start = line_end + 1;
+  }
+  return store->count;
+}
+
+// Split a branch log into typed lines; "---END-COMMIT---" markers become the
+// blank line between commits
+int preview_parse_branch_log(NCursesLineStore *store, const char *log) {
+  if (!store || !log) {
+    return 0;
+  }
+
+  line_store_clear(store);
+
+  const char *line_start = log;
+  while (*line_start) {
+    const char *line_end = strchr(line_start, '\n');
+    if (!line_end) {
+      line_end = line_start + strlen(line_start);
+    }
+    size_t line_len = line_end - line_start;
+
+    NCursesFileLine *file_line;
+    if (line_len == 16 && strncmp(line_start, "---END-COMMIT---", 16) == 0) {
+      file_line = line_store_append(store, "", 0);
+      if (!file_line)
+        break;
+      file_line->type = ' ';
+    } else {
+      file_line = line_store_append(store, line_start, line_len);
+      if (!file_line)
+        break;
+
+      if (strncmp(line_start, "commit ", 7) == 0) {
+        file_line->type = 'h'; // Commit header
+      } else if (strncmp(line_start, "Author:", 7) == 0 ||
+                 strncmp(line_start, "Date:", 5) == 0) {
+        file_line->type = 'i'; // Info line
+      } else {
+        file_line->type = ' '; // Regular line
+      }
+    }
+    file_line->is_diff_line = 0;
+
+    if (*line_end != '\n')
+      break;
+    line_start = line_end + 1;
+  }
+  return store->count;
+}
+
+// Find the object id a preview is cached under. Commit hashes are their own
+// key; branches and stashes resolve to the commit they point at, so a moved
+// branch or a renumbered stash never hits a stale entry. Returns 0 if the id
+// can't be resolved, in which case the preview is loaded uncached
+int preview_resolve_key(PreviewKind kind, const char *object, char *key,
+                        size_t key_size) {
+  if (!object || !*object || !key || key_size == 0)
+    return 0;
+
+  if (kind == PREVIEW_COMMIT) {
+    snprintf(key, key_size, "%s", object);
+    return 1;
+  }
+
+  char name[PREVIEW_OBJECT_LEN + 16];
+  snprintf(name, sizeof(name), "%s^{commit}", object);
+  GitObjectInfo info;
+  if (git_batch_object_info(name, &info) != 1)
+    return 0;
+
+  snprintf(key, key_size, "%s", info.oid);
+  return 1;
+}
+
+// Run git for a preview and parse it into store. The key, when known, pins
+// the load to the resolved commit
+int preview_load(PreviewKind kind, const char *object, const char *key,
+                 NCursesLineStore *store, int *item_count) {
+  if (!object || !store)
+    return 0;
+
+  const char *target = key ? key : object;
+  char *content = NULL;
+  int count = 0;
+
+  switch (kind) {
+  case PREVIEW_COMMIT:
+    content = get_commit_details(target);
+    break;
+  case PREVIEW_STASH:
+    content = get_stash_diff_by_ref(target);
+    break;
+  case PREVIEW_BRANCH:
+    content = get_branch_commits(target, PREVIEW_BRANCH_LOG_LENGTH, &count);
+    break;
+  }
+
+  line_store_clear(store);
+  if (item_count)
+    *item_count = count;
+  if (!content)
+    return 0;
+
+  if (kind == PREVIEW_BRANCH)
+    preview_parse_branch_log(store, content);
+  else
+    preview_parse_content(store, content);
+
+  free(content);
+  return 1;
+}
+
+static PreviewEntry *find_entry(PreviewCache *cache, PreviewKind kind,
+                                const char *key) {
+  for (PreviewEntry *entry = cache->head; entry; entry = entry->next) {
+    if (entry->kind == kind && strcmp(entry->key, key) == 0)
+      return entry;
+  }
+  return NULL;
+}
+
+static void unlink_entry(PreviewCache *cache, PreviewEntry *entry) {
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache->head = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache->tail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+static void push_front(PreviewCache *cache, PreviewEntry *entry) {
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head)
+    cache->head->prev = entry;
+  cache->head = entry;
+  if (!cache->tail)
+    cache->tail = entry;
+}
+
+static void free_entry(PreviewCache *cache, PreviewEntry *entry) {
+  unlink_entry(cache, entry);
+  cache->entry_count--;
+  cache->total_bytes -= entry->bytes;
+  line_store_free(&entry->store);
+  free(entry);
+}
+
+// Copy a cached preview into store. Returns 1 on a hit
+int preview_cache_lookup(PreviewCache *cache, PreviewKind kind,
+                         const char *key, NCursesLineStore *store,
+                         int *item_count) {
+  if (!cache || !key || !store)
+    return 0;
+
+  pthread_mutex_lock(&cache->lock);
+  PreviewEntry *entry = find_entry(cache, kind, key);
+  int hit = entry && line_store_copy(store, &entry->store);
+  if (hit) {
+    unlink_entry(cache, entry);
+    push_front(cache, entry);
+    if (item_count)
+      *item_count = entry->item_count;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return hit;
+}
+
+// Store a copy of a parsed preview, evicting least recently used entries
+// once the entry or byte budget is exceeded
+void preview_cache_insert(PreviewCache *cache, PreviewKind kind,
+                          const char *key, const NCursesLineStore *store,
+                          int item_count) {
+  if (!cache || !key || !store)
+    return;
+
+  PreviewEntry *entry = calloc(1, sizeof(PreviewEntry));
+  if (!entry)
+    return;
+  entry->kind = kind;
+  snprintf(entry->key, sizeof(entry->key), "%s", key);
+  entry->item_count = item_count;
+  if (!line_store_copy(&entry->store, store)) {
+    line_store_free(&entry->store);
+    free(entry);
+    return;
+  }
+  entry->bytes = entry->store.text_cap +
+                 entry->store.capacity * sizeof(NCursesFileLine);
+
+  pthread_mutex_lock(&cache->lock);
+  PreviewEntry *existing = find_entry(cache, kind, key);
+  if (existing)
+    free_entry(cache, existing);
+
+  push_front(cache, entry);
+  cache->entry_count++;
+  cache->total_bytes += entry->bytes;
+
+  while (cache->tail != entry &&
+         (cache->entry_count > PREVIEW_CACHE_MAX_ENTRIES ||
+          cache->total_bytes > PREVIEW_CACHE_MAX_BYTES)) {
+    free_entry(cache, cache->tail);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+// Drop every cached preview, e.g. after refs moved and decorations changed
+void preview_cache_clear(PreviewCache *cache) {
+  if (!cache)
+    return;
+
+  pthread_mutex_lock(&cache->lock);
+  while (cache->head)
+    free_entry(cache, cache->head);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+// Drop the cached previews keep rejects, leaving the rest warm
+void preview_cache_retain(PreviewCache *cache, PreviewKeep keep,
+                          void *context) {
+  if (!cache || !keep)
+    return;
+
+  pthread_mutex_lock(&cache->lock);
+  PreviewEntry *entry = cache->head;
+  while (entry) {
+    PreviewEntry *next = entry->next;
+    if (!keep(entry->kind, entry->key, context))
+      free_entry(cache, entry);
+    entry = next;
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+// Replace the pending prefetch work; the nearest neighbours come first
+void preview_cache_prefetch(PreviewCache *cache, const PreviewJob *jobs,
+                            int job_count) {
+  if (!cache || !cache->thread_running)
+    return;
+  if (job_count > PREVIEW_MAX_JOBS)
+    job_count = PREVIEW_MAX_JOBS;
+
+  pthread_mutex_lock(&cache->lock);
+  memcpy(cache->jobs, jobs, job_count * sizeof(PreviewJob));
+  cache->job_count = job_count;
+  pthread_cond_signal(&cache->wake);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+static void *preview_worker(void *arg) {
+  PreviewCache *cache = arg;
+
+  pthread_mutex_lock(&cache->lock);
+  while (!cache->stopping) {
+    if (cache->job_count == 0) {
+      pthread_cond_wait(&cache->wake, &cache->lock);
+      continue;
+    }
+
+    PreviewJob job = cache->jobs[0];
+    memmove(&cache->jobs[0], &cache->jobs[1],
+            (cache->job_count - 1) * sizeof(PreviewJob));
+    cache->job_count--;
+    pthread_mutex_unlock(&cache->lock);
+
+    char key[PREVIEW_KEY_LEN];
+    if (preview_resolve_key(job.kind, job.object, key, sizeof(key))) {
+      pthread_mutex_lock(&cache->lock);
+      int cached = find_entry(cache, job.kind, key) != NULL;
+      pthread_mutex_unlock(&cache->lock);
+
+      if (!cached) {
+        NCursesLineStore store;
+        int item_count = 0;
+        line_store_init(&store);
+        if (preview_load(job.kind, job.object, key, &store, &item_count))
+          preview_cache_insert(cache, job.kind, key, &store, item_count);
+        line_store_free(&store);
+      }
+    }
+
+    pthread_mutex_lock(&cache->lock);
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return NULL;
+}
+
+void preview_cache_init(PreviewCache *cache) {
+  if (!cache)
+    return;
+
+  memset(cache, 0, sizeof(PreviewCache));
+  pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->wake, NULL);
+
+  // Signals (resize, child exit) stay with the UI thread
+  sigset_t all_signals, old_mask;
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask);
+  cache->thread_running =
+      (pthread_create(&cache->thread, NULL, preview_worker, cache) == 0);
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+void preview_cache_destroy(PreviewCache *cache) {
+  if (!cache)
+    return;
+
+  if (cache->thread_running) {
+    pthread_mutex_lock(&cache->lock);
+    cache->stopping = 1;
+    cache->job_count = 0;
+    pthread_cond_signal(&cache->wake);
+    pthread_mutex_unlock(&cache->lock);
+    pthread_join(cache->thread, NULL);
+    cache->thread_running = 0;
+  }
+
+  preview_cache_clear(cache);
+  pthread_cond_destroy(&cache->wake);
+  pthread_mutex_destroy(&cache->lock);
+}
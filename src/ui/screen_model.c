@@ -0,0 +1,558 @@
+#include "screen_model.h"
+#include "text_width.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+void screen_frame_init(ScreenFrame *frame) {
+  frame->data = NULL;
+  frame->len = 0;
+  frame->capacity = 0;
+}
+
+void screen_frame_free(ScreenFrame *frame) {
+  free(frame->data);
+  screen_frame_init(frame);
+}
+
+static int reserve_frame(ScreenFrame *frame, size_t needed) {
+  if (frame->len + needed <= frame->capacity)
+    return 1;
+
+  size_t new_capacity = frame->capacity ? frame->capacity * 2 : 1024;
+  while (new_capacity < frame->len + needed)
+    new_capacity *= 2;
+
+  char *grown = realloc(frame->data, new_capacity);
+  if (!grown)
+    return 0;
+
+  frame->data = grown;
+  frame->capacity = new_capacity;
+  return 1;
+}
+
+int screen_frame_append(ScreenFrame *frame, const char *data, size_t len) {
+  if (!reserve_frame(frame, len))
+    return 0;
+  memcpy(frame->data + frame->len, data, len);
+  frame->len += len;
+  return 1;
+}
+
+int screen_frame_appendf(ScreenFrame *frame, const char *fmt, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+  va_end(args);
+
+  if (len < 0)
+    return 0;
+  if ((size_t)len < sizeof(buffer))
+    return screen_frame_append(frame, buffer, len);
+
+  if (!reserve_frame(frame, len + 1))
+    return 0;
+  va_start(args, fmt);
+  vsnprintf(frame->data + frame->len, len + 1, fmt, args);
+  va_end(args);
+  frame->len += len;
+  return 1;
+}
+
+// Send the queued bytes and empty the frame. Anything still sitting in
+// stdio's buffer goes first so output stays in order
+int screen_frame_write(ScreenFrame *frame, int fd) {
+  fflush(stdout);
+
+  size_t written = 0;
+  while (written < frame->len) {
+    ssize_t n = write(fd, frame->data + written, frame->len - written);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      frame->len = 0;
+      return 0;
+    }
+    written += n;
+  }
+
+  frame->len = 0;
+  return 1;
+}
+
+void screen_line_init(ScreenLine *line) {
+  memset(line, 0, sizeof(ScreenLine));
+}
+
+void screen_line_free(ScreenLine *line) {
+  free(line->cells);
+  free(line->text);
+  free(line->attrs);
+  screen_line_init(line);
+}
+
+void screen_line_clear(ScreenLine *line) {
+  line->count = 0;
+  line->text_len = 0;
+  line->attr_count = 0;
+  line->current_attr = 0;
+  line->cursor = 0;
+}
+
+// Index of an SGR state in the line's table, added if it is new
+static int intern_attr(ScreenLine *line, const char *state) {
+  if (line->attr_count == 0) {
+    if (line->attr_capacity == 0) {
+      line->attrs = malloc(8 * sizeof(*line->attrs));
+      if (!line->attrs)
+        return 0;
+      line->attr_capacity = 8;
+    }
+    line->attrs[0][0] = '\0';
+    line->attr_count = 1;
+  }
+
+  for (int i = 0; i < line->attr_count; i++) {
+    if (strcmp(line->attrs[i], state) == 0)
+      return i;
+  }
+
+  // Cells store the index in a byte; past that, reuse the last state
+  if (line->attr_count > 255)
+    return line->attr_count - 1;
+
+  if (line->attr_count == line->attr_capacity) {
+    int new_capacity = line->attr_capacity * 2;
+    char(*grown)[SCREEN_ATTR_MAX] =
+        realloc(line->attrs, new_capacity * sizeof(*line->attrs));
+    if (!grown)
+      return line->attr_count - 1;
+    line->attrs = grown;
+    line->attr_capacity = new_capacity;
+  }
+
+  snprintf(line->attrs[line->attr_count], SCREEN_ATTR_MAX, "%s", state);
+  return line->attr_count++;
+}
+
+// Fold one SGR sequence into the current state: a reset empties it, any
+// other sequence is appended to it
+static void apply_sgr(ScreenLine *line, const char *seq, size_t len) {
+  char state[SCREEN_ATTR_MAX];
+  int is_reset = (len == 3 && strncmp(seq, "\033[m", 3) == 0) ||
+                 (len == 4 && strncmp(seq, "\033[0m", 4) == 0);
+
+  if (is_reset) {
+    state[0] = '\0';
+  } else {
+    const char *current =
+        line->attr_count > 0 ? line->attrs[line->current_attr] : "";
+    size_t current_len = strlen(current);
+    if (current_len + len >= SCREEN_ATTR_MAX)
+      current_len = 0; // Too long to stack: the new sequence stands alone
+    if (len >= SCREEN_ATTR_MAX)
+      return;
+    memcpy(state, current, current_len);
+    memcpy(state + current_len, seq, len);
+    state[current_len + len] = '\0';
+  }
+
+  line->current_attr = intern_attr(line, state);
+}
+
+static int add_cell(ScreenLine *line, const char *bytes, size_t len,
+                    int width) {
+  if (line->count == line->capacity) {
+    int new_capacity = line->capacity ? line->capacity * 2 : 128;
+    ScreenCell *grown =
+        realloc(line->cells, new_capacity * sizeof(ScreenCell));
+    if (!grown)
+      return 0;
+    line->cells = grown;
+    line->capacity = new_capacity;
+  }
+
+  if (line->text_len + len > line->text_capacity) {
+    size_t new_capacity = line->text_capacity ? line->text_capacity * 2 : 512;
+    while (new_capacity < line->text_len + len)
+      new_capacity *= 2;
+    char *grown = realloc(line->text, new_capacity);
+    if (!grown)
+      return 0;
+    line->text = grown;
+    line->text_capacity = new_capacity;
+  }
+
+  if (line->attr_count == 0)
+    intern_attr(line, "");
+
+  ScreenCell *cell = &line->cells[line->count++];
+  memcpy(line->text + line->text_len, bytes, len);
+  cell->offset = line->text_len;
+  cell->len = len;
+  cell->width = width;
+  cell->attr = line->current_attr;
+  line->text_len += len;
+  return 1;
+}
+
+// Append text to the line. Each grapheme cluster becomes one cell; escape
+// sequences never occupy a cell
+int screen_line_add(ScreenLine *line, const char *text) {
+  const char *p = text;
+  while (*p) {
+    if (*p == '\033') {
+      const char *start = p++;
+      if (*p == '[') {
+        p++;
+        while (*p && (*p < 0x40 || *p > 0x7e))
+          p++;
+        if (*p == 'm')
+          apply_sgr(line, start, p + 1 - start);
+        if (*p)
+          p++;
+      } else if (*p) {
+        p++;
+      }
+      continue;
+    }
+
+    // Clusters never reach across an escape sequence
+    const char *escape = strchr(p, '\033');
+    size_t run = escape ? (size_t)(escape - p) : strlen(p);
+    size_t pos = 0;
+    while (pos < run) {
+      size_t end = grapheme_next(p, run, pos);
+      if (end - pos > 0xffff ||
+          !add_cell(line, p + pos, end - pos,
+                    grapheme_width(p + pos, end - pos)))
+        return 0;
+      pos = end;
+    }
+    p += run;
+  }
+  return 1;
+}
+
+// Columns taken by the first cells cells of the line
+int screen_line_columns(const ScreenLine *line, int cells) {
+  int columns = 0;
+  for (int i = 0; i < cells && i < line->count; i++)
+    columns += line->cells[i].width;
+  return columns;
+}
+
+// Drop the cells that don't fit in width columns
+void screen_line_clip(ScreenLine *line, int width) {
+  int columns = 0;
+  for (int i = 0; i < line->count; i++) {
+    columns += line->cells[i].width;
+    if (columns > width) {
+      line->count = i;
+      line->text_len = line->cells[i].offset;
+      return;
+    }
+  }
+}
+
+// Pad with blank cells in the current state up to width columns
+int screen_line_fill(ScreenLine *line, int width) {
+  for (int columns = screen_line_columns(line, line->count); columns < width;
+       columns++) {
+    if (!add_cell(line, " ", 1, 1))
+      return 0;
+  }
+  return 1;
+}
+
+static int cells_equal(const ScreenLine *a, const ScreenCell *x,
+                       const ScreenLine *b, const ScreenCell *y) {
+  return x->len == y->len &&
+         memcmp(a->text + x->offset, b->text + y->offset, x->len) == 0 &&
+         strcmp(a->attrs[x->attr], b->attrs[y->attr]) == 0;
+}
+
+// First cell where the lines differ, or -1 when they are identical
+int screen_line_difference(const ScreenLine *a, const ScreenLine *b) {
+  int common = a->count < b->count ? a->count : b->count;
+  for (int i = 0; i < common; i++) {
+    if (!cells_equal(a, &a->cells[i], b, &b->cells[i]))
+      return i;
+  }
+  return a->count == b->count ? -1 : common;
+}
+
+// Queue the cells from index from up to to, switching SGR state only where
+// it changes and leaving the terminal reset afterwards
+static void emit_cells(ScreenFrame *frame, const ScreenLine *line, int from,
+                       int to) {
+  const char *state = "";
+  for (int i = from; i < to; i++) {
+    const ScreenCell *cell = &line->cells[i];
+    const char *attr = line->attrs[cell->attr];
+    if (strcmp(attr, state) != 0) {
+      if (*state)
+        screen_frame_append(frame, "\033[0m", 4);
+      screen_frame_append(frame, attr, strlen(attr));
+      state = attr;
+    }
+    screen_frame_append(frame, line->text + cell->offset, cell->len);
+  }
+  if (*state)
+    screen_frame_append(frame, "\033[0m", 4);
+}
+
+// Queue the cells from index from onward
+void screen_line_emit(ScreenFrame *frame, const ScreenLine *line, int from) {
+  emit_cells(frame, line, from, line->count);
+}
+
+void screen_line_swap(ScreenLine *a, ScreenLine *b) {
+  ScreenLine tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+void screen_model_init(ScreenModel *screen) {
+  memset(screen, 0, sizeof(ScreenModel));
+  screen_frame_init(&screen->frame);
+  screen_line_init(&screen->shown);
+  screen_line_init(&screen->next);
+}
+
+static void free_rows(char **rows, int count) {
+  for (int i = 0; i < count; i++)
+    free(rows[i]);
+}
+
+void screen_model_free(ScreenModel *screen) {
+  screen_frame_free(&screen->frame);
+  screen_line_free(&screen->shown);
+  screen_line_free(&screen->next);
+  free_rows(screen->menu_shown, screen->menu_shown_count);
+  free_rows(screen->menu_next, screen->menu_next_count);
+  free(screen->menu_shown);
+  free(screen->menu_next);
+  memset(screen, 0, sizeof(ScreenModel));
+}
+
+// Forget what is on screen, e.g. when a new prompt starts on a fresh row
+void screen_model_reset(ScreenModel *screen) {
+  screen->shown_valid = 0;
+  screen->line_pending = 0;
+  screen->menu_pending = 0;
+  screen_line_clear(&screen->shown);
+  free_rows(screen->menu_shown, screen->menu_shown_count);
+  screen->menu_shown_count = 0;
+  free_rows(screen->menu_next, screen->menu_next_count);
+  screen->menu_next_count = 0;
+}
+
+void screen_model_line_begin(ScreenModel *screen) {
+  screen_line_clear(&screen->next);
+  screen->line_pending = 1;
+}
+
+void screen_model_line_add(ScreenModel *screen, const char *text) {
+  screen_line_add(&screen->next, text);
+}
+
+// The cursor rests after everything added so far
+void screen_model_line_cursor(ScreenModel *screen) {
+  screen->next.cursor = screen->next.count;
+}
+
+void screen_model_menu_begin(ScreenModel *screen) {
+  free_rows(screen->menu_next, screen->menu_next_count);
+  screen->menu_next_count = 0;
+  screen->menu_pending = 1;
+}
+
+// Both row lists share one capacity so they can be swapped
+static int ensure_menu_capacity(ScreenModel *screen, int needed) {
+  if (needed <= screen->menu_capacity)
+    return 1;
+
+  int new_capacity = screen->menu_capacity ? screen->menu_capacity * 2 : 16;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  char **shown = realloc(screen->menu_shown, new_capacity * sizeof(char *));
+  if (!shown)
+    return 0;
+  screen->menu_shown = shown;
+  char **next = realloc(screen->menu_next, new_capacity * sizeof(char *));
+  if (!next)
+    return 0;
+  screen->menu_next = next;
+  screen->menu_capacity = new_capacity;
+  return 1;
+}
+
+void screen_model_menu_add(ScreenModel *screen, const char *row) {
+  if (!ensure_menu_capacity(screen, screen->menu_next_count + 1))
+    return;
+  char *copy = strdup(row);
+  if (copy)
+    screen->menu_next[screen->menu_next_count++] = copy;
+}
+
+static void move_columns(ScreenFrame *frame, int from, int to) {
+  if (to < from)
+    screen_frame_appendf(frame, "\033[%dD", from - to);
+  else if (to > from)
+    screen_frame_appendf(frame, "\033[%dC", to - from);
+}
+
+static int terminal_width(int fd) {
+  struct winsize ws;
+  if (ioctl(fd, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+    return 0;
+  return ws.ws_col;
+}
+
+// Cells at the end of both lines that match, stopping at the first
+// difference from the start
+static int common_suffix(const ScreenLine *a, const ScreenLine *b,
+                         int first) {
+  int suffix = 0;
+  while (suffix < a->count - first && suffix < b->count - first &&
+         cells_equal(a, &a->cells[a->count - 1 - suffix], b,
+                     &b->cells[b->count - 1 - suffix]))
+    suffix++;
+  return suffix;
+}
+
+// Queue the changes to the input row: move to the first cell that differs,
+// then open or close a gap with ICH/DCH when one span was typed or deleted
+// before text that stays, else rewrite from there and erase any leftover
+// tail
+static void render_line(ScreenModel *screen, int width) {
+  if (!screen->line_pending)
+    return;
+  screen->line_pending = 0;
+
+  ScreenLine *old = &screen->shown;
+  ScreenLine *new = &screen->next;
+  ScreenFrame *frame = &screen->frame;
+  int cursor;
+
+  // Relative moves can't cross a wrapped row, so long lines are redrawn
+  // from the start of the row the cursor is on
+  int old_columns = screen_line_columns(old, old->count);
+  int new_columns = screen_line_columns(new, new->count);
+  int wraps = width > 0 && (old_columns >= width || new_columns >= width);
+  if (!screen->shown_valid || wraps) {
+    screen_frame_append(frame, "\r", 1);
+    screen_line_emit(frame, new, 0);
+    screen_frame_append(frame, "\033[K", 3);
+    cursor = new_columns;
+  } else {
+    int first = screen_line_difference(old, new);
+    if (first < 0) {
+      cursor = screen_line_columns(old, old->cursor);
+    } else {
+      // Cells before first match, so they take the same columns in both
+      int start = screen_line_columns(new, first);
+      move_columns(frame, screen_line_columns(old, old->cursor), start);
+
+      // Neither line reaches the right margin here, so nothing the
+      // terminal shifts is lost off the edge
+      int suffix = common_suffix(old, new, first);
+      int removed = old->count - first - suffix;
+      int inserted = new->count - first - suffix;
+      if (suffix > 0 && removed == 0) {
+        int end = first + inserted;
+        screen_frame_appendf(frame, "\033[%d@",
+                             screen_line_columns(new, end) - start);
+        emit_cells(frame, new, first, end);
+        cursor = screen_line_columns(new, end);
+      } else if (suffix > 0 && inserted == 0) {
+        screen_frame_appendf(frame, "\033[%dP",
+                             screen_line_columns(old, first + removed) -
+                                 start);
+        cursor = start;
+      } else {
+        screen_line_emit(frame, new, first);
+        if (new_columns < old_columns)
+          screen_frame_append(frame, "\033[K", 3);
+        cursor = new_columns;
+      }
+    }
+  }
+
+  move_columns(frame, cursor, screen_line_columns(new, new->cursor));
+  screen_line_swap(old, new);
+  screen->shown_valid = 1;
+}
+
+// Queue the menu rows that changed. Rows are reached with newlines, which
+// scroll the terminal when the menu first needs the room, and the cursor is
+// then walked back up to the input row
+static void render_menu(ScreenModel *screen) {
+  if (!screen->menu_pending)
+    return;
+  screen->menu_pending = 0;
+
+  int shown = screen->menu_shown_count;
+  int next = screen->menu_next_count;
+  int rows = shown > next ? shown : next;
+  int last_changed = -1;
+  for (int r = 0; r < rows; r++) {
+    if (r >= shown || r >= next ||
+        strcmp(screen->menu_shown[r], screen->menu_next[r]) != 0)
+      last_changed = r;
+  }
+
+  ScreenFrame *frame = &screen->frame;
+  for (int r = 0; r <= last_changed; r++) {
+    screen_frame_append(frame, "\n", 1);
+    if (r < shown && r < next &&
+        strcmp(screen->menu_shown[r], screen->menu_next[r]) == 0)
+      continue;
+    screen_frame_append(frame, "\r\033[2K", 5);
+    if (r < next)
+      screen_frame_append(frame, screen->menu_next[r],
+                          strlen(screen->menu_next[r]));
+  }
+  if (last_changed >= 0) {
+    screen_frame_appendf(frame, "\033[%dA\r", last_changed + 1);
+    move_columns(frame, 0,
+                 screen_line_columns(&screen->shown, screen->shown.cursor));
+  }
+
+  free_rows(screen->menu_shown, shown);
+  char **tmp = screen->menu_shown;
+  screen->menu_shown = screen->menu_next;
+  screen->menu_shown_count = next;
+  screen->menu_next = tmp;
+  screen->menu_next_count = 0;
+}
+
+// Leave the input row for good: drop the menu and any hint after the
+// cursor, then move to a fresh row
+void screen_model_end_line(ScreenModel *screen) {
+  if (screen->menu_shown_count > 0 && !screen->menu_pending)
+    screen_model_menu_begin(screen);
+
+  render_line(screen, terminal_width(STDOUT_FILENO));
+  render_menu(screen);
+  screen_frame_append(&screen->frame, "\033[K\n", 4);
+  screen_model_reset(screen);
+}
+
+// Work out everything that changed since the last frame and send it in
+// one write()
+int screen_model_flush(ScreenModel *screen, int fd) {
+  render_line(screen, terminal_width(fd));
+  render_menu(screen);
+  if (screen->frame.len == 0)
+    return 1;
+  return screen_frame_write(&screen->frame, fd);
+}
@@ -0,0 +1,410 @@
+#include "syntax_highlight.h"
+#include <ctype.h>
+#include <string.h>
+
+// Keyword and type tables are kept in strcmp order for bsearch
+
+static const char *const c_matches[] = {".c",   ".h",   ".cc", ".cpp",
+                                        ".cxx", ".hpp", ".hh", NULL};
+static const char *const c_keywords[] = {
+    "break",     "case",     "catch",    "class",    "const",    "constexpr",
+    "continue",  "default",  "delete",   "do",       "else",     "enum",
+    "extern",    "for",      "goto",     "if",       "inline",   "namespace",
+    "new",       "nullptr",  "private",  "protected", "public",  "register",
+    "return",    "sizeof",   "static",   "struct",   "switch",   "template",
+    "this",      "throw",    "try",      "typedef",  "typename", "union",
+    "using",     "virtual",  "volatile", "while",    NULL};
+static const char *const c_types[] = {
+    "FILE",    "NULL",     "auto",     "bool",     "char",     "double",
+    "false",   "float",    "int",      "int16_t",  "int32_t",  "int64_t",
+    "int8_t",  "long",     "pid_t",    "short",    "signed",   "size_t",
+    "ssize_t", "time_t",   "true",     "uint16_t", "uint32_t", "uint64_t",
+    "uint8_t", "unsigned", "void",     NULL};
+
+static const char *const python_matches[] = {".py", NULL};
+static const char *const python_keywords[] = {
+    "and",    "as",     "assert", "async", "await",  "break",  "class",
+    "continue", "def",  "del",    "elif",  "else",   "except", "finally",
+    "for",    "from",   "global", "if",    "import", "in",     "is",
+    "lambda", "nonlocal", "not",  "or",    "pass",   "raise",  "return",
+    "try",    "while",  "with",   "yield", NULL};
+static const char *const python_types[] = {
+    "False", "None",  "True", "bool",  "bytes", "dict",
+    "float", "int",   "list", "self",  "set",   "str",
+    "tuple", NULL};
+
+static const char *const shell_matches[] = {".sh", ".bash", ".zsh", NULL};
+static const char *const shell_keywords[] = {
+    "case",  "do",     "done",   "elif",   "else",   "esac",  "export",
+    "fi",    "for",    "function", "if",   "in",     "local", "readonly",
+    "return", "select", "then",  "until",  "while",  NULL};
+static const char *const shell_types[] = {"false", "true", NULL};
+
+static const char *const js_matches[] = {".js",  ".jsx", ".mjs", ".cjs",
+                                         ".ts",  ".tsx", NULL};
+static const char *const js_keywords[] = {
+    "async",  "await",     "break",  "case",    "catch",   "class",
+    "const",  "continue",  "default", "delete", "do",      "else",
+    "export", "extends",   "finally", "for",    "from",    "function",
+    "if",     "implements", "import", "in",     "instanceof", "interface",
+    "let",    "new",       "of",     "return",  "static",  "super",
+    "switch", "this",      "throw",  "try",     "type",    "typeof",
+    "var",    "while",     "yield",  NULL};
+static const char *const js_types[] = {
+    "any",    "boolean", "false",  "never", "null", "number",
+    "string", "true",    "undefined", "void", NULL};
+
+static const char *const go_matches[] = {".go", NULL};
+static const char *const go_keywords[] = {
+    "break",  "case",   "chan",    "const",  "continue", "default",
+    "defer",  "else",   "fallthrough", "for", "func",    "go",
+    "goto",   "if",     "import",  "interface", "map",   "package",
+    "range",  "return", "select",  "struct", "switch",   "type",
+    "var",    NULL};
+static const char *const go_types[] = {
+    "bool",   "byte",    "error",  "false",  "float32", "float64",
+    "int",    "int16",   "int32",  "int64",  "int8",    "nil",
+    "rune",   "string",  "true",   "uint",   "uint16",  "uint32",
+    "uint64", "uint8",   NULL};
+
+static const char *const rust_matches[] = {".rs", NULL};
+static const char *const rust_keywords[] = {
+    "as",    "async", "await", "break",  "const",  "continue", "crate",
+    "dyn",   "else",  "enum",  "extern", "fn",     "for",      "if",
+    "impl",  "in",    "let",   "loop",   "match",  "mod",      "move",
+    "mut",   "pub",   "ref",   "return", "self",   "static",   "struct",
+    "super", "trait", "type",  "unsafe", "use",    "where",    "while",
+    NULL};
+static const char *const rust_types[] = {
+    "Option", "Result", "Self",  "String", "Vec",   "bool",  "char",
+    "f32",    "f64",    "false", "i16",    "i32",   "i64",   "i8",
+    "isize",  "str",    "true",  "u16",    "u32",   "u64",   "u8",
+    "usize",  NULL};
+
+static const char *const java_matches[] = {".java", ".kt", NULL};
+static const char *const java_keywords[] = {
+    "abstract", "break",    "case",    "catch",     "class",     "continue",
+    "default",  "do",       "else",    "extends",   "final",     "finally",
+    "for",      "if",       "implements", "import", "instanceof", "interface",
+    "new",      "package",  "private", "protected", "public",    "return",
+    "static",   "super",    "switch",  "synchronized", "this",   "throw",
+    "throws",   "try",      "while",   NULL};
+static const char *const java_types[] = {
+    "String", "boolean", "byte",  "char", "double", "false",
+    "float",  "int",     "long",  "null", "short",  "true",
+    "void",   NULL};
+
+static const char *const make_matches[] = {"Makefile", "makefile",
+                                           "GNUmakefile", ".mk", NULL};
+static const char *const make_keywords[] = {
+    "define", "else", "endef",  "endif",    "export", "ifdef",
+    "ifeq",   "ifndef", "ifneq", "include", "override", NULL};
+static const char *const no_types[] = {NULL};
+
+static const SyntaxLanguage languages[] = {
+    {"c", c_matches, c_keywords, c_types, "//", "/*", "*/", NULL, "\"'", 1},
+    {"python", python_matches, python_keywords, python_types, "#", NULL, NULL,
+     "\"\"\"", "\"'", 0},
+    {"shell", shell_matches, shell_keywords, shell_types, "#", NULL, NULL,
+     NULL, "\"'", 0},
+    {"javascript", js_matches, js_keywords, js_types, "//", "/*", "*/", "`",
+     "\"'", 0},
+    {"go", go_matches, go_keywords, go_types, "//", "/*", "*/", "`", "\"'", 0},
+    {"rust", rust_matches, rust_keywords, rust_types, "//", "/*", "*/", NULL,
+     "\"", 0},
+    {"java", java_matches, java_keywords, java_types, "//", "/*", "*/",
+     "\"\"\"", "\"'", 0},
+    {"make", make_matches, make_keywords, no_types, "#", NULL, NULL, NULL,
+     "\"'", 0},
+};
+
+// Language for a file by its extension or name, NULL if we don't know it
+const SyntaxLanguage *syntax_language_for_path(const char *path) {
+  if (!path || !*path)
+    return NULL;
+
+  const char *base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  size_t base_len = strlen(base);
+
+  for (size_t i = 0; i < sizeof(languages) / sizeof(languages[0]); i++) {
+    for (const char *const *match = languages[i].matches; *match; match++) {
+      size_t match_len = strlen(*match);
+      if ((*match)[0] == '.'
+              ? base_len > match_len &&
+                    strcmp(base + base_len - match_len, *match) == 0
+              : strcmp(base, *match) == 0)
+        return &languages[i];
+    }
+  }
+  return NULL;
+}
+
+static int compare_word(const void *key, const void *element) {
+  return strcmp((const char *)key, *(const char *const *)element);
+}
+
+static int in_table(const char *const *table, const char *word) {
+  size_t count = 0;
+  while (table[count])
+    count++;
+  return bsearch(word, table, count, sizeof(char *), compare_word) != NULL;
+}
+
+static int starts_with(const char *text, const char *prefix) {
+  return prefix && strncmp(text, prefix, strlen(prefix)) == 0;
+}
+
+static int is_word_char(char c) {
+  return isalnum((unsigned char)c) || c == '_';
+}
+
+typedef struct {
+  SyntaxSpan *spans;
+  int count;
+  int capacity;
+} SpanList;
+
+static void add_span(SpanList *list, int start, int len, SyntaxKind kind) {
+  if (len <= 0)
+    return;
+  if (list->count == list->capacity) {
+    int new_capacity = list->capacity ? list->capacity * 2 : 8;
+    SyntaxSpan *grown =
+        realloc(list->spans, new_capacity * sizeof(SyntaxSpan));
+    if (!grown)
+      return;
+    list->spans = grown;
+    list->capacity = new_capacity;
+  }
+  list->spans[list->count++] = (SyntaxSpan){start, len, kind};
+}
+
+// Scan to the end of a delimited region starting at pos. Returns the
+// offset just past the closing delimiter, or -1 if the line ends first
+static int find_close(const char *text, int pos, const char *close) {
+  const char *found = strstr(text + pos, close);
+  return found ? (int)(found - text) + (int)strlen(close) : -1;
+}
+
+// Split one line into spans. state is where the previous line left off;
+// returns where this one does
+static int tokenize(const SyntaxLanguage *lang, const char *text, int state,
+                    SpanList *list) {
+  int len = strlen(text);
+  int pos = 0;
+
+  // Continue a comment or string from the line before
+  if (state != SYNTAX_STATE_NORMAL) {
+    const char *close = state == SYNTAX_STATE_COMMENT ? lang->block_close
+                                                      : lang->multiline_string;
+    int end = close ? find_close(text, 0, close) : -1;
+    SyntaxKind kind =
+        state == SYNTAX_STATE_COMMENT ? SYNTAX_COMMENT : SYNTAX_STRING;
+    if (end == -1) {
+      add_span(list, 0, len, kind);
+      return close ? state : SYNTAX_STATE_NORMAL;
+    }
+    add_span(list, 0, end, kind);
+    pos = end;
+  }
+
+  // Preprocessor directives: "#include", "#  define"
+  if (lang->preprocessor && pos == 0) {
+    int first = 0;
+    while (text[first] == ' ' || text[first] == '\t')
+      first++;
+    if (text[first] == '#') {
+      int end = first + 1;
+      while (text[end] == ' ' || text[end] == '\t')
+        end++;
+      while (is_word_char(text[end]))
+        end++;
+      add_span(list, first, end - first, SYNTAX_PREPROC);
+      pos = end;
+    }
+  }
+
+  while (pos < len) {
+    char c = text[pos];
+
+    if (starts_with(text + pos, lang->line_comment)) {
+      add_span(list, pos, len - pos, SYNTAX_COMMENT);
+      break;
+    }
+
+    if (starts_with(text + pos, lang->block_open)) {
+      int end = find_close(text, pos + strlen(lang->block_open),
+                           lang->block_close);
+      if (end == -1) {
+        add_span(list, pos, len - pos, SYNTAX_COMMENT);
+        return SYNTAX_STATE_COMMENT;
+      }
+      add_span(list, pos, end - pos, SYNTAX_COMMENT);
+      pos = end;
+      continue;
+    }
+
+    if (starts_with(text + pos, lang->multiline_string)) {
+      int end = find_close(text, pos + strlen(lang->multiline_string),
+                           lang->multiline_string);
+      if (end == -1) {
+        add_span(list, pos, len - pos, SYNTAX_STRING);
+        return SYNTAX_STATE_STRING;
+      }
+      add_span(list, pos, end - pos, SYNTAX_STRING);
+      pos = end;
+      continue;
+    }
+
+    if (strchr(lang->quotes, c)) {
+      int end = pos + 1;
+      while (end < len && text[end] != c) {
+        if (text[end] == '\\' && end + 1 < len)
+          end++;
+        end++;
+      }
+      if (end < len)
+        end++;
+      add_span(list, pos, end - pos, SYNTAX_STRING);
+      pos = end;
+      continue;
+    }
+
+    if (isdigit((unsigned char)c) &&
+        (pos == 0 || !is_word_char(text[pos - 1]))) {
+      int end = pos + 1;
+      while (end < len && (is_word_char(text[end]) || text[end] == '.'))
+        end++;
+      add_span(list, pos, end - pos, SYNTAX_NUMBER);
+      pos = end;
+      continue;
+    }
+
+    if (isalpha((unsigned char)c) || c == '_') {
+      int end = pos + 1;
+      while (end < len && is_word_char(text[end]))
+        end++;
+
+      char word[32];
+      if (end - pos < (int)sizeof(word)) {
+        memcpy(word, text + pos, end - pos);
+        word[end - pos] = '\0';
+        if (in_table(lang->keywords, word))
+          add_span(list, pos, end - pos, SYNTAX_KEYWORD);
+        else if (in_table(lang->types, word))
+          add_span(list, pos, end - pos, SYNTAX_TYPE);
+      }
+      pos = end;
+      continue;
+    }
+
+    pos++;
+  }
+  return SYNTAX_STATE_NORMAL;
+}
+
+void syntax_cache_init(SyntaxCache *cache) {
+  if (cache)
+    memset(cache, 0, sizeof(SyntaxCache));
+}
+
+void syntax_cache_clear(SyntaxCache *cache) {
+  if (!cache)
+    return;
+  for (size_t i = 0; i < cache->capacity; i++) {
+    free(cache->entries[i].spans);
+    memset(&cache->entries[i], 0, sizeof(SyntaxCacheEntry));
+  }
+  cache->count = 0;
+}
+
+void syntax_cache_free(SyntaxCache *cache) {
+  if (!cache)
+    return;
+  syntax_cache_clear(cache);
+  free(cache->entries);
+  syntax_cache_init(cache);
+}
+
+// FNV-1a over the text, mixed with the language and incoming state
+static uint64_t line_key(const SyntaxLanguage *language, const char *text,
+                         int state) {
+  uint64_t hash = 1469598103934665603ULL;
+  for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+    hash ^= *p;
+    hash *= 1099511628211ULL;
+  }
+  hash ^= (uint64_t)(language - languages) << 56 ^ (uint64_t)state << 48;
+  hash *= 1099511628211ULL;
+  return hash ? hash : 1;
+}
+
+static int cache_grow(SyntaxCache *cache) {
+  size_t new_capacity = cache->capacity ? cache->capacity * 2 : 1024;
+  SyntaxCacheEntry *entries = calloc(new_capacity, sizeof(SyntaxCacheEntry));
+  if (!entries)
+    return 0;
+
+  for (size_t i = 0; i < cache->capacity; i++) {
+    if (!cache->entries[i].key)
+      continue;
+    size_t slot = cache->entries[i].key & (new_capacity - 1);
+    while (entries[slot].key)
+      slot = (slot + 1) & (new_capacity - 1);
+    entries[slot] = cache->entries[i];
+  }
+  free(cache->entries);
+  cache->entries = entries;
+  cache->capacity = new_capacity;
+  return 1;
+}
+
+// Spans for one line of code (without the diff marker). A line is
+// tokenized the first time and served from the cache after that; the
+// spans stay valid until the next call. Returns the state the line ends in
+int syntax_highlight(SyntaxCache *cache, const SyntaxLanguage *language,
+                     const char *text, int in_state, const SyntaxSpan **spans,
+                     int *span_count) {
+  *spans = NULL;
+  *span_count = 0;
+  if (!cache || !language || !text)
+    return SYNTAX_STATE_NORMAL;
+
+  uint64_t key = line_key(language, text, in_state);
+  size_t slot = 0;
+  if (cache->capacity) {
+    for (slot = key & (cache->capacity - 1); cache->entries[slot].key;
+         slot = (slot + 1) & (cache->capacity - 1)) {
+      if (cache->entries[slot].key == key) {
+        *spans = cache->entries[slot].spans;
+        *span_count = cache->entries[slot].span_count;
+        return cache->entries[slot].out_state;
+      }
+    }
+  }
+
+  SpanList list = {NULL, 0, 0};
+  int out_state = tokenize(language, text, in_state, &list);
+
+  // Start over rather than grow without bound on huge diffs
+  if (cache->count >= SYNTAX_CACHE_MAX_ENTRIES)
+    syntax_cache_clear(cache);
+  if ((cache->count + 1) * 4 > cache->capacity * 3 && !cache_grow(cache)) {
+    free(list.spans);
+    return out_state;
+  }
+
+  for (slot = key & (cache->capacity - 1); cache->entries[slot].key;
+       slot = (slot + 1) & (cache->capacity - 1))
+    ;
+  cache->entries[slot].key = key;
+  cache->entries[slot].out_state = out_state;
+  cache->entries[slot].span_count = list.count;
+  cache->entries[slot].spans = list.spans;
+  cache->count++;
+
+  *spans = list.spans;
+  *span_count = list.count;
+  return out_state;
+}
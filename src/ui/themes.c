@@ -191,6 +191,174 @@ static ShellTheme catppuccin_mocha_theme = {
 // Path to the theme configuration file
 char theme_config_path[PATH_MAX];
 
+ThemePalette theme_palette;
+
+// xterm's values for the 16 basic colors, 30-37 then 90-97
+static const unsigned char basic_colors[16][3] = {
+    {0, 0, 0},       {205, 0, 0},     {0, 205, 0},     {205, 205, 0},
+    {0, 0, 238},     {205, 0, 205},   {0, 205, 205},   {229, 229, 229},
+    {127, 127, 127}, {255, 0, 0},     {0, 255, 0},     {255, 255, 0},
+    {92, 92, 255},   {255, 0, 255},   {0, 255, 255},   {255, 255, 255}};
+
+static ThemeDepth detect_color_depth(void) {
+  const char *colorterm = getenv("COLORTERM");
+  if (colorterm && (strcmp(colorterm, "truecolor") == 0 ||
+                    strcmp(colorterm, "24bit") == 0))
+    return THEME_DEPTH_TRUE;
+
+  const char *term = getenv("TERM");
+  if (term && strstr(term, "256color"))
+    return THEME_DEPTH_256;
+  return THEME_DEPTH_16;
+}
+
+static int color_distance(int r1, int g1, int b1, int r2, int g2, int b2) {
+  return (r1 - r2) * (r1 - r2) + (g1 - g2) * (g1 - g2) +
+         (b1 - b2) * (b1 - b2);
+}
+
+// Nearest entry of the 256-color palette: the 6x6x6 cube or the gray ramp
+static int nearest_256(int r, int g, int b) {
+  static const int levels[6] = {0, 95, 135, 175, 215, 255};
+  int cube[3];
+  int rgb[3] = {r, g, b};
+  for (int i = 0; i < 3; i++) {
+    int v = rgb[i];
+    cube[i] = v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+  }
+  int cube_index = 16 + 36 * cube[0] + 6 * cube[1] + cube[2];
+  int cube_distance = color_distance(r, g, b, levels[cube[0]],
+                                     levels[cube[1]], levels[cube[2]]);
+
+  int average = (r + g + b) / 3;
+  int gray = average > 238 ? 23 : average < 8 ? 0 : (average - 8) / 10;
+  int gray_level = 8 + gray * 10;
+  int gray_distance =
+      color_distance(r, g, b, gray_level, gray_level, gray_level);
+
+  return gray_distance < cube_distance ? 232 + gray : cube_index;
+}
+
+// SGR code of the nearest basic color, as a foreground
+static int nearest_16(int r, int g, int b) {
+  int best = 0;
+  int best_distance = -1;
+  for (int i = 0; i < 16; i++) {
+    int distance = color_distance(r, g, b, basic_colors[i][0],
+                                  basic_colors[i][1], basic_colors[i][2]);
+    if (best_distance < 0 || distance < best_distance) {
+      best = i;
+      best_distance = distance;
+    }
+  }
+  return best < 8 ? 30 + best : 90 + best - 8;
+}
+
+// Write the SGR parameters for a theme color, given as the escape
+// sequence it is defined with: "\033[38;2;R;G;Bm" or a basic "\033[Nm".
+// True color is downgraded to what the terminal shows
+static int color_parameters(char *out, size_t size, const char *color,
+                            int background) {
+  int r, g, b, code;
+  if (sscanf(color, "\033[38;2;%d;%d;%dm", &r, &g, &b) == 3) {
+    if (theme_palette.depth == THEME_DEPTH_TRUE)
+      return snprintf(out, size, "%d;2;%d;%d;%d", background ? 48 : 38, r,
+                      g, b);
+    if (theme_palette.depth == THEME_DEPTH_256)
+      return snprintf(out, size, "%d;5;%d", background ? 48 : 38,
+                      nearest_256(r, g, b));
+    code = nearest_16(r, g, b);
+  } else if (sscanf(color, "\033[%dm", &code) != 1) {
+    return 0;
+  }
+  return snprintf(out, size, "%d", background ? code + 10 : code);
+}
+
+// Resolve one role into the palette: attributes such as "1" for bold,
+// then the foreground and background colors, any of which may be NULL
+static void compile_role(ThemeRole role, const char *attrs, const char *fg,
+                         const char *bg) {
+  char sequence[96];
+  size_t len = snprintf(sequence, sizeof(sequence), "\033[%s",
+                        attrs ? attrs : "");
+  const char *colors[2] = {fg, bg};
+  for (int i = 0; i < 2; i++) {
+    if (!colors[i])
+      continue;
+    char parameters[32];
+    if (color_parameters(parameters, sizeof(parameters), colors[i], i) <= 0)
+      continue;
+    len += snprintf(sequence + len, sizeof(sequence) - len, "%s%s",
+                    len > 2 ? ";" : "", parameters);
+  }
+  len += snprintf(sequence + len, sizeof(sequence) - len, "m");
+
+  if (theme_palette.used + len + 1 > sizeof(theme_palette.bytes))
+    return;
+  theme_palette.offset[role] = theme_palette.used;
+  theme_palette.len[role] = len;
+  memcpy(theme_palette.bytes + theme_palette.used, sequence, len + 1);
+  theme_palette.used += len + 1;
+}
+
+// The closest basic color to a console attribute mask, as an escape
+static void legacy_color(char *out, size_t size, WORD attributes) {
+  int fg = 37; // Default to white text
+
+  if (attributes & 0x01) fg = 34; // Blue
+  if (attributes & 0x02) fg = 32; // Green
+  if (attributes & 0x04) fg = 31; // Red
+
+  // Combinations
+  if ((attributes & 0x03) == 0x03) fg = 36; // Cyan (Green + Blue)
+  if ((attributes & 0x05) == 0x05) fg = 35; // Magenta (Red + Blue)
+  if ((attributes & 0x06) == 0x06) fg = 33; // Yellow (Red + Green)
+  if ((attributes & 0x07) == 0x07) fg = 37; // White (Red + Green + Blue)
+
+  // Bright variants
+  if (attributes & 0x08) fg += 60; // Add intensity
+
+  snprintf(out, size, "\033[%dm", fg);
+}
+
+// Build the palette for current_theme. Themes without true color keep
+// the shell's standard colors for the prompt and menus
+static void compile_palette(void) {
+  const ShellTheme *theme = &current_theme;
+  theme_palette.used = 0;
+
+  if (theme->use_ansi_colors) {
+    compile_role(THEME_TEXT, NULL, theme->ANSI_TEXT, NULL);
+    compile_role(THEME_PROMPT_PATH, "1", theme->ANSI_FOAM, NULL);
+    compile_role(THEME_PROMPT_GIT, "1", theme->ANSI_IRIS, NULL);
+    compile_role(THEME_PROMPT_MARK, "1", theme->ANSI_LOVE, NULL);
+    compile_role(THEME_SUGGESTION, NULL, theme->ANSI_MUTED, NULL);
+    compile_role(THEME_MENU_ITEM, "0", theme->ANSI_FOAM, NULL);
+    compile_role(THEME_MENU_SELECTED, "7", theme->ANSI_FOAM, NULL);
+    compile_role(THEME_MENU_HINT, NULL, theme->ANSI_SUBTLE, NULL);
+    compile_role(THEME_STATUS_BAR, NULL, theme->ANSI_BASE, theme->ANSI_FOAM);
+  } else {
+    char text[16];
+    legacy_color(text, sizeof(text), theme->PRIMARY_COLOR);
+    compile_role(THEME_TEXT, NULL, text, NULL);
+    compile_role(THEME_PROMPT_PATH, "1", "\033[36m", NULL);
+    compile_role(THEME_PROMPT_GIT, "1", "\033[35m", NULL);
+    compile_role(THEME_PROMPT_MARK, "1", "\033[31m", NULL);
+    compile_role(THEME_SUGGESTION, "2", "\033[37m", NULL);
+    compile_role(THEME_MENU_ITEM, "0", "\033[36m", NULL);
+    compile_role(THEME_MENU_SELECTED, "7", "\033[36m", NULL);
+    compile_role(THEME_MENU_HINT, "2", NULL, NULL);
+    compile_role(THEME_STATUS_BAR, NULL, "\033[30m", "\033[36m");
+  }
+  compile_role(THEME_RESET, "0", NULL, NULL);
+}
+
+const char *theme_color(ThemeRole role) {
+  return theme_palette.bytes + theme_palette.offset[role];
+}
+
+size_t theme_color_len(ThemeRole role) { return theme_palette.len[role]; }
+
 void init_theme_system(void) {
   // Determine theme config file location in user's home directory
   char *home_dir = getenv("HOME");
@@ -202,7 +370,8 @@ void init_theme_system(void) {
   }
 
   // Set default theme initially
-  memcpy(&current_theme, &default_theme, sizeof(ShellTheme));
+  theme_palette.depth = detect_color_depth();
+  load_theme("default");
 
   // Try to load theme from config file
   FILE *config_file = fopen(theme_config_path, "r");
@@ -226,12 +395,15 @@ void init_theme_system(void) {
 int load_theme(const char *theme_name) {
   if (strcmp(theme_name, "default") == 0) {
     memcpy(&current_theme, &default_theme, sizeof(ShellTheme));
+    compile_palette();
     return 1;
   } else if (strcmp(theme_name, "rose-pine") == 0) {
     memcpy(&current_theme, &rose_pine_theme, sizeof(ShellTheme));
+    compile_palette();
     return 1;
   } else if (strcmp(theme_name, "catppuccin-mocha") == 0) {
     memcpy(&current_theme, &catppuccin_mocha_theme, sizeof(ShellTheme));
+    compile_palette();
     return 1;
   }
 
@@ -243,33 +415,7 @@ int load_theme(const char *theme_name) {
 void apply_current_theme(void) {
   // When called, the shell can update any on-screen elements that depend on
   // theme colors. This function would be called when changing themes or at startup.
-
-  // In Linux, we'll always use ANSI colors, as the terminal emulator handles this natively
-  if (current_theme.use_ansi_colors) {
-    // Use ANSI true color
-    printf("%s", current_theme.ANSI_TEXT);
-  } else {
-    // Use standard ANSI color approximation of the theme's primary color
-    // Linux terminals always support basic ANSI colors, so we'll map the Windows color attributes
-    // to the closest ANSI colors
-    
-    int fg = 37; // Default to white text
-    
-    if (current_theme.PRIMARY_COLOR & 0x01) fg = 34; // Blue
-    if (current_theme.PRIMARY_COLOR & 0x02) fg = 32; // Green
-    if (current_theme.PRIMARY_COLOR & 0x04) fg = 31; // Red
-    
-    // Combinations
-    if ((current_theme.PRIMARY_COLOR & 0x03) == 0x03) fg = 36; // Cyan (Green + Blue)
-    if ((current_theme.PRIMARY_COLOR & 0x05) == 0x05) fg = 35; // Magenta (Red + Blue)
-    if ((current_theme.PRIMARY_COLOR & 0x06) == 0x06) fg = 33; // Yellow (Red + Green)
-    if ((current_theme.PRIMARY_COLOR & 0x07) == 0x07) fg = 37; // White (Red + Green + Blue)
-    
-    // Bright variants
-    if (current_theme.PRIMARY_COLOR & 0x08) fg += 60; // Add intensity
-    
-    printf("\033[%dm", fg); // Set the color
-  }
+  fwrite(theme_color(THEME_TEXT), 1, theme_color_len(THEME_TEXT), stdout);
 }
 
 const ShellTheme *get_current_theme(void) { return &current_theme; }
@@ -362,6 +508,10 @@ int lsh_theme(char **args) {
     return 1;
   } else if (strcmp(args[1], "show") == 0) {
     printf("Current theme: %s\n", current_theme.name);
+    printf("Terminal colors: %s\n",
+           theme_palette.depth == THEME_DEPTH_TRUE  ? "true color"
+           : theme_palette.depth == THEME_DEPTH_256 ? "256"
+                                                    : "16");
 
     // Display ANSI color status
     if (current_theme.use_ansi_colors) {
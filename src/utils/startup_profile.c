@@ -0,0 +1,78 @@
+#include "startup_profile.h"
+#include <pthread.h>
+#include <stdio.h>
+
+// --startup-profile: how long each subsystem takes to come up. Steps that
+// run before the first prompt are reported as they finish; files loaded
+// later, on first use or in the background, are reported between prompts
+static int profile_enabled = 0;
+static int profile_finished = 0;
+static struct timespec profile_start;
+
+// Loads that happen while a line is being edited are held back and printed
+// between prompts. History loads on its own thread, hence the lock
+#define DEFERRED_MAX 16
+static char deferred[DEFERRED_MAX][80];
+static int deferred_count = 0;
+static pthread_mutex_t deferred_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double elapsed_ms(const struct timespec *since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) * 1000.0 +
+         (now.tv_nsec - since->tv_nsec) / 1000000.0;
+}
+
+void startup_profile_enable(void) {
+  profile_enabled = 1;
+  clock_gettime(CLOCK_MONOTONIC, &profile_start);
+}
+
+int startup_profile_enabled(void) { return profile_enabled; }
+
+void startup_profile_mark(struct timespec *mark) {
+  if (profile_enabled)
+    clock_gettime(CLOCK_MONOTONIC, mark);
+}
+
+// A step on the way to the first prompt; later calls are ignored so the
+// per-prompt work can be reported once
+void startup_profile_report(const char *step, const struct timespec *mark) {
+  if (!profile_enabled || profile_finished)
+    return;
+  fprintf(stderr, "startup: %-24s %8.3f ms\n", step, elapsed_ms(mark));
+}
+
+// A file loaded after startup, the first time it was needed
+void startup_profile_deferred(const char *step, const struct timespec *mark) {
+  if (!profile_enabled)
+    return;
+  double ms = elapsed_ms(mark);
+
+  pthread_mutex_lock(&deferred_lock);
+  if (deferred_count < DEFERRED_MAX) {
+    snprintf(deferred[deferred_count++], sizeof(deferred[0]),
+             "startup: %-24s %8.3f ms (deferred)", step, ms);
+  }
+  pthread_mutex_unlock(&deferred_lock);
+}
+
+// Print the deferred loads reported since the last call
+void startup_profile_flush(void) {
+  if (!profile_enabled)
+    return;
+  pthread_mutex_lock(&deferred_lock);
+  for (int i = 0; i < deferred_count; i++)
+    fprintf(stderr, "%s\n", deferred[i]);
+  deferred_count = 0;
+  pthread_mutex_unlock(&deferred_lock);
+}
+
+// Called once the first prompt is on screen
+void startup_profile_finish(void) {
+  if (!profile_enabled || profile_finished)
+    return;
+  profile_finished = 1;
+  fprintf(stderr, "startup: %-24s %8.3f ms\n", "first prompt",
+          elapsed_ms(&profile_start));
+}
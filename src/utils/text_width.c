@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include "text_width.h"
+#include <string.h>
+#include <wchar.h>
+
+#define ZERO_WIDTH_JOINER 0x200D
+
+// wcwidth results for the Basic Multilingual Plane, stored as width + 2 so
+// the zero-initialised table means "not looked up yet"
+static signed char bmp_widths[0x10000];
+
+// Code points above the BMP (mostly emoji) share a small direct-mapped cache
+#define ASTRAL_CACHE_SIZE 256
+static struct {
+  uint32_t codepoint; // 0 marks an empty slot
+  signed char width;
+} astral_widths[ASTRAL_CACHE_SIZE];
+
+// Decode one UTF-8 sequence and return its length. Malformed or truncated
+// input decodes as a single byte so callers always make progress
+int utf8_decode(const char *text, size_t len, uint32_t *codepoint) {
+  const unsigned char *s = (const unsigned char *)text;
+  if (len == 0) {
+    *codepoint = 0;
+    return 0;
+  }
+
+  int need;
+  uint32_t cp;
+  if (s[0] < 0x80) {
+    *codepoint = s[0];
+    return 1;
+  } else if (s[0] >= 0xf0 && s[0] < 0xf8) {
+    need = 4;
+    cp = s[0] & 0x07;
+  } else if (s[0] >= 0xe0) {
+    need = 3;
+    cp = s[0] & 0x0f;
+  } else if (s[0] >= 0xc0) {
+    need = 2;
+    cp = s[0] & 0x1f;
+  } else {
+    *codepoint = s[0];
+    return 1;
+  }
+
+  if ((size_t)need > len) {
+    *codepoint = s[0];
+    return 1;
+  }
+  for (int i = 1; i < need; i++) {
+    if ((s[i] & 0xc0) != 0x80) {
+      *codepoint = s[0];
+      return 1;
+    }
+    cp = (cp << 6) | (s[i] & 0x3f);
+  }
+
+  *codepoint = cp;
+  return need;
+}
+
+// Columns a code point takes: 0 for combining marks, 2 for wide and most
+// emoji, 1 otherwise. Control characters count as 1 so nothing vanishes
+int codepoint_width(uint32_t codepoint) {
+  if (codepoint >= 0x20 && codepoint < 0x7f)
+    return 1;
+
+  if (codepoint < 0x10000) {
+    signed char cached = bmp_widths[codepoint];
+    if (cached == 0) {
+      int width = wcwidth((wchar_t)codepoint);
+      cached = (signed char)((width < 0 ? 1 : width) + 2);
+      bmp_widths[codepoint] = cached;
+    }
+    return cached - 2;
+  }
+
+  size_t slot = (codepoint * 2654435761u) & (ASTRAL_CACHE_SIZE - 1);
+  if (astral_widths[slot].codepoint != codepoint) {
+    int width = wcwidth((wchar_t)codepoint);
+    astral_widths[slot].codepoint = codepoint;
+    astral_widths[slot].width = (signed char)(width < 0 ? 1 : width);
+  }
+  return astral_widths[slot].width;
+}
+
+// Code points that attach to the one before them: combining marks,
+// variation selectors, emoji skin tones, tag characters and the joiner
+static int is_extender(uint32_t codepoint) {
+  if (codepoint < 0x300)
+    return 0;
+  if (codepoint == ZERO_WIDTH_JOINER ||
+      (codepoint >= 0xfe00 && codepoint <= 0xfe0f) ||
+      (codepoint >= 0x1f3fb && codepoint <= 0x1f3ff) ||
+      (codepoint >= 0xe0020 && codepoint <= 0xe007f))
+    return 1;
+  return codepoint_width(codepoint) == 0;
+}
+
+static int is_regional_indicator(uint32_t codepoint) {
+  return codepoint >= 0x1f1e6 && codepoint <= 0x1f1ff;
+}
+
+// Start of the code point that ends at pos
+static size_t codepoint_start(const char *text, size_t pos) {
+  size_t start = pos - 1;
+  while (start > 0 && pos - start < 4 &&
+         ((unsigned char)text[start] & 0xc0) == 0x80)
+    start--;
+  return start;
+}
+
+// End of the grapheme cluster starting at pos: a base code point with its
+// combining marks, a joiner sequence, or a pair of regional indicators
+size_t grapheme_next(const char *text, size_t len, size_t pos) {
+  if (pos >= len)
+    return len;
+
+  uint32_t base;
+  size_t end = pos + utf8_decode(text + pos, len - pos, &base);
+  uint32_t previous = base;
+
+  while (end < len) {
+    uint32_t next;
+    int next_len = utf8_decode(text + end, len - end, &next);
+    if (is_extender(next) || previous == ZERO_WIDTH_JOINER) {
+      end += next_len;
+      previous = next;
+      continue;
+    }
+    if (is_regional_indicator(base) && is_regional_indicator(next) &&
+        end - pos == 4) {
+      end += next_len;
+      break;
+    }
+    break;
+  }
+  return end;
+}
+
+// Start of the grapheme cluster that ends at pos
+size_t grapheme_prev(const char *text, size_t pos) {
+  if (pos == 0)
+    return 0;
+
+  size_t start = codepoint_start(text, pos);
+  uint32_t current;
+  utf8_decode(text + start, pos - start, &current);
+
+  // Flags pair up from the start of the run, so count the run's length
+  if (is_regional_indicator(current)) {
+    int run = 1;
+    size_t p = start;
+    while (p > 0) {
+      size_t q = codepoint_start(text, p);
+      uint32_t cp;
+      utf8_decode(text + q, p - q, &cp);
+      if (!is_regional_indicator(cp))
+        break;
+      run++;
+      p = q;
+    }
+    if (run % 2 == 0)
+      start = codepoint_start(text, start);
+    return start;
+  }
+
+  while (start > 0) {
+    size_t before = codepoint_start(text, start);
+    uint32_t previous;
+    utf8_decode(text + before, start - before, &previous);
+    if (!is_extender(current) && previous != ZERO_WIDTH_JOINER)
+      break;
+    start = before;
+    current = previous;
+  }
+  return start;
+}
+
+// Columns a grapheme cluster takes: its base's width, widened to 2 when a
+// variation selector asks for emoji presentation
+int grapheme_width(const char *text, size_t len) {
+  uint32_t base;
+  size_t pos = utf8_decode(text, len, &base);
+  int width = codepoint_width(base);
+  if (width == 0)
+    width = 1; // A stray combining mark still gets a cell
+
+  while (pos < len && width < 2) {
+    uint32_t cp;
+    pos += utf8_decode(text + pos, len - pos, &cp);
+    if (cp == 0xfe0f)
+      width = 2;
+  }
+  return width;
+}
+
+// Display width of a string, skipping ANSI escape sequences
+int text_width(const char *text) {
+  size_t len = strlen(text);
+  size_t pos = 0;
+  int width = 0;
+
+  while (pos < len) {
+    if (text[pos] == '\033') {
+      pos++;
+      if (pos < len && text[pos] == '[') {
+        pos++;
+        while (pos < len && (text[pos] < 0x40 || text[pos] > 0x7e))
+          pos++;
+      }
+      if (pos < len)
+        pos++;
+      continue;
+    }
+    size_t end = grapheme_next(text, len, pos);
+    width += grapheme_width(text + pos, end - pos);
+    pos = end;
+  }
+  return width;
+}
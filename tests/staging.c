@@ -0,0 +1,141 @@
+#include "git_command.h"
+#include "ncurses_diff_viewer.h"
+
+// Regression tests for line staging in the diff viewer: each case builds a
+// repository in a temporary directory, takes one line out of the index the
+// way the staged pane does and checks what the index holds afterwards
+//
+//   make test                  run everything
+//   ./shell_test newline       run cases whose name contains a word
+
+typedef struct {
+  const char *name;
+  const char *head;     // File as committed
+  const char *index;    // File as staged
+  const char *unstage;  // Staged pane line to take out, with its +/- sign
+  const char *expected; // Index afterwards
+} StagingCase;
+
+static const StagingCase cases[] = {
+    // The removed line ended the committed file without a newline; lines
+    // after it stay staged, so it comes back with one
+    {"unstage removal lacking newline", "a\nold last", "a\nnew last\nmore",
+     "-old last", "a\nold last\nnew last\nmore"},
+    {"unstage addition lacking newline", "a\nold last", "a\nnew last\nmore",
+     "+more", "a\nnew last\n"},
+    {"unstage addition before one lacking newline", "a\nold last",
+     "a\nnew last\nmore", "+new last", "a\nmore"},
+    {"unstage addition with newline", "a\nb\n", "a\nb\nc\n", "+c", "a\nb\n"},
+};
+
+static int write_file(const char *path, const char *text) {
+  FILE *fp = fopen(path, "w");
+  if (!fp)
+    return 0;
+  fputs(text, fp);
+  return fclose(fp) == 0;
+}
+
+// The staged blob of f, or NULL if git has none
+static char *read_index_file(void) {
+  const char *argv[] = {"git", "cat-file", "blob", ":f", NULL};
+  GitOutput output;
+  if (!git_command_run(argv, NULL, 0, &output))
+    return NULL;
+  if (output.status != 0) {
+    git_output_free(&output);
+    return NULL;
+  }
+  return output.data;
+}
+
+static int make_repo(const char *root, const StagingCase *c) {
+  char command[PATH_MAX * 2];
+  snprintf(command, sizeof(command),
+           "rm -rf '%s/repo' && mkdir '%s/repo' && cd '%s/repo' && "
+           "git init -q && git config user.email test@example.com && "
+           "git config user.name test",
+           root, root, root);
+  if (system(command) != 0)
+    return 0;
+
+  snprintf(command, sizeof(command), "%s/repo", root);
+  if (chdir(command) != 0 || !write_file("f", c->head) ||
+      system("git add f && git commit -qm head") != 0 ||
+      !write_file("f", c->index) || system("git add f") != 0)
+    return 0;
+  return 1;
+}
+
+static int run_case(const char *root, const StagingCase *c) {
+  if (!make_repo(root, c)) {
+    fprintf(stderr, "%s: could not set up the repository\n", c->name);
+    return 0;
+  }
+
+  NCursesDiffViewer viewer;
+  memset(&viewer, 0, sizeof(viewer));
+  line_store_init(&viewer.file_store);
+  line_store_init(&viewer.staged_store);
+  load_file_with_staging_info(&viewer, "f");
+
+  int line = -1;
+  for (int i = 0; i < viewer.staged_store.count; i++) {
+    const NCursesFileLine *staged = &viewer.staged_store.lines[i];
+    if (strcmp(line_store_text(&viewer.staged_store, staged), c->unstage) ==
+        0) {
+      line = i;
+      break;
+    }
+  }
+
+  int passed = 0;
+  if (line < 0) {
+    fprintf(stderr, "%s: \"%s\" is not in the staged pane\n", c->name,
+            c->unstage);
+  } else if (!unstage_line_from_git(&viewer, line)) {
+    fprintf(stderr, "%s: git apply rejected the patch\n", c->name);
+  } else {
+    char *index = read_index_file();
+    passed = index && strcmp(index, c->expected) == 0;
+    if (!passed)
+      fprintf(stderr, "%s: index holds \"%s\", expected \"%s\"\n", c->name,
+              index ? index : "(nothing)", c->expected);
+    free(index);
+  }
+
+  line_store_free(&viewer.file_store);
+  line_store_free(&viewer.staged_store);
+  free(viewer.hunks);
+  free(viewer.files);
+  return passed;
+}
+
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : NULL;
+
+  char root[] = "/tmp/lsh-test-XXXXXX";
+  if (!mkdtemp(root)) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  int run = 0, failed = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    if (filter && !strstr(cases[i].name, filter))
+      continue;
+    run++;
+    if (!run_case(root, &cases[i]))
+      failed++;
+    else
+      printf("ok\t%s\n", cases[i].name);
+  }
+
+  char command[PATH_MAX];
+  snprintf(command, sizeof(command), "rm -rf '%s'", root);
+  if (system(command) != 0)
+    fprintf(stderr, "test: could not remove %s\n", root);
+
+  printf("%d of %d passed\n", run - failed, run);
+  return failed ? 1 : 0;
+}